@@ -0,0 +1,45 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+/**
+ * Selects how a #Cache decides which items to evict.
+ */
+enum class CachePolicy : uint_least8_t {
+	/**
+	 * Evict the least recently used item.
+	 */
+	LRU,
+
+	/**
+	 * W-TinyLFU: new items enter a small LRU window; items
+	 * leaving the window are admitted to the main LRU segment
+	 * only if they have been requested more often (according to
+	 * a #FrequencySketch) than the item they would displace.
+	 * This keeps one-off requests (e.g. a crawler) from flushing
+	 * the working set.
+	 */
+	TINY_LFU,
+
+	/**
+	 * S3-FIFO: new items enter a small FIFO queue; only those
+	 * which get hit while in there are moved to the main FIFO
+	 * queue; the keys of evicted items are remembered in a
+	 * "ghost" queue, so they go straight to the main queue when
+	 * they come back.
+	 */
+	S3_FIFO,
+};
+
+/**
+ * Parse a policy name ("lru", "tinylfu" or "s3fifo").
+ *
+ * Throws std::invalid_argument on error.
+ */
+CachePolicy
+ParseCachePolicy(std::string_view s);
@@ -160,6 +160,7 @@ try {
 				     handler, cancel_ptr);
 		else
 			fcgi_remote_request(&pool, event_loop, tcp_balancer,
+					    fcgi_mux_stock,
 					    parent_stopwatch,
 					    &cgi->address_list,
 					    cgi->path,
@@ -17,6 +17,7 @@ class WasMetricsHandler;
 class StockMap;
 class LhttpStock;
 class FcgiStock;
+class FcgiMuxStock;
 class NfsCache;
 class TcpBalancer;
 namespace Uring { class Queue; }
@@ -39,6 +40,7 @@ class DirectResourceLoader final : public ResourceLoader {
 	SpawnService &spawn_service;
 	LhttpStock *lhttp_stock;
 	FcgiStock *fcgi_stock;
+	FcgiMuxStock *const fcgi_mux_stock;
 #ifdef HAVE_LIBWAS
 	WasStock *was_stock;
 	MultiWasStock *const multi_was_stock;
@@ -65,6 +67,7 @@ public:
 			     SpawnService &_spawn_service,
 			     LhttpStock *_lhttp_stock,
 			     FcgiStock *_fcgi_stock,
+			     FcgiMuxStock *_fcgi_mux_stock,
 #ifdef HAVE_LIBWAS
 			     WasStock *_was_stock,
 			     MultiWasStock *_multi_was_stock,
@@ -90,6 +93,7 @@ public:
 		 spawn_service(_spawn_service),
 		 lhttp_stock(_lhttp_stock),
 		 fcgi_stock(_fcgi_stock),
+		 fcgi_mux_stock(_fcgi_mux_stock),
 #ifdef HAVE_LIBWAS
 		 was_stock(_was_stock),
 		 multi_was_stock(_multi_was_stock),
@@ -0,0 +1,61 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#include "FrequencySketch.hxx"
+
+#include <algorithm>
+#include <bit>
+
+FrequencySketch::FrequencySketch(std::size_t _width) noexcept
+	:width(std::bit_ceil(std::max<std::size_t>(_width, 64))),
+	 sample_size(width * 10),
+	 counters(std::make_unique<uint_least8_t[]>(DEPTH * width))
+{
+}
+
+inline std::size_t
+FrequencySketch::IndexOf(unsigned row, std::size_t hash) const noexcept
+{
+	/* derive one independent-ish hash per row by multiplying
+	   with a different odd constant */
+	static constexpr uint_least64_t seeds[DEPTH] = {
+		UINT64_C(0x9e3779b97f4a7c15),
+		UINT64_C(0xc2b2ae3d27d4eb4f),
+		UINT64_C(0x165667b19e3779f9),
+		UINT64_C(0xd6e8feb86659fd93),
+	};
+
+	const uint_least64_t h = (uint_least64_t(hash) + row) * seeds[row];
+	return row * width + ((h >> 32) & (width - 1));
+}
+
+void
+FrequencySketch::Increment(std::size_t hash) noexcept
+{
+	for (unsigned row = 0; row < DEPTH; ++row) {
+		auto &c = counters[IndexOf(row, hash)];
+		if (c < MAX_COUNT)
+			++c;
+	}
+
+	if (++n_increments >= sample_size)
+		Age();
+}
+
+unsigned
+FrequencySketch::Estimate(std::size_t hash) const noexcept
+{
+	unsigned result = MAX_COUNT;
+	for (unsigned row = 0; row < DEPTH; ++row)
+		result = std::min<unsigned>(result, counters[IndexOf(row, hash)]);
+	return result;
+}
+
+void
+FrequencySketch::Age() noexcept
+{
+	std::for_each(counters.get(), counters.get() + DEPTH * width,
+		      [](auto &c){ c >>= 1; });
+	n_increments /= 2;
+}
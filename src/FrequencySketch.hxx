@@ -0,0 +1,57 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/**
+ * A count-min sketch which estimates how often a hash value has been
+ * seen recently.  Counters saturate at 15, and all of them are
+ * halved after a number of increments proportional to the width, so
+ * old popularity fades away.  This is the admission filter of
+ * #CachePolicy::TINY_LFU.
+ */
+class FrequencySketch {
+	static constexpr unsigned DEPTH = 4;
+	static constexpr uint_least8_t MAX_COUNT = 15;
+
+	/**
+	 * The number of counters per row; a power of two.
+	 */
+	const std::size_t width;
+
+	/**
+	 * Halve all counters after this many increments.
+	 */
+	const std::size_t sample_size;
+
+	std::size_t n_increments = 0;
+
+	/**
+	 * #DEPTH rows of #width counters.
+	 */
+	const std::unique_ptr<uint_least8_t[]> counters;
+
+public:
+	/**
+	 * @param _width the number of counters per row, which should
+	 * be at least the number of items expected in the cache; it
+	 * is rounded up to the next power of two
+	 */
+	explicit FrequencySketch(std::size_t _width) noexcept;
+
+	void Increment(std::size_t hash) noexcept;
+
+	[[gnu::pure]]
+	unsigned Estimate(std::size_t hash) const noexcept;
+
+private:
+	[[gnu::const]]
+	std::size_t IndexOf(unsigned row, std::size_t hash) const noexcept;
+
+	void Age() noexcept;
+};
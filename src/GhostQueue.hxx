@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <unordered_map>
+
+/**
+ * A bounded FIFO of hash values of recently evicted items, used by
+ * #CachePolicy::S3_FIFO to recognize items which come back shortly
+ * after having been evicted.
+ */
+class GhostQueue {
+	std::deque<std::size_t> fifo;
+
+	/**
+	 * How often does each hash occur in #fifo?
+	 */
+	std::unordered_map<std::size_t, unsigned> counts;
+
+public:
+	[[gnu::pure]]
+	bool Contains(std::size_t hash) const noexcept {
+		return counts.contains(hash);
+	}
+
+	/**
+	 * Add a hash value, discarding the oldest ones if there are
+	 * more than #capacity.
+	 */
+	void Add(std::size_t hash, std::size_t capacity) noexcept {
+		fifo.push_back(hash);
+		++counts[hash];
+
+		while (fifo.size() > capacity) {
+			auto i = counts.find(fifo.front());
+			if (--i->second == 0)
+				counts.erase(i);
+			fifo.pop_front();
+		}
+	}
+
+	void Clear() noexcept {
+		fifo.clear();
+		counts.clear();
+	}
+};
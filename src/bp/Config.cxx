@@ -13,6 +13,19 @@
 
 using std::string_view_literals::operator""sv;
 
+/**
+ * Parse a pipe capacity for F_SETPIPE_SZ, which takes an "int".
+ */
+static size_t
+ParsePipeSize(const char *s)
+{
+	const size_t value = ParseSize(s);
+	if (value > 1024 * 1024 * 1024)
+		throw std::runtime_error("Pipe size is too large");
+
+	return value;
+}
+
 void
 BpConfig::HandleSet(std::string_view name, const char *value)
 {
@@ -28,10 +41,14 @@ BpConfig::HandleSet(std::string_view name, const char *value)
 		fcgi_stock_limit = ParseUnsignedLong(value);
 	} else if (name == "fcgi_stock_max_idle"sv) {
 		fcgi_stock_max_idle = ParseUnsignedLong(value);
+	} else if (name == "fcgi_multiplex"sv) {
+		fcgi_multiplex = ParsePositiveLong(value, 0xffff);
 	} else if (name == "was_stock_limit"sv) {
 		was_stock_limit = ParseUnsignedLong(value);
 	} else if (name == "was_stock_max_idle"sv) {
 		was_stock_max_idle = ParseUnsignedLong(value);
+	} else if (name == "was_shm"sv) {
+		was_shm = ParseSize(value);
 	} else if (name == "multi_was_stock_limit"sv) {
 		multi_was_stock_limit = ParseUnsignedLong(value);
 	} else if (name == "multi_was_stock_max_idle"sv) {
@@ -42,16 +59,34 @@ BpConfig::HandleSet(std::string_view name, const char *value)
 		remote_was_stock_max_idle = ParseUnsignedLong(value);
 	} else if (name == "http_cache_size"sv) {
 		http_cache_size = ParseSize(value);
+	} else if (name == "http_cache_policy"sv) {
+		http_cache_policy = ParseCachePolicy(value);
 	} else if (name == "http_cache_obey_no_cache"sv) {
 		http_cache_obey_no_cache = ParseBool(value);
 	} else if (name == "filter_cache_size"sv) {
 		filter_cache_size = ParseSize(value);
+	} else if (name == "filter_cache_policy"sv) {
+		filter_cache_policy = ParseCachePolicy(value);
 	} else if (name == "nfs_cache_size"sv) {
 		nfs_cache_size = ParseSize(value);
+	} else if (name == "nfs_read_ahead"sv) {
+		nfs_read_ahead = ParseSize(value);
+	} else if (name == "bulk_pipe_size"sv) {
+		bulk_pipe_size = ParsePipeSize(value);
+	} else if (name == "bulk_pipe_max_size"sv) {
+		bulk_pipe_max_size = ParsePipeSize(value);
+	} else if (name == "xml_template_cache_size"sv) {
+		xml_template_cache_size = ParseSize(value);
 	} else if (name == "translate_cache_size"sv) {
 		translate_cache_size = ParseUnsignedLong(value);
+	} else if (name == "translate_cache_save_path"sv) {
+		translate_cache_save_path = value;
+	} else if (name == "translate_cache_generation"sv) {
+		translate_cache_generation = value;
 	} else if (name == "translate_stock_limit"sv) {
 		translate_stock_limit = ParseUnsignedLong(value);
+	} else if (name == "translate_multiplex"sv) {
+		translate_multiplex = ParseBool(value);
 	} else if (name == "stopwatch"sv) {
 		/* deprecated */
 	} else if (name == "dump_widget_tree"sv) {
@@ -102,4 +137,7 @@ BpConfig::Finish(unsigned default_port)
 
 	if (spawn.default_uid_gid.IsEmpty())
 		spawn.default_uid_gid.LoadEffective();
+
+	if (bulk_pipe_max_size > 0 && bulk_pipe_max_size < bulk_pipe_size)
+		throw std::runtime_error("bulk_pipe_max_size must not be smaller than bulk_pipe_size");
 }
@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include "CachePolicy.hxx"
 #include "access_log/Config.hxx"
 #include "ssl/Config.hxx"
 #include "http/CookieSameSite.hxx"
@@ -44,6 +45,27 @@ struct BpConfig {
 
 		bool auth_alt_host = false;
 
+		/**
+		 * Send responses using io_uring (only without SSL)?
+		 * This disables splice() and sendfile() for
+		 * responses.
+		 */
+		bool uring = false;
+
+		/**
+		 * Send response bodies of at least this many bytes
+		 * with MSG_ZEROCOPY (only without SSL and without
+		 * io_uring)?  0 disables the feature.
+		 */
+		size_t zerocopy_threshold = 0;
+
+		/**
+		 * The maximum number of pipelined HTTP/1.1 requests
+		 * which are dispatched while a previous response is
+		 * still being sent.  0 disables the feature.
+		 */
+		unsigned pipeline_depth = 0;
+
 		bool ssl = false;
 
 		Listener() {
@@ -89,6 +111,19 @@ struct BpConfig {
 
 	std::string session_save_path;
 
+	/**
+	 * If non-empty, then a snapshot of the translation cache is
+	 * saved to this file periodically and on shutdown, and loaded
+	 * on startup.
+	 */
+	std::string translate_cache_save_path;
+
+	/**
+	 * An opaque string stored in the translation cache snapshot.
+	 * A snapshot with a different value is discarded on startup.
+	 */
+	std::string translate_cache_generation;
+
 	struct ControlListener : SocketConfig {
 		ControlListener() {
 			pass_cred = true;
@@ -111,17 +146,61 @@ struct BpConfig {
 
 	size_t filter_cache_size = 128 * 1024 * 1024;
 
+	CachePolicy http_cache_policy = CachePolicy::LRU;
+	CachePolicy filter_cache_policy = CachePolicy::LRU;
+
 	size_t nfs_cache_size = 256 * 1024 * 1024;
 
+	/**
+	 * The maximum number of bytes requested from a NFS server
+	 * ahead of the consumer.
+	 */
+	size_t nfs_read_ahead = 1024 * 1024;
+
+	/**
+	 * The initial capacity of pipes in the "bulk_pipe" stock
+	 * (response bodies and caches); 0 means the kernel default.
+	 */
+	size_t bulk_pipe_size = 256 * 1024;
+
+	/**
+	 * Pipes in the "bulk_pipe" stock which get filled by a single
+	 * transfer are enlarged up to this capacity; 0 disables
+	 * this.
+	 */
+	size_t bulk_pipe_max_size = 1024 * 1024;
+
+	size_t xml_template_cache_size = 16 * 1024 * 1024;
+
 	unsigned translate_cache_size = 131072;
 	unsigned translate_stock_limit = 32;
 
+	/**
+	 * Attempt to negotiate multiplexed translation server
+	 * connections?
+	 */
+	bool translate_multiplex = false;
+
+	/**
+	 * The maximum number of concurrent requests on one
+	 * multiplexed connection to a remote FastCGI server; 0
+	 * disables multiplexing.
+	 */
+	unsigned fcgi_multiplex = 0;
+
 	unsigned tcp_stock_limit = 0;
 
 	unsigned lhttp_stock_limit = 0, lhttp_stock_max_idle = 8;
 	unsigned fcgi_stock_limit = 0, fcgi_stock_max_idle = 8;
 
 	unsigned was_stock_limit = 0, was_stock_max_idle = 16;
+
+	/**
+	 * The size of each ring of the shared-memory data channel
+	 * offered to WAS child processes; 0 disables it.
+	 */
+	size_t was_shm = 0;
+
 	unsigned multi_was_stock_limit = 0, multi_was_stock_max_idle = 16;
 	unsigned remote_was_stock_limit = 0, remote_was_stock_max_idle = 16;
 
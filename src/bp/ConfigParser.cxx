@@ -172,6 +172,19 @@ BpConfigParser::Listener::ParseLine(FileLineParser &line)
 	} else if (strcmp(word, "auth_alt_host") == 0) {
 		config.auth_alt_host = line.NextBool();
 		line.ExpectEnd();
+	} else if (strcmp(word, "io_uring") == 0) {
+#ifdef HAVE_URING
+		config.uring = line.NextBool();
+		line.ExpectEnd();
+#else
+		throw LineParser::Error("io_uring support is disabled at compile time");
+#endif
+	} else if (strcmp(word, "zerocopy_threshold") == 0) {
+		config.zerocopy_threshold = line.NextPositiveInteger();
+		line.ExpectEnd();
+	} else if (strcmp(word, "pipeline_depth") == 0) {
+		config.pipeline_depth = line.NextPositiveInteger();
+		line.ExpectEnd();
 	} else if (strcmp(word, "ssl") == 0) {
 		bool value = line.NextBool();
 
@@ -194,6 +194,7 @@ new_connection(PoolPtr pool, BpInstance &instance, BPListener &listener,
 						   : nullptr,
 						   address,
 						   true,
+						   listener.GetPipelineDepth(),
 						   *connection,
 						   *request_handler);
 }
@@ -16,6 +16,7 @@
 #include "BufferedResourceLoader.hxx"
 #include "http/cache/Public.hxx"
 #include "fcache.hxx"
+#include "XmlTemplateCache.hxx"
 #include "translation/Stock.hxx"
 #include "translation/Cache.hxx"
 #include "translation/Multi.hxx"
@@ -23,6 +24,7 @@
 #include "widget/Registry.hxx"
 #include "http/local/Stock.hxx"
 #include "fcgi/Stock.hxx"
+#include "fcgi/MuxStock.hxx"
 #include "was/Stock.hxx"
 #include "was/MStock.hxx"
 #include "was/RStock.hxx"
@@ -59,7 +61,9 @@ BpInstance::BpInstance(BpConfig &&_config) noexcept
 	 shutdown_listener(event_loop, BIND_THIS_METHOD(ShutdownCallback)),
 	 sighup_event(event_loop, SIGHUP, BIND_THIS_METHOD(ReloadEventCallback)),
 	 compress_timer(event_loop, BIND_THIS_METHOD(OnCompressTimer)),
-	 session_save_timer(event_loop, BIND_THIS_METHOD(SaveSessions))
+	 session_save_timer(event_loop, BIND_THIS_METHOD(SaveSessions)),
+	 translation_cache_save_timer(event_loop,
+				      BIND_THIS_METHOD(OnTranslationCacheSaveTimer))
 {
 	ForkCow(false);
 	ScheduleCompress();
@@ -100,6 +104,8 @@ BpInstance::FreeStocksAndCaches() noexcept
 		filter_cache = nullptr;
 	}
 
+	xml_template_cache.reset();
+
 	if (lhttp_stock != nullptr) {
 		lhttp_stock_free(lhttp_stock);
 		lhttp_stock = nullptr;
@@ -110,6 +116,8 @@ BpInstance::FreeStocksAndCaches() noexcept
 		fcgi_stock = nullptr;
 	}
 
+	delete std::exchange(fcgi_mux_stock, nullptr);
+
 #ifdef HAVE_LIBWAS
 	delete std::exchange(was_stock, nullptr);
 	delete std::exchange(multi_was_stock, nullptr);
@@ -145,6 +153,7 @@ BpInstance::FreeStocksAndCaches() noexcept
 	}
 #endif
 
+	delete std::exchange(bulk_pipe_stock, nullptr);
 	delete std::exchange(pipe_stock, nullptr);
 }
 
@@ -285,3 +294,24 @@ BpInstance::ScheduleSaveSessions() noexcept
 	/* save all sessions every 2 minutes */
 	session_save_timer.Schedule(std::chrono::minutes(2));
 }
+
+void
+BpInstance::SaveTranslationCache() noexcept
+{
+	if (translation_caches && !config.translate_cache_save_path.empty())
+		translation_caches->SaveSnapshot(config.translate_cache_save_path.c_str());
+}
+
+void
+BpInstance::OnTranslationCacheSaveTimer() noexcept
+{
+	SaveTranslationCache();
+	ScheduleSaveTranslationCache();
+}
+
+void
+BpInstance::ScheduleSaveTranslationCache() noexcept
+{
+	/* save a snapshot every 10 minutes */
+	translation_cache_save_timer.Schedule(std::chrono::minutes(10));
+}
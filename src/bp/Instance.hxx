@@ -56,10 +56,12 @@ class MultiTranslationService;
 class WidgetRegistry;
 class LhttpStock;
 class FcgiStock;
+class FcgiMuxStock;
 class NfsStock;
 class NfsCache;
 class HttpCache;
 class FilterCache;
+class XmlTemplateCache;
 class SessionManager;
 namespace Uring { class Manager; }
 class BPListener;
@@ -157,8 +159,11 @@ struct BpInstance final : PInstance, ControlHandler, SpawnServerClientHandler,
 
 	FilterCache *filter_cache = nullptr;
 
+	std::unique_ptr<XmlTemplateCache> xml_template_cache;
+
 	LhttpStock *lhttp_stock = nullptr;
 	FcgiStock *fcgi_stock = nullptr;
+	FcgiMuxStock *fcgi_mux_stock = nullptr;
 
 #ifdef HAVE_LIBWAS
 	WasStock *was_stock = nullptr;
@@ -175,8 +180,17 @@ struct BpInstance final : PInstance, ControlHandler, SpawnServerClientHandler,
 	NfsCache *nfs_cache = nullptr;
 #endif
 
+	/**
+	 * Pipes for small transfers (e.g. request bodies).
+	 */
 	PipeStock *pipe_stock = nullptr;
 
+	/**
+	 * Large pipes for response bodies, which grow further if
+	 * transfers keep filling them.
+	 */
+	PipeStock *bulk_pipe_stock = nullptr;
+
 	ResourceLoader *direct_resource_loader = nullptr;
 	ResourceLoader *cached_resource_loader = nullptr;
 	ResourceLoader *filter_resource_loader = nullptr;
@@ -185,6 +199,8 @@ struct BpInstance final : PInstance, ControlHandler, SpawnServerClientHandler,
 	/* session */
 	FarTimerEvent session_save_timer;
 
+	FarTimerEvent translation_cache_save_timer;
+
 	explicit BpInstance(BpConfig &&_config) noexcept;
 	~BpInstance() noexcept;
 
@@ -202,6 +218,9 @@ struct BpInstance final : PInstance, ControlHandler, SpawnServerClientHandler,
 
 	void ScheduleSaveSessions() noexcept;
 
+	void ScheduleSaveTranslationCache() noexcept;
+	void SaveTranslationCache() noexcept;
+
 	/**
 	 * Handler for #CONTROL_FADE_CHILDREN
 	 */
@@ -254,5 +273,7 @@ private:
 
 	void SaveSessions() noexcept;
 
+	void OnTranslationCacheSaveTimer() noexcept;
+
 	void FreeStocksAndCaches() noexcept;
 };
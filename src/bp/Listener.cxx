@@ -15,6 +15,10 @@
 #include "net/SocketAddress.hxx"
 #include "io/Logger.hxx"
 
+#ifdef HAVE_URING
+#include "event/uring/Manager.hxx"
+#endif
+
 static std::unique_ptr<SslFactory>
 MakeSslFactory(const SslConfig *ssl_config)
 {
@@ -37,6 +41,9 @@ BPListener::BPListener(BpInstance &_instance,
 		       const char *_tag,
 		       bool _prometheus_exporter,
 		       bool _auth_alt_host,
+		       bool _uring,
+		       std::size_t _zerocopy_threshold,
+		       unsigned _pipeline_depth,
 		       const SslConfig *ssl_config)
 	:instance(_instance),
 	 http_stats(_http_stats),
@@ -46,6 +53,9 @@ BPListener::BPListener(BpInstance &_instance,
 			     : nullptr),
 	 tag(_tag),
 	 auth_alt_host(_auth_alt_host),
+	 uring(_uring),
+	 zerocopy_threshold(_zerocopy_threshold),
+	 pipeline_depth(_pipeline_depth),
 	 listener(instance.root_pool, instance.event_loop,
 		  MakeSslFactory(ssl_config),
 		  *this)
@@ -60,6 +70,20 @@ BPListener::OnFilteredSocketConnect(PoolPtr pool,
 				    SocketAddress address,
 				    const SslFilter *ssl_filter) noexcept
 {
+#ifdef HAVE_URING
+	if (uring && !socket->HasFilter() && instance.uring)
+		socket->EnableUring(*instance.uring);
+	else
+#endif
+	if (zerocopy_threshold > 0 && !socket->HasFilter()) {
+		try {
+			socket->EnableZeroCopy(zerocopy_threshold);
+		} catch (...) {
+			/* not fatal; this connection will copy */
+			LogConcat(2, "listener", std::current_exception());
+		}
+	}
+
 	new_connection(std::move(pool), instance, *this,
 		       prometheus_exporter.get(),
 		       std::move(socket), ssl_filter,
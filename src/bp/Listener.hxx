@@ -7,6 +7,7 @@
 #include "fs/Listener.hxx"
 #include "net/StaticSocketAddress.hxx"
 
+#include <cstddef>
 #include <memory>
 
 struct BpInstance;
@@ -31,6 +32,22 @@ class BPListener final : FilteredSocketListenerHandler {
 
 	const bool auth_alt_host;
 
+	/**
+	 * Send responses using io_uring?
+	 */
+	const bool uring;
+
+	/**
+	 * Send large responses with MSG_ZEROCOPY?  See
+	 * BpConfig::Listener::zerocopy_threshold.
+	 */
+	const std::size_t zerocopy_threshold;
+
+	/**
+	 * See BpConfig::Listener::pipeline_depth.
+	 */
+	const unsigned pipeline_depth;
+
 	FilteredSocketListener listener;
 
 public:
@@ -40,6 +57,9 @@ public:
 		   const char *_tag,
 		   bool _prometheus_exporter,
 		   bool _auth_alt_host,
+		   bool _uring,
+		   std::size_t _zerocopy_threshold,
+		   unsigned _pipeline_depth,
 		   const SslConfig *ssl_config);
 	~BPListener() noexcept;
 
@@ -71,6 +91,10 @@ public:
 		return auth_alt_host;
 	}
 
+	unsigned GetPipelineDepth() const noexcept {
+		return pipeline_depth;
+	}
+
 	TranslationService &GetTranslationService() const noexcept {
 		return *translation_service;
 	}
@@ -23,11 +23,13 @@
 #include "http/cache/Public.hxx"
 #include "http/local/Stock.hxx"
 #include "fcgi/Stock.hxx"
+#include "fcgi/MuxStock.hxx"
 #include "was/Stock.hxx"
 #include "was/MStock.hxx"
 #include "was/RStock.hxx"
 #include "delegate/Stock.hxx"
 #include "fcache.hxx"
+#include "XmlTemplateCache.hxx"
 #include "thread/Pool.hxx"
 #include "pipe/Stock.hxx"
 #include "nfs/Stock.hxx"
@@ -160,6 +162,9 @@ BpInstance::ShutdownCallback() noexcept
 	session_save_timer.Cancel();
 	session_save_deinit(*session_manager);
 
+	translation_cache_save_timer.Cancel();
+	SaveTranslationCache();
+
 	session_manager.reset();
 
 	FreeStocksAndCaches();
@@ -186,6 +191,9 @@ BpInstance::ReloadEventCallback(int) noexcept
 	if (filter_cache != nullptr)
 		filter_cache_flush(*filter_cache);
 
+	if (xml_template_cache)
+		xml_template_cache->Flush();
+
 #ifdef HAVE_LIBNFS
 	if (nfs_cache != nullptr)
 		nfs_cache_flush(*nfs_cache);
@@ -248,6 +256,9 @@ BpInstance::AddListener(const BpConfig::Listener &c
 				c.tag.empty() ? nullptr : c.tag.c_str(),
 				c.handler == BpConfig::Listener::Handler::PROMETHEUS_EXPORTER,
 				c.auth_alt_host,
+				c.uring,
+				c.zerocopy_threshold,
+				c.pipeline_depth,
 				c.ssl ? &c.ssl_config : nullptr);
 	auto &listener = listeners.front();
 
@@ -411,7 +422,8 @@ try {
 	assert(!instance.config.translation_sockets.empty());
 
 	instance.translation_stocks =
-		std::make_unique<TranslationStockBuilder>(instance.config.translate_stock_limit);
+		std::make_unique<TranslationStockBuilder>(instance.config.translate_stock_limit,
+							  instance.config.translate_multiplex);
 	instance.uncached_translation_service =
 		std::make_unique<MultiTranslationService>();
 
@@ -422,6 +434,9 @@ try {
 								  instance.config.translate_cache_size);
 		instance.cached_translation_service =
 			std::make_unique<MultiTranslationService>();
+
+		if (!instance.config.translate_cache_save_path.empty())
+			instance.translation_caches->EnableSnapshot(instance.config.translate_cache_generation);
 	}
 
 	for (const auto &config : instance.config.translation_sockets) {
@@ -439,6 +454,12 @@ try {
 		? instance.cached_translation_service
 		: instance.uncached_translation_service;
 
+	if (instance.translation_caches &&
+	    !instance.config.translate_cache_save_path.empty()) {
+		instance.translation_caches->LoadSnapshot(instance.config.translate_cache_save_path.c_str());
+		instance.ScheduleSaveTranslationCache();
+	}
+
 
 	/* the WidgetRegistry class has its own cache and doesn't need
 	   the TranslationCache */
@@ -459,12 +480,18 @@ try {
 					     *instance.spawn_service,
 					     child_log_socket, child_log_options);
 
+	if (instance.config.fcgi_multiplex > 0)
+		instance.fcgi_mux_stock =
+			new FcgiMuxStock(instance.event_loop,
+					 instance.config.fcgi_multiplex);
+
 #ifdef HAVE_LIBWAS
 	instance.was_stock = new WasStock(instance.event_loop,
 					  *instance.spawn_service,
 					  child_log_socket, child_log_options,
 					  instance.config.was_stock_limit,
-					  instance.config.was_stock_max_idle);
+					  instance.config.was_stock_max_idle,
+					  instance.config.was_shm);
 	instance.multi_was_stock =
 		new MultiWasStock(instance.config.multi_was_stock_limit,
 				  instance.config.multi_was_stock_max_idle,
@@ -485,6 +512,7 @@ try {
 	instance.nfs_stock = nfs_stock_new(instance.event_loop);
 	instance.nfs_cache = nfs_cache_new(instance.root_pool,
 					   instance.config.nfs_cache_size,
+					   instance.config.nfs_read_ahead,
 					   *instance.nfs_stock,
 					   instance.event_loop);
 #endif
@@ -502,6 +530,7 @@ try {
 					 *instance.spawn_service,
 					 instance.lhttp_stock,
 					 instance.fcgi_stock,
+					 instance.fcgi_mux_stock,
 #ifdef HAVE_LIBWAS
 					 instance.was_stock,
 					 instance.multi_was_stock,
@@ -515,11 +544,19 @@ try {
 					 instance.ssl_client_factory.get(),
 					 instance.config.access_log.xff);
 
+	instance.pipe_stock = new PipeStock(instance.event_loop);
+	instance.bulk_pipe_stock = new PipeStock(instance.event_loop,
+						 "bulk_pipe",
+						 instance.config.bulk_pipe_size,
+						 instance.config.bulk_pipe_max_size);
+
 	if (instance.config.http_cache_size > 0) {
 		instance.http_cache = http_cache_new(instance.root_pool,
 						     instance.config.http_cache_size,
+						     instance.config.http_cache_policy,
 						     instance.config.http_cache_obey_no_cache,
 						     instance.event_loop,
+						     instance.bulk_pipe_stock,
 						     *instance.direct_resource_loader);
 
 		instance.cached_resource_loader =
@@ -527,18 +564,23 @@ try {
 	} else
 		instance.cached_resource_loader = instance.direct_resource_loader;
 
-	instance.pipe_stock = new PipeStock(instance.event_loop);
-
 	if (instance.config.filter_cache_size > 0) {
 		instance.filter_cache = filter_cache_new(instance.root_pool,
 							 instance.config.filter_cache_size,
+							 instance.config.filter_cache_policy,
 							 instance.event_loop,
+							 instance.bulk_pipe_stock,
 							 *instance.direct_resource_loader);
 		instance.filter_resource_loader =
 			new FilterResourceLoader(*instance.filter_cache);
 	} else
 		instance.filter_resource_loader = instance.direct_resource_loader;
 
+	if (instance.config.xml_template_cache_size > 0)
+		instance.xml_template_cache =
+			std::make_unique<XmlTemplateCache>(instance.event_loop,
+							   instance.config.xml_template_cache_size);
+
 	instance.buffered_filter_resource_loader =
 		new BufferedResourceLoader(instance.event_loop,
 					   *instance.filter_resource_loader,
@@ -580,7 +622,7 @@ try {
 						 instance.translation_service,
 						 tag,
 						 false,
-						 false, nullptr);
+						 false, false, 0, nullptr);
 		instance.listeners.front().Listen(UniqueSocketDescriptor(STDIN_FILENO));
 	}
 
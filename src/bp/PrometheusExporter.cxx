@@ -11,9 +11,137 @@
 #include "http/ResponseHandler.hxx"
 #include "memory/istream_gb.hxx"
 #include "memory/GrowingBuffer.hxx"
+#include "translation/Builder.hxx"
+#include "http/cache/Public.hxx"
+#include "fcache.hxx"
+#include "nfs/Cache.hxx"
+#include "pipe/Stock.hxx"
+#include "stats/AllocatorStats.hxx"
+#include "stats/CacheStats.hxx"
+
+#include <chrono>
+#include <utility>
+#include <vector>
 
 using std::string_view_literals::operator""sv;
 
+static double
+ToSeconds(std::chrono::steady_clock::duration d) noexcept
+{
+	return std::chrono::duration_cast<std::chrono::duration<double>>(d).count();
+}
+
+static void
+WriteCacheStats(GrowingBuffer &buffer,
+		const std::vector<std::pair<const char *, CacheStats>> &caches) noexcept
+{
+	buffer.Write("# HELP beng_proxy_cache_hits Number of cache lookups which found a valid item\n"
+		     "# TYPE beng_proxy_cache_hits counter\n"sv);
+	for (const auto &[name, stats] : caches)
+		buffer.Fmt("beng_proxy_cache_hits{{cache=\"{}\"}} {}\n",
+			   name, stats.hits);
+
+	buffer.Write("# HELP beng_proxy_cache_misses Number of cache lookups which did not find a valid item\n"
+		     "# TYPE beng_proxy_cache_misses counter\n"sv);
+	for (const auto &[name, stats] : caches)
+		buffer.Fmt("beng_proxy_cache_misses{{cache=\"{}\"}} {}\n",
+			   name, stats.misses);
+
+	buffer.Write("# HELP beng_proxy_cache_evictions Number of cache items removed to make room for new ones\n"
+		     "# TYPE beng_proxy_cache_evictions counter\n"sv);
+	for (const auto &[name, stats] : caches)
+		buffer.Fmt("beng_proxy_cache_evictions{{cache=\"{}\"}} {}\n",
+			   name, stats.evictions);
+
+	buffer.Write("# HELP beng_proxy_cache_admission_rejected Number of new cache items evicted by the TinyLFU admission filter\n"
+		     "# TYPE beng_proxy_cache_admission_rejected counter\n"sv);
+	for (const auto &[name, stats] : caches)
+		buffer.Fmt("beng_proxy_cache_admission_rejected{{cache=\"{}\"}} {}\n",
+			   name, stats.admission_rejected);
+
+	buffer.Write("# HELP beng_proxy_cache_expire_passes Number of cache expiry passes\n"
+		     "# TYPE beng_proxy_cache_expire_passes counter\n"sv);
+	for (const auto &[name, stats] : caches)
+		buffer.Fmt("beng_proxy_cache_expire_passes{{cache=\"{}\"}} {}\n",
+			   name, stats.expire_passes);
+
+	buffer.Write("# HELP beng_proxy_cache_expire_checked Number of items examined by cache expiry passes\n"
+		     "# TYPE beng_proxy_cache_expire_checked counter\n"sv);
+	for (const auto &[name, stats] : caches)
+		buffer.Fmt("beng_proxy_cache_expire_checked{{cache=\"{}\"}} {}\n",
+			   name, stats.expire_checked);
+
+	buffer.Write("# HELP beng_proxy_cache_expire_removed Number of items removed by cache expiry passes\n"
+		     "# TYPE beng_proxy_cache_expire_removed counter\n"sv);
+	for (const auto &[name, stats] : caches)
+		buffer.Fmt("beng_proxy_cache_expire_removed{{cache=\"{}\"}} {}\n",
+			   name, stats.expire_removed);
+
+	buffer.Write("# HELP beng_proxy_cache_expire_seconds Time spent in cache expiry passes\n"
+		     "# TYPE beng_proxy_cache_expire_seconds counter\n"sv);
+	for (const auto &[name, stats] : caches)
+		buffer.Fmt("beng_proxy_cache_expire_seconds{{cache=\"{}\"}} {:e}\n",
+			   name, ToSeconds(stats.expire_duration));
+
+	buffer.Write("# HELP beng_proxy_cache_expire_max_seconds Duration of the most expensive cache expiry pass\n"
+		     "# TYPE beng_proxy_cache_expire_max_seconds gauge\n"sv);
+	for (const auto &[name, stats] : caches)
+		buffer.Fmt("beng_proxy_cache_expire_max_seconds{{cache=\"{}\"}} {:e}\n",
+			   name, ToSeconds(stats.expire_max_duration));
+}
+
+static void
+WriteAllocatorStats(GrowingBuffer &buffer,
+		    const std::vector<std::pair<const char *, AllocatorStats>> &allocators) noexcept
+{
+	buffer.Write("# HELP beng_proxy_cache_holes Number of unused gaps in the cache allocator\n"
+		     "# TYPE beng_proxy_cache_holes gauge\n"sv);
+	for (const auto &[name, stats] : allocators)
+		buffer.Fmt("beng_proxy_cache_holes{{cache=\"{}\"}} {}\n",
+			   name, stats.n_holes);
+
+	buffer.Write("# HELP beng_proxy_cache_compress_moved Number of bytes relocated by cache compaction\n"
+		     "# TYPE beng_proxy_cache_compress_moved counter\n"sv);
+	for (const auto &[name, stats] : allocators)
+		buffer.Fmt("beng_proxy_cache_compress_moved{{cache=\"{}\"}} {}\n",
+			   name, stats.compress_moved);
+
+	buffer.Write("# HELP beng_proxy_cache_compress_remapped Number of bytes relocated by cache compaction by remapping pages\n"
+		     "# TYPE beng_proxy_cache_compress_remapped counter\n"sv);
+	for (const auto &[name, stats] : allocators)
+		buffer.Fmt("beng_proxy_cache_compress_remapped{{cache=\"{}\"}} {}\n",
+			   name, stats.compress_remapped);
+}
+
+static void
+WritePipeStats(GrowingBuffer &buffer,
+	       const std::vector<std::pair<const char *, PipeStockStats>> &stocks) noexcept
+{
+	buffer.Write("# HELP beng_proxy_pipe_splices Number of splice() calls into pooled pipes\n"
+		     "# TYPE beng_proxy_pipe_splices counter\n"sv);
+	for (const auto &[name, stats] : stocks)
+		buffer.Fmt("beng_proxy_pipe_splices{{stock=\"{}\"}} {}\n",
+			   name, stats.n_splices);
+
+	buffer.Write("# HELP beng_proxy_pipe_spliced_bytes Number of bytes moved into pooled pipes with splice()\n"
+		     "# TYPE beng_proxy_pipe_spliced_bytes counter\n"sv);
+	for (const auto &[name, stats] : stocks)
+		buffer.Fmt("beng_proxy_pipe_spliced_bytes{{stock=\"{}\"}} {}\n",
+			   name, stats.spliced_bytes);
+
+	buffer.Write("# HELP beng_proxy_pipe_grows Number of times a pooled pipe was enlarged\n"
+		     "# TYPE beng_proxy_pipe_grows counter\n"sv);
+	for (const auto &[name, stats] : stocks)
+		buffer.Fmt("beng_proxy_pipe_grows{{stock=\"{}\"}} {}\n",
+			   name, stats.n_grows);
+
+	buffer.Write("# HELP beng_proxy_pipe_grow_refused Number of times a pooled pipe was not enlarged because too many pipes were enlarged already\n"
+		     "# TYPE beng_proxy_pipe_grow_refused counter\n"sv);
+	for (const auto &[name, stats] : stocks)
+		buffer.Fmt("beng_proxy_pipe_grow_refused{{stock=\"{}\"}} {}\n",
+			   name, stats.n_grow_refused);
+}
+
 void
 BpPrometheusExporter::HandleHttpRequest(IncomingHttpRequest &request,
 					const StopwatchPtr &,
@@ -27,6 +155,44 @@ BpPrometheusExporter::HandleHttpRequest(IncomingHttpRequest &request,
 	for (const auto &[name, stats] : instance.listener_stats)
 		Prometheus::Write(buffer, process, name.c_str(), stats);
 
+	std::vector<std::pair<const char *, CacheStats>> caches;
+	if (instance.translation_caches)
+		caches.emplace_back("translation",
+				    instance.translation_caches->GetCacheStats());
+	if (instance.http_cache != nullptr)
+		caches.emplace_back("http",
+				    http_cache_get_cache_stats(*instance.http_cache));
+	if (instance.filter_cache != nullptr)
+		caches.emplace_back("filter",
+				    filter_cache_get_cache_stats(*instance.filter_cache));
+#ifdef HAVE_LIBNFS
+	if (instance.nfs_cache != nullptr)
+		caches.emplace_back("nfs",
+				    nfs_cache_get_cache_stats(*instance.nfs_cache));
+#endif
+
+	WriteCacheStats(buffer, caches);
+
+	std::vector<std::pair<const char *, AllocatorStats>> allocators;
+	if (instance.http_cache != nullptr)
+		allocators.emplace_back("http",
+					http_cache_get_stats(*instance.http_cache));
+	if (instance.filter_cache != nullptr)
+		allocators.emplace_back("filter",
+					filter_cache_get_stats(*instance.filter_cache));
+
+	WriteAllocatorStats(buffer, allocators);
+
+	std::vector<std::pair<const char *, PipeStockStats>> pipe_stocks;
+	if (instance.pipe_stock != nullptr)
+		pipe_stocks.emplace_back("pipe",
+					 instance.pipe_stock->GetStats());
+	if (instance.bulk_pipe_stock != nullptr)
+		pipe_stocks.emplace_back("bulk_pipe",
+					 instance.bulk_pipe_stock->GetStats());
+
+	WritePipeStats(buffer, pipe_stocks);
+
 #ifdef HAVE_LIBWAS
 	buffer.Write("# HELP beng_proxy_was_metric Metric received from WAS applications\n"
 		     "# TYPE beng_proxy_was_metric counter\n"sv);
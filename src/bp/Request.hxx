@@ -736,10 +736,15 @@ private:
 
 	SharedPoolPtr<WidgetContext> NewWidgetContext() const noexcept;
 
+	/**
+	 * @param source_tag identifies the template source for the
+	 * #XmlTemplateCache (may be nullptr)
+	 */
 	void InvokeXmlProcessor(HttpStatus status,
 				StringMap &response_headers,
 				UnusedIstreamPtr response_body,
-				const Transformation &transformation) noexcept;
+				const Transformation &transformation,
+				const char *source_tag) noexcept;
 
 	void HandleProxyWidget(UnusedIstreamPtr body,
 			       Widget &widget, const WidgetRef *proxy_ref,
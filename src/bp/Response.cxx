@@ -182,6 +182,7 @@ Request::NewWidgetContext() const noexcept
 		 session_id, realm,
 		 &request.headers);
 
+	ctx->xml_template_cache = instance.xml_template_cache.get();
 	ctx->peer_subject = connection.peer_subject;
 	ctx->peer_issuer_subject = connection.peer_issuer_subject;
 	ctx->user = user;
@@ -201,7 +202,8 @@ inline void
 Request::InvokeXmlProcessor(HttpStatus status,
 			    StringMap &response_headers,
 			    UnusedIstreamPtr response_body,
-			    const Transformation &transformation) noexcept
+			    const Transformation &transformation,
+			    const char *source_tag) noexcept
 {
 	assert(!response_sent);
 
@@ -302,7 +304,8 @@ Request::InvokeXmlProcessor(HttpStatus status,
 						  std::move(response_body),
 						  widget,
 						  std::move(ctx),
-						  transformation.u.processor.options);
+						  transformation.u.processor.options,
+						  source_tag);
 		assert(response_body);
 
 		InvokeResponse(status,
@@ -626,7 +629,8 @@ Request::DispatchResponseDirect(HttpStatus status, HttpHeaders headers,
 	}
 
 	if (body)
-		body = NewAutoPipeIstream(&pool, std::move(body), instance.pipe_stock);
+		body = NewAutoPipeIstream(&pool, std::move(body),
+					  instance.bulk_pipe_stock);
 
 #ifndef NDEBUG
 	response_sent = true;
@@ -664,7 +668,8 @@ Request::ApplyFilter(HttpStatus status, StringMap &&headers2,
 							     UnusedHoldIstreamPtr{pool, std::move(body)});
 
 	if (body)
-		body = NewAutoPipeIstream(&pool, std::move(body), instance.pipe_stock);
+		body = NewAutoPipeIstream(&pool, std::move(body),
+					  instance.bulk_pipe_stock);
 
 	instance.buffered_filter_resource_loader
 		->SendRequest(pool, stopwatch,
@@ -696,13 +701,17 @@ Request::ApplyTransformation(HttpStatus status, StringMap &&headers,
 			    transformation.u.filter);
 		break;
 
-	case Transformation::Type::PROCESS:
-		/* processor responses cannot be cached */
+	case Transformation::Type::PROCESS: {
+		/* processor responses cannot be cached, but the
+		   parsed template can */
+		const char *source_tag =
+			resource_tag_append_etag(pool, resource_tag, headers);
 		resource_tag = nullptr;
 
 		InvokeXmlProcessor(status, headers, std::move(response_body),
-				   transformation);
+				   transformation, source_tag);
 		break;
+	}
 
 	case Transformation::Type::PROCESS_CSS:
 		/* processor responses cannot be cached */
@@ -3,6 +3,8 @@
 // author: Max Kellermann <mk@cm4all.com>
 
 #include "XmlProcessor.hxx"
+#include "XmlTemplate.hxx"
+#include "XmlTemplateCache.hxx"
 #include "WidgetContainerParser.hxx"
 #include "TextProcessor.hxx"
 #include "CssProcessor.hxx"
@@ -31,6 +33,8 @@
 #include "util/StringSplit.hxx"
 #include "stopwatch.hxx"
 
+#include <optional>
+
 #include <assert.h>
 #include <string.h>
 
@@ -68,6 +72,31 @@ class XmlProcessor final : public ReplaceIstream, WidgetContainerParser {
 
 	const unsigned options;
 
+	/**
+	 * The cache for parsed templates; nullptr if the template
+	 * shall not be cached.
+	 */
+	XmlTemplateCache *const template_cache;
+
+	/**
+	 * Identifies the source in #template_cache.
+	 */
+	const char *const source_tag;
+
+	/**
+	 * A parsed template from #template_cache.  As long as
+	 * #player is set, its events are replayed instead of feeding
+	 * the source into #parser.
+	 */
+	XmlTemplateLease template_lease;
+	std::optional<XmlTemplatePlayer> player;
+
+	/**
+	 * Records the parser events for #template_cache if there was
+	 * no cached template.
+	 */
+	XmlTemplateRecorder recorder;
+
 	XmlParser parser;
 	bool had_input;
 
@@ -117,15 +146,32 @@ public:
 	XmlProcessor(PoolPtr &&_pool, const StopwatchPtr &parent_stopwatch,
 		     UnusedIstreamPtr &&_input,
 		     Widget &_widget, SharedPoolPtr<WidgetContext> &&_ctx,
-		     unsigned _options) noexcept
+		     unsigned _options, const char *_source_tag) noexcept
 		:ReplaceIstream(std::move(_pool), _ctx->event_loop, std::move(_input)),
 		 WidgetContainerParser(GetPool(), _widget, std::move(_ctx)),
 		 stopwatch(parent_stopwatch, "XmlProcessor"),
 		 options(_options),
-		 parser(GetPool(), *this),
+		 template_cache(_source_tag != nullptr
+				? ctx->xml_template_cache
+				: nullptr),
+		 source_tag(_source_tag),
+		 template_lease(template_cache != nullptr
+				? template_cache->Get(source_tag, options)
+				: XmlTemplateLease{}),
+		 recorder(*this, template_cache != nullptr && !template_lease,
+			  XmlTemplateCache::MAX_SOURCE_SIZE),
+		 parser(GetPool(),
+			recorder.IsEnabled()
+			? (XmlParserHandler &)recorder
+			: (XmlParserHandler &)*this),
 		 buffer(GetPool(), 128, 2048),
 		 postponed_rewrite(GetPool())
 	{
+		if (template_lease)
+			player.emplace(*template_lease, *this);
+
+		recorder.SetParser(parser);
+
 		if (HasOptionRewriteUrl()) {
 			default_uri_rewrite.base = UriBase::TEMPLATE;
 			default_uri_rewrite.mode = RewriteUriMode::PARTIAL;
@@ -222,18 +268,23 @@ private:
 	Istream *StartCdataIstream() noexcept;
 	void StopCdataIstream() noexcept;
 
+	/**
+	 * The source differs from the cached template: stop replaying
+	 * it and resume parsing after the last verified segment.
+	 *
+	 * @param chunk_start the source offset of #b
+	 * @param b the current chunk of source data
+	 */
+	void ResumeParser(off_t chunk_start,
+			  std::span<const std::byte> b) noexcept;
+
 	/* virtual methods from class IstreamHandler */
 	void OnEof() noexcept override;
 	void OnError(std::exception_ptr ep) noexcept override;
 
 	/* virtual methods from class ReplaceIstream */
-	void Parse(std::span<const std::byte> b) override {
-		parser.Feed((const char *)b.data(), b.size());
-	}
-
-	void ParseEnd() override {
-		ReplaceIstream::Finish();
-	}
+	void Parse(std::span<const std::byte> b) override;
+	void ParseEnd() override;
 
 	/* virtual methods from class WidgetContainerParser */
 	bool WantWidget(const Widget &) const noexcept override {
@@ -999,9 +1050,15 @@ XmlProcessor::OnXmlTagFinished(const XmlParserTag &xml_tag) noexcept
 		CommitUriRewrite();
 
 	if (tag == Tag::SCRIPT) {
-		if (xml_tag.type == XmlParserTagType::OPEN)
-			parser.Script();
-		else
+		if (xml_tag.type == XmlParserTagType::OPEN) {
+			/* while replaying a template, the parser is
+			   idle; if it gets resumed later, that
+			   happens outside of the SCRIPT element; while
+			   recording, the recorder does this for all
+			   SCRIPT elements */
+			if (!player && !recorder.IsEnabled())
+				parser.Script();
+		} else
 			tag = Tag::NONE;
 		return true;
 	} else if (tag == Tag::REWRITE_URI) {
@@ -1060,6 +1117,72 @@ XmlProcessor::OnXmlCdata(std::string_view text,
 	return text.size();
 }
 
+void
+XmlProcessor::ResumeParser(off_t chunk_start,
+			   std::span<const std::byte> b) noexcept
+{
+	assert(player);
+
+	const off_t resume = player->GetResumePosition();
+	parser.Reset(resume);
+
+	if (resume < chunk_start) {
+		/* this part of the current segment was already
+		   consumed from the input; take it from the
+		   template, where it has been verified */
+		const auto src = player->GetSource(resume, chunk_start);
+		parser.Feed((const char *)src.data(), src.size());
+	} else
+		b = b.subspan(resume - chunk_start);
+
+	player.reset();
+	template_lease = {};
+
+	if (!b.empty())
+		parser.Feed((const char *)b.data(), b.size());
+}
+
+void
+XmlProcessor::Parse(std::span<const std::byte> b)
+{
+	if (player) {
+		const off_t chunk_start = player->GetPosition();
+		switch (player->Feed(b)) {
+		case XmlTemplatePlayer::FeedResult::OK:
+			break;
+
+		case XmlTemplatePlayer::FeedResult::MISMATCH:
+			ResumeParser(chunk_start, b);
+			break;
+
+		case XmlTemplatePlayer::FeedResult::CLOSED:
+			/* just like XmlParser::Feed() returning 0 */
+			break;
+		}
+
+		return;
+	}
+
+	recorder.AppendSource(b);
+
+	parser.Feed((const char *)b.data(), b.size());
+
+	recorder.EndOfChunk(parser.IsIdle());
+}
+
+void
+XmlProcessor::ParseEnd()
+{
+	if (player) {
+		if (!player->IsComplete())
+			/* the source is shorter than the template */
+			ResumeParser(player->GetPosition(), {});
+	} else if (recorder.Finish(parser.IsIdle()))
+		template_cache->Put(source_tag, options, recorder.Steal());
+
+	ReplaceIstream::Finish();
+}
+
 void
 XmlProcessor::OnEof() noexcept
 {
@@ -1110,7 +1233,8 @@ processor_process(struct pool &caller_pool,
 		  UnusedIstreamPtr input,
 		  Widget &widget,
 		  SharedPoolPtr<WidgetContext> ctx,
-		  unsigned options) noexcept
+		  unsigned options,
+		  const char *source_tag) noexcept
 {
 	auto pool = pool_new_linear(&caller_pool, "WidgetLookupProcessor", 32768);
 
@@ -1122,6 +1246,7 @@ processor_process(struct pool &caller_pool,
 	auto *processor =
 		NewFromPool<XmlProcessor>(std::move(pool), parent_stopwatch,
 					  std::move(input),
-					  widget, std::move(ctx), options);
+					  widget, std::move(ctx), options,
+					  source_tag);
 	return UnusedIstreamPtr(processor);
 }
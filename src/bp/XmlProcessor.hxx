@@ -50,6 +50,9 @@ processable(const StringMap &headers) noexcept;
  * Process the specified istream, and return the processed stream.
  *
  * @param widget the widget that represents the template
+ * @param source_tag identifies the (unmodified) source in
+ * WidgetContext::xml_template_cache; nullptr if the parsed template
+ * shall not be cached
  */
 UnusedIstreamPtr
 processor_process(struct pool &pool,
@@ -57,4 +60,5 @@ processor_process(struct pool &pool,
 		  UnusedIstreamPtr istream,
 		  Widget &widget,
 		  SharedPoolPtr<WidgetContext> ctx,
-		  unsigned options) noexcept;
+		  unsigned options,
+		  const char *source_tag=nullptr) noexcept;
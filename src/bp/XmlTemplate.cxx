@@ -0,0 +1,314 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#include "XmlTemplate.hxx"
+
+#include <algorithm>
+
+#include <string.h>
+
+using std::string_view_literals::operator""sv;
+
+std::size_t
+XmlTemplate::GetMemorySize() const noexcept
+{
+	return sizeof(*this) + source.capacity() + strings.capacity() +
+		events.capacity() * sizeof(events.front()) +
+		segments.capacity() * sizeof(segments.front());
+}
+
+bool
+XmlTemplate::Replay(std::size_t begin, std::size_t end,
+		    XmlParserHandler &handler) const noexcept
+{
+	assert(begin <= end);
+	assert(end <= events.size());
+
+	/* segments end outside of markup, therefore a tag never
+	   spans two Replay() calls */
+	bool skip_tag = false;
+
+	for (std::size_t i = begin; i < end; ++i) {
+		const auto &event = events[i];
+
+		switch (event.type) {
+		case EventType::TAG_START:
+			skip_tag = !handler.OnXmlTagStart({
+				.start = event.start,
+				.end = event.end,
+				.name = GetName(event),
+				.type = event.tag_type,
+			});
+			break;
+
+		case EventType::TAG_FINISHED:
+			if (skip_tag) {
+				skip_tag = false;
+				break;
+			}
+
+			if (!handler.OnXmlTagFinished({
+					.start = event.start,
+					.end = event.end,
+					.name = GetName(event),
+					.type = event.tag_type,
+				}))
+				return false;
+			break;
+
+		case EventType::ATTRIBUTE:
+			if (skip_tag)
+				break;
+
+			handler.OnXmlAttributeFinished({
+				.name_start = event.start,
+				.value_start = event.value_start,
+				.value_end = event.value_end,
+				.end = event.end,
+				.name = GetName(event),
+				.value = GetValue(event),
+			});
+			break;
+
+		case EventType::CDATA:
+			handler.OnXmlCdata(GetName(event), event.escaped,
+					   event.start);
+			break;
+
+		case EventType::SOURCE_CDATA:
+			handler.OnXmlCdata(std::string_view{source}.substr(event.name_offset,
+									   event.name_length),
+					   event.escaped, event.start);
+			break;
+		}
+	}
+
+	return true;
+}
+
+void
+XmlTemplateRecorder::Disable() noexcept
+{
+	enabled = false;
+	t = {};
+}
+
+void
+XmlTemplateRecorder::AppendSource(std::span<const std::byte> src) noexcept
+{
+	if (!enabled)
+		return;
+
+	if (t.source.size() + src.size() > max_source_size) {
+		/* too large to be cached */
+		Disable();
+		return;
+	}
+
+	t.source.append((const char *)src.data(), src.size());
+}
+
+void
+XmlTemplateRecorder::EndOfChunk(bool idle) noexcept
+{
+	if (!enabled || !idle)
+		return;
+
+	const off_t end = t.source.size();
+	if (!t.segments.empty() && t.segments.back().end == end)
+		return;
+
+	t.segments.push_back({end, t.events.size()});
+}
+
+bool
+XmlTemplateRecorder::Finish(bool idle) noexcept
+{
+	if (!enabled)
+		return false;
+
+	/* if the parser is inside markup at the end of the source,
+	   the last segment would not be a valid resume position */
+	if (!idle) {
+		Disable();
+		return false;
+	}
+
+	EndOfChunk(idle);
+
+	if (t.empty() || t.segments.back().end != (off_t)t.source.size()) {
+		Disable();
+		return false;
+	}
+
+	t.source.shrink_to_fit();
+	t.strings.shrink_to_fit();
+	t.events.shrink_to_fit();
+	t.segments.shrink_to_fit();
+	return true;
+}
+
+inline uint32_t
+XmlTemplateRecorder::AddString(std::string_view s) noexcept
+{
+	const uint32_t offset = t.strings.size();
+	t.strings.append(s);
+	return offset;
+}
+
+inline void
+XmlTemplateRecorder::AddTag(XmlTemplate::EventType type,
+			    const XmlParserTag &tag) noexcept
+{
+	XmlTemplate::Event event{};
+	event.type = type;
+	event.tag_type = tag.type;
+	event.start = tag.start;
+	event.end = tag.end;
+	event.name_length = tag.name.size();
+	event.name_offset = AddString(tag.name);
+	t.events.push_back(event);
+}
+
+inline bool
+XmlTemplateRecorder::IsSimpleTag(const XmlParserTag &tag) const noexcept
+{
+	assert(tag.start < tag.end);
+	assert((std::size_t)tag.end <= t.source.size());
+
+	const std::string_view s = std::string_view{t.source}
+		.substr(tag.start, tag.end - tag.start);
+	return s.find('>') == s.size() - 1;
+}
+
+bool
+XmlTemplateRecorder::OnXmlTagStart(const XmlParserTag &tag) noexcept
+{
+	if (!enabled) {
+		/* let the parser skip tags which the next handler is
+		   not interested in */
+		forward_tag = true;
+		return next.OnXmlTagStart(tag);
+	}
+
+	/* the end offset is not yet known */
+	AddTag(XmlTemplate::EventType::TAG_START,
+	       {tag.start, tag.start, tag.name, tag.type});
+
+	forward_tag = next.OnXmlTagStart(tag);
+
+	/* always parse the whole tag, because the next request
+	   replaying this template may be interested in it */
+	return true;
+}
+
+bool
+XmlTemplateRecorder::OnXmlTagFinished(const XmlParserTag &tag) noexcept
+{
+	if (enabled) {
+		if (IsSimpleTag(tag))
+			AddTag(XmlTemplate::EventType::TAG_FINISHED, tag);
+		else
+			/* replaying this tag could not emulate what
+			   the parser does with an ignored tag */
+			Disable();
+	}
+
+	if (forward_tag && !next.OnXmlTagFinished(tag))
+		return false;
+
+	if (enabled && tag.type == XmlParserTagType::OPEN &&
+	    tag.name == "script"sv) {
+		/* the parser lower-cases all tag names */
+		assert(parser != nullptr);
+		parser->Script();
+	}
+
+	return true;
+}
+
+void
+XmlTemplateRecorder::OnXmlAttributeFinished(const XmlParserAttribute &attr) noexcept
+{
+	if (enabled) {
+		XmlTemplate::Event event{};
+		event.type = XmlTemplate::EventType::ATTRIBUTE;
+		event.start = attr.name_start;
+		event.end = attr.end;
+		event.value_start = attr.value_start;
+		event.value_end = attr.value_end;
+		event.name_length = attr.name.size();
+		event.name_offset = AddString(attr.name);
+		event.value_length = attr.value.size();
+		event.value_offset = AddString(attr.value);
+		t.events.push_back(event);
+	}
+
+	if (forward_tag)
+		next.OnXmlAttributeFinished(attr);
+}
+
+size_t
+XmlTemplateRecorder::OnXmlCdata(std::string_view text, bool escaped,
+				off_t start) noexcept
+{
+	const size_t result = next.OnXmlCdata(text, escaped, start);
+
+	if (enabled && result > 0) {
+		text = text.substr(0, result);
+
+		XmlTemplate::Event event{};
+		event.escaped = escaped;
+		event.start = start;
+		event.name_length = text.size();
+
+		if ((std::size_t)start + text.size() <= t.source.size() &&
+		    t.source.compare(start, text.size(), text) == 0) {
+			/* no need to copy the text, it's in the
+			   source already */
+			event.type = XmlTemplate::EventType::SOURCE_CDATA;
+			event.name_offset = start;
+		} else {
+			event.type = XmlTemplate::EventType::CDATA;
+			event.name_offset = AddString(text);
+		}
+
+		t.events.push_back(event);
+	}
+
+	return result;
+}
+
+XmlTemplatePlayer::FeedResult
+XmlTemplatePlayer::Feed(std::span<const std::byte> src) noexcept
+{
+	while (!src.empty()) {
+		if (segment >= t.segments.size())
+			/* the source is longer than the template */
+			return FeedResult::MISMATCH;
+
+		const auto &s = t.segments[segment];
+		assert(s.end > position);
+
+		const std::size_t n = std::min<std::size_t>(src.size(),
+							    s.end - position);
+		if (memcmp(t.source.data() + position, src.data(), n) != 0)
+			return FeedResult::MISMATCH;
+
+		position += n;
+		src = src.subspan(n);
+
+		if (position == s.end) {
+			const std::size_t begin = segment > 0
+				? t.segments[segment - 1].end_event
+				: 0;
+			++segment;
+
+			if (!t.Replay(begin, s.end_event, handler))
+				return FeedResult::CLOSED;
+		}
+	}
+
+	return FeedResult::OK;
+}
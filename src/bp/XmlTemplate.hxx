@@ -0,0 +1,340 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#pragma once
+
+#include "parser/XmlParser.hxx"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * A template which has been parsed by #XmlParser: a copy of the
+ * source and the list of events emitted by the parser.  These events
+ * can be replayed into a #XmlParserHandler (see #XmlTemplatePlayer)
+ * without parsing the source again.
+ *
+ * The source is split into segments which end at positions where
+ * the parser was idle (i.e. outside of any markup).  If a new source
+ * differs from the template, parsing can be resumed with a fresh
+ * #XmlParser at the end of the last matching segment.
+ *
+ * The events depend only on the source, not on the decisions of the
+ * handler which was active while recording: all tags are parsed
+ * completely, and replaying emulates the parser's behavior for tags
+ * which the handler is not interested in.
+ */
+class XmlTemplate {
+	friend class XmlTemplateRecorder;
+	friend class XmlTemplatePlayer;
+
+	enum class EventType : uint8_t {
+		TAG_START,
+		TAG_FINISHED,
+		ATTRIBUTE,
+
+		/**
+		 * CDATA whose text is stored in #strings.
+		 */
+		CDATA,
+
+		/**
+		 * CDATA whose text is a portion of #source (the usual
+		 * case).
+		 */
+		SOURCE_CDATA,
+	};
+
+	struct Event {
+		EventType type;
+
+		/**
+		 * Only used by #TAG_START and #TAG_FINISHED.
+		 */
+		XmlParserTagType tag_type;
+
+		/**
+		 * Only used by CDATA events.
+		 */
+		bool escaped;
+
+		/**
+		 * Tags: start and end offset; attributes: name start
+		 * and end offset; CDATA: start offset.
+		 */
+		off_t start, end;
+
+		/**
+		 * Only used by #ATTRIBUTE.
+		 */
+		off_t value_start, value_end;
+
+		/**
+		 * The tag or attribute name or the CDATA text.
+		 */
+		uint32_t name_offset, name_length;
+
+		/**
+		 * The attribute value.
+		 */
+		uint32_t value_offset, value_length;
+	};
+
+	struct Segment {
+		/**
+		 * The source offset where this segment ends.
+		 */
+		off_t end;
+
+		/**
+		 * The index of the first event after this segment.
+		 */
+		std::size_t end_event;
+	};
+
+	std::string source;
+
+	/**
+	 * Names, attribute values and CDATA texts referenced by
+	 * #events.
+	 */
+	std::string strings;
+
+	std::vector<Event> events;
+	std::vector<Segment> segments;
+
+public:
+	bool empty() const noexcept {
+		return segments.empty();
+	}
+
+	/**
+	 * Returns the approximate amount of memory occupied by this
+	 * object.
+	 */
+	[[gnu::pure]]
+	std::size_t GetMemorySize() const noexcept;
+
+private:
+	std::string_view GetString(uint32_t offset,
+				   uint32_t length) const noexcept {
+		return std::string_view{strings}.substr(offset, length);
+	}
+
+	std::string_view GetName(const Event &event) const noexcept {
+		return GetString(event.name_offset, event.name_length);
+	}
+
+	std::string_view GetValue(const Event &event) const noexcept {
+		return GetString(event.value_offset, event.value_length);
+	}
+
+	/**
+	 * Invoke the #XmlParserHandler methods for the events with
+	 * the indexes [begin, end).  If the handler returns false
+	 * from OnXmlTagStart(), the attributes and the
+	 * OnXmlTagFinished() call of this tag are skipped, just like
+	 * #XmlParser would do.
+	 *
+	 * @return false if the handler has closed the parser
+	 */
+	bool Replay(std::size_t begin, std::size_t end,
+		    XmlParserHandler &handler) const noexcept;
+};
+
+/**
+ * An #XmlParserHandler which forwards all calls to another handler
+ * and records them into an #XmlTemplate.
+ *
+ * While recording, this class asks the parser to parse every tag
+ * completely, regardless of what the next handler returns from
+ * OnXmlTagStart(), and it switches the parser to script mode after
+ * each opening "script" tag; that way, the recorded events do not
+ * depend on the next handler.  Templates containing tags which
+ * #XmlParser would end differently when ignoring them (e.g. a '>'
+ * in a quoted attribute value) are not recorded.
+ */
+class XmlTemplateRecorder final : public XmlParserHandler {
+	XmlParserHandler &next;
+
+	XmlParser *parser = nullptr;
+
+	XmlTemplate t;
+
+	const std::size_t max_source_size;
+
+	bool enabled;
+
+	/**
+	 * Did the next handler return true from the most recent
+	 * OnXmlTagStart() call?  If not, the attributes and the
+	 * OnXmlTagFinished() call of this tag are not forwarded.
+	 */
+	bool forward_tag = true;
+
+public:
+	XmlTemplateRecorder(XmlParserHandler &_next, bool _enabled,
+			    std::size_t _max_source_size) noexcept
+		:next(_next), max_source_size(_max_source_size),
+		 enabled(_enabled) {}
+
+	/**
+	 * Set the #XmlParser which feeds this object; it is needed
+	 * to switch the parser to script mode.
+	 */
+	void SetParser(XmlParser &_parser) noexcept {
+		parser = &_parser;
+	}
+
+	bool IsEnabled() const noexcept {
+		return enabled;
+	}
+
+	/**
+	 * Stop recording and free all memory; calls are still
+	 * forwarded to the next handler.
+	 */
+	void Disable() noexcept;
+
+	/**
+	 * Append data to the template source.  Call this before
+	 * passing the data to XmlParser::Feed().
+	 */
+	void AppendSource(std::span<const std::byte> src) noexcept;
+
+	/**
+	 * The parser has consumed all data passed to
+	 * AppendSource().
+	 *
+	 * @param idle the return value of XmlParser::IsIdle()
+	 */
+	void EndOfChunk(bool idle) noexcept;
+
+	/**
+	 * The end of the source has been reached.
+	 *
+	 * @param idle the return value of XmlParser::IsIdle()
+	 * @return true if a template has been recorded successfully
+	 * and can be obtained with Steal()
+	 */
+	bool Finish(bool idle) noexcept;
+
+	XmlTemplate &&Steal() noexcept {
+		return std::move(t);
+	}
+
+private:
+	uint32_t AddString(std::string_view s) noexcept;
+
+	void AddTag(XmlTemplate::EventType type,
+		    const XmlParserTag &tag) noexcept;
+
+	/**
+	 * Would #XmlParser end this tag at the same position if the
+	 * handler was not interested in it?  That is the case if the
+	 * tag ends with the first '>' after its start.
+	 */
+	[[gnu::pure]]
+	bool IsSimpleTag(const XmlParserTag &tag) const noexcept;
+
+public:
+	/* virtual methods from class XmlParserHandler */
+	bool OnXmlTagStart(const XmlParserTag &tag) noexcept override;
+	bool OnXmlTagFinished(const XmlParserTag &tag) noexcept override;
+	void OnXmlAttributeFinished(const XmlParserAttribute &attr) noexcept override;
+	size_t OnXmlCdata(std::string_view text, bool escaped,
+			  off_t start) noexcept override;
+};
+
+/**
+ * Compares incoming source data with an #XmlTemplate, and replays
+ * the template's events into an #XmlParserHandler as soon as a
+ * segment has been verified.
+ */
+class XmlTemplatePlayer {
+	const XmlTemplate &t;
+
+	XmlParserHandler &handler;
+
+	/**
+	 * The number of source bytes which have been verified.
+	 */
+	off_t position = 0;
+
+	/**
+	 * The index of the segment which is currently being
+	 * verified.
+	 */
+	std::size_t segment = 0;
+
+public:
+	XmlTemplatePlayer(const XmlTemplate &_t,
+			  XmlParserHandler &_handler) noexcept
+		:t(_t), handler(_handler) {}
+
+	off_t GetPosition() const noexcept {
+		return position;
+	}
+
+	/**
+	 * Returns the source offset where parsing can be resumed
+	 * with a fresh #XmlParser after Feed() has failed.  All
+	 * events before this offset have been replayed.
+	 */
+	off_t GetResumePosition() const noexcept {
+		return segment > 0 ? t.segments[segment - 1].end : 0;
+	}
+
+	/**
+	 * Returns a portion of the template source which has already
+	 * been verified.
+	 */
+	std::span<const std::byte> GetSource(off_t start,
+					     off_t end) const noexcept {
+		assert(start <= end);
+		assert(end <= position);
+
+		return std::as_bytes(std::span{t.source})
+			.subspan(start, end - start);
+	}
+
+	/**
+	 * Has the whole template been verified and replayed?
+	 */
+	bool IsComplete() const noexcept {
+		return segment == t.segments.size();
+	}
+
+	enum class FeedResult {
+		/**
+		 * The data matches the template, and all complete
+		 * segments have been replayed.
+		 */
+		OK,
+
+		/**
+		 * The data does not match the template; parsing
+		 * shall be resumed with a fresh #XmlParser at
+		 * GetResumePosition().
+		 */
+		MISMATCH,
+
+		/**
+		 * The handler has closed the parser (i.e. returned
+		 * false from OnXmlTagFinished()); this object must
+		 * not be used anymore.
+		 */
+		CLOSED,
+	};
+
+	/**
+	 * Verify more source data and replay all segments which are
+	 * complete.
+	 */
+	FeedResult Feed(std::span<const std::byte> src) noexcept;
+};
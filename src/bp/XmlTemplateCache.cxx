@@ -0,0 +1,86 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#include "XmlTemplateCache.hxx"
+#include "XmlTemplate.hxx"
+#include "event/Loop.hxx"
+
+#include <fmt/core.h>
+
+#include <string>
+
+class XmlTemplateCacheItem final : public CacheItem {
+	const std::string key_buffer;
+
+public:
+	const XmlTemplate t;
+
+	XmlTemplateCacheItem(std::chrono::steady_clock::time_point now,
+			     std::string &&_key, XmlTemplate &&_t) noexcept
+		:CacheItem(now, std::chrono::hours(1),
+			   _key.size() + _t.GetMemorySize()),
+		 key_buffer(std::move(_key)), t(std::move(_t)) {}
+
+	const char *GetKeyBuffer() const noexcept {
+		return key_buffer.c_str();
+	}
+
+	/* virtual methods from class CacheItem */
+	void Destroy() noexcept override {
+		delete this;
+	}
+};
+
+XmlTemplateLease::XmlTemplateLease(XmlTemplateCacheItem &_item) noexcept
+	:item(&_item)
+{
+	item->Lock();
+}
+
+XmlTemplateLease::~XmlTemplateLease() noexcept
+{
+	if (item != nullptr)
+		item->Unlock();
+}
+
+const XmlTemplate &
+XmlTemplateLease::operator*() const noexcept
+{
+	assert(item != nullptr);
+
+	return item->t;
+}
+
+static std::string
+MakeKey(const char *source_tag, unsigned options) noexcept
+{
+	return fmt::format("{}|{:x}", source_tag, options);
+}
+
+XmlTemplateCache::XmlTemplateCache(EventLoop &event_loop,
+				   std::size_t max_size) noexcept
+	:cache(event_loop, max_size) {}
+
+XmlTemplateCache::~XmlTemplateCache() noexcept = default;
+
+XmlTemplateLease
+XmlTemplateCache::Get(const char *source_tag, unsigned options) noexcept
+{
+	auto *item = (XmlTemplateCacheItem *)
+		cache.Get(MakeKey(source_tag, options).c_str());
+	if (item == nullptr)
+		return {};
+
+	return XmlTemplateLease{*item};
+}
+
+void
+XmlTemplateCache::Put(const char *source_tag, unsigned options,
+		      XmlTemplate &&t) noexcept
+{
+	auto *item = new XmlTemplateCacheItem(cache.SteadyNow(),
+					      MakeKey(source_tag, options),
+					      std::move(t));
+	cache.Put(item->GetKeyBuffer(), *item);
+}
@@ -0,0 +1,72 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#pragma once
+
+#include "cache.hxx"
+
+#include <cstddef>
+#include <utility>
+
+class EventLoop;
+class XmlTemplate;
+class XmlTemplateCacheItem;
+
+/**
+ * Holds a lock on a cached #XmlTemplate.
+ */
+class XmlTemplateLease {
+	XmlTemplateCacheItem *item = nullptr;
+
+public:
+	XmlTemplateLease() noexcept = default;
+	explicit XmlTemplateLease(XmlTemplateCacheItem &_item) noexcept;
+
+	XmlTemplateLease(XmlTemplateLease &&src) noexcept
+		:item(std::exchange(src.item, nullptr)) {}
+
+	~XmlTemplateLease() noexcept;
+
+	XmlTemplateLease &operator=(XmlTemplateLease &&src) noexcept {
+		std::swap(item, src.item);
+		return *this;
+	}
+
+	operator bool() const noexcept {
+		return item != nullptr;
+	}
+
+	const XmlTemplate &operator*() const noexcept;
+};
+
+/**
+ * A cache for templates which have been parsed by #XmlProcessor,
+ * addressed by the resource tag of the source and the processor
+ * options.
+ */
+class XmlTemplateCache {
+	Cache cache;
+
+public:
+	/**
+	 * Templates larger than this will not be cached.
+	 */
+	static constexpr std::size_t MAX_SOURCE_SIZE = 1024 * 1024;
+
+	XmlTemplateCache(EventLoop &event_loop, std::size_t max_size) noexcept;
+	~XmlTemplateCache() noexcept;
+
+	XmlTemplateCache(const XmlTemplateCache &) = delete;
+	XmlTemplateCache &operator=(const XmlTemplateCache &) = delete;
+
+	void Flush() noexcept {
+		cache.Flush();
+	}
+
+	XmlTemplateLease Get(const char *source_tag,
+			     unsigned options) noexcept;
+
+	void Put(const char *source_tag, unsigned options,
+		 XmlTemplate &&t) noexcept;
+};
@@ -24,7 +24,18 @@ SessionManager::SessionAttachHash::operator()(std::span<const std::byte> attach)
 inline size_t
 SessionManager::SessionAttachHash::operator()(const Session &session) const noexcept
 {
-	return session.id.Hash();
+	/* must be the same as the hash of the key; see
+	   IntrusiveGrowingHashSet::insert(iterator, T&) */
+	return djb_hash(session.attach.data(), session.attach.size());
+}
+
+void
+SessionManager::DisposeSession(Session &session) noexcept
+{
+	if (session.attach != nullptr)
+		sessions_by_attach.erase(sessions_by_attach.iterator_to(session));
+
+	delete &session;
 }
 
 void
@@ -33,7 +44,9 @@ SessionManager::EraseAndDispose(Session &session)
 	assert(!sessions.empty());
 
 	auto i = sessions.iterator_to(session);
-	sessions.erase_and_dispose(i, DeleteDisposer{});
+	sessions.erase_and_dispose(i, [this](Session *s){
+		DisposeSession(*s);
+	});
 }
 
 void
@@ -43,7 +56,9 @@ SessionManager::Cleanup() noexcept
 
 	sessions.remove_and_dispose_if([now](const Session &session){
 		return session.expires.IsExpired(now);
-	}, DeleteDisposer{});
+	}, [this](Session *session){
+		DisposeSession(*session);
+	});
 
 	if (!sessions.empty())
 		cleanup_timer.Schedule(cleanup_interval);
@@ -78,7 +93,9 @@ SessionManager::SeedPrng()
 
 SessionManager::~SessionManager() noexcept
 {
-	sessions.clear_and_dispose(DeleteDisposer{});
+	sessions.clear_and_dispose([this](Session *session){
+		DisposeSession(*session);
+	});
 }
 
 void
@@ -7,7 +7,7 @@
 #include "Session.hxx"
 #include "Prng.hxx"
 #include "event/FarTimerEvent.hxx"
-#include "util/IntrusiveHashSet.hxx"
+#include "util/IntrusiveGrowingHashSet.hxx"
 
 #include <chrono>
 #include <random>
@@ -74,19 +74,15 @@ class SessionManager {
 		}
 	};
 
-	static constexpr unsigned N_BUCKETS = 65521;
-
-	using Set = IntrusiveHashSet<Session, N_BUCKETS,
-				     SessionHash, SessionEqual,
-				     IntrusiveHashSetMemberHookTraits<&Session::set_hook>,
-				     true>;
+	using Set = IntrusiveGrowingHashSet<Session,
+					    SessionHash, SessionEqual,
+					    IntrusiveGrowingHashSetMemberHookTraits<&Session::set_hook>>;
 
 	Set sessions;
 
-	using ByAttach = IntrusiveHashSet<Session, N_BUCKETS,
-					  SessionAttachHash, SessionAttachEqual,
-					  IntrusiveHashSetMemberHookTraits<&Session::by_attach_hook>,
-					  true>;
+	using ByAttach = IntrusiveGrowingHashSet<Session,
+						 SessionAttachHash, SessionAttachEqual,
+						 IntrusiveGrowingHashSetMemberHookTraits<&Session::by_attach_hook>>;
 
 	ByAttach sessions_by_attach;
 
@@ -179,5 +175,13 @@ private:
 	void SeedPrng();
 
 	SessionId GenerateSessionId() noexcept;
+
+	/**
+	 * Remove the session from #sessions_by_attach (if it is
+	 * there) and delete it.  It must have been removed from
+	 * #sessions already.
+	 */
+	void DisposeSession(Session &session) noexcept;
+
 	void EraseAndDispose(Session &session);
 };
@@ -15,6 +15,7 @@
 #include "util/AllocatedArray.hxx"
 #include "util/AllocatedString.hxx"
 #include "util/Expiry.hxx"
+#include "util/IntrusiveGrowingHashSet.hxx"
 #include "util/IntrusiveHashSet.hxx"
 
 #include <boost/intrusive/set.hpp>
@@ -198,9 +199,9 @@ struct RealmSession
 };
 
 struct Session {
-	IntrusiveHashSetHook<IntrusiveHookMode::NORMAL> set_hook;
+	IntrusiveGrowingHashSetHook set_hook;
 
-	IntrusiveHashSetHook<IntrusiveHookMode::AUTO_UNLINK> by_attach_hook;
+	IntrusiveGrowingHashSetHook by_attach_hook;
 
 	/** identification number of this session */
 	const SessionId id;
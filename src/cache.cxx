@@ -6,9 +6,18 @@
 #include "event/Loop.hxx"
 #include "util/djbhash.h"
 
+#include <algorithm>
+
 #include <assert.h>
 #include <string.h>
 
+/**
+ * The granularity of #Cache::expiry_buckets; this should match the
+ * cleanup timer interval.
+ */
+static constexpr std::chrono::steady_clock::duration expiry_granularity =
+	std::chrono::minutes(1);
+
 inline size_t
 CacheItem::KeyHasher(const char *key) noexcept
 {
@@ -35,11 +44,41 @@ CacheItem::Release() noexcept
 		removed = true;
 }
 
+static constexpr size_t
+MaxProbationSize(CachePolicy policy, size_t max_size) noexcept
+{
+	switch (policy) {
+	case CachePolicy::LRU:
+		break;
+
+	case CachePolicy::TINY_LFU:
+		/* a 1% window, as suggested by the W-TinyLFU paper */
+		return max_size / 100;
+
+	case CachePolicy::S3_FIFO:
+		/* a 10% small queue, as suggested by the S3-FIFO
+		   paper */
+		return max_size / 10;
+	}
+
+	return 0;
+}
+
 Cache::Cache(EventLoop &event_loop,
-	     size_t _max_size) noexcept
-	:max_size(_max_size),
-	 cleanup_timer(event_loop, std::chrono::minutes(1),
-		       BIND_THIS_METHOD(ExpireCallback)) {}
+	     size_t _max_size, CachePolicy _policy) noexcept
+	:policy(_policy),
+	 max_size(_max_size),
+	 max_probation_size(MaxProbationSize(policy, max_size)),
+	 cleanup_timer(event_loop, expiry_granularity,
+		       BIND_THIS_METHOD(ExpireCallback))
+{
+	if (policy == CachePolicy::TINY_LFU)
+		/* assume that the average item is at least 4 kB;
+		   allow up to 1M counters per row (4 MB total) */
+		sketch = std::make_unique<FrequencySketch>(std::clamp<size_t>(max_size / 4096,
+									     1024,
+									     1024 * 1024));
+}
 
 Cache::~Cache() noexcept
 {
@@ -49,14 +88,18 @@ Cache::~Cache() noexcept
 		size -= item->size;
 
 #ifndef NDEBUG
-		sorted_items.erase(sorted_items.iterator_to(*item));
+		UnlinkItem(*item);
 #endif
 
+		/* the buckets outlive the items */
+		item->expiry_siblings.unlink();
+
 		item->Destroy();
 	});
 
 	assert(size == 0);
 	assert(sorted_items.empty());
+	assert(probation_items.empty());
 }
 
 std::chrono::steady_clock::time_point
@@ -79,7 +122,10 @@ Cache::ItemRemoved(CacheItem *item) noexcept
 	assert(item->lock > 0 || !item->removed);
 	assert(size >= item->size);
 
-	sorted_items.erase(sorted_items.iterator_to(*item));
+	UnlinkItem(*item);
+
+	if (item->expiry_siblings.is_linked())
+		item->expiry_siblings.unlink();
 
 	size -= item->size;
 
@@ -93,6 +139,76 @@ void
 Cache::Flush() noexcept
 {
 	items.clear_and_dispose(Cache::ItemRemover(*this));
+	expiry_buckets.clear();
+	ghost.Clear();
+}
+
+void
+Cache::ScheduleExpiry(CacheItem &item) noexcept
+{
+	assert(!item.expiry_siblings.is_linked());
+
+	using clock = std::chrono::steady_clock;
+
+	/* round up, so all items in a bucket have expired when the
+	   bucket's time has been reached */
+	const auto key = item.expires < clock::time_point::max() - expiry_granularity
+		? clock::time_point{} +
+		  ((item.expires.time_since_epoch() + expiry_granularity - clock::duration{1})
+		   / expiry_granularity) * expiry_granularity
+		: clock::time_point::max();
+
+	expiry_buckets[key].push_back(item);
+}
+
+void
+Cache::LinkItem(CacheItem &item) noexcept
+{
+	assert(!item.probation);
+
+	switch (policy) {
+	case CachePolicy::LRU:
+		break;
+
+	case CachePolicy::TINY_LFU:
+		item.probation = true;
+		break;
+
+	case CachePolicy::S3_FIFO:
+		/* items which have been evicted recently go straight
+		   to the main queue */
+		item.frequency = 0;
+		item.probation = !ghost.Contains(CacheItem::KeyHasher(item.key));
+		break;
+	}
+
+	if (item.probation) {
+		probation_items.push_back(item);
+		probation_size += item.size;
+	} else
+		sorted_items.push_back(item);
+}
+
+void
+Cache::UnlinkItem(CacheItem &item) noexcept
+{
+	if (item.probation) {
+		assert(probation_size >= item.size);
+
+		probation_items.erase(probation_items.iterator_to(item));
+		probation_size -= item.size;
+		item.probation = false;
+	} else
+		sorted_items.erase(sorted_items.iterator_to(item));
+}
+
+void
+Cache::PromoteItem(CacheItem &item) noexcept
+{
+	assert(item.probation);
+
+	UnlinkItem(item);
+	sorted_items.push_back(item);
 }
 
 void
@@ -101,9 +217,27 @@ Cache::RefreshItem(CacheItem &item,
 {
 	item.last_accessed = now;
 
-	/* move to the front of the linked list */
-	sorted_items.erase(sorted_items.iterator_to(item));
-	sorted_items.push_back(item);
+	switch (policy) {
+	case CachePolicy::LRU:
+	case CachePolicy::TINY_LFU:
+		/* move to the end of the linked list */
+		if (item.probation) {
+			probation_items.erase(probation_items.iterator_to(item));
+			probation_items.push_back(item);
+		} else {
+			sorted_items.erase(sorted_items.iterator_to(item));
+			sorted_items.push_back(item);
+		}
+
+		break;
+
+	case CachePolicy::S3_FIFO:
+		/* FIFO queues are never reordered on a hit; just
+		   remember the hit for EvictOne() */
+		if (item.frequency < 3)
+			++item.frequency;
+		break;
+	}
 }
 
 void
@@ -118,9 +252,14 @@ Cache::RemoveItem(CacheItem &item) noexcept
 CacheItem *
 Cache::Get(const char *key) noexcept
 {
+	if (sketch)
+		sketch->Increment(CacheItem::KeyHasher(key));
+
 	auto i = items.find(key);
-	if (i == items.end())
+	if (i == items.end()) {
+		++stats.misses;
 		return nullptr;
+	}
 
 	CacheItem *item = &*i;
 
@@ -128,24 +267,24 @@ Cache::Get(const char *key) noexcept
 
 	if (!item->Validate(now)) {
 		RemoveItem(*item);
+		++stats.misses;
 		return nullptr;
 	}
 
+	++stats.hits;
 	RefreshItem(*item, now);
 	return item;
 }
 
 CacheItem *
-Cache::GetMatch(const char *key,
-		bool (*match)(const CacheItem *, void *),
-		void *ctx) noexcept
+Cache::LookupMatch(const char *key,
+		   bool (*match)(const CacheItem *, void *), void *ctx,
+		   std::chrono::steady_clock::time_point now) noexcept
 {
-	const auto now = SteadyNow();
-
 	auto i = items.expire_find_if(key, [now](const auto &item){
 		return !item.Validate(now);
-	}, [this](auto *item){
-		RemoveItem(*item);
+	}, [this](CacheItem *item){
+		ItemRemoved(item);
 	}, [match, ctx](const auto &item){
 		return match(&item, ctx);
 	});
@@ -153,19 +292,120 @@ Cache::GetMatch(const char *key,
 	if (i == items.end())
 		return nullptr;
 
-	/* this one matches: return it to the caller */
-	RefreshItem(*i, now);
 	return &*i;
 }
 
+CacheItem *
+Cache::GetMatch(const char *key,
+		bool (*match)(const CacheItem *, void *),
+		void *ctx) noexcept
+{
+	if (sketch)
+		sketch->Increment(CacheItem::KeyHasher(key));
+
+	const auto now = SteadyNow();
+
+	auto *item = LookupMatch(key, match, ctx, now);
+	if (item == nullptr) {
+		++stats.misses;
+		return nullptr;
+	}
+
+	/* this one matches: return it to the caller */
+	++stats.hits;
+	RefreshItem(*item, now);
+	return item;
+}
+
 void
-Cache::DestroyOldestItem() noexcept
+Cache::EvictOne(size_t incoming_size) noexcept
 {
-	if (sorted_items.empty())
+	assert(!sorted_items.empty() || !probation_items.empty());
+
+	switch (policy) {
+	case CachePolicy::LRU:
+		break;
+
+	case CachePolicy::TINY_LFU:
+		if (!probation_items.empty() &&
+		    (sorted_items.empty() ||
+		     probation_size + incoming_size > max_probation_size)) {
+			/* the window is full: its oldest item
+			   competes with the main segment's oldest
+			   item; the less popular one is evicted */
+			CacheItem &candidate = probation_items.front();
+
+			if (sorted_items.empty()) {
+				/* nothing to compete with */
+				RemoveItem(candidate);
+				++stats.evictions;
+				return;
+			}
+
+			CacheItem &victim = sorted_items.front();
+
+			if (sketch->Estimate(CacheItem::KeyHasher(candidate.key)) >
+			    sketch->Estimate(CacheItem::KeyHasher(victim.key))) {
+				PromoteItem(candidate);
+				RemoveItem(victim);
+			} else {
+				RemoveItem(candidate);
+				++stats.admission_rejected;
+			}
+
+			++stats.evictions;
+			return;
+		}
+
+		break;
+
+	case CachePolicy::S3_FIFO:
+		if (!probation_items.empty() &&
+		    (sorted_items.empty() ||
+		     probation_size >= max_probation_size)) {
+			CacheItem &item = probation_items.front();
+
+			if (item.frequency > 0) {
+				/* it was hit while in the small
+				   queue: move it to the main queue */
+				item.frequency = 0;
+				PromoteItem(item);
+			} else {
+				ghost.Add(CacheItem::KeyHasher(item.key),
+					  items.size());
+				RemoveItem(item);
+				++stats.evictions;
+			}
+
+			return;
+		}
+
+		if (CacheItem &item = sorted_items.front(); item.frequency > 0) {
+			/* give it another round */
+			--item.frequency;
+			sorted_items.erase(sorted_items.iterator_to(item));
+			sorted_items.push_back(item);
+			return;
+		}
+
+		break;
+	}
+
+	RemoveItem(sorted_items.front());
+	++stats.evictions;
+}
+
+void
+Cache::TrimWindow() noexcept
+{
+	if (policy != CachePolicy::TINY_LFU)
 		return;
 
-	CacheItem &item = sorted_items.front();
-	RemoveItem(item);
+	/* only reached if there was enough room for the new item
+	   without evicting; items leaving the window are admitted
+	   without competition */
+	while (probation_size > max_probation_size)
+		PromoteItem(probation_items.front());
 }
 
 bool
@@ -178,7 +418,7 @@ Cache::NeedRoom(size_t _size) noexcept
 		if (size + _size <= max_size)
 			return true;
 
-		DestroyOldestItem();
+		EvictOne(_size);
 	}
 }
 
@@ -193,7 +433,9 @@ Cache::Add(const char *key, CacheItem &item) noexcept
 
 	item.key = key;
 	items.insert(item);
-	sorted_items.push_back(item);
+	LinkItem(item);
+	TrimWindow();
+	ScheduleExpiry(item);
 
 	size += item.size;
 	item.last_accessed = SteadyNow();
@@ -226,7 +468,9 @@ Cache::Put(const char *key, CacheItem &item) noexcept
 	item.last_accessed = SteadyNow();
 
 	items.insert(item);
-	sorted_items.push_back(item);
+	LinkItem(item);
+	TrimWindow();
+	ScheduleExpiry(item);
 
 	cleanup_timer.Enable();
 	return true;
@@ -236,7 +480,7 @@ bool
 Cache::PutMatch(const char *key, CacheItem &item,
 		bool (*match)(const CacheItem *, void *), void *ctx) noexcept
 {
-	auto *old = GetMatch(key, match, ctx);
+	auto *old = LookupMatch(key, match, ctx, SteadyNow());
 
 	assert(item.size > 0);
 	assert(item.lock == 0);
@@ -287,16 +531,17 @@ Cache::RemoveAllMatch(bool (*match)(const CacheItem *, void *),
 {
 	unsigned removed = 0;
 
-	for (auto i = sorted_items.begin(), end = sorted_items.end();
-	     i != end;) {
-		CacheItem &item = *i++;
+	for (auto *list : {&sorted_items, &probation_items}) {
+		for (auto i = list->begin(), end = list->end(); i != end;) {
+			CacheItem &item = *i++;
 
-		if (!match(&item, ctx))
-			continue;
+			if (!match(&item, ctx))
+				continue;
 
-		items.erase(items.iterator_to(item));
-		ItemRemoved(&item);
-		++removed;
+			items.erase(items.iterator_to(item));
+			ItemRemoved(&item);
+			++removed;
+		}
 	}
 
 	return removed;
@@ -348,18 +593,42 @@ CacheItem::SetExpires(std::chrono::steady_clock::time_point steady_now,
 bool
 Cache::ExpireCallback() noexcept
 {
+	const auto start = std::chrono::steady_clock::now();
 	const auto now = SteadyNow();
 
-	for (auto i = sorted_items.begin(), end = sorted_items.end(); i != end;) {
-		CacheItem &item = *i++;
-
-		if (item.expires > now)
-			/* not yet expired */
-			continue;
-
-		RemoveItem(item);
+	while (!expiry_buckets.empty()) {
+		auto b = expiry_buckets.begin();
+		if (b->first > now)
+			/* this bucket and all following ones have not
+			   yet expired */
+			break;
+
+		auto &list = b->second;
+		while (!list.empty()) {
+			CacheItem &item = list.front();
+			++stats.expire_checked;
+
+			if (item.expires > now) {
+				/* the expiry time has been moved with
+				   SetExpires() */
+				item.expiry_siblings.unlink();
+				ScheduleExpiry(item);
+				continue;
+			}
+
+			RemoveItem(item);
+			++stats.expire_removed;
+		}
+
+		expiry_buckets.erase(b);
 	}
 
+	const auto duration = std::chrono::steady_clock::now() - start;
+	++stats.expire_passes;
+	stats.expire_duration += duration;
+	stats.expire_max_duration = std::max(stats.expire_max_duration,
+					     duration);
+
 	return size > 0;
 }
 
@@ -4,11 +4,16 @@
 
 #pragma once
 
+#include "CachePolicy.hxx"
+#include "FrequencySketch.hxx"
+#include "GhostQueue.hxx"
 #include "event/CleanupTimer.hxx"
-#include "util/IntrusiveHashSet.hxx"
+#include "stats/CacheStats.hxx"
+#include "util/IntrusiveGrowingHashSet.hxx"
 #include "util/IntrusiveList.hxx"
 
 #include <chrono>
+#include <map>
 #include <memory>
 
 #include <stddef.h>
@@ -19,11 +24,18 @@ class CacheItem {
 	friend class Cache;
 
 	/**
-	 * This item's siblings, sorted by #last_accessed.
+	 * This item's siblings in Cache::sorted_items or
+	 * Cache::probation_items.
 	 */
 	IntrusiveListHook<IntrusiveHookMode::NORMAL> sorted_siblings;
 
-	IntrusiveHashSetHook<IntrusiveHookMode::NORMAL> set_hook;
+	/**
+	 * This item's siblings in the same expiry bucket (see
+	 * Cache::expiry_buckets).
+	 */
+	IntrusiveListHook<IntrusiveHookMode::TRACK> expiry_siblings;
+
+	IntrusiveGrowingHashSetHook set_hook;
 
 	/**
 	 * The key under which this item is stored in the hash table.
@@ -42,12 +54,24 @@ class CacheItem {
 	 */
 	unsigned lock = 0;
 
+	/**
+	 * How often has this item been hit recently?  Only used by
+	 * #CachePolicy::S3_FIFO; saturates at 3.
+	 */
+	uint_least8_t frequency = 0;
+
 	/**
 	 * If true, then this item has been removed from the cache, but
 	 * could not be destroyed yet, because it is locked.
 	 */
 	bool removed = false;
 
+	/**
+	 * Is this item in Cache::probation_items (and not in
+	 * Cache::sorted_items)?
+	 */
+	bool probation = false;
+
 public:
 	CacheItem(std::chrono::steady_clock::time_point _expires,
 		  size_t _size) noexcept
@@ -79,6 +103,11 @@ public:
 		return key;
 	}
 
+	/**
+	 * Change the expiry time.  If the new time is earlier than
+	 * the old one, the #Cache may keep the item in memory longer
+	 * than necessary, but Validate() will reject it.
+	 */
 	void SetExpires(std::chrono::steady_clock::time_point _expires) noexcept {
 		expires = _expires;
 	}
@@ -87,6 +116,10 @@ public:
 			std::chrono::system_clock::time_point system_now,
 			std::chrono::system_clock::time_point _expires) noexcept;
 
+	std::chrono::steady_clock::time_point GetExpires() const noexcept {
+		return expires;
+	}
+
 	size_t GetSize() const noexcept {
 		return size;
 	}
@@ -141,26 +174,80 @@ public:
 };
 
 class Cache {
+	const CachePolicy policy;
+
 	const size_t max_size;
 	size_t size = 0;
 
-	using ItemSet = IntrusiveHashSet<CacheItem, 65521,
-					 CacheItem::Hash, CacheItem::Equal,
-					 IntrusiveHashSetMemberHookTraits<&CacheItem::set_hook>>;
+	/**
+	 * The maximum size of #probation_items (for
+	 * #CachePolicy::TINY_LFU) or the size above which it gets
+	 * evicted first (for #CachePolicy::S3_FIFO).
+	 */
+	const size_t max_probation_size;
+
+	/**
+	 * The total size of all items in #probation_items.
+	 */
+	size_t probation_size = 0;
+
+	using ItemSet = IntrusiveGrowingHashSet<CacheItem,
+						CacheItem::Hash, CacheItem::Equal,
+						IntrusiveGrowingHashSetMemberHookTraits<&CacheItem::set_hook>>;
 
 	ItemSet items;
 
+	using ItemList =
+		IntrusiveList<CacheItem,
+			      IntrusiveListMemberHookTraits<&CacheItem::sorted_siblings>>;
+
+	/**
+	 * A linked list of cache items, the next eviction candidate
+	 * first.  With #CachePolicy::LRU, this contains all items,
+	 * sorted by last_accessed; with the other policies, it is
+	 * the "main" segment.
+	 */
+	ItemList sorted_items;
+
+	/**
+	 * New items which have not yet been admitted to
+	 * #sorted_items: the LRU window of #CachePolicy::TINY_LFU or
+	 * the small FIFO queue of #CachePolicy::S3_FIFO.  Unused with
+	 * #CachePolicy::LRU.
+	 */
+	ItemList probation_items;
+
+	/**
+	 * Estimates how often each key has been requested; only
+	 * used by #CachePolicy::TINY_LFU.
+	 */
+	std::unique_ptr<FrequencySketch> sketch;
+
+	/**
+	 * Hashes of keys recently evicted from #probation_items;
+	 * only used by #CachePolicy::S3_FIFO.
+	 */
+	GhostQueue ghost;
+
+	using ExpiryList =
+		IntrusiveList<CacheItem,
+			      IntrusiveListMemberHookTraits<&CacheItem::expiry_siblings>>;
+
 	/**
-	 * A linked list of all cache items, sorted by last_accessed,
-	 * oldest first.
+	 * All cache items, indexed by their expiry time rounded up to
+	 * the cleanup interval.  This allows ExpireCallback() to
+	 * visit only those items which have actually expired,
+	 * instead of walking the whole #sorted_items list.
 	 */
-	IntrusiveList<CacheItem,
-		      IntrusiveListMemberHookTraits<&CacheItem::sorted_siblings>> sorted_items;
+	std::map<std::chrono::steady_clock::time_point, ExpiryList> expiry_buckets;
 
 	CleanupTimer cleanup_timer;
 
+	CacheStats stats = CacheStats::Zero();
+
 public:
-	Cache(EventLoop &event_loop, size_t _max_size) noexcept;
+	Cache(EventLoop &event_loop, size_t _max_size,
+	      CachePolicy _policy=CachePolicy::LRU) noexcept;
 
 	~Cache() noexcept;
 
@@ -174,6 +261,10 @@ public:
 	[[gnu::pure]]
 	std::chrono::system_clock::time_point SystemNow() const noexcept;
 
+	const CacheStats &GetStats() const noexcept {
+		return stats;
+	}
+
 	void EventAdd() noexcept;
 	void EventDel() noexcept;
 
@@ -239,6 +330,19 @@ public:
 
 	void Flush() noexcept;
 
+	/**
+	 * Invoke a function for each item, the next eviction
+	 * candidate first (with #CachePolicy::LRU: least recently
+	 * used first).  The function must not modify the cache.
+	 */
+	template<typename F>
+	void ForEach(F &&f) const {
+		for (const auto &item : sorted_items)
+			f(item);
+		for (const auto &item : probation_items)
+			f(item);
+	}
+
 private:
 	/** clean up expired cache items every 60 seconds */
 	bool ExpireCallback() noexcept;
@@ -259,10 +363,53 @@ private:
 
 	void RemoveItem(CacheItem &item) noexcept;
 
+	/**
+	 * Add a new item to #sorted_items or #probation_items,
+	 * depending on the policy.
+	 */
+	void LinkItem(CacheItem &item) noexcept;
+
+	/**
+	 * Remove the item from #sorted_items or #probation_items.
+	 */
+	void UnlinkItem(CacheItem &item) noexcept;
+
+	/**
+	 * Move an item from #probation_items to the end of
+	 * #sorted_items.
+	 */
+	void PromoteItem(CacheItem &item) noexcept;
+
+	/**
+	 * Like GetMatch(), but without updating statistics and
+	 * without refreshing the item.
+	 */
+	CacheItem *LookupMatch(const char *key,
+			       bool (*match)(const CacheItem *, void *),
+			       void *ctx,
+			       std::chrono::steady_clock::time_point now) noexcept;
+
+	/**
+	 * Add the item to the #expiry_buckets.
+	 */
+	void ScheduleExpiry(CacheItem &item) noexcept;
+
 	void RefreshItem(CacheItem &item,
 			 std::chrono::steady_clock::time_point now) noexcept;
 
-	void DestroyOldestItem() noexcept;
+	/**
+	 * Evict one item (or, depending on the policy, move an item
+	 * closer to eviction) to make room for a new item.
+	 *
+	 * @param incoming_size the size of the new item
+	 */
+	void EvictOne(size_t incoming_size) noexcept;
+
+	/**
+	 * Move items from the #CachePolicy::TINY_LFU window to the
+	 * main segment while the window is too large.
+	 */
+	void TrimWindow() noexcept;
 
 	bool NeedRoom(size_t _size) noexcept;
 };
@@ -9,6 +9,7 @@
 #include "AllocatorPtr.hxx"
 #include "ResourceAddress.hxx"
 #include "ResourceLoader.hxx"
+#include "stopwatch.hxx"
 #include "istream/UnusedPtr.hxx"
 #include "istream/istream_null.hxx"
 #include "istream/TeeIstream.hxx"
@@ -23,6 +24,7 @@
 #include "pool/Ptr.hxx"
 #include "pool/Holder.hxx"
 #include "event/CoarseTimerEvent.hxx"
+#include "event/DeferEvent.hxx"
 #include "event/FarTimerEvent.hxx"
 #include "event/Loop.hxx"
 #include "lib/fmt/RuntimeError.hxx"
@@ -176,9 +178,14 @@ public:
 	}
 
 	/**
-	 * Release resources held by this request.
+	 * Release resources held by this request and wake up the
+	 * #FilterCacheWaiter instances waiting for it.
+	 *
+	 * @param bypass_waiters true if the waiters shall bypass the
+	 * cache (because the response was not cacheable or there was
+	 * an error)
 	 */
-	void Destroy() noexcept;
+	void Destroy(bool bypass_waiters=true) noexcept;
 
 	/**
 	 * Cancel storing the response body.
@@ -203,8 +210,93 @@ private:
 	void RubberError(std::exception_ptr ep) noexcept override;
 };
 
+/**
+ * A cache miss while another #FilterCacheRequest for the same key was
+ * already running.  Instead of running the filter again, it waits
+ * for that request to finish; then the response is served from the
+ * cache, or (if it was not cacheable) the filter is run after all.
+ */
+class FilterCacheWaiter final : Cancellable, LeakDetector {
+	PoolPtr caller_pool;
+	FilterCache &cache;
+
+	const StopwatchPtr stopwatch;
+
+	FilterCacheInfo info;
+	const ResourceAddress address;
+	const HttpStatus status;
+	StringMap headers;
+	UnusedIstreamPtr body;
+	const char *const body_etag;
+
+	HttpResponseHandler &handler;
+	CancellablePointer &caller_cancel_ptr;
+
+	AutoUnlinkIntrusiveListHook siblings;
+
+	/**
+	 * Shall this request bypass the cache?  This is set if the
+	 * request we waited for was not cacheable or has failed.
+	 */
+	bool bypass = false;
+
+public:
+	using List =
+		IntrusiveList<FilterCacheWaiter,
+			      IntrusiveListMemberHookTraits<&FilterCacheWaiter::siblings>>;
+
+	FilterCacheWaiter(struct pool &_caller_pool, FilterCache &_cache,
+			  const StopwatchPtr &parent_stopwatch,
+			  FilterCacheInfo &&_info,
+			  const ResourceAddress &_address,
+			  HttpStatus _status, StringMap &&_headers,
+			  UnusedIstreamPtr &&_body, const char *_body_etag,
+			  HttpResponseHandler &_handler,
+			  CancellablePointer &_cancel_ptr) noexcept
+		:caller_pool(_caller_pool), cache(_cache),
+		 stopwatch(parent_stopwatch, "fcache_wait"),
+		 info(std::move(_info)),
+		 address(_caller_pool, _address),
+		 status(_status), headers(std::move(_headers)),
+		 body(std::move(_body)), body_etag(_body_etag),
+		 handler(_handler), caller_cancel_ptr(_cancel_ptr)
+	{
+		caller_cancel_ptr = *this;
+	}
+
+	void SetBypass() noexcept {
+		bypass = true;
+	}
+
+	/**
+	 * The request we waited for has finished: look up the cache
+	 * again and, on a miss, run the filter.
+	 */
+	void Resume() noexcept;
+
+	/**
+	 * Run the filter without the cache.
+	 */
+	void SendDirect(ResourceLoader &resource_loader) noexcept;
+
+private:
+	void Destroy() noexcept {
+		/* release the caller pool only after the destructor
+		   has returned, because this object was allocated
+		   from it */
+		const auto _caller_pool = std::move(caller_pool);
+		this->~FilterCacheWaiter();
+	}
+
+	/* virtual methods from class Cancellable */
+	void Cancel() noexcept override {
+		Destroy();
+	}
+};
+
 class FilterCache final : LeakDetector {
 	friend class FilterCacheRequest;
+	friend class FilterCacheWaiter;
 
 	PoolPtr pool;
 	SlicePool slice_pool;
@@ -220,8 +312,20 @@ class FilterCache final : LeakDetector {
 
 	FarTimerEvent compress_timer;
 
+	/**
+	 * Performs one slice of incremental #Rubber compaction
+	 * whenever the #EventLoop is idle, until it is complete.
+	 */
+	DeferEvent compress_step_event;
+
 	ResourceLoader &resource_loader;
 
+	/**
+	 * Passed to istream_rubber_new() for zero-copy transmission
+	 * of cached bodies.  May be nullptr.
+	 */
+	PipeStock *const pipe_stock;
+
 	/**
 	 * A list of requests that are currently copying the response body
 	 * to a #Rubber allocation.  We keep track of them so we can
@@ -229,9 +333,24 @@ class FilterCache final : LeakDetector {
 	 */
 	FilterCacheRequest::List requests;
 
+	/**
+	 * The keys of all running #FilterCacheRequest instances,
+	 * each with the misses which are waiting for it.
+	 */
+	std::unordered_map<std::string, FilterCacheWaiter::List> running;
+
+	/**
+	 * Waiters whose #FilterCacheRequest has finished; they will
+	 * be resumed by #resume_waiters_event.
+	 */
+	FilterCacheWaiter::List ready_waiters;
+
+	DeferEvent resume_waiters_event;
+
 public:
-	FilterCache(struct pool &_pool, size_t max_size,
-		    EventLoop &_event_loop, ResourceLoader &_resource_loader);
+	FilterCache(struct pool &_pool, size_t max_size, CachePolicy policy,
+		    EventLoop &_event_loop, PipeStock *_pipe_stock,
+		    ResourceLoader &_resource_loader);
 
 	~FilterCache() noexcept;
 
@@ -248,6 +367,10 @@ public:
 		return slice_pool.GetStats() + rubber.GetStats();
 	}
 
+	const CacheStats &GetCacheStats() const noexcept {
+		return cache.GetStats();
+	}
+
 	void Flush() noexcept {
 		cache.Flush();
 		Compress();
@@ -270,6 +393,18 @@ public:
 		 RubberAllocation &&a, size_t size) noexcept;
 
 private:
+	/**
+	 * Look up the given key; on a miss, run the filter.
+	 */
+	void Lookup(struct pool &caller_pool,
+		    const StopwatchPtr &parent_stopwatch,
+		    FilterCacheInfo &&info,
+		    const ResourceAddress &address,
+		    HttpStatus status, StringMap &&headers,
+		    UnusedIstreamPtr body, const char *body_etag,
+		    HttpResponseHandler &handler,
+		    CancellablePointer &cancel_ptr) noexcept;
+
 	void Miss(struct pool &caller_pool,
 		  const StopwatchPtr &parent_stopwatch,
 		  FilterCacheInfo &&info,
@@ -279,6 +414,14 @@ private:
 		  HttpResponseHandler &_handler,
 		  CancellablePointer &cancel_ptr) noexcept;
 
+	/**
+	 * A #FilterCacheRequest has finished; schedule the resumption
+	 * of all requests waiting for it.
+	 */
+	void OnRequestFinished(const char *key, bool bypass_waiters) noexcept;
+
+	void OnResumeWaiters() noexcept;
+
 	void Serve(FilterCacheItem &item,
 		   struct pool &caller_pool,
 		   HttpResponseHandler &handler) noexcept;
@@ -293,9 +436,15 @@ private:
 	}
 
 	void OnCompressTimer() noexcept {
-		Compress();
+		slice_pool.Compress();
+		compress_step_event.ScheduleIdle();
 		compress_timer.Schedule(fcache_compress_interval);
 	}
+
+	void OnCompressStep() noexcept {
+		if (rubber.CompressStep())
+			compress_step_event.ScheduleIdle();
+	}
 };
 
 FilterCacheRequest::FilterCacheRequest(PoolPtr &&_pool,
@@ -312,10 +461,12 @@ FilterCacheRequest::FilterCacheRequest(PoolPtr &&_pool,
 }
 
 void
-FilterCacheRequest::Destroy() noexcept
+FilterCacheRequest::Destroy(bool bypass_waiters) noexcept
 {
 	assert(!response.cancel_ptr);
 
+	cache.OnRequestFinished(info.key, bypass_waiters);
+
 	this->~FilterCacheRequest();
 }
 
@@ -461,7 +612,7 @@ FilterCacheRequest::RubberDone(RubberAllocation &&a, size_t size) noexcept
 	   saved: add it to the cache */
 	cache.Put(info, response.status, *response.headers, std::move(a), size);
 
-	Destroy();
+	Destroy(false);
 }
 
 void
@@ -495,7 +646,10 @@ void
 FilterCacheRequest::Cancel() noexcept
 {
 	cancel_ptr.Cancel();
-	Destroy();
+
+	/* our caller has lost interest, but the waiters may still
+	   get a cacheable response */
+	Destroy(false);
 }
 
 /*
@@ -555,7 +709,7 @@ FilterCacheRequest::OnHttpResponse(HttpStatus status, StringMap &&headers,
 		   to avoid use-after-free bugs */
 		headers = {caller_pool, headers};
 
-		Destroy();
+		Destroy(false);
 		_handler.InvokeResponse(status, std::move(headers), std::move(body));
 	} else {
 		/* tee the body: one goes to our client, and one goes into the
@@ -611,7 +765,8 @@ FilterCacheRequest::OnHttpError(std::exception_ptr ep) noexcept
  */
 
 FilterCache::FilterCache(struct pool &_pool, size_t max_size,
-			 EventLoop &_event_loop,
+			 CachePolicy policy,
+			 EventLoop &_event_loop, PipeStock *_pipe_stock,
 			 ResourceLoader &_resource_loader)
 	:pool(pool_new_dummy(&_pool, "filter_cache")),
 	 slice_pool(1024, 65536, "filter_cache_meta"),
@@ -619,26 +774,41 @@ FilterCache::FilterCache(struct pool &_pool, size_t max_size,
 	 /* leave 12.5% of the rubber allocator empty, to increase the
 	    chances that a hole can be found for a new allocation, to
 	    reduce the pressure that rubber_compress() creates */
-	 cache(_event_loop, max_size * 7 / 8),
+	 cache(_event_loop, max_size * 7 / 8, policy),
 	 compress_timer(_event_loop, BIND_THIS_METHOD(OnCompressTimer)),
-	 resource_loader(_resource_loader) {
+	 compress_step_event(_event_loop, BIND_THIS_METHOD(OnCompressStep)),
+	 resource_loader(_resource_loader),
+	 pipe_stock(_pipe_stock),
+	 resume_waiters_event(_event_loop, BIND_THIS_METHOD(OnResumeWaiters)) {
 	compress_timer.Schedule(fcache_compress_interval);
 }
 
 FilterCache *
 filter_cache_new(struct pool *pool, size_t max_size,
-		 EventLoop &event_loop,
+		 CachePolicy policy,
+		 EventLoop &event_loop, PipeStock *pipe_stock,
 		 ResourceLoader &resource_loader)
 {
 	assert(max_size > 0);
 
-	return new FilterCache(*pool, max_size,
-			       event_loop, resource_loader);
+	return new FilterCache(*pool, max_size, policy,
+			       event_loop, pipe_stock, resource_loader);
 }
 
 inline FilterCache::~FilterCache() noexcept
 {
 	requests.clear_and_dispose([](FilterCacheRequest *r){ r->CancelStore(); });
+
+	/* the remaining waiters bypass the cache which is about to
+	   be destroyed */
+	for (auto &i : running)
+		i.second.clear_and_dispose([this](FilterCacheWaiter *w){
+			w->SendDirect(resource_loader);
+		});
+
+	ready_waiters.clear_and_dispose([this](FilterCacheWaiter *w){
+		w->SendDirect(resource_loader);
+	});
 }
 
 void
@@ -659,6 +829,12 @@ filter_cache_get_stats(const FilterCache &cache) noexcept
 	return cache.GetStats();
 }
 
+CacheStats
+filter_cache_get_cache_stats(const FilterCache &cache) noexcept
+{
+	return cache.GetCacheStats();
+}
+
 void
 filter_cache_flush(FilterCache &cache) noexcept
 {
@@ -693,6 +869,23 @@ FilterCache::Miss(struct pool &caller_pool,
 		  HttpResponseHandler &_handler,
 		  CancellablePointer &cancel_ptr) noexcept
 {
+	if (auto i = running.find(info.key); i != running.end()) {
+		/* the same filter is already running; wait for it
+		   instead of running it again */
+		LogConcat(4, "FilterCache", "wait ", info.key);
+
+		auto *waiter = NewFromPool<FilterCacheWaiter>(caller_pool, caller_pool,
+							      *this, parent_stopwatch,
+							      std::move(info), address,
+							      status, std::move(headers),
+							      std::move(body), body_etag,
+							      _handler, cancel_ptr);
+		i->second.push_back(*waiter);
+		return;
+	}
+
+	running.try_emplace(info.key);
+
 	/* the cache request may live longer than the caller pool, so
 	   allocate a new pool for it from cache->pool */
 	auto request_pool = pool_new_linear(pool, "filter_cache_request", 8192);
@@ -710,6 +903,77 @@ FilterCache::Miss(struct pool &caller_pool,
 		       cancel_ptr);
 }
 
+void
+FilterCache::OnRequestFinished(const char *key, bool bypass_waiters) noexcept
+{
+	auto i = running.find(key);
+	assert(i != running.end());
+
+	auto &waiters = i->second;
+	if (!waiters.empty()) {
+		while (!waiters.empty()) {
+			auto &waiter = waiters.front();
+			waiters.pop_front();
+
+			if (bypass_waiters)
+				waiter.SetBypass();
+
+			ready_waiters.push_back(waiter);
+		}
+
+		/* don't resume them right now, because we may be
+		   called from deep inside an istream handler */
+		resume_waiters_event.Schedule();
+	}
+
+	running.erase(i);
+}
+
+void
+FilterCache::OnResumeWaiters() noexcept
+{
+	while (!ready_waiters.empty()) {
+		auto &waiter = ready_waiters.front();
+		ready_waiters.pop_front();
+		waiter.Resume();
+	}
+}
+
+void
+FilterCacheWaiter::Resume() noexcept
+{
+	if (bypass) {
+		LogConcat(4, "FilterCache", "nocache waiter ", info.key);
+		SendDirect(cache.resource_loader);
+		return;
+	}
+
+	/* keep the caller pool alive until this method returns,
+	   because this object was allocated from it */
+	const auto _caller_pool = std::move(caller_pool);
+
+	cache.Lookup(_caller_pool, stopwatch,
+		     std::move(info), address,
+		     status, std::move(headers),
+		     std::move(body), body_etag,
+		     handler, caller_cancel_ptr);
+	this->~FilterCacheWaiter();
+}
+
+void
+FilterCacheWaiter::SendDirect(ResourceLoader &resource_loader) noexcept
+{
+	const auto _caller_pool = std::move(caller_pool);
+
+	resource_loader.SendRequest(_caller_pool, stopwatch,
+				    {0, false, false, false, info.tag, nullptr},
+				    HttpMethod::POST, address,
+				    status, std::move(headers),
+				    std::move(body), body_etag,
+				    handler, caller_cancel_ptr);
+	this->~FilterCacheWaiter();
+}
+
 void
 FilterCache::Serve(FilterCacheItem &item,
 		   struct pool &caller_pool,
@@ -723,7 +987,7 @@ FilterCache::Serve(FilterCacheItem &item,
 
 	auto response_body = item.body
 		? istream_rubber_new(caller_pool, rubber, item.body.GetId(),
-				     0, item.size, false)
+				     0, item.size, false, pipe_stock)
 		: istream_null_new(caller_pool);
 
 	response_body = istream_unlock_new(caller_pool, std::move(response_body), item);
@@ -741,6 +1005,31 @@ FilterCache::Hit(FilterCacheItem &item,
 	Serve(item, caller_pool, handler);
 }
 
+inline void
+FilterCache::Lookup(struct pool &caller_pool,
+		    const StopwatchPtr &parent_stopwatch,
+		    FilterCacheInfo &&info,
+		    const ResourceAddress &address,
+		    HttpStatus status, StringMap &&headers,
+		    UnusedIstreamPtr body, const char *body_etag,
+		    HttpResponseHandler &handler,
+		    CancellablePointer &cancel_ptr) noexcept
+{
+	FilterCacheItem *item
+		= (FilterCacheItem *)cache.Get(info.key);
+
+	if (item == nullptr)
+		Miss(caller_pool, parent_stopwatch,
+		     std::move(info),
+		     address, status, std::move(headers),
+		     std::move(body), body_etag,
+		     handler, cancel_ptr);
+	else {
+		body.Clear();
+		Hit(*item, caller_pool, handler);
+	}
+}
+
 void
 FilterCache::Get(struct pool &caller_pool,
 		 const StopwatchPtr &parent_stopwatch,
@@ -755,19 +1044,11 @@ FilterCache::Get(struct pool &caller_pool,
 	auto *info = filter_cache_request_evaluate(caller_pool, cache_tag, address,
 						   source_id, headers);
 	if (info != nullptr) {
-		FilterCacheItem *item
-			= (FilterCacheItem *)cache.Get(info->key);
-
-		if (item == nullptr)
-			Miss(caller_pool, parent_stopwatch,
-			     std::move(*info),
-			     address, status, std::move(headers),
-			     std::move(body), source_id,
-			     handler, cancel_ptr);
-		else {
-			body.Clear();
-			Hit(*item, caller_pool, handler);
-		}
+		Lookup(caller_pool, parent_stopwatch,
+		       std::move(*info),
+		       address, status, std::move(headers),
+		       std::move(body), source_id,
+		       handler, cancel_ptr);
 	} else {
 		resource_loader.SendRequest(caller_pool, parent_stopwatch,
 					    {0, false, false, false, cache_tag, nullptr},
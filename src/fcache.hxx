@@ -8,15 +8,18 @@
 #include <string>
 
 enum class HttpStatus : uint_least16_t;
+enum class CachePolicy : uint_least8_t;
 struct pool;
 class StopwatchPtr;
 class UnusedIstreamPtr;
 class EventLoop;
+class PipeStock;
 class ResourceLoader;
 struct ResourceAddress;
 class StringMap;
 class HttpResponseHandler;
 struct AllocatorStats;
+struct CacheStats;
 class FilterCache;
 class CancellablePointer;
 
@@ -25,7 +28,8 @@ class CancellablePointer;
  */
 FilterCache *
 filter_cache_new(struct pool *pool, size_t max_size,
-		 EventLoop &event_loop,
+		 CachePolicy policy,
+		 EventLoop &event_loop, PipeStock *pipe_stock,
 		 ResourceLoader &resource_loader);
 
 void
@@ -38,6 +42,10 @@ filter_cache_fork_cow(FilterCache &cache, bool inherit) noexcept;
 AllocatorStats
 filter_cache_get_stats(const FilterCache &cache) noexcept;
 
+[[gnu::pure]]
+CacheStats
+filter_cache_get_cache_stats(const FilterCache &cache) noexcept;
+
 void
 filter_cache_flush(FilterCache &cache) noexcept;
 
@@ -17,7 +17,6 @@
 #include "http/Method.hxx"
 #include "http/HeaderParser.hxx"
 #include "strmap.hxx"
-#include "product.h"
 #include "pool/pool.hxx"
 #include "system/Error.hxx"
 #include "event/net/BufferedSocket.hxx"
@@ -1051,73 +1050,20 @@ fcgi_client_request(struct pool *pool, EventLoop &event_loop,
 
 	struct fcgi_record_header header{
 		FCGI_VERSION_1,
-		FCGI_BEGIN_REQUEST,
+		FCGI_STDIN,
 		ToBE16(next_request_id),
 	};
-	static constexpr struct fcgi_begin_request begin_request{
-		ToBE16(FCGI_RESPONDER),
-		FCGI_KEEP_CONN,
-	};
 
 	assert(http_method_is_valid(method));
 
 	GrowingBuffer buffer;
-	header.content_length = ToBE16(sizeof(begin_request));
-	buffer.WriteT(header);
-	buffer.WriteT(begin_request);
-
-	FcgiParamsSerializer ps(buffer, header.request_id);
-
-	ps("REQUEST_METHOD", http_method_to_string(method))
-		("REQUEST_URI", uri)
-		("SCRIPT_FILENAME", script_filename)
-		("SCRIPT_NAME", script_name)
-		("PATH_INFO", path_info)
-		("QUERY_STRING", query_string)
-		("DOCUMENT_ROOT", document_root)
-		("SERVER_SOFTWARE", PRODUCT_TOKEN);
-
-	if (remote_addr != nullptr)
-		ps("REMOTE_ADDR", remote_addr);
-
-	off_t available = body
-		? body.GetAvailable(false)
-		: -1;
-	if (available >= 0) {
-		char value[64];
-		snprintf(value, sizeof(value),
-			 "%lu", (unsigned long)available);
-
-		const char *content_type = headers.Get("content-type");
-
-		ps("HTTP_CONTENT_LENGTH", value)
-			/* PHP wants the parameter without
-			   "HTTP_" */
-			("CONTENT_LENGTH", value);
-
-		/* same for the "Content-Type" request
-		   header */
-		if (content_type != nullptr)
-			ps("CONTENT_TYPE", content_type);
-	}
-
-	const char *https = headers.Remove("x-cm4all-https");
-	if (https != nullptr && strcmp(https, "on") == 0)
-		ps("HTTPS", https);
-
-	ps.Headers(headers);
-
-	for (const std::string_view param : params) {
-		const auto [name, value] = Split(param, '=');
-		if (!name.empty() && value.data() != nullptr)
-			ps(name, value);
-	}
-
-	ps.Commit();
-
-	header.type = FCGI_PARAMS;
-	header.content_length = ToBE16(0);
-	buffer.WriteT(header);
+	fcgi_serialize_request_head(buffer, header.request_id,
+				    method, uri, script_filename,
+				    script_name, path_info,
+				    query_string, document_root,
+				    remote_addr, headers,
+				    body ? body.GetAvailable(false) : -1,
+				    params);
 
 	UnusedIstreamPtr request;
 
@@ -1129,7 +1075,6 @@ fcgi_client_request(struct pool *pool, EventLoop &event_loop,
 							    header.request_id));
 	else {
 		/* no request body - append an empty STDIN packet */
-		header.type = FCGI_STDIN;
 		header.content_length = ToBE16(0);
 		buffer.WriteT(header);
 
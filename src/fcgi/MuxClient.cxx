@@ -0,0 +1,1248 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#include "MuxClient.hxx"
+#include "Error.hxx"
+#include "Protocol.hxx"
+#include "Serialize.hxx"
+#include "http/ResponseHandler.hxx"
+#include "http/HeaderParser.hxx"
+#include "http/Method.hxx"
+#include "http/Status.hxx"
+#include "istream/istream.hxx"
+#include "istream/Sink.hxx"
+#include "istream/UnusedPtr.hxx"
+#include "strmap.hxx"
+#include "pool/pool.hxx"
+#include "system/Error.hxx"
+#include "net/SocketAddress.hxx"
+#include "net/UniqueSocketDescriptor.hxx"
+#include "net/TimeoutError.hxx"
+#include "net/SocketProtocolError.hxx"
+#include "io/UniqueFileDescriptor.hxx"
+#include "util/ByteOrder.hxx"
+#include "util/Cancellable.hxx"
+#include "util/DestructObserver.hxx"
+#include "util/Exception.hxx"
+#include "util/SpanCast.hxx"
+#include "util/StringSplit.hxx"
+#include "util/StringStrip.hxx"
+#include "AllocatorPtr.hxx"
+#include "stopwatch.hxx"
+
+#include <algorithm>
+#include <charconv>
+#include <vector>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+class FcgiMuxConnection::Waiter final
+	: public IntrusiveListHook<IntrusiveHookMode::NORMAL>,
+	  Cancellable
+{
+	FcgiMuxConnection &connection;
+
+public:
+	FcgiMuxGetHandler &handler;
+
+	Waiter(FcgiMuxConnection &_connection, FcgiMuxGetHandler &_handler,
+	       CancellablePointer &cancel_ptr) noexcept
+		:connection(_connection), handler(_handler)
+	{
+		cancel_ptr = *this;
+	}
+
+	void Destroy() noexcept {
+		this->~Waiter();
+	}
+
+private:
+	/* virtual methods from class Cancellable */
+	void Cancel() noexcept override {
+		auto &c = connection;
+		c.waiters.erase(c.waiters.iterator_to(*this));
+		Destroy();
+		c.UpdateTimers();
+	}
+};
+
+class FcgiMuxConnection::Request final
+	: public IntrusiveListHook<IntrusiveHookMode::NORMAL>,
+	  Istream, IstreamSink, Cancellable, DestructAnchor
+{
+	/**
+	 * The maximum payload of one #FCGI_STDIN record generated
+	 * from the request body.
+	 */
+	static constexpr std::size_t MAX_STDIN_RECORD = 32 * 1024;
+
+	/**
+	 * Stop reading from the socket while this many bytes of
+	 * response body are buffered for this request.
+	 */
+	static constexpr std::size_t MAX_BUFFER = 64 * 1024;
+
+	/**
+	 * The maximum length of a response header line.
+	 */
+	static constexpr std::size_t MAX_HEADER_LINE = 8192;
+
+	/**
+	 * nullptr after this request has been removed from the
+	 * connection (either because the #FCGI_END_REQUEST record has
+	 * been received or because the connection has failed).
+	 */
+	FcgiMuxConnection *connection;
+
+	const StopwatchPtr stopwatch;
+
+	HttpResponseHandler &handler;
+
+	UniqueFileDescriptor stderr_fd;
+
+	/**
+	 * Response body data which has been received but not yet
+	 * consumed by our #IstreamHandler.
+	 */
+	GrowingBuffer buffer;
+
+	/**
+	 * The number of bytes in #buffer.
+	 */
+	std::size_t buffer_size = 0;
+
+	/**
+	 * An incomplete response header line which was split across
+	 * records.
+	 */
+	std::string header_line;
+
+	StringMap headers;
+
+	/**
+	 * The number of response body bytes remaining (including
+	 * those in #buffer), or -1 if unknown.
+	 */
+	off_t available = -1;
+
+	/**
+	 * Only used when state==NO_BODY.
+	 */
+	HttpStatus status;
+
+	enum class State : uint_least8_t {
+		HEADERS,
+
+		/**
+		 * There is no response body.  Waiting for the
+		 * #FCGI_END_REQUEST record, and then we'll forward the
+		 * response to the #HttpResponseHandler.
+		 */
+		NO_BODY,
+
+		BODY,
+
+		/**
+		 * The #FCGI_END_REQUEST record has been received, but
+		 * #buffer is not yet empty.
+		 */
+		END,
+	} state = State::HEADERS;
+
+	/**
+	 * This flag is true in HEAD requests.  HEAD responses may
+	 * contain a Content-Length header, but no response body will
+	 * follow (RFC 2616 4.3).
+	 */
+	const bool no_body;
+
+	/**
+	 * This flag is true while SubmitResponse() is calling the
+	 * #HttpResponseHandler.  During this period, _Read() does
+	 * nothing, to prevent recursion.
+	 */
+	bool in_handler = false;
+
+public:
+	/**
+	 * The request id in big-endian byte order.
+	 */
+	const uint16_t id;
+
+	Request(struct pool &_pool, FcgiMuxConnection &_connection,
+		uint16_t _id, StopwatchPtr &&_stopwatch,
+		HttpMethod method, UnusedIstreamPtr &&body,
+		UniqueFileDescriptor &&_stderr_fd,
+		HttpResponseHandler &_handler,
+		CancellablePointer &cancel_ptr) noexcept
+		:Istream(_pool), IstreamSink(std::move(body)),
+		 connection(&_connection),
+		 stopwatch(std::move(_stopwatch)),
+		 handler(_handler),
+		 stderr_fd(std::move(_stderr_fd)),
+		 no_body(http_method_is_empty(method)),
+		 id(_id)
+	{
+		cancel_ptr = *this;
+	}
+
+	bool HasRequestBody() const noexcept {
+		return HasInput();
+	}
+
+	void ReadRequestBody() noexcept {
+		input.Read();
+	}
+
+	/**
+	 * Feed payload of a #FCGI_STDOUT record.
+	 *
+	 * @return the number of bytes consumed; if this is less
+	 * than the given size, the caller shall stop reading until
+	 * ResumeRead() is called; if this object has been destroyed,
+	 * this is always the full size
+	 */
+	std::size_t FeedStdout(std::span<const std::byte> src) noexcept;
+
+	void FeedStderr(std::span<const std::byte> src) noexcept {
+		/* ignore errors and partial writes while forwarding
+		   STDERR payload, just like FcgiClient does */
+		if (stderr_fd.IsDefined())
+			stderr_fd.Write(src.data(), src.size());
+		else
+			fwrite(src.data(), 1, src.size(), stderr);
+	}
+
+	/**
+	 * The #FCGI_END_REQUEST record has been received.  The
+	 * caller must not have removed this request from the
+	 * connection.
+	 */
+	void HandleEnd() noexcept;
+
+	/**
+	 * The connection has failed.  The caller has already
+	 * removed this request from the connection.
+	 */
+	void OnConnectionFailed(std::exception_ptr e) noexcept {
+		connection = nullptr;
+		Abort(std::move(e));
+	}
+
+private:
+	/**
+	 * Remove this request from the connection.
+	 *
+	 * @param abort send #FCGI_ABORT_REQUEST to the server?
+	 */
+	void Detach(bool abort) noexcept {
+		if (connection == nullptr)
+			return;
+
+		auto &c = *std::exchange(connection, nullptr);
+		c.RemoveRequest(*this);
+		if (abort)
+			c.WriteAbort(id);
+	}
+
+	void Abort(std::exception_ptr e) noexcept;
+
+	/**
+	 * Throws on error.
+	 *
+	 * @return true if the end of the response headers was found
+	 */
+	bool HandleLine(std::string_view line);
+
+	/**
+	 * Throws on error.
+	 *
+	 * @return the number of bytes consumed; less than the given
+	 * size only if the end of the response headers was found
+	 */
+	std::size_t ParseHeaders(std::span<const std::byte> src);
+
+	/**
+	 * Submit the response metadata to the #HttpResponseHandler.
+	 *
+	 * @return false if this object has been destroyed
+	 */
+	bool SubmitResponse() noexcept;
+
+	std::size_t FeedBody(std::span<const std::byte> src) noexcept;
+
+	/**
+	 * Submit data from #buffer to our #IstreamHandler.
+	 *
+	 * @return false if this object has been destroyed
+	 */
+	bool SubmitBuffer() noexcept;
+
+	/* virtual methods from class Cancellable */
+	void Cancel() noexcept override {
+		/* Cancellable::Cancel() can only be used before the
+		   response was delivered to our callback */
+		assert(state == State::HEADERS || state == State::NO_BODY);
+
+		stopwatch.RecordEvent("cancel");
+
+		Detach(true);
+		Destroy();
+	}
+
+	/* virtual methods from class Istream */
+	off_t _GetAvailable(bool partial) noexcept override {
+		if (available >= 0)
+			return available;
+
+		if (state == State::END || partial)
+			return buffer_size;
+
+		return -1;
+	}
+
+	void _Read() noexcept override {
+		if (in_handler)
+			/* avoid recursion; SubmitResponse() will
+			   continue if possible */
+			return;
+
+		if (SubmitBuffer() && connection != nullptr &&
+		    buffer_size < MAX_BUFFER)
+			connection->ResumeRead();
+	}
+
+	void _Close() noexcept override {
+		stopwatch.RecordEvent("close");
+
+		Detach(true);
+		Istream::_Close();
+	}
+
+	/* virtual methods from class IstreamHandler */
+	std::size_t OnData(std::span<const std::byte> src) noexcept override;
+	void OnEof() noexcept override;
+	void OnError(std::exception_ptr ep) noexcept override;
+};
+
+void
+FcgiMuxConnection::Request::Abort(std::exception_ptr e) noexcept
+{
+	stopwatch.RecordEvent("error");
+
+	/* the server may still be working on this request */
+	Detach(true);
+
+	if (state == State::HEADERS || state == State::NO_BODY) {
+		auto &_handler = handler;
+		Destroy();
+		_handler.InvokeError(std::move(e));
+	} else
+		DestroyError(std::move(e));
+}
+
+inline bool
+FcgiMuxConnection::Request::HandleLine(std::string_view line)
+{
+	if (!line.empty()) {
+		if (!header_parse_line(GetPool(), headers, line))
+			throw FcgiClientError("Malformed FastCGI response header");
+		return false;
+	} else {
+		stopwatch.RecordEvent("response_headers");
+		state = State::BODY;
+		return true;
+	}
+}
+
+inline std::size_t
+FcgiMuxConnection::Request::ParseHeaders(const std::span<const std::byte> src0)
+{
+	const std::string_view s0 = ToStringView(src0);
+	std::string_view s = s0;
+
+	while (true) {
+		auto [line, rest] = Split(s, '\n');
+		if (rest.data() == nullptr) {
+			/* incomplete line; keep it for the next
+			   record */
+			if (header_line.size() + s.size() > MAX_HEADER_LINE)
+				throw FcgiClientError("FastCGI response header line too long");
+
+			header_line.append(s);
+			return src0.size();
+		}
+
+		bool end;
+		if (!header_line.empty()) {
+			header_line.append(line);
+			end = HandleLine(StripRight(std::string_view{header_line}));
+			header_line.clear();
+		} else
+			end = HandleLine(StripRight(line));
+
+		s = rest;
+
+		if (end)
+			return rest.data() - s0.data();
+	}
+}
+
+inline bool
+FcgiMuxConnection::Request::SubmitResponse() noexcept
+{
+	assert(state == State::BODY);
+
+	HttpStatus _status = HttpStatus::OK;
+
+	const char *p = headers.Remove("status");
+	if (p != nullptr) {
+		int i = atoi(p);
+		if (http_status_is_valid(static_cast<HttpStatus>(i)))
+			_status = static_cast<HttpStatus>(i);
+	}
+
+	if (http_status_is_empty(_status) || no_body) {
+		stopwatch.RecordEvent("response_no_body");
+
+		state = State::NO_BODY;
+		status = _status;
+		return true;
+	}
+
+	available = -1;
+	p = headers.Remove("content-length");
+	if (p != nullptr) {
+		char *endptr;
+		unsigned long long l = strtoull(p, &endptr, 10);
+		if (endptr > p && *endptr == 0)
+			available = l;
+	}
+
+	const DestructObserver destructed(*this);
+
+	in_handler = true;
+	handler.InvokeResponse(_status, std::move(headers),
+			       UnusedIstreamPtr(this));
+	if (destructed)
+		return false;
+
+	in_handler = false;
+	return true;
+}
+
+inline std::size_t
+FcgiMuxConnection::Request::FeedBody(std::span<const std::byte> src) noexcept
+{
+	assert(state == State::BODY);
+
+	if (available >= 0 &&
+	    (off_t)(buffer_size + src.size()) > available) {
+		Abort(std::make_exception_ptr(FcgiClientError("excess data at end of body "
+							      "from FastCGI application")));
+		return src.size();
+	}
+
+	std::size_t consumed = 0;
+
+	if (buffer_size == 0 && !in_handler) {
+		/* fast path: submit directly from the socket
+		   buffer */
+		const DestructObserver destructed(*this);
+
+		consumed = InvokeData(src);
+		if (destructed)
+			return src.size();
+
+		if (available >= 0)
+			available -= consumed;
+
+		src = src.subspan(consumed);
+	}
+
+	if (buffer_size >= MAX_BUFFER)
+		return consumed;
+
+	src = src.first(std::min(src.size(), MAX_BUFFER - buffer_size));
+	buffer.Write(src.data(), src.size());
+	buffer_size += src.size();
+
+	return consumed + src.size();
+}
+
+std::size_t
+FcgiMuxConnection::Request::FeedStdout(std::span<const std::byte> src) noexcept
+{
+	std::size_t consumed;
+
+	switch (state) {
+	case State::HEADERS:
+		try {
+			consumed = ParseHeaders(src);
+		} catch (...) {
+			Abort(std::current_exception());
+			return src.size();
+		}
+
+		if (state == State::HEADERS)
+			return consumed;
+
+		if (!SubmitResponse())
+			return src.size();
+
+		if (state == State::NO_BODY || consumed == src.size())
+			/* ignore the rest of this STDOUT payload */
+			return src.size();
+
+		return consumed + FeedBody(src.subspan(consumed));
+
+	case State::NO_BODY:
+	case State::END:
+		return src.size();
+
+	case State::BODY:
+		return FeedBody(src);
+	}
+
+	/* unreachable */
+	assert(false);
+	return src.size();
+}
+
+void
+FcgiMuxConnection::Request::HandleEnd() noexcept
+{
+	assert(connection != nullptr);
+
+	stopwatch.RecordEvent("end");
+
+	Detach(false);
+
+	if (HasInput())
+		/* the application doesn't want the rest of the
+		   request body */
+		CloseInput();
+
+	switch (state) {
+	case State::HEADERS:
+		Abort(std::make_exception_ptr(FcgiClientError("premature end of headers "
+							      "from FastCGI application")));
+		break;
+
+	case State::NO_BODY:
+		{
+			auto &_handler = handler;
+			const auto _status = status;
+			auto _headers = std::move(headers);
+			Destroy();
+			_handler.InvokeResponse(_status, std::move(_headers),
+						UnusedIstreamPtr{});
+		}
+
+		break;
+
+	case State::BODY:
+		if (available > (off_t)buffer_size)
+			Abort(std::make_exception_ptr(FcgiClientError("premature end of body "
+								      "from FastCGI application")));
+		else if (buffer_size == 0)
+			DestroyEof();
+		else
+			state = State::END;
+		break;
+
+	case State::END:
+		/* unreachable */
+		assert(false);
+		break;
+	}
+}
+
+bool
+FcgiMuxConnection::Request::SubmitBuffer() noexcept
+{
+	const DestructObserver destructed(*this);
+
+	while (buffer_size > 0) {
+		const auto r = buffer.Read();
+		assert(!r.empty());
+
+		const std::size_t nbytes = InvokeData(r);
+		if (destructed)
+			return false;
+
+		if (nbytes == 0)
+			return true;
+
+		buffer.Consume(nbytes);
+		buffer_size -= nbytes;
+		if (available >= 0)
+			available -= nbytes;
+
+		if (nbytes < r.size())
+			return true;
+	}
+
+	if (state == State::END) {
+		DestroyEof();
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * istream handler for the request body
+ *
+ */
+
+std::size_t
+FcgiMuxConnection::Request::OnData(std::span<const std::byte> src) noexcept
+{
+	assert(connection != nullptr);
+
+	if (!connection->HasOutputRoom())
+		/* wait for ReadRequestBodies() */
+		return 0;
+
+	src = src.first(std::min(src.size(), MAX_STDIN_RECORD));
+	connection->WriteRecord(FCGI_STDIN, id, src);
+	return src.size();
+}
+
+void
+FcgiMuxConnection::Request::OnEof() noexcept
+{
+	assert(connection != nullptr);
+
+	ClearInput();
+
+	stopwatch.RecordEvent("request_end");
+
+	/* an empty STDIN record marks the end of the request
+	   body */
+	connection->WriteRecord(FCGI_STDIN, id, {});
+}
+
+void
+FcgiMuxConnection::Request::OnError(std::exception_ptr ep) noexcept
+{
+	ClearInput();
+
+	stopwatch.RecordEvent("request_error");
+
+	Abort(NestException(ep,
+			    std::runtime_error("FastCGI request stream failed")));
+}
+
+/*
+ * FcgiMuxConnection
+ *
+ */
+
+FcgiMuxConnection::FcgiMuxConnection(EventLoop &event_loop,
+				     unsigned _max_requests,
+				     FcgiMuxConnectionHandler &_handler) noexcept
+	:handler(_handler),
+	 connect(event_loop, *this),
+	 socket(event_loop),
+	 read_timer(event_loop, BIND_THIS_METHOD(OnReadTimeout)),
+	 idle_timer(event_loop, BIND_THIS_METHOD(OnIdleTimeout)),
+	 resume_event(event_loop, BIND_THIS_METHOD(OnResume)),
+	 max_requests(_max_requests)
+{
+}
+
+FcgiMuxConnection::~FcgiMuxConnection() noexcept
+{
+	assert(requests.empty());
+	assert(waiters.empty());
+
+	if (socket.IsValid()) {
+		if (socket.IsConnected())
+			socket.Close();
+		socket.Destroy();
+	}
+}
+
+void
+FcgiMuxConnection::Start(SocketAddress address) noexcept
+{
+	assert(state == State::CONNECTING);
+
+	fd_type = address.GetFamily() == AF_LOCAL
+		? FdType::FD_SOCKET
+		: FdType::FD_TCP;
+
+	connect.Connect(address, connect_timeout);
+}
+
+void
+FcgiMuxConnection::Get(AllocatorPtr alloc, FcgiMuxGetHandler &get_handler,
+		       CancellablePointer &cancel_ptr) noexcept
+{
+	assert(state != State::CLOSED);
+
+	if (state == State::READY) {
+		idle_timer.Cancel();
+		get_handler.OnFcgiMuxReady(*this);
+		return;
+	}
+
+	auto *w = alloc.New<Waiter>(*this, get_handler, cancel_ptr);
+	waiters.push_back(*w);
+}
+
+void
+FcgiMuxConnection::ReleaseWaiters() noexcept
+{
+	assert(state == State::READY);
+
+	while (!waiters.empty()) {
+		auto &w = waiters.front();
+		waiters.pop_front();
+
+		auto &get_handler = w.handler;
+		w.Destroy();
+
+		if (requests.size() < max_requests)
+			get_handler.OnFcgiMuxReady(*this);
+		else
+			/* the server accepts fewer concurrent
+			   requests than we had expected */
+			get_handler.OnFcgiMuxUnavailable();
+	}
+}
+
+void
+FcgiMuxConnection::AbortWaiters() noexcept
+{
+	while (!waiters.empty()) {
+		auto &w = waiters.front();
+		waiters.pop_front();
+
+		auto &get_handler = w.handler;
+		w.Destroy();
+		get_handler.OnFcgiMuxUnavailable();
+	}
+}
+
+void
+FcgiMuxConnection::SendRequest(struct pool &pool,
+			       StopwatchPtr &&stopwatch,
+			       HttpMethod method, const char *uri,
+			       const char *script_filename,
+			       const char *script_name, const char *path_info,
+			       const char *query_string,
+			       const char *document_root,
+			       const char *remote_addr,
+			       StringMap &&headers, UnusedIstreamPtr body,
+			       std::span<const char *const> params,
+			       UniqueFileDescriptor &&stderr_fd,
+			       HttpResponseHandler &response_handler,
+			       CancellablePointer &cancel_ptr) noexcept
+{
+	assert(state == State::READY);
+	assert(http_method_is_valid(method));
+
+	const uint16_t id = ToBE16(MakeRequestId());
+
+	GrowingBuffer gb;
+	fcgi_serialize_request_head(gb, id, method, uri, script_filename,
+				    script_name, path_info,
+				    query_string, document_root,
+				    remote_addr, headers,
+				    body ? body.GetAvailable(false) : -1,
+				    params);
+	Write(std::move(gb));
+
+	const bool has_body = (bool)body;
+
+	auto *r = NewFromPool<Request>(pool, pool, *this, id,
+				       std::move(stopwatch), method,
+				       std::move(body),
+				       std::move(stderr_fd),
+				       response_handler, cancel_ptr);
+	requests.push_back(*r);
+	UpdateTimers();
+
+	if (has_body)
+		/* this may abort the request synchronously */
+		r->ReadRequestBody();
+	else
+		/* no request body - append an empty STDIN record */
+		WriteRecord(FCGI_STDIN, id, {});
+}
+
+void
+FcgiMuxConnection::WriteRecord(uint8_t type, uint16_t request_id_be,
+			       std::span<const std::byte> payload) noexcept
+{
+	assert(payload.size() <= 0xffff);
+
+	const struct fcgi_record_header header{
+		.version = FCGI_VERSION_1,
+		.type = type,
+		.request_id = request_id_be,
+		.content_length = ToBE16(payload.size()),
+		.padding_length = 0,
+		.reserved = 0,
+	};
+
+	output.WriteT(header);
+	if (!payload.empty())
+		output.Write(payload.data(), payload.size());
+
+	output_size += sizeof(header) + payload.size();
+	socket.ScheduleWrite();
+}
+
+void
+FcgiMuxConnection::Write(GrowingBuffer &&src) noexcept
+{
+	output_size += src.GetSize();
+	output.AppendMoveFrom(std::move(src));
+	socket.ScheduleWrite();
+}
+
+void
+FcgiMuxConnection::WriteAbort(uint16_t request_id_be) noexcept
+{
+	if (state != State::READY)
+		/* the connection is going away anyway */
+		return;
+
+	WriteRecord(FCGI_ABORT_REQUEST, request_id_be, {});
+}
+
+bool
+FcgiMuxConnection::TryWrite() noexcept
+{
+	const bool had_room = HasOutputRoom();
+
+	while (true) {
+		auto src = output.Read();
+		if (src.empty()) {
+			socket.UnscheduleWrite();
+			break;
+		}
+
+		ssize_t nbytes = socket.Write(src.data(), src.size());
+		if (nbytes < 0) [[unlikely]] {
+			if (nbytes == WRITE_BLOCKING) [[likely]]
+				return true;
+
+			Fail(std::make_exception_ptr(MakeErrno("write error to FastCGI server")));
+			return false;
+		}
+
+		output.Consume(nbytes);
+		output_size -= nbytes;
+
+		if (static_cast<std::size_t>(nbytes) < src.size()) {
+			socket.ScheduleWrite();
+			break;
+		}
+	}
+
+	if (!had_room && HasOutputRoom())
+		ReadRequestBodies();
+
+	return true;
+}
+
+void
+FcgiMuxConnection::ReadRequestBodies() noexcept
+{
+	/* collect the ids first, because reading from a request
+	   body may abort (and remove) requests */
+	std::vector<uint16_t> ids;
+	for (const auto &r : requests)
+		if (r.HasRequestBody())
+			ids.push_back(r.id);
+
+	for (const uint16_t id : ids) {
+		if (!HasOutputRoom())
+			break;
+
+		if (auto *r = FindRequest(id))
+			r->ReadRequestBody();
+	}
+}
+
+uint16_t
+FcgiMuxConnection::MakeRequestId() noexcept
+{
+	/* skip ids which are still in use; request id 0 is
+	   reserved for management records */
+	uint16_t id = next_request_id;
+	while (FindRequest(ToBE16(id)) != nullptr)
+		if (++id == 0)
+			id = 1;
+
+	next_request_id = id + 1;
+	if (next_request_id == 0)
+		next_request_id = 1;
+
+	return id;
+}
+
+inline FcgiMuxConnection::Request *
+FcgiMuxConnection::FindRequest(uint16_t request_id_be) noexcept
+{
+	auto i = std::find_if(requests.begin(), requests.end(),
+			      [request_id_be](const Request &r){
+				      return r.id == request_id_be;
+			      });
+	return i != requests.end() ? &*i : nullptr;
+}
+
+void
+FcgiMuxConnection::RemoveRequest(Request &request) noexcept
+{
+	if (current == &request) {
+		/* discard the rest of the current record */
+		current = nullptr;
+		ResumeRead();
+	}
+
+	requests.erase(requests.iterator_to(request));
+	UpdateTimers();
+}
+
+void
+FcgiMuxConnection::ResumeRead() noexcept
+{
+	if (read_blocked)
+		resume_event.Schedule();
+}
+
+inline void
+FcgiMuxConnection::OnResume() noexcept
+{
+	read_blocked = false;
+	if (socket.Read())
+		UpdateTimers();
+}
+
+void
+FcgiMuxConnection::UpdateTimers() noexcept
+{
+	if (state != State::READY)
+		return;
+
+	if (requests.empty() || read_blocked)
+		read_timer.Cancel();
+	else if (!read_timer.IsPending())
+		read_timer.Schedule(read_timeout);
+
+	if (!IsIdle())
+		idle_timer.Cancel();
+	else if (!idle_timer.IsPending())
+		idle_timer.Schedule(idle_timeout);
+}
+
+void
+FcgiMuxConnection::AbortAllRequests(std::exception_ptr e) noexcept
+{
+	current = nullptr;
+
+	while (!requests.empty()) {
+		auto &r = requests.front();
+		requests.pop_front();
+		r.OnConnectionFailed(e);
+	}
+}
+
+void
+FcgiMuxConnection::Fail(std::exception_ptr e) noexcept
+{
+	/* even if this happens before the server has responded to
+	   #FCGI_GET_VALUES, this is an ordinary connection failure
+	   and says nothing about multiplexing support; the next
+	   caller will try again */
+
+	state = State::CLOSED;
+
+	/* these callers will use a classic connection */
+	AbortWaiters();
+
+	AbortAllRequests(NestException(e,
+				       FcgiClientError("FastCGI server connection failed")));
+	handler.OnFcgiMuxClosed(*this, true);
+}
+
+void
+FcgiMuxConnection::Unsupported() noexcept
+{
+	assert(requests.empty());
+
+	state = State::CLOSED;
+	AbortWaiters();
+	handler.OnFcgiMuxClosed(*this, false);
+}
+
+/**
+ * Parse a name-value pair length (FastCGI specification 3.4).
+ *
+ * @return false if the input is truncated
+ */
+static bool
+ReadNameValueLength(std::span<const std::byte> &src,
+		    std::size_t &length_r) noexcept
+{
+	if (src.empty())
+		return false;
+
+	if ((static_cast<uint8_t>(src.front()) & 0x80) == 0) {
+		length_r = static_cast<uint8_t>(src.front());
+		src = src.subspan(1);
+		return true;
+	}
+
+	if (src.size() < 4)
+		return false;
+
+	length_r = ((static_cast<uint32_t>(src[0]) & 0x7f) << 24) |
+		(static_cast<uint32_t>(src[1]) << 16) |
+		(static_cast<uint32_t>(src[2]) << 8) |
+		static_cast<uint32_t>(src[3]);
+	src = src.subspan(4);
+	return true;
+}
+
+void
+FcgiMuxConnection::HandleValues() noexcept
+{
+	assert(state == State::NEGOTIATING);
+
+	bool mpxs_conns = false;
+
+	std::span<const std::byte> src = AsBytes(values);
+	while (!src.empty()) {
+		std::size_t name_length, value_length;
+		if (!ReadNameValueLength(src, name_length) ||
+		    !ReadNameValueLength(src, value_length) ||
+		    src.size() < name_length + value_length)
+			break;
+
+		const std::string_view name = ToStringView(src.first(name_length));
+		src = src.subspan(name_length);
+		const std::string_view value = ToStringView(src.first(value_length));
+		src = src.subspan(value_length);
+
+		if (name == FCGI_MPXS_CONNS) {
+			mpxs_conns = value == "1";
+		} else if (name == FCGI_MAX_REQS) {
+			unsigned n;
+			auto [ptr, ec] = std::from_chars(value.data(),
+							 value.data() + value.size(),
+							 n);
+			if (ec == std::errc{} && n > 0)
+				max_requests = std::min(max_requests, n);
+		}
+	}
+
+	values = {};
+
+	if (!mpxs_conns) {
+		Unsupported();
+		return;
+	}
+
+	state = State::READY;
+	read_timer.Cancel();
+
+	ReleaseWaiters();
+	UpdateTimers();
+}
+
+void
+FcgiMuxConnection::OnReadTimeout() noexcept
+{
+	Fail(std::make_exception_ptr(TimeoutError{}));
+}
+
+void
+FcgiMuxConnection::OnIdleTimeout() noexcept
+{
+	assert(IsIdle());
+
+	state = State::CLOSED;
+	handler.OnFcgiMuxClosed(*this, true);
+}
+
+inline BufferedResult
+FcgiMuxConnection::FeedRecords(std::span<const std::byte> src) noexcept
+{
+	while (!src.empty()) {
+		if (content_remaining == 0 && padding_remaining == 0) {
+			struct fcgi_record_header header;
+			if (src.size() < sizeof(header))
+				return BufferedResult::MORE;
+
+			memcpy(&header, src.data(), sizeof(header));
+			src = src.subspan(sizeof(header));
+			socket.DisposeConsumed(sizeof(header));
+
+			current_type = header.type;
+			content_remaining = FromBE16(header.content_length);
+			padding_remaining = header.padding_length;
+
+			if (header.request_id == 0) {
+				/* a management record */
+				current = nullptr;
+
+				if (current_type == FCGI_UNKNOWN_TYPE &&
+				    state == State::NEGOTIATING) {
+					/* the server does not know
+					   #FCGI_GET_VALUES */
+					Unsupported();
+					return BufferedResult::CLOSED;
+				}
+			} else {
+				current = FindRequest(header.request_id);
+
+				if (current_type == FCGI_END_REQUEST &&
+				    current != nullptr) {
+					/* the payload (application
+					   status and protocol status)
+					   is not interesting;
+					   HandleEnd() removes the
+					   request, and the payload will
+					   be discarded */
+					current->HandleEnd();
+					assert(current == nullptr);
+				}
+			}
+		} else if (content_remaining > 0) {
+			const auto chunk = src.first(std::min(src.size(),
+							      content_remaining));
+			std::size_t consumed = chunk.size();
+
+			if (current_type == FCGI_GET_VALUES_RESULT &&
+			    state == State::NEGOTIATING) {
+				values.append(ToStringView(chunk));
+			} else if (current == nullptr) {
+				/* discard data for unknown (canceled)
+				   requests and management records */
+			} else if (current_type == FCGI_STDOUT) {
+				consumed = current->FeedStdout(chunk);
+			} else if (current_type == FCGI_STDERR) {
+				current->FeedStderr(chunk);
+			}
+
+			src = src.subspan(consumed);
+			content_remaining -= consumed;
+			socket.DisposeConsumed(consumed);
+
+			if (consumed < chunk.size()) {
+				/* this request's response buffer is
+				   full; wait until it has been
+				   drained (head-of-line blocking,
+				   because FastCGI has no per-request
+				   flow control) */
+				read_blocked = true;
+				UpdateTimers();
+				return BufferedResult::OK;
+			}
+		} else {
+			const std::size_t nbytes = std::min(src.size(),
+							    padding_remaining);
+			src = src.subspan(nbytes);
+			padding_remaining -= nbytes;
+			socket.DisposeConsumed(nbytes);
+		}
+
+		if (content_remaining == 0 && padding_remaining == 0 &&
+		    current_type == FCGI_GET_VALUES_RESULT &&
+		    state == State::NEGOTIATING) {
+			HandleValues();
+			if (state == State::CLOSED)
+				return BufferedResult::CLOSED;
+		}
+	}
+
+	return BufferedResult::MORE;
+}
+
+/*
+ * ConnectSocketHandler
+ *
+ */
+
+void
+FcgiMuxConnection::OnSocketConnectSuccess(UniqueSocketDescriptor fd) noexcept
+{
+	assert(state == State::CONNECTING);
+
+	socket.Init(fd.Release(), fd_type, write_timeout, *this);
+
+	/* ask the server whether it supports multiplexing */
+	GrowingBuffer gb;
+	FcgiParamsSerializer ps(gb, 0, FCGI_GET_VALUES);
+	ps(FCGI_MPXS_CONNS, std::string_view{})
+		(FCGI_MAX_REQS, std::string_view{});
+	ps.Commit();
+	Write(std::move(gb));
+
+	state = State::NEGOTIATING;
+	socket.ScheduleRead();
+	read_timer.Schedule(negotiate_timeout);
+}
+
+void
+FcgiMuxConnection::OnSocketConnectTimeout() noexcept
+{
+	Fail(std::make_exception_ptr(TimeoutError{}));
+}
+
+void
+FcgiMuxConnection::OnSocketConnectError(std::exception_ptr ep) noexcept
+{
+	Fail(std::move(ep));
+}
+
+/*
+ * BufferedSocketHandler
+ *
+ */
+
+BufferedResult
+FcgiMuxConnection::OnBufferedData()
+{
+	auto r = socket.ReadBuffer();
+	assert(!r.empty());
+
+	read_blocked = false;
+
+	if (state == State::READY && !requests.empty())
+		/* the server is alive: restart the timeout */
+		read_timer.Schedule(read_timeout);
+
+	return FeedRecords(r);
+}
+
+bool
+FcgiMuxConnection::OnBufferedClosed() noexcept
+{
+	Fail(std::make_exception_ptr(SocketClosedPrematurelyError()));
+	return false;
+}
+
+bool
+FcgiMuxConnection::OnBufferedWrite()
+{
+	return TryWrite();
+}
+
+void
+FcgiMuxConnection::OnBufferedError(std::exception_ptr e) noexcept
+{
+	Fail(std::move(e));
+}
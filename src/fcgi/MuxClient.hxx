@@ -0,0 +1,338 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#pragma once
+
+#include "event/net/BufferedSocket.hxx"
+#include "event/net/ConnectSocket.hxx"
+#include "event/CoarseTimerEvent.hxx"
+#include "event/DeferEvent.hxx"
+#include "memory/GrowingBuffer.hxx"
+#include "util/IntrusiveList.hxx"
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <span>
+#include <string>
+
+enum class HttpMethod : uint_least8_t;
+struct pool;
+class AllocatorPtr;
+class SocketAddress;
+class UnusedIstreamPtr;
+class UniqueFileDescriptor;
+class StringMap;
+class HttpResponseHandler;
+class CancellablePointer;
+class StopwatchPtr;
+class FcgiMuxConnection;
+
+/**
+ * Handler for FcgiMuxConnection::Get().
+ */
+class FcgiMuxGetHandler {
+public:
+	/**
+	 * The connection is ready for a new request.  The handler
+	 * shall call FcgiMuxConnection::SendRequest() right now.
+	 */
+	virtual void OnFcgiMuxReady(FcgiMuxConnection &connection) noexcept = 0;
+
+	/**
+	 * Multiplexing is not available, e.g. because the server
+	 * does not support it or because the connection has failed.
+	 * The caller shall send the request over a classic
+	 * (exclusive) connection instead.
+	 */
+	virtual void OnFcgiMuxUnavailable() noexcept = 0;
+};
+
+class FcgiMuxConnectionHandler {
+public:
+	/**
+	 * The connection has been closed and shall be destroyed.
+	 * All pending requests have already been aborted, and all
+	 * waiters have been notified.
+	 *
+	 * @param supported false if the server has declined
+	 * multiplexing in its response to #FCGI_GET_VALUES; connection
+	 * failures and timeouts (even during the negotiation) pass
+	 * true
+	 */
+	virtual void OnFcgiMuxClosed(FcgiMuxConnection &connection,
+				     bool supported) noexcept = 0;
+};
+
+/**
+ * A connection to a FastCGI server which transmits many requests
+ * concurrently, each with its own request id (#FCGI_MPXS_CONNS).
+ * After connecting, it asks the server (#FCGI_GET_VALUES) whether
+ * it supports multiplexing and how many concurrent requests it
+ * accepts; until the answer arrives, new callers are queued as
+ * "waiters".
+ *
+ * FastCGI has no per-request flow control.  The output of all
+ * requests is limited by a shared buffer, and request bodies are
+ * only read while there is room in it.  Response bodies which the
+ * #HttpResponseHandler doesn't consume right away are buffered per
+ * request; if one request's buffer is full, reading from the socket
+ * stops until that request's handler catches up.
+ */
+class FcgiMuxConnection final
+	: public IntrusiveListHook<IntrusiveHookMode::NORMAL>,
+	  BufferedSocketHandler, ConnectSocketHandler
+{
+	static constexpr Event::Duration connect_timeout = std::chrono::seconds{20};
+	static constexpr Event::Duration negotiate_timeout = std::chrono::seconds{10};
+	static constexpr Event::Duration read_timeout = std::chrono::minutes{2};
+	static constexpr Event::Duration write_timeout = std::chrono::minutes{2};
+	static constexpr Event::Duration idle_timeout = std::chrono::minutes{1};
+
+	/**
+	 * Stop reading request bodies while this many bytes are
+	 * waiting to be sent.
+	 */
+	static constexpr std::size_t MAX_OUTPUT = 64 * 1024;
+
+	FcgiMuxConnectionHandler &handler;
+
+	ConnectSocket connect;
+
+	BufferedSocket socket;
+
+	/**
+	 * Fires when the server does not respond to pending
+	 * requests (or to the negotiation request).
+	 */
+	CoarseTimerEvent read_timer;
+
+	/**
+	 * Closes the connection after it has been idle for a while.
+	 */
+	CoarseTimerEvent idle_timer;
+
+	/**
+	 * Resumes reading from the socket after a request has drained
+	 * its response buffer.  This is deferred to avoid recursion
+	 * from the response body handler into FeedRecords().
+	 */
+	DeferEvent resume_event;
+
+	/**
+	 * Data waiting to be sent to the server.  It contains only
+	 * complete records, so records of different requests never
+	 * interleave.
+	 */
+	GrowingBuffer output;
+
+	/**
+	 * The number of bytes in #output.
+	 */
+	std::size_t output_size = 0;
+
+	class Waiter;
+	using WaiterList =
+		IntrusiveList<Waiter,
+			      IntrusiveListBaseHookTraits<Waiter>,
+			      true>;
+
+	WaiterList waiters;
+
+	class Request;
+	using RequestList =
+		IntrusiveList<Request,
+			      IntrusiveListBaseHookTraits<Request>,
+			      true>;
+
+	RequestList requests;
+
+	/**
+	 * The request which receives the payload of the current
+	 * record.  nullptr if there is no current record or if the
+	 * record belongs to a request which is not (anymore) known,
+	 * e.g. because it was canceled.
+	 */
+	Request *current = nullptr;
+
+	/**
+	 * The payload of the current #FCGI_GET_VALUES_RESULT record.
+	 */
+	std::string values;
+
+	/**
+	 * The number of payload and padding bytes remaining in the
+	 * current record.
+	 */
+	std::size_t content_remaining = 0, padding_remaining = 0;
+
+	/**
+	 * The type of the current record.
+	 */
+	uint8_t current_type;
+
+	uint16_t next_request_id = 1;
+
+	/**
+	 * The maximum number of concurrent requests; configured by
+	 * the caller and possibly lowered by the server's
+	 * #FCGI_MAX_REQS value.
+	 */
+	unsigned max_requests;
+
+	FdType fd_type = FdType::FD_TCP;
+
+	/**
+	 * Has FeedRecords() stopped because a request's response
+	 * buffer is full?
+	 */
+	bool read_blocked = false;
+
+	enum class State : uint_least8_t {
+		CONNECTING,
+
+		/**
+		 * Waiting for #FCGI_GET_VALUES_RESULT.
+		 */
+		NEGOTIATING,
+
+		READY,
+
+		/**
+		 * The connection has failed or has been closed; it
+		 * accepts no more requests and is about to be
+		 * destroyed.
+		 */
+		CLOSED,
+	} state = State::CONNECTING;
+
+public:
+	FcgiMuxConnection(EventLoop &event_loop,
+			  unsigned _max_requests,
+			  FcgiMuxConnectionHandler &_handler) noexcept;
+	~FcgiMuxConnection() noexcept;
+
+	FcgiMuxConnection(const FcgiMuxConnection &) = delete;
+	FcgiMuxConnection &operator=(const FcgiMuxConnection &) = delete;
+
+	/**
+	 * Start connecting.  This may invoke the handler (and the
+	 * waiters) synchronously if the connection fails right away.
+	 */
+	void Start(SocketAddress address) noexcept;
+
+	bool IsIdle() const noexcept {
+		return requests.empty() && waiters.empty();
+	}
+
+	/**
+	 * Can another caller be added?
+	 */
+	bool HasCapacity() const noexcept {
+		return state != State::CLOSED &&
+			requests.size() + waiters.size() < max_requests;
+	}
+
+	/**
+	 * Wait until the connection is ready for a new request.  If
+	 * it is already, the handler is invoked right away.
+	 */
+	void Get(AllocatorPtr alloc, FcgiMuxGetHandler &get_handler,
+		 CancellablePointer &cancel_ptr) noexcept;
+
+	/**
+	 * Send a request.  This may only be called from
+	 * FcgiMuxGetHandler::OnFcgiMuxReady().  The parameters are
+	 * the same as for fcgi_client_request().
+	 */
+	void SendRequest(struct pool &pool,
+			 StopwatchPtr &&stopwatch,
+			 HttpMethod method, const char *uri,
+			 const char *script_filename,
+			 const char *script_name, const char *path_info,
+			 const char *query_string,
+			 const char *document_root,
+			 const char *remote_addr,
+			 StringMap &&headers, UnusedIstreamPtr body,
+			 std::span<const char *const> params,
+			 UniqueFileDescriptor &&stderr_fd,
+			 HttpResponseHandler &response_handler,
+			 CancellablePointer &cancel_ptr) noexcept;
+
+private:
+	void ReleaseWaiters() noexcept;
+	void AbortWaiters() noexcept;
+
+	/**
+	 * Append a complete record to #output.
+	 */
+	void WriteRecord(uint8_t type, uint16_t request_id_be,
+			 std::span<const std::byte> payload) noexcept;
+	void Write(GrowingBuffer &&src) noexcept;
+	void WriteAbort(uint16_t request_id_be) noexcept;
+
+	bool HasOutputRoom() const noexcept {
+		return output_size < MAX_OUTPUT;
+	}
+
+	bool TryWrite() noexcept;
+
+	/**
+	 * Read more request body data from all requests (after room
+	 * has become available in #output).
+	 */
+	void ReadRequestBodies() noexcept;
+
+	/**
+	 * Allocate a new request id (in host byte order).
+	 */
+	uint16_t MakeRequestId() noexcept;
+
+	[[gnu::pure]]
+	Request *FindRequest(uint16_t request_id_be) noexcept;
+
+	void RemoveRequest(Request &request) noexcept;
+
+	/**
+	 * The given request has drained its response buffer; resume
+	 * reading from the socket if it had been stopped for it.
+	 */
+	void ResumeRead() noexcept;
+	void OnResume() noexcept;
+
+	void UpdateTimers() noexcept;
+
+	void AbortAllRequests(std::exception_ptr e) noexcept;
+
+	/**
+	 * Close the connection, abort all requests and notify the
+	 * handler.
+	 */
+	void Fail(std::exception_ptr e) noexcept;
+
+	/**
+	 * The server has explicitly declined multiplexing, either in
+	 * its #FCGI_GET_VALUES_RESULT or with #FCGI_UNKNOWN_TYPE.
+	 * This is not used for transport errors.
+	 */
+	void Unsupported() noexcept;
+
+	void HandleValues() noexcept;
+
+	void OnReadTimeout() noexcept;
+	void OnIdleTimeout() noexcept;
+
+	BufferedResult FeedRecords(std::span<const std::byte> src) noexcept;
+
+	/* virtual methods from class ConnectSocketHandler */
+	void OnSocketConnectSuccess(UniqueSocketDescriptor fd) noexcept override;
+	void OnSocketConnectTimeout() noexcept override;
+	void OnSocketConnectError(std::exception_ptr ep) noexcept override;
+
+	/* virtual methods from class BufferedSocketHandler */
+	BufferedResult OnBufferedData() override;
+	bool OnBufferedClosed() noexcept override;
+	bool OnBufferedWrite() override;
+	void OnBufferedError(std::exception_ptr e) noexcept override;
+};
@@ -0,0 +1,118 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#include "MuxStock.hxx"
+#include "MuxClient.hxx"
+#include "cluster/AddressList.hxx"
+#include "net/AllocatedSocketAddress.hxx"
+#include "net/ToString.hxx"
+#include "io/Logger.hxx"
+#include "AllocatorPtr.hxx"
+
+#include <cassert>
+
+class FcgiMuxStock::Server final : FcgiMuxConnectionHandler {
+	FcgiMuxStock &stock;
+
+	const AllocatedSocketAddress address;
+
+	/**
+	 * For log messages.
+	 */
+	const std::string name;
+
+	IntrusiveList<FcgiMuxConnection> connections;
+
+	/**
+	 * Has the server told us that it does not support
+	 * multiplexing?
+	 */
+	bool unsupported = false;
+
+public:
+	Server(FcgiMuxStock &_stock, SocketAddress _address,
+	       std::string_view _name) noexcept
+		:stock(_stock), address(_address), name(_name) {}
+
+	~Server() noexcept {
+		connections.clear_and_dispose([](FcgiMuxConnection *c){
+			delete c;
+		});
+	}
+
+	Server(const Server &) = delete;
+	Server &operator=(const Server &) = delete;
+
+	void Get(AllocatorPtr alloc, FcgiMuxGetHandler &handler,
+		 CancellablePointer &cancel_ptr) noexcept {
+		if (unsupported) {
+			handler.OnFcgiMuxUnavailable();
+			return;
+		}
+
+		for (auto &c : connections) {
+			if (c.HasCapacity()) {
+				c.Get(alloc, handler, cancel_ptr);
+				return;
+			}
+		}
+
+		auto *c = new FcgiMuxConnection(stock.event_loop,
+						stock.max_requests, *this);
+		connections.push_back(*c);
+
+		/* the caller waits for the negotiation */
+		c->Get(alloc, handler, cancel_ptr);
+		c->Start(address);
+	}
+
+private:
+	/* virtual methods from class FcgiMuxConnectionHandler */
+	void OnFcgiMuxClosed(FcgiMuxConnection &c,
+			     bool supported) noexcept override {
+		if (!supported && !unsupported) {
+			unsupported = true;
+			LogConcat(3, "fcgi", "FastCGI server does not support multiplexing: ",
+				  name);
+		}
+
+		connections.erase(connections.iterator_to(c));
+		delete &c;
+	}
+};
+
+FcgiMuxStock::FcgiMuxStock(EventLoop &_event_loop,
+			   unsigned _max_requests) noexcept
+	:event_loop(_event_loop), max_requests(_max_requests)
+{
+	assert(max_requests > 0);
+}
+
+FcgiMuxStock::~FcgiMuxStock() noexcept = default;
+
+void
+FcgiMuxStock::Get(AllocatorPtr alloc, const AddressList &address_list,
+		  FcgiMuxGetHandler &handler,
+		  CancellablePointer &cancel_ptr) noexcept
+{
+	assert(!address_list.empty());
+
+	const SocketAddress address =
+		address_list.addresses[next_address++ % address_list.size()];
+
+	char buffer[1024];
+	if (!ToString(buffer, sizeof(buffer), address)) {
+		handler.OnFcgiMuxUnavailable();
+		return;
+	}
+
+	const std::string_view key{buffer};
+
+	auto i = servers.find(key);
+	if (i == servers.end())
+		i = servers.try_emplace(std::string{key},
+					*this, address, key).first;
+
+	i->second.Get(alloc, handler, cancel_ptr);
+}
@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#pragma once
+
+#include <map>
+#include <string>
+
+class EventLoop;
+class AllocatorPtr;
+class CancellablePointer;
+class FcgiMuxGetHandler;
+struct AddressList;
+
+/**
+ * Manages multiplexed connections (#FcgiMuxConnection) to remote
+ * FastCGI servers.  Each server gets as many connections as needed
+ * for the configured number of concurrent requests per connection.
+ * Servers which don't support multiplexing are remembered, and all
+ * further callers are told to use a classic connection.
+ */
+class FcgiMuxStock final {
+	EventLoop &event_loop;
+
+	/**
+	 * The maximum number of concurrent requests on one
+	 * connection.
+	 */
+	const unsigned max_requests;
+
+	class Server;
+
+	/**
+	 * All servers, indexed by their address string.
+	 */
+	std::map<std::string, Server, std::less<>> servers;
+
+	/**
+	 * For round-robin address selection.
+	 */
+	unsigned next_address = 0;
+
+public:
+	FcgiMuxStock(EventLoop &_event_loop, unsigned _max_requests) noexcept;
+	~FcgiMuxStock() noexcept;
+
+	FcgiMuxStock(const FcgiMuxStock &) = delete;
+	FcgiMuxStock &operator=(const FcgiMuxStock &) = delete;
+
+	/**
+	 * Obtain a connection to one of the given servers.  The
+	 * handler is invoked when the connection is ready (maybe
+	 * right away), or when multiplexing is not available.
+	 */
+	void Get(AllocatorPtr alloc, const AddressList &address_list,
+		 FcgiMuxGetHandler &handler,
+		 CancellablePointer &cancel_ptr) noexcept;
+};
@@ -4,6 +4,8 @@
 
 #include "Remote.hxx"
 #include "Client.hxx"
+#include "MuxClient.hxx"
+#include "MuxStock.hxx"
 #include "http/PendingRequest.hxx"
 #include "http/ResponseHandler.hxx"
 #include "lease.hxx"
@@ -20,10 +22,15 @@
 #include "AllocatorPtr.hxx"
 #include "stopwatch.hxx"
 
-class FcgiRemoteRequest final : StockGetHandler, Cancellable, Lease, PoolLeakDetector {
+class FcgiRemoteRequest final
+	: StockGetHandler, FcgiMuxGetHandler, Cancellable, Lease, PoolLeakDetector
+{
 	struct pool &pool;
 	EventLoop &event_loop;
 
+	TcpBalancer &tcp_balancer;
+	const AddressList &address_list;
+
 	StopwatchPtr stopwatch;
 
 	StockItem *stock_item;
@@ -47,6 +54,8 @@ class FcgiRemoteRequest final : StockGetHandler, Cancellable, Lease, PoolLeakDet
 
 public:
 	FcgiRemoteRequest(struct pool &_pool, EventLoop &_event_loop,
+			  TcpBalancer &_tcp_balancer,
+			  const AddressList &_address_list,
 			  const StopwatchPtr &parent_stopwatch,
 			  HttpMethod _method, const char *_uri,
 			  const char *_script_filename,
@@ -62,6 +71,7 @@ public:
 			  CancellablePointer &_cancel_ptr)
 	:PoolLeakDetector(_pool),
 	 pool(_pool), event_loop(_event_loop),
+	 tcp_balancer(_tcp_balancer), address_list(_address_list),
 	 stopwatch(parent_stopwatch, "fcgi", _uri),
 	 pending_request(_pool, _method, _uri,
 			 std::move(_headers), std::move(_body)),
@@ -75,8 +85,19 @@ public:
 		caller_cancel_ptr = *this;
 	}
 
-	void Start(TcpBalancer &tcp_balancer,
-		   const AddressList &address_list) noexcept {
+	void Start(FcgiMuxStock *mux_stock) noexcept {
+		if (mux_stock != nullptr)
+			mux_stock->Get(pool, address_list,
+				       *this, connect_cancel_ptr);
+		else
+			StartClassic();
+	}
+
+private:
+	/**
+	 * Obtain an exclusive connection from the #TcpBalancer.
+	 */
+	void StartClassic() noexcept {
 		tcp_balancer.Get(pool,
 				 stopwatch,
 				 false, SocketAddress::Null(),
@@ -84,7 +105,6 @@ public:
 				 *this, connect_cancel_ptr);
 	}
 
-private:
 	void Destroy() noexcept {
 		DeleteFromPool(pool, this);
 	}
@@ -93,6 +113,12 @@ private:
 	void OnStockItemReady(StockItem &item) noexcept override;
 	void OnStockItemError(std::exception_ptr ep) noexcept override;
 
+	/* virtual methods from class FcgiMuxGetHandler */
+	void OnFcgiMuxReady(FcgiMuxConnection &connection) noexcept override;
+	void OnFcgiMuxUnavailable() noexcept override {
+		StartClassic();
+	}
+
 	/* virtual methods from class Cancellable */
 	void Cancel() noexcept override {
 		connect_cancel_ptr.Cancel();
@@ -148,6 +174,44 @@ FcgiRemoteRequest::OnStockItemError(std::exception_ptr ep) noexcept
 	_handler.InvokeError(ep);
 }
 
+/*
+ * FcgiMuxGetHandler
+ *
+ */
+
+void
+FcgiRemoteRequest::OnFcgiMuxReady(FcgiMuxConnection &connection) noexcept
+{
+	/* this object is not needed anymore; the connection takes
+	   over */
+	auto &_pool = pool;
+	auto _stopwatch = std::move(stopwatch);
+	const auto method = pending_request.method;
+	const char *const uri = pending_request.uri;
+	auto headers = std::move(pending_request.headers);
+	auto body = std::move(pending_request.body);
+	const char *const _script_filename = script_filename;
+	const char *const _script_name = script_name;
+	const char *const _path_info = path_info;
+	const char *const _query_string = query_string;
+	const char *const _document_root = document_root;
+	const char *const _remote_addr = remote_addr;
+	const auto _params = params;
+	auto _stderr_fd = std::move(stderr_fd);
+	auto &_handler = handler;
+	auto &_cancel_ptr = caller_cancel_ptr;
+	Destroy();
+
+	connection.SendRequest(_pool, std::move(_stopwatch),
+			       method, uri, _script_filename,
+			       _script_name, _path_info,
+			       _query_string, _document_root,
+			       _remote_addr,
+			       std::move(headers), std::move(body),
+			       _params, std::move(_stderr_fd),
+			       _handler, _cancel_ptr);
+}
+
 /*
  * constructor
  *
@@ -156,6 +220,7 @@ FcgiRemoteRequest::OnStockItemError(std::exception_ptr ep) noexcept
 void
 fcgi_remote_request(struct pool *pool, EventLoop &event_loop,
 		    TcpBalancer *tcp_balancer,
+		    FcgiMuxStock *mux_stock,
 		    const StopwatchPtr &parent_stopwatch,
 		    const AddressList *address_list,
 		    const char *path,
@@ -173,6 +238,8 @@ fcgi_remote_request(struct pool *pool, EventLoop &event_loop,
 	CancellablePointer *cancel_ptr = &_cancel_ptr;
 
 	auto request = NewFromPool<FcgiRemoteRequest>(*pool, *pool, event_loop,
+						      *tcp_balancer,
+						      *address_list,
 						      parent_stopwatch,
 						      method, uri, path,
 						      script_name, path_info,
@@ -184,5 +251,5 @@ fcgi_remote_request(struct pool *pool, EventLoop &event_loop,
 						      std::move(stderr_fd),
 						      handler, *cancel_ptr);
 
-	request->Start(*tcp_balancer, *address_list);
+	request->Start(mux_stock);
 }
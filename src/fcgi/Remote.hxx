@@ -12,6 +12,7 @@ struct pool;
 class EventLoop;
 class UnusedIstreamPtr;
 class TcpBalancer;
+class FcgiMuxStock;
 struct AddressList;
 class StringMap;
 class HttpResponseHandler;
@@ -21,10 +22,14 @@ class StopwatchPtr;
 
 /**
  * High level FastCGI client for remote FastCGI servers.
+ *
+ * @param mux_stock if not nullptr, then the request is sent over a
+ * multiplexed connection if the server supports it
  */
 void
 fcgi_remote_request(struct pool *pool, EventLoop &event_loop,
 		    TcpBalancer *tcp_balancer,
+		    FcgiMuxStock *mux_stock,
 		    const StopwatchPtr &parent_stopwatch,
 		    const AddressList *address_list,
 		    const char *path,
@@ -5,13 +5,19 @@
 #include "Serialize.hxx"
 #include "Protocol.hxx"
 #include "memory/GrowingBuffer.hxx"
+#include "http/Method.hxx"
 #include "strmap.hxx"
+#include "product.h"
 #include "util/CharUtil.hxx"
 #include "util/ByteOrder.hxx"
+#include "util/StringSplit.hxx"
 
 #include <cassert>
 #include <cstdint>
 
+#include <stdio.h>
+#include <string.h>
+
 FcgiRecordSerializer::FcgiRecordSerializer(GrowingBuffer &_buffer,
 					   uint8_t type,
 					   uint16_t request_id_be) noexcept
@@ -61,8 +67,9 @@ fcgi_serialize_pair(GrowingBuffer &gb, std::string_view name,
 }
 
 FcgiParamsSerializer::FcgiParamsSerializer(GrowingBuffer &_buffer,
-					   uint16_t request_id_be) noexcept
-	:record(_buffer, FCGI_PARAMS, request_id_be) {}
+					   uint16_t request_id_be,
+					   uint8_t type) noexcept
+	:record(_buffer, type, request_id_be) {}
 
 FcgiParamsSerializer &
 FcgiParamsSerializer::operator()(std::string_view name,
@@ -93,3 +100,79 @@ FcgiParamsSerializer::Headers(const StringMap &headers) noexcept
 		(*this)({buffer, 5 + i}, pair.value);
 	}
 }
+
+void
+fcgi_serialize_request_head(GrowingBuffer &buffer, uint16_t request_id_be,
+			    HttpMethod method, const char *uri,
+			    const char *script_filename,
+			    const char *script_name, const char *path_info,
+			    const char *query_string,
+			    const char *document_root,
+			    const char *remote_addr,
+			    StringMap &headers, off_t body_length,
+			    std::span<const char *const> params) noexcept
+{
+	struct fcgi_record_header header{
+		FCGI_VERSION_1,
+		FCGI_BEGIN_REQUEST,
+		request_id_be,
+	};
+	static constexpr struct fcgi_begin_request begin_request{
+		ToBE16(FCGI_RESPONDER),
+		FCGI_KEEP_CONN,
+	};
+
+	header.content_length = ToBE16(sizeof(begin_request));
+	buffer.WriteT(header);
+	buffer.WriteT(begin_request);
+
+	FcgiParamsSerializer ps(buffer, request_id_be);
+
+	ps("REQUEST_METHOD", http_method_to_string(method))
+		("REQUEST_URI", uri)
+		("SCRIPT_FILENAME", script_filename)
+		("SCRIPT_NAME", script_name)
+		("PATH_INFO", path_info)
+		("QUERY_STRING", query_string)
+		("DOCUMENT_ROOT", document_root)
+		("SERVER_SOFTWARE", PRODUCT_TOKEN);
+
+	if (remote_addr != nullptr)
+		ps("REMOTE_ADDR", remote_addr);
+
+	if (body_length >= 0) {
+		char value[64];
+		snprintf(value, sizeof(value),
+			 "%lu", (unsigned long)body_length);
+
+		const char *content_type = headers.Get("content-type");
+
+		ps("HTTP_CONTENT_LENGTH", value)
+			/* PHP wants the parameter without
+			   "HTTP_" */
+			("CONTENT_LENGTH", value);
+
+		/* same for the "Content-Type" request
+		   header */
+		if (content_type != nullptr)
+			ps("CONTENT_TYPE", content_type);
+	}
+
+	const char *https = headers.Remove("x-cm4all-https");
+	if (https != nullptr && strcmp(https, "on") == 0)
+		ps("HTTPS", https);
+
+	ps.Headers(headers);
+
+	for (const std::string_view param : params) {
+		const auto [name, value] = Split(param, '=');
+		if (!name.empty() && value.data() != nullptr)
+			ps(name, value);
+	}
+
+	ps.Commit();
+
+	header.type = FCGI_PARAMS;
+	header.content_length = ToBE16(0);
+	buffer.WriteT(header);
+}
@@ -8,11 +8,16 @@
 
 #pragma once
 
+#include "Protocol.hxx"
+
+#include <span>
 #include <string_view>
 
 #include <stdint.h>
 #include <stddef.h>
+#include <sys/types.h> // for off_t
 
+enum class HttpMethod : uint_least8_t;
 class GrowingBuffer;
 class StringMap;
 
@@ -37,8 +42,13 @@ class FcgiParamsSerializer {
 	size_t content_length = 0;
 
 public:
+	/**
+	 * @param type the record type; #FCGI_GET_VALUES uses the
+	 * same name-value pair encoding as #FCGI_PARAMS
+	 */
 	FcgiParamsSerializer(GrowingBuffer &_buffer,
-			     uint16_t request_id_be) noexcept;
+			     uint16_t request_id_be,
+			     uint8_t type=FCGI_PARAMS) noexcept;
 
 	FcgiParamsSerializer &operator()(std::string_view name,
 					 std::string_view value) noexcept;
@@ -57,3 +67,24 @@ public:
 		record.Commit(content_length);
 	}
 };
+
+/**
+ * Serialize the #FCGI_BEGIN_REQUEST and #FCGI_PARAMS records of a
+ * #FCGI_RESPONDER request, including the empty #FCGI_PARAMS record
+ * which terminates the parameters.
+ *
+ * @param request_id_be the request id in network byte order
+ * @param headers the request headers; "X-CM4all-HTTPS" is removed
+ * @param body_length the length of the request body or -1 if there
+ * is no body or if its length is unknown
+ */
+void
+fcgi_serialize_request_head(GrowingBuffer &buffer, uint16_t request_id_be,
+			    HttpMethod method, const char *uri,
+			    const char *script_filename,
+			    const char *script_name, const char *path_info,
+			    const char *query_string,
+			    const char *document_root,
+			    const char *remote_addr,
+			    StringMap &headers, off_t body_length,
+			    std::span<const char *const> params) noexcept;
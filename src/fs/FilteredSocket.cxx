@@ -3,10 +3,16 @@
 // author: Max Kellermann <mk@cm4all.com>
 
 #include "FilteredSocket.hxx"
+#include "ZeroCopySender.hxx"
 #include "net/UniqueSocketDescriptor.hxx"
 
+#ifdef HAVE_URING
+#include "UringSocketWriter.hxx"
+#endif
+
 #include <utility>
 
+#include <fcntl.h>
 #include <string.h>
 
 FilteredSocket::FilteredSocket(EventLoop &_event_loop,
@@ -112,6 +118,10 @@ FilteredSocket::Init(SocketDescriptor fd, FdType fd_type,
 		  write_timeout,
 		  *_handler);
 
+#ifdef HAVE_URING
+	assert(uring_writer == nullptr);
+#endif
+
 #ifndef NDEBUG
 	ended = false;
 #endif
@@ -154,15 +164,120 @@ FilteredSocket::Reinit(Event::Duration write_timeout,
 		base.SetWriteTimeout(write_timeout);
 	} else
 		base.Reinit(write_timeout, _handler);
+
+#ifdef HAVE_URING
+	if (uring_writer != nullptr)
+		uring_writer->SetHandler(write_timeout, _handler);
+#endif
+}
+
+#ifdef HAVE_URING
+
+void
+FilteredSocket::EnableUring(Uring::Queue &queue) noexcept
+{
+	assert(filter == nullptr);
+	assert(uring_writer == nullptr);
+	assert(IsConnected());
+
+	UniqueSocketDescriptor fd{fcntl(base.GetSocket().Get(),
+					F_DUPFD_CLOEXEC, 0)};
+	if (!fd.IsDefined())
+		/* out of file descriptors: keep using send() */
+		return;
+
+	uring_writer = new UringSocketWriter(GetEventLoop(), queue,
+					     std::move(fd));
+}
+
+void
+FilteredSocket::DisableUring() noexcept
+{
+	delete std::exchange(uring_writer, nullptr);
+}
+
+#endif
+
+void
+FilteredSocket::EnableZeroCopy(std::size_t threshold)
+{
+	assert(filter == nullptr);
+	assert(zero_copy == nullptr);
+	assert(IsConnected());
+
+	zero_copy = ZeroCopySender::Create(GetEventLoop(), base.GetSocket(),
+					   threshold);
+}
+
+void
+FilteredSocket::DisableZeroCopy(bool shutdown) noexcept
+{
+	if (zero_copy != nullptr)
+		/* the kernel may still read from the buffers; the
+		   sender deletes itself when that's done */
+		std::exchange(zero_copy, nullptr)->Orphan(shutdown);
+}
+
+bool
+FilteredSocket::ShouldZeroCopy(std::size_t size) const noexcept
+{
+	return zero_copy != nullptr && zero_copy->ShouldUse(size);
 }
 
 void
 FilteredSocket::Destroy() noexcept
 {
+#ifdef HAVE_URING
+	DisableUring();
+#endif
+
+	DisableZeroCopy(false);
+
 	filter.reset();
 	base.Destroy();
 }
 
+int
+FilteredSocket::AsFD() noexcept
+{
+	if (filter != nullptr)
+		return -1;
+
+#ifdef HAVE_URING
+	if (uring_writer != nullptr) {
+		if (!uring_writer->IsDrained())
+			/* data is still in flight */
+			return -1;
+
+		DisableUring();
+	}
+#endif
+
+	if (zero_copy != nullptr) {
+		if (!zero_copy->IsIdle())
+			/* the kernel may still read from our
+			   buffers */
+			return -1;
+
+		DisableZeroCopy(false);
+	}
+
+	return base.AsFD();
+}
+
+bool
+FilteredSocket::IsDrained() const noexcept
+{
+	assert(IsValid());
+
+#ifdef HAVE_URING
+	if (uring_writer != nullptr && !uring_writer->IsDrained())
+		return false;
+#endif
+
+	return drained;
+}
+
 bool
 FilteredSocket::IsEmpty() const noexcept
 {
@@ -225,9 +340,109 @@ FilteredSocket::Read() noexcept
 ssize_t
 FilteredSocket::Write(std::span<const std::byte> src) noexcept
 {
-	return filter != nullptr
-		? filter->Write(src)
-		: base.Write(src.data(), src.size());
+	if (filter != nullptr)
+		return filter->Write(src);
+
+#ifdef HAVE_URING
+	if (uring_writer != nullptr)
+		return uring_writer->Write(src);
+#endif
+
+	return base.Write(src.data(), src.size());
+}
+
+ssize_t
+FilteredSocket::WriteV(std::span<const struct iovec> v) noexcept
+{
+	assert(filter == nullptr);
+
+#ifdef HAVE_URING
+	if (uring_writer != nullptr)
+		return uring_writer->WriteV(v);
+#endif
+
+	return base.WriteV(v.data(), v.size());
+}
+
+ssize_t
+FilteredSocket::WriteZeroCopy(std::span<const struct iovec> v) noexcept
+{
+	assert(filter == nullptr);
+	assert(zero_copy != nullptr);
+#ifdef HAVE_URING
+	assert(uring_writer == nullptr);
+#endif
+
+	const ssize_t nbytes = zero_copy->Send(v);
+	if (nbytes >= 0) [[likely]]
+		return nbytes;
+
+	/* repeat the send without MSG_ZEROCOPY: this copies the
+	   data if the kernel is out of option memory for the
+	   notifications (ENOBUFS), and lets BufferedSocket deal
+	   with all other errors (schedule the write on EAGAIN,
+	   report broken pipes to the handler, ...) */
+	return base.WriteV(v.data(), v.size());
+}
+
+void
+FilteredSocket::HoldZeroCopy(ZeroCopyHoldList &holds) noexcept
+{
+	assert(zero_copy != nullptr);
+
+	zero_copy->Hold(holds);
+}
+
+bool
+FilteredSocket::IsReadyForWriting() const noexcept
+{
+	assert(filter == nullptr);
+
+#ifdef HAVE_URING
+	if (uring_writer != nullptr)
+		return !uring_writer->IsBusy();
+#endif
+
+	return base.IsReadyForWriting();
+}
+
+void
+FilteredSocket::DeferWrite() noexcept
+{
+	if (filter != nullptr)
+		filter->ScheduleWrite();
+#ifdef HAVE_URING
+	else if (uring_writer != nullptr)
+		uring_writer->ScheduleWrite();
+#endif
+	else
+		base.DeferWrite();
+}
+
+void
+FilteredSocket::ScheduleWrite() noexcept
+{
+	if (filter != nullptr)
+		filter->ScheduleWrite();
+#ifdef HAVE_URING
+	else if (uring_writer != nullptr)
+		uring_writer->ScheduleWrite();
+#endif
+	else
+		base.ScheduleWrite();
+}
+
+void
+FilteredSocket::UnscheduleWrite() noexcept
+{
+	if (filter != nullptr)
+		filter->UnscheduleWrite();
+#ifdef HAVE_URING
+	else if (uring_writer != nullptr)
+		uring_writer->UnscheduleWrite();
+#endif
+	else
+		base.UnscheduleWrite();
 }
 
 bool
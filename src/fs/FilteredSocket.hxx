@@ -13,6 +13,10 @@
 #include <span>
 
 class UniqueSocketDescriptor;
+class UringSocketWriter;
+class ZeroCopySender;
+class ZeroCopyHoldList;
+namespace Uring { class Queue; }
 
 /**
  * A wrapper for #BufferedSocket that can filter input and output.
@@ -35,6 +39,20 @@ class FilteredSocket final : BufferedSocketHandler {
 
 	BufferedSocketHandler *handler;
 
+#ifdef HAVE_URING
+	/**
+	 * If set, then all data (without a filter) is sent using
+	 * io_uring.  See EnableUring().
+	 */
+	UringSocketWriter *uring_writer = nullptr;
+#endif
+
+	/**
+	 * If set, then large sends (without a filter) may use
+	 * MSG_ZEROCOPY.  See EnableZeroCopy().
+	 */
+	ZeroCopySender *zero_copy = nullptr;
+
 	/**
 	 * Is there still data in the filter's output?  Once this turns
 	 * from "false" to "true", the #BufferedSocket_handler method
@@ -75,6 +93,58 @@ public:
 	void Reinit(Event::Duration write_timeout,
 		    BufferedSocketHandler &handler) noexcept;
 
+#ifdef HAVE_URING
+	/**
+	 * Send all data using io_uring instead of send().  This is
+	 * only possible if there is no filter.  It disables
+	 * splice() and sendfile() into this socket (see GetType()),
+	 * because all data gets copied; receiving is not affected.
+	 *
+	 * This is experimental.  If the socket cannot be duplicated,
+	 * this method does nothing.
+	 *
+	 * This must be called after InitDummy() and before
+	 * Reinit().
+	 */
+	void EnableUring(Uring::Queue &queue) noexcept;
+
+private:
+	void DisableUring() noexcept;
+
+public:
+#endif
+
+	/**
+	 * Allow sending large buffers with MSG_ZEROCOPY (see
+	 * WriteZeroCopy()).  This is only possible if there is no
+	 * filter.
+	 *
+	 * Throws on error (e.g. if the kernel doesn't support
+	 * SO_ZEROCOPY).
+	 *
+	 * @param threshold the minimum size of a send to use
+	 * MSG_ZEROCOPY
+	 */
+	void EnableZeroCopy(std::size_t threshold);
+
+	bool HasZeroCopy() const noexcept {
+		return zero_copy != nullptr;
+	}
+
+	/**
+	 * Shall a send of this size use WriteZeroCopy()?
+	 */
+	[[gnu::pure]]
+	bool ShouldZeroCopy(std::size_t size) const noexcept;
+
+private:
+	/**
+	 * @param shutdown shall the sending side be shut down
+	 * (because the socket is going to be closed)?
+	 */
+	void DisableZeroCopy(bool shutdown) noexcept;
+
+public:
 	bool HasFilter() const noexcept {
 		return filter != nullptr;
 	}
@@ -92,7 +162,30 @@ public:
 		return base.GetSocket();
 	}
 
+	/**
+	 * Returns the type for sending with WriteFrom(), i.e. which
+	 * sources may be spliced into this socket.
+	 */
 	FdType GetType() const noexcept {
+#ifdef HAVE_URING
+		if (uring_writer != nullptr)
+			/* the io_uring writer copies all data; a
+			   splice() or sendfile() outside of io_uring
+			   could overtake a send which is still in
+			   flight, therefore WriteFrom() is disabled */
+			return FdType::FD_NONE;
+#endif
+
+		return GetReadType();
+	}
+
+	/**
+	 * Returns the type for receiving with splice() from this
+	 * socket, e.g. for a request body.  Unlike GetType(), this is
+	 * not affected by EnableUring(), because receiving does not
+	 * use io_uring.
+	 */
+	FdType GetReadType() const noexcept {
 		return filter == nullptr
 			? base.GetType()
 			/* can't do splice() with a filter */
@@ -125,6 +218,12 @@ public:
 		if (filter != nullptr)
 			filter->OnClosed();
 
+#ifdef HAVE_URING
+		DisableUring();
+#endif
+
+		DisableZeroCopy(true);
+
 #ifndef NDEBUG
 		/* work around bogus assertion failure */
 		if (filter != nullptr && base.HasEnded())
@@ -143,6 +242,12 @@ public:
 		if (filter != nullptr)
 			filter->OnClosed();
 
+#ifdef HAVE_URING
+		DisableUring();
+#endif
+
+		DisableZeroCopy(false);
+
 #ifndef NDEBUG
 		/* work around bogus assertion failure */
 		if (filter != nullptr && base.HasEnded())
@@ -172,11 +277,7 @@ public:
 	 * Returns the socket descriptor and calls Abandon().  Returns -1
 	 * if the input buffer is not empty.
 	 */
-	int AsFD() noexcept {
-		return filter != nullptr
-			? -1
-			: base.AsFD();
-	}
+	int AsFD() noexcept;
 
 	/**
 	 * Is the socket still connected?  This does not actually check
@@ -202,13 +303,11 @@ public:
 	}
 
 	/**
-	 * Accessor for #drained.
+	 * Accessor for #drained (which also considers pending
+	 * io_uring send operations).
 	 */
-	bool IsDrained() const noexcept {
-		assert(IsValid());
-
-		return drained;
-	}
+	[[gnu::pure]]
+	bool IsDrained() const noexcept;
 
 	/**
 	 * Is the input buffer empty?
@@ -257,25 +356,36 @@ public:
 
 	ssize_t Write(std::span<const std::byte> src) noexcept;
 
-	ssize_t WriteV(std::span<const struct iovec> v) noexcept {
-		assert(filter == nullptr);
+	ssize_t WriteV(std::span<const struct iovec> v) noexcept;
 
-		return base.WriteV(v.data(), v.size());
-	}
+	/**
+	 * Like WriteV(), but send with MSG_ZEROCOPY.  The memory
+	 * must not be modified or freed until the kernel has
+	 * completed the send; pass ownership with HoldZeroCopy().
+	 *
+	 * Call this only if ShouldZeroCopy() returns true.
+	 */
+	ssize_t WriteZeroCopy(std::span<const struct iovec> v) noexcept;
+
+	/**
+	 * Keep the given memory (which was sent with
+	 * WriteZeroCopy()) until the kernel has completed all sends.
+	 * All holds are moved from the list.
+	 */
+	void HoldZeroCopy(ZeroCopyHoldList &holds) noexcept;
 
 	ssize_t WriteFrom(FileDescriptor fd, FdType fd_type, off_t *offset,
 			  std::size_t length) noexcept {
 		assert(filter == nullptr);
+#ifdef HAVE_URING
+		assert(!uring_writer);
+#endif
 
 		return base.WriteFrom(fd, fd_type, offset, length);
 	}
 
 	[[gnu::pure]]
-	bool IsReadyForWriting() const noexcept {
-		assert(filter == nullptr);
-
-		return base.IsReadyForWriting();
-	}
+	bool IsReadyForWriting() const noexcept;
 
 	/**
 	 * Wrapper for BufferedSocket::DeferRead().  This works only
@@ -297,26 +407,9 @@ public:
 	}
 
 
-	void DeferWrite() noexcept {
-		if (filter != nullptr)
-			filter->ScheduleWrite();
-		else
-			base.DeferWrite();
-	}
-
-	void ScheduleWrite() noexcept {
-		if (filter != nullptr)
-			filter->ScheduleWrite();
-		else
-			base.ScheduleWrite();
-	}
-
-	void UnscheduleWrite() noexcept {
-		if (filter != nullptr)
-			filter->UnscheduleWrite();
-		else
-			base.UnscheduleWrite();
-	}
+	void DeferWrite() noexcept;
+	void ScheduleWrite() noexcept;
+	void UnscheduleWrite() noexcept;
 
 	[[gnu::pure]]
 	bool InternalIsEmpty() const noexcept {
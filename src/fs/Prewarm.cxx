@@ -0,0 +1,132 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#include "Prewarm.hxx"
+#include "Stock.hxx"
+#include "Key.hxx"
+#include "FilteredSocket.hxx"
+#include "stock/Stats.hxx"
+#include "event/Loop.hxx"
+#include "util/StringBuilder.hxx"
+#include "stopwatch.hxx"
+
+#include <algorithm>
+#include <cassert>
+
+#include <stdlib.h>
+
+/**
+ * How often do we check whether new connections are needed?
+ */
+static constexpr Event::Duration PREWARM_CHECK_INTERVAL = std::chrono::seconds(10);
+
+/**
+ * Stop pre-opening connections if there was no demand for this
+ * long.
+ */
+static constexpr Event::Duration PREWARM_DEMAND_WINDOW = std::chrono::minutes(10);
+
+/**
+ * The upper limit for the back-off after connect failures.
+ */
+static constexpr Event::Duration PREWARM_MAX_BACKOFF = std::chrono::minutes(5);
+
+static std::string
+MakeKey(SocketAddress address, const SocketFilterFactory *filter_factory)
+{
+	char buffer[1024];
+	StringBuilder b(buffer);
+	MakeFilteredSocketStockKey(b, nullptr, SocketAddress::Null(), address,
+				   filter_factory);
+	return buffer;
+}
+
+FilteredSocketPrewarm::FilteredSocketPrewarm(FilteredSocketStock &_stock,
+					     SocketAddress _address,
+					     SocketFilterFactory *_filter_factory,
+					     ReferencedFailureInfo &_failure,
+					     const Event::TimePoint &_last_demand,
+					     Event::Duration _connect_timeout,
+					     unsigned _min_idle)
+	:stock(_stock), address(_address),
+	 filter_factory(_filter_factory),
+	 failure(_failure),
+	 key(MakeKey(_address, _filter_factory)),
+	 logger("prewarm " + key),
+	 last_demand(_last_demand),
+	 connect_timeout(_connect_timeout),
+	 min_idle(_min_idle),
+	 timer(stock.GetEventLoop(), BIND_THIS_METHOD(OnTimer))
+{
+	ScheduleCheck(PREWARM_CHECK_INTERVAL);
+}
+
+FilteredSocketPrewarm::~FilteredSocketPrewarm() noexcept
+{
+	if (cancel_ptr)
+		cancel_ptr.Cancel();
+}
+
+void
+FilteredSocketPrewarm::ScheduleCheck(Event::Duration delay) noexcept
+{
+	const auto max_jitter = delay.count() / 2 + 1;
+	timer.Schedule(delay + Event::Duration(random() % max_jitter));
+}
+
+void
+FilteredSocketPrewarm::OnTimer() noexcept
+{
+	assert(!cancel_ptr);
+
+	const auto now = stock.GetEventLoop().SteadyNow();
+	if (now - last_demand > PREWARM_DEMAND_WINDOW ||
+	    !failure->Check(now)) {
+		ScheduleCheck(PREWARM_CHECK_INTERVAL);
+		return;
+	}
+
+	StockStats stats{};
+	stock.AddStats(key.c_str(), stats);
+	if (stats.idle >= min_idle) {
+		ScheduleCheck(PREWARM_CHECK_INTERVAL);
+		return;
+	}
+
+	ConnectFilteredSocket(stock.GetEventLoop(), nullptr,
+			      false, SocketAddress::Null(), address,
+			      connect_timeout, filter_factory,
+			      *this, cancel_ptr);
+}
+
+void
+FilteredSocketPrewarm::OnConnectFilteredSocket(std::unique_ptr<FilteredSocket> socket) noexcept
+{
+	cancel_ptr = nullptr;
+	n_failures = 0;
+
+	stock.Add(key.c_str(), address, std::move(socket));
+
+	/* check again soon; there may be more connections missing */
+	ScheduleCheck(std::chrono::milliseconds(100));
+}
+
+void
+FilteredSocketPrewarm::OnConnectFilteredSocketError(std::exception_ptr e) noexcept
+{
+	cancel_ptr = nullptr;
+
+	logger(2, "Failed to connect: ", e);
+
+	/* let the balancer skip this destination, just like a failed
+	   connect of a real request would */
+	failure->SetConnect(stock.GetEventLoop().SteadyNow(),
+			    std::chrono::seconds(20));
+
+	if (n_failures < 8)
+		++n_failures;
+
+	ScheduleCheck(std::min<Event::Duration>(PREWARM_CHECK_INTERVAL * (1U << n_failures),
+						PREWARM_MAX_BACKOFF));
+}
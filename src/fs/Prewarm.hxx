@@ -0,0 +1,106 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#pragma once
+
+#include "Connect.hxx"
+#include "event/CoarseTimerEvent.hxx"
+#include "net/AllocatedSocketAddress.hxx"
+#include "net/FailureRef.hxx"
+#include "io/Logger.hxx"
+#include "util/Cancellable.hxx"
+
+#include <string>
+
+class FilteredSocketStock;
+class SocketFilterFactory;
+
+/**
+ * Keeps a minimum number of idle connections to one destination in a
+ * #FilteredSocketStock, so requests after a traffic lull (or after a
+ * failover) do not have to wait for the TCP connect and the TLS
+ * handshake.
+ *
+ * Connections are only opened while there has been recent demand
+ * and while the #FailureInfo does not report the destination as
+ * failed.  Only one connection is established at a time, and all
+ * timers are randomized so many destinations (or many processes) do
+ * not reconnect in lock-step.
+ */
+class FilteredSocketPrewarm final : ConnectFilteredSocketHandler {
+	FilteredSocketStock &stock;
+
+	const AllocatedSocketAddress address;
+
+	SocketFilterFactory *const filter_factory;
+
+	const FailurePtr failure;
+
+	/**
+	 * The #FilteredSocketStock key; it is the same as the one
+	 * generated by FilteredSocketStock::Get() for this
+	 * destination.
+	 */
+	const std::string key;
+
+	const LLogger logger;
+
+	/**
+	 * The time of the most recent request which may have been
+	 * sent to this destination.  The referenced variable is
+	 * owned and updated by the caller.
+	 */
+	const Event::TimePoint &last_demand;
+
+	const Event::Duration connect_timeout;
+
+	const unsigned min_idle;
+
+	/**
+	 * The number of consecutive connect failures; used for the
+	 * back-off.
+	 */
+	unsigned n_failures = 0;
+
+	CoarseTimerEvent timer;
+
+	/**
+	 * To cancel ConnectFilteredSocket().
+	 */
+	CancellablePointer cancel_ptr;
+
+public:
+	/**
+	 * Throws on error.
+	 *
+	 * @param filter_factory the #SocketFilterFactory which is
+	 * passed to FilteredSocketStock::Get(); it must remain valid
+	 * until this object is destroyed
+	 */
+	FilteredSocketPrewarm(FilteredSocketStock &_stock,
+			      SocketAddress _address,
+			      SocketFilterFactory *_filter_factory,
+			      ReferencedFailureInfo &_failure,
+			      const Event::TimePoint &_last_demand,
+			      Event::Duration _connect_timeout,
+			      unsigned _min_idle);
+
+	~FilteredSocketPrewarm() noexcept;
+
+	FilteredSocketPrewarm(const FilteredSocketPrewarm &) = delete;
+	FilteredSocketPrewarm &operator=(const FilteredSocketPrewarm &) = delete;
+
+private:
+	/**
+	 * Schedule the next check after the given delay plus a random
+	 * amount of up to half of it.
+	 */
+	void ScheduleCheck(Event::Duration delay) noexcept;
+
+	void OnTimer() noexcept;
+
+	/* virtual methods from class ConnectFilteredSocketHandler */
+	void OnConnectFilteredSocket(std::unique_ptr<FilteredSocket> socket) noexcept override;
+	void OnConnectFilteredSocketError(std::exception_ptr e) noexcept override;
+};
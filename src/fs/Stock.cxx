@@ -24,6 +24,8 @@
 #include <cassert>
 #include <memory>
 
+#include <stdlib.h>
+
 struct FilteredSocketStockRequest {
 	StopwatchPtr stopwatch;
 
@@ -99,6 +101,9 @@ public:
 		 idle_timer(c.stock.GetEventLoop(),
 			    BIND_THIS_METHOD(OnIdleTimeout))
 	{
+		/* this connection goes straight to the idle list, so
+		   watch it like a released one */
+		SetIdle();
 	}
 
 	~FilteredSocketStockConnection() override {
@@ -132,6 +137,21 @@ public:
 	}
 
 private:
+	/**
+	 * Watch the idle socket for hangups and start the idle timer.
+	 * The timeout is randomized so connections which were
+	 * created at the same time (e.g. by #FilteredSocketPrewarm)
+	 * don't expire all at once.
+	 */
+	void SetIdle() noexcept {
+		socket->Reinit(Event::Duration(-1), *this);
+		socket->UnscheduleWrite();
+
+		socket->ScheduleRead();
+		idle_timer.Schedule(std::chrono::minutes(1) +
+				    std::chrono::milliseconds(random() % 15000));
+	}
+
 	void OnIdleTimeout() noexcept {
 		InvokeIdleDisconnect();
 	}
@@ -278,12 +298,7 @@ FilteredSocketStockConnection::Release() noexcept
 		return false;
 	}
 
-	socket->Reinit(Event::Duration(-1), *this);
-	socket->UnscheduleWrite();
-
-	socket->ScheduleRead();
-	idle_timer.Schedule(std::chrono::minutes(1));
-
+	SetIdle();
 	return true;
 }
 
@@ -332,6 +347,12 @@ FilteredSocketStock::Get(AllocatorPtr alloc,
 	stock.Get(key, std::move(request), handler, cancel_ptr);
 }
 
+void
+FilteredSocketStock::AddStats(const char *key, StockStats &data) noexcept
+{
+	stock.GetStock(key, nullptr).AddStats(data);
+}
+
 void
 FilteredSocketStock::Add(const char *key, SocketAddress address,
 			 std::unique_ptr<FilteredSocket> socket) noexcept
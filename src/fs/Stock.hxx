@@ -45,6 +45,13 @@ public:
 		stock.AddStats(data);
 	}
 
+	/**
+	 * Add the statistics of the connections with the given key.
+	 *
+	 * @param key a string generated with MakeFilteredSocketStockKey()
+	 */
+	void AddStats(const char *key, StockStats &data) noexcept;
+
 	void FadeAll() noexcept {
 		stock.FadeAll();
 	}
@@ -72,7 +79,9 @@ public:
 		 CancellablePointer &cancel_ptr) noexcept;
 
 	/**
-	 * Add a newly connected socket to the stock.
+	 * Add a newly connected socket to the stock.  It becomes idle
+	 * and can be obtained by the next Get() call with the same
+	 * key.
 	 *
 	 * @param key a string generated with MakeFilteredSocketStockKey()
 	 */
@@ -0,0 +1,199 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#include "UringSocketWriter.hxx"
+#include "event/net/BufferedSocket.hxx"
+#include "io/uring/Queue.hxx"
+#include "memory/fb_pool.hxx"
+#include "system/Error.hxx"
+
+#include <algorithm>
+
+#include <assert.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+/**
+ * Owns the buffer and the socket of a #UringSocketWriter which was
+ * destroyed while its send operation was still in flight.
+ */
+class CanceledUringSocketWriter final : public Uring::Operation {
+	SliceFifoBuffer buffer;
+
+	/**
+	 * Keeps the file descriptor number allocated until the
+	 * operation completes, so it cannot be reused for another
+	 * connection while the (maybe not yet submitted) send
+	 * operation refers to it.
+	 */
+	UniqueSocketDescriptor fd;
+
+public:
+	CanceledUringSocketWriter(SliceFifoBuffer &&_buffer,
+				  UniqueSocketDescriptor &&_fd) noexcept
+		:buffer(std::move(_buffer)), fd(std::move(_fd)) {}
+
+	void OnUringCompletion(int) noexcept override {
+		/* ignore the result and delete this object, which
+		   will free the buffer and close the socket */
+		delete this;
+	}
+};
+
+UringSocketWriter::UringSocketWriter(EventLoop &event_loop,
+				     Uring::Queue &_queue,
+				     UniqueSocketDescriptor &&_fd) noexcept
+	:queue(_queue), fd(std::move(_fd)),
+	 defer_write(event_loop, BIND_THIS_METHOD(OnDeferredWrite)),
+	 timeout_event(event_loop, BIND_THIS_METHOD(OnTimeout))
+{
+}
+
+UringSocketWriter::~UringSocketWriter() noexcept
+{
+	if (IsUringPending()) {
+		/* the kernel may still read from the buffer; pass
+		   ownership to an object which lives until the
+		   operation completes */
+		assert(buffer.IsDefined());
+
+		auto *c = new CanceledUringSocketWriter(std::move(buffer),
+							std::move(fd));
+		ReplaceUring(*c);
+	}
+}
+
+inline std::span<std::byte>
+UringSocketWriter::PrepareBuffer() noexcept
+{
+	assert(!IsBusy());
+	assert(buffer.empty());
+
+	if (buffer.IsNull())
+		buffer.Allocate(fb_pool_get());
+
+	return buffer.Write();
+}
+
+void
+UringSocketWriter::StartSend() noexcept
+{
+	assert(!IsUringPending());
+	assert(!buffer.empty());
+
+	const auto r = buffer.Read();
+
+	auto &s = queue.RequireSubmitEntry();
+	io_uring_prep_send(&s, fd.Get(), r.data(), r.size(), MSG_NOSIGNAL);
+	queue.Push(s, *this);
+
+	defer_write.Cancel();
+
+	if (write_timeout > Event::Duration{})
+		timeout_event.Schedule(write_timeout);
+}
+
+ssize_t
+UringSocketWriter::Write(std::span<const std::byte> src) noexcept
+{
+	assert(!src.empty());
+
+	if (IsBusy())
+		return WRITE_BLOCKING;
+
+	const auto w = PrepareBuffer();
+	const std::size_t n = std::min(src.size(), w.size());
+	memcpy(w.data(), src.data(), n);
+	buffer.Append(n);
+
+	StartSend();
+	return n;
+}
+
+ssize_t
+UringSocketWriter::WriteV(std::span<const struct iovec> v) noexcept
+{
+	if (IsBusy())
+		return WRITE_BLOCKING;
+
+	auto w = PrepareBuffer();
+	std::size_t total = 0;
+
+	for (const auto &i : v) {
+		const std::size_t n = std::min(i.iov_len, w.size());
+		memcpy(w.data(), i.iov_base, n);
+		w = w.subspan(n);
+		total += n;
+
+		if (w.empty())
+			break;
+	}
+
+	if (total == 0)
+		return 0;
+
+	buffer.Append(total);
+
+	StartSend();
+	return total;
+}
+
+inline void
+UringSocketWriter::OnDeferredWrite() noexcept
+{
+	assert(handler != nullptr);
+	assert(want_write);
+	assert(!IsBusy());
+
+	try {
+		if (!handler->OnBufferedWrite())
+			return;
+	} catch (...) {
+		handler->OnBufferedError(std::current_exception());
+		return;
+	}
+
+	/* like a socket which is still writable: keep calling the
+	   handler until it unschedules */
+	if (want_write && !IsBusy())
+		defer_write.Schedule();
+}
+
+inline void
+UringSocketWriter::OnTimeout() noexcept
+{
+	assert(handler != nullptr);
+	assert(IsBusy());
+
+	handler->OnBufferedTimeout();
+}
+
+void
+UringSocketWriter::OnUringCompletion(int res) noexcept
+{
+	assert(handler != nullptr);
+
+	timeout_event.Cancel();
+
+	if (res < 0) {
+		handler->OnBufferedError(std::make_exception_ptr(MakeErrno(-res, "Failed to send")));
+		return;
+	}
+
+	buffer.Consume(res);
+	if (!buffer.empty()) {
+		/* short send; submit the rest */
+		StartSend();
+		return;
+	}
+
+	buffer.Free();
+
+	if (!handler->OnBufferedDrained())
+		return;
+
+	if (want_write)
+		defer_write.Schedule();
+}
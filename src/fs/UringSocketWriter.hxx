@@ -0,0 +1,139 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#pragma once
+
+#include "event/CoarseTimerEvent.hxx"
+#include "event/DeferEvent.hxx"
+#include "event/Chrono.hxx"
+#include "io/uring/Operation.hxx"
+#include "memory/SliceFifoBuffer.hxx"
+#include "net/UniqueSocketDescriptor.hxx"
+
+#include <cstddef>
+#include <span>
+
+#include <sys/types.h> // for ssize_t
+
+struct iovec;
+class EventLoop;
+class BufferedSocketHandler;
+namespace Uring { class Queue; }
+
+/**
+ * Sends data to a socket using io_uring instead of send().  Data
+ * passed to Write() is copied to a buffer and the send operation is
+ * submitted to the io_uring, which means the kernel call is batched
+ * with those of all other connections.  Only one operation may be in
+ * flight; meanwhile, Write() returns #WRITE_BLOCKING and the
+ * #BufferedSocketHandler gets notified when it completes.
+ *
+ * This is used by #FilteredSocket (without a #SocketFilter) instead
+ * of BufferedSocket::Write().
+ *
+ * This is experimental and disabled by default.  Limitations: this
+ * covers only the send side (receiving still uses
+ * #BufferedSocket), every byte is copied into one fb_pool slice
+ * (there is no zero-copy send and no registered buffer), and there
+ * is no equivalent of BufferedSocket::WriteFrom(), so splice() and
+ * sendfile() into the socket are not available.
+ */
+class UringSocketWriter final : Uring::Operation {
+	Uring::Queue &queue;
+
+	/**
+	 * A duplicate of the #FilteredSocket's file descriptor.  It
+	 * is owned by this object (and by #CanceledUringSocketWriter
+	 * after destruction) because the send operation may be
+	 * submitted after the #FilteredSocket has closed its file
+	 * descriptor; the number would then refer to whatever file
+	 * was opened next.
+	 */
+	UniqueSocketDescriptor fd;
+
+	BufferedSocketHandler *handler = nullptr;
+
+	Event::Duration write_timeout{-1};
+
+	/**
+	 * Invokes BufferedSocketHandler::OnBufferedWrite() while the
+	 * socket is ready for writing, i.e. there is no pending send
+	 * operation.
+	 */
+	DeferEvent defer_write;
+
+	CoarseTimerEvent timeout_event;
+
+	/**
+	 * The data which is currently being sent.  It is only
+	 * allocated while an operation is in flight.
+	 */
+	SliceFifoBuffer buffer;
+
+	/**
+	 * Has the handler scheduled a write?
+	 */
+	bool want_write = false;
+
+public:
+	/**
+	 * @param _fd a duplicate of the socket's file descriptor
+	 */
+	UringSocketWriter(EventLoop &event_loop, Uring::Queue &_queue,
+			  UniqueSocketDescriptor &&_fd) noexcept;
+	~UringSocketWriter() noexcept;
+
+	UringSocketWriter(const UringSocketWriter &) = delete;
+	UringSocketWriter &operator=(const UringSocketWriter &) = delete;
+
+	void SetHandler(Event::Duration _write_timeout,
+			BufferedSocketHandler &_handler) noexcept {
+		write_timeout = _write_timeout;
+		handler = &_handler;
+	}
+
+	/**
+	 * Is a send operation in flight?
+	 */
+	bool IsBusy() const noexcept {
+		return IsUringPending();
+	}
+
+	/**
+	 * Has all data been handed to the kernel?
+	 */
+	bool IsDrained() const noexcept {
+		return !IsBusy();
+	}
+
+	ssize_t Write(std::span<const std::byte> src) noexcept;
+	ssize_t WriteV(std::span<const struct iovec> v) noexcept;
+
+	void ScheduleWrite() noexcept {
+		want_write = true;
+
+		if (!IsBusy())
+			defer_write.Schedule();
+	}
+
+	void UnscheduleWrite() noexcept {
+		want_write = false;
+		defer_write.Cancel();
+	}
+
+private:
+	/**
+	 * Allocate the buffer (if necessary) and return its writable
+	 * tail.
+	 */
+	std::span<std::byte> PrepareBuffer() noexcept;
+
+	void StartSend() noexcept;
+
+	void OnDeferredWrite() noexcept;
+	void OnTimeout() noexcept;
+
+	/* virtual methods from class Uring::Operation */
+	void OnUringCompletion(int res) noexcept override;
+};
@@ -0,0 +1,207 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#include "ZeroCopySender.hxx"
+#include "system/Error.hxx"
+
+#include <cassert>
+
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <linux/errqueue.h> // after sys/socket.h for struct timespec
+
+/**
+ * How long does an orphaned #ZeroCopySender wait for the peer to
+ * acknowledge the remaining data before it resets the connection?
+ */
+static constexpr Event::Duration ZERO_COPY_LINGER = std::chrono::seconds(30);
+
+ZeroCopySender::ZeroCopySender(EventLoop &event_loop,
+			       UniqueSocketDescriptor &&_fd,
+			       std::size_t _threshold) noexcept
+	:fd(std::move(_fd)),
+	 event(event_loop, BIND_THIS_METHOD(OnSocketReady), fd),
+	 linger_timer(event_loop, BIND_THIS_METHOD(OnLingerTimeout)),
+	 threshold(_threshold)
+{
+	event.Schedule(SocketEvent::ERROR);
+}
+
+ZeroCopySender *
+ZeroCopySender::Create(EventLoop &event_loop, SocketDescriptor s,
+		       std::size_t threshold)
+{
+	if (!s.SetBoolOption(SOL_SOCKET, SO_ZEROCOPY, true))
+		throw MakeErrno("Failed to set SO_ZEROCOPY");
+
+	UniqueSocketDescriptor fd(dup(s.Get()));
+	if (!fd.IsDefined())
+		throw MakeErrno("Failed to duplicate socket");
+
+	return new ZeroCopySender(event_loop, std::move(fd), threshold);
+}
+
+ZeroCopySender::~ZeroCopySender() noexcept
+{
+	event.Cancel();
+
+	pending.clear_and_dispose([](PendingSend *s){
+		delete s;
+	});
+}
+
+ssize_t
+ZeroCopySender::Send(std::span<const struct iovec> v) noexcept
+{
+	assert(!orphaned);
+	assert(!v.empty());
+
+	/* collect completions now, so the error queue doesn't fill
+	   up (which would make sendmsg() fail with ENOBUFS) */
+	ReceiveCompletions();
+
+	struct msghdr m{};
+	m.msg_iov = const_cast<struct iovec *>(v.data());
+	m.msg_iovlen = v.size();
+
+	const ssize_t nbytes = sendmsg(fd.Get(), &m,
+				       MSG_ZEROCOPY|MSG_DONTWAIT|MSG_NOSIGNAL);
+	if (nbytes <= 0)
+		/* the kernel counts only successful calls */
+		return nbytes;
+
+	pending.push_back(*new PendingSend(next_id++));
+	return nbytes;
+}
+
+void
+ZeroCopySender::Hold(ZeroCopyHoldList &holds) noexcept
+{
+	assert(!orphaned);
+
+	if (pending.empty())
+		holds.Clear();
+	else
+		pending.back().holds.MoveFrom(holds);
+}
+
+void
+ZeroCopySender::Orphan(bool shutdown) noexcept
+{
+	assert(!orphaned);
+
+	ReceiveCompletions();
+
+	if (pending.empty()) {
+		delete this;
+		return;
+	}
+
+	orphaned = true;
+
+	if (shutdown)
+		/* flush the remaining data and then send FIN, just
+		   like close() would have done if it weren't for our
+		   duplicate descriptor */
+		::shutdown(fd.Get(), SHUT_WR);
+
+	linger_timer.Schedule(ZERO_COPY_LINGER);
+}
+
+bool
+ZeroCopySender::ReceiveCompletions() noexcept
+{
+	bool result = false;
+
+	while (true) {
+		alignas(struct cmsghdr) std::byte control[CMSG_SPACE(sizeof(struct sock_extended_err)) + 64];
+
+		struct msghdr m{};
+		m.msg_control = control;
+		m.msg_controllen = sizeof(control);
+
+		if (recvmsg(fd.Get(), &m, MSG_ERRQUEUE|MSG_DONTWAIT) < 0)
+			/* EAGAIN: the error queue is empty */
+			break;
+
+		for (auto *cmsg = CMSG_FIRSTHDR(&m); cmsg != nullptr;
+		     cmsg = CMSG_NXTHDR(&m, cmsg)) {
+			if (!(cmsg->cmsg_level == SOL_IP &&
+			      cmsg->cmsg_type == IP_RECVERR) &&
+			    !(cmsg->cmsg_level == SOL_IPV6 &&
+			      cmsg->cmsg_type == IPV6_RECVERR))
+				continue;
+
+			struct sock_extended_err e;
+			memcpy(&e, CMSG_DATA(cmsg), sizeof(e));
+
+			if (e.ee_errno != 0 ||
+			    e.ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+				continue;
+
+			if (e.ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+				copied = true;
+
+			/* the range of completed sendmsg() calls
+			   (inclusive) */
+			Complete(e.ee_info, e.ee_data);
+			result = true;
+		}
+	}
+
+	return result;
+}
+
+void
+ZeroCopySender::Complete(uint32_t first, uint32_t last) noexcept
+{
+	pending.remove_and_dispose_if([first, last](const PendingSend &s){
+		/* unsigned arithmetic handles counter wraparound */
+		return uint32_t(s.id - first) <= uint32_t(last - first);
+	}, [](PendingSend *s){
+		delete s;
+	});
+}
+
+inline void
+ZeroCopySender::OnSocketReady(unsigned events) noexcept
+{
+	if (!ReceiveCompletions() && (events & SocketEvent::ERROR) != 0)
+		/* no notification, so this must be a real socket
+		   error; clear it to avoid busy-looping on EPOLLERR
+		   (the owner's next send will fail anyway) */
+		fd.GetError();
+
+	if (orphaned && pending.empty()) {
+		delete this;
+		return;
+	}
+
+	if (events & SocketEvent::HANGUP)
+		/* EPOLLHUP is level-triggered and can't be masked;
+		   from now on, completions are collected only by
+		   Send() and by the linger timer */
+		event.Cancel();
+}
+
+void
+ZeroCopySender::OnLingerTimeout() noexcept
+{
+	assert(orphaned);
+
+	ReceiveCompletions();
+
+	if (!pending.empty()) {
+		/* the peer doesn't acknowledge our data; reset the
+		   connection, which makes the kernel drop its
+		   references to our pages */
+		static constexpr struct linger l{1, 0};
+		fd.SetOption(SOL_SOCKET, SO_LINGER, &l, sizeof(l));
+	}
+
+	delete this;
+}
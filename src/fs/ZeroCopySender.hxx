@@ -0,0 +1,175 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#pragma once
+
+#include "memory/ZeroCopyHold.hxx"
+#include "event/SocketEvent.hxx"
+#include "event/CoarseTimerEvent.hxx"
+#include "net/UniqueSocketDescriptor.hxx"
+#include "util/IntrusiveList.hxx"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include <sys/types.h> // for ssize_t
+
+struct iovec;
+
+/**
+ * Sends data with MSG_ZEROCOPY and keeps the memory alive
+ * (#ZeroCopyHold) until the kernel reports completion on the
+ * socket's error queue.
+ *
+ * It operates on a duplicate of the socket descriptor, which
+ * allows it to register its own #SocketEvent (for EPOLLERR) and to
+ * outlive the connection: if the owner goes away while sends are
+ * still in flight, it calls Orphan() instead of deleting this
+ * object, and the object deletes itself after the last completion.
+ *
+ * This is used by #FilteredSocket (without a #SocketFilter); see
+ * FilteredSocket::EnableZeroCopy().
+ */
+class ZeroCopySender final {
+	/**
+	 * A duplicate of the socket descriptor passed to the
+	 * constructor.
+	 */
+	UniqueSocketDescriptor fd;
+
+	/**
+	 * Monitors #fd for EPOLLERR, which indicates pending
+	 * completion notifications.
+	 */
+	SocketEvent event;
+
+	/**
+	 * Only used by orphans: gives up if the peer doesn't
+	 * acknowledge the data in time.
+	 */
+	CoarseTimerEvent linger_timer;
+
+	/**
+	 * One successful sendmsg(MSG_ZEROCOPY) call.
+	 */
+	struct PendingSend final : IntrusiveListHook<IntrusiveHookMode::NORMAL> {
+		/**
+		 * The kernel's counter value for this call.
+		 */
+		const uint32_t id;
+
+		/**
+		 * The memory which the kernel may still read.
+		 */
+		ZeroCopyHoldList holds;
+
+		explicit PendingSend(uint32_t _id) noexcept
+			:id(_id) {}
+	};
+
+	IntrusiveList<PendingSend> pending;
+
+	/**
+	 * The counter value of the next successful send.  The kernel
+	 * counts all sendmsg(MSG_ZEROCOPY) calls on the socket,
+	 * starting at zero.
+	 */
+	uint32_t next_id = 0;
+
+	/**
+	 * Sends smaller than this are not worth the completion
+	 * overhead and should be copied.
+	 */
+	const std::size_t threshold;
+
+	/**
+	 * Has the kernel reported that it copied the data anyway
+	 * (e.g. because the route or the network device doesn't
+	 * support zero-copy)?  In that case, MSG_ZEROCOPY is only
+	 * overhead, and we stop using it.
+	 */
+	bool copied = false;
+
+	/**
+	 * Has Orphan() been called?
+	 */
+	bool orphaned = false;
+
+	ZeroCopySender(EventLoop &event_loop, UniqueSocketDescriptor &&_fd,
+		       std::size_t _threshold) noexcept;
+
+public:
+	/**
+	 * Enable SO_ZEROCOPY on the given socket and create a new
+	 * instance.
+	 *
+	 * Throws on error (e.g. if the kernel doesn't support
+	 * SO_ZEROCOPY on this socket).
+	 */
+	static ZeroCopySender *Create(EventLoop &event_loop, SocketDescriptor s,
+				      std::size_t threshold);
+
+	~ZeroCopySender() noexcept;
+
+	ZeroCopySender(const ZeroCopySender &) = delete;
+	ZeroCopySender &operator=(const ZeroCopySender &) = delete;
+
+	/**
+	 * Shall a send of this size use MSG_ZEROCOPY?
+	 */
+	bool ShouldUse(std::size_t size) const noexcept {
+		return !copied && size >= threshold;
+	}
+
+	/**
+	 * Are there no sends in flight?
+	 */
+	bool IsIdle() const noexcept {
+		return pending.empty();
+	}
+
+	/**
+	 * Send data with sendmsg(MSG_ZEROCOPY).
+	 *
+	 * @return the number of bytes sent or -1 on error (with
+	 * errno set); the caller may retry the send without
+	 * MSG_ZEROCOPY
+	 */
+	ssize_t Send(std::span<const struct iovec> v) noexcept;
+
+	/**
+	 * Keep the given memory until the most recent Send() has
+	 * completed (which implies that all previous ones have
+	 * completed, too).  If nothing is in flight, the holds are
+	 * released right away.
+	 */
+	void Hold(ZeroCopyHoldList &holds) noexcept;
+
+	/**
+	 * The owner doesn't need this object anymore.  It deletes
+	 * itself (maybe right now) as soon as all sends have
+	 * completed.
+	 *
+	 * @param shutdown shall the sending side of the socket be
+	 * shut down?  This must be set if the owner is going to close
+	 * the socket: closing its descriptor does not close the
+	 * connection while our duplicate is still open.
+	 */
+	void Orphan(bool shutdown) noexcept;
+
+private:
+	/**
+	 * Read all notifications from the socket's error queue and
+	 * release the holds of completed sends.
+	 *
+	 * @return true if at least one notification was received
+	 */
+	bool ReceiveCompletions() noexcept;
+
+	void Complete(uint32_t first, uint32_t last) noexcept;
+
+	void OnSocketReady(unsigned events) noexcept;
+	void OnLingerTimeout() noexcept;
+};
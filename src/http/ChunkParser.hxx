@@ -10,10 +10,13 @@
 #include <cassert>
 #include <algorithm>
 #include <cstddef>
+#include <limits>
 #include <stdexcept>
 #include <span>
 #include <string_view>
 
+#include <string.h>
+
 /**
  * Incremental parser for "Transfer-Encoding:chunked".
  */
@@ -31,6 +34,21 @@ class HttpChunkParser {
 
 	size_t remaining_chunk;
 
+	/**
+	 * @return the value of the given hex digit or -1 if it is not
+	 * a hex digit
+	 */
+	static constexpr int ParseHexDigit(char ch) noexcept {
+		if (ch >= '0' && ch <= '9')
+			return ch - '0';
+		else if (ch >= 'a' && ch <= 'f')
+			return ch - 'a' + 0xa;
+		else if (ch >= 'A' && ch <= 'F')
+			return ch - 'A' + 0xa;
+		else
+			return -1;
+	}
+
 public:
 	bool HasEnded() const {
 		return state == State::END;
@@ -39,6 +57,11 @@ public:
 	/**
 	 * Find the next data chunk.
 	 *
+	 * The chunk framing is not parsed one character per state
+	 * transition: the size is parsed in a tight loop, and line
+	 * ends (after chunk extensions and trailer lines) are located
+	 * with memchr(), which is vectorized by the C library.
+	 *
 	 * Throws exception on error.
 	 *
 	 * @return a pointer to the data chunk, an empty chunk pointing to
@@ -70,79 +93,90 @@ std::span<const std::byte>
 HttpChunkParser::Parse(std::span<const std::byte> _input)
 {
 	const auto input = ToStringView(_input);
-	auto p = input.begin();
-	const auto end = input.end();
-	size_t digit;
+	const char *p = input.data();
+	const char *const end = p + input.size();
 
 	while (p != end) {
 		assert(p < end);
 
-		const auto ch = *p;
 		switch (state) {
 		case State::NONE:
-		case State::SIZE:
-			if (ch >= '0' && ch <= '9') {
-				digit = ch - '0';
-			} else if (ch >= 'a' && ch <= 'f') {
-				digit = ch - 'a' + 0xa;
-			} else if (ch >= 'A' && ch <= 'F') {
-				digit = ch - 'A' + 0xa;
-			} else if (state == State::SIZE) {
-				state = State::AFTER_SIZE;
-				continue;
-			} else {
+			if (ParseHexDigit(*p) < 0)
 				throw std::runtime_error("chunk length expected");
-			}
 
-			if (state == State::NONE) {
-				state = State::SIZE;
-				remaining_chunk = 0;
-			}
+			state = State::SIZE;
+			remaining_chunk = 0;
+			[[fallthrough]];
 
-			++p;
-			remaining_chunk = remaining_chunk * 0x10 + digit;
+		case State::SIZE:
+			do {
+				const int digit = ParseHexDigit(*p);
+				if (digit < 0) {
+					state = State::AFTER_SIZE;
+					break;
+				}
+
+				if (remaining_chunk > std::numeric_limits<size_t>::max() / 0x10)
+					throw std::runtime_error("chunk length too large");
+
+				remaining_chunk = remaining_chunk * 0x10 + digit;
+				++p;
+			} while (p != end);
 			break;
 
 		case State::AFTER_SIZE:
-			if (ch == '\n') {
+			/* skip chunk extensions up to the end of the
+			   line */
+			if (const char *newline = (const char *)memchr(p, '\n', end - p)) {
+				p = newline + 1;
+
 				if (remaining_chunk == 0)
 					state = State::TRAILER;
 				else
 					state = State::DATA;
-			}
-
-			++p;
+			} else
+				p = end;
 			break;
 
 		case State::DATA:
 			assert(remaining_chunk > 0);
 
-			return AsBytes({p, std::min(size_t(end - p), remaining_chunk)});
+			return AsBytes(std::string_view{p, std::min(size_t(end - p), remaining_chunk)});
 
 		case State::AFTER_DATA:
-			if (ch == '\n') {
+			if (end - p >= 2 && p[0] == '\r' && p[1] == '\n') {
+				/* fast path for the usual CRLF */
+				p += 2;
 				state = State::NONE;
-			} else if (ch != '\r') {
+				break;
+			}
+
+			if (*p == '\n') {
+				state = State::NONE;
+			} else if (*p != '\r') {
 				throw std::runtime_error("newline expected");
 			}
 
 			++p;
 			break;
 
-		case State::TRAILER:
-			++p;
+		case State::TRAILER: {
+			const char ch = *p++;
 			if (ch == '\n') {
 				state = State::END;
-				return AsBytes({p, 0});
+				return AsBytes(std::string_view{p, 0});
 			} else if (ch != '\r') {
 				state = State::TRAILER_DATA;
 			}
 			break;
+		}
 
 		case State::TRAILER_DATA:
-			++p;
-			if (ch == '\n')
+			if (const char *newline = (const char *)memchr(p, '\n', end - p)) {
+				p = newline + 1;
 				state = State::TRAILER;
+			} else
+				p = end;
 			break;
 
 		case State::END:
@@ -151,5 +185,5 @@ HttpChunkParser::Parse(std::span<const std::byte> _input)
 		}
 	}
 
-	return AsBytes({p, 0});
+	return AsBytes(std::string_view{p, 0});
 }
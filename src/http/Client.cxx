@@ -352,7 +352,7 @@ private:
 	/**
 	 * Throws on error.
 	 */
-	void HandleLine(std::string_view line);
+	void HandleLine(std::string_view line, const HeaderLineCopy &copy);
 
 	/**
 	 * Throws on error.
@@ -773,7 +773,7 @@ HttpClient::HeadersFinished()
 }
 
 inline void
-HttpClient::HandleLine(std::string_view line)
+HttpClient::HandleLine(std::string_view line, const HeaderLineCopy &copy)
 {
 	assert(response.state == Response::State::STATUS ||
 	       response.state == Response::State::HEADERS);
@@ -781,7 +781,8 @@ HttpClient::HandleLine(std::string_view line)
 	if (response.state == Response::State::STATUS)
 		ParseStatusLine(line);
 	else if (!line.empty()) {
-		if (!header_parse_line(caller_pool, response.headers, line))
+		if (!header_parse_line_in_place(caller_pool, response.headers,
+						copy.Translate(line)))
 			throw HttpClientError(HttpClientErrorCode::GARBAGE,
 					      "malformed HTTP header line");
 	} else
@@ -813,6 +814,10 @@ HttpClient::ParseHeaders(const std::string_view b)
 	       response.state == Response::State::HEADERS);
 	assert(!b.empty());
 
+	/* the header lines are copied to the caller pool once, and
+	   the response header map points into this copy */
+	HeaderLineCopy copy;
+
 	/* parse line by line */
 	std::string_view remaining = b;
 	while (true) {
@@ -821,10 +826,15 @@ HttpClient::ParseHeaders(const std::string_view b)
 			break;
 
 		std::string_view line = s.first;
+
+		if (response.state == Response::State::HEADERS &&
+		    !line.empty() && !copy.IsDefined())
+			copy.Copy(caller_pool, remaining);
+
 		remaining = s.second;
 
 		/* handle this line */
-		HandleLine(StripRight(line));
+		HandleLine(StripRight(line), copy);
 
 		if (response.state != Response::State::HEADERS) {
 			/* header parsing is finished */
@@ -11,9 +11,11 @@
 #include "util/StaticFifoBuffer.hxx"
 #include "util/StringSplit.hxx"
 #include "util/StringStrip.hxx"
+#include "util/CharUtil.hxx"
 #include "AllocatorPtr.hxx"
 
 #include <algorithm>
+#include <cstdint>
 
 #include <string.h>
 
@@ -23,34 +25,138 @@ IsValidHeaderValueChar(char ch) noexcept
 	return ch != '\0' && ch != '\n' && ch != '\r';
 }
 
+static constexpr uint64_t
+RepeatByte(uint8_t ch) noexcept
+{
+	return 0x0101010101010101ULL * ch;
+}
+
+/**
+ * Returns non-zero if one of the bytes in the given word is zero.
+ */
+static constexpr uint64_t
+HasZeroByte(uint64_t v) noexcept
+{
+	return (v - RepeatByte(0x01)) & ~v & RepeatByte(0x80);
+}
+
+/**
+ * Check for NUL, CR and LF eight bytes at a time ("SIMD within a
+ * register"); header values are usually too short for memchr() to
+ * pay off, let alone three of them.
+ */
 [[gnu::pure]]
 static bool
 IsValidHeaderValue(std::string_view value) noexcept
 {
-	for (char ch : value)
-		if (!IsValidHeaderValueChar(ch))
+	const char *p = value.data();
+	const char *const end = p + value.size();
+
+	for (; end - p >= 8; p += 8) {
+		uint64_t v;
+		memcpy(&v, p, sizeof(v));
+
+		if (HasZeroByte(v) |
+		    HasZeroByte(v ^ RepeatByte('\n')) |
+		    HasZeroByte(v ^ RepeatByte('\r')))
+			return false;
+	}
+
+	for (; p < end; ++p)
+		if (!IsValidHeaderValueChar(*p))
 			return false;
 
 	return true;
 }
 
+/**
+ * Validate a header line.
+ *
+ * @return the position of the colon or std::string_view::npos on
+ * error
+ */
+[[gnu::pure]]
+static std::size_t
+CheckHeaderLine(std::string_view line) noexcept
+{
+	const auto colon = line.find(':');
+	if (colon == line.npos ||
+	    !http_header_name_valid(line.substr(0, colon)) ||
+	    !IsValidHeaderValue(line.substr(colon + 1))) [[unlikely]]
+		return line.npos;
+
+	return colon;
+}
+
+/**
+ * Convert the (validated) line in place and add it to the map.
+ */
+static void
+AddHeaderLine(AllocatorPtr alloc, StringMap &headers,
+	      std::span<char> line, std::size_t colon) noexcept
+{
+	char *const name = line.data();
+	for (std::size_t i = 0; i < colon; ++i)
+		name[i] = ToLowerASCII(name[i]);
+	name[colon] = 0;
+
+	char *const end = line.data() + line.size();
+	const char *value = StripLeft(name + colon + 1, end);
+	*end = 0;
+
+	headers.Add(alloc, name, value);
+}
+
 bool
 header_parse_line(AllocatorPtr alloc, StringMap &headers,
 		  std::string_view line) noexcept
 {
-	auto [name, value] = Split(line, ':');
-
-	if (value.data() == nullptr ||
-	    !http_header_name_valid(name) ||
-	    !IsValidHeaderValue(value)) [[unlikely]]
+	const auto colon = CheckHeaderLine(line);
+	if (colon == line.npos) [[unlikely]]
 		return false;
 
-	value = StripLeft(value);
+	/* one allocation for both name and value */
+	char *copy = alloc.NewArray<char>(line.size() + 1);
+	std::copy(line.begin(), line.end(), copy);
+
+	AddHeaderLine(alloc, headers, {copy, line.size()}, colon);
+	return true;
+}
+
+bool
+header_parse_line_in_place(AllocatorPtr alloc, StringMap &headers,
+			   std::span<char> line) noexcept
+{
+	const auto colon = CheckHeaderLine({line.data(), line.size()});
+	if (colon == std::string_view::npos) [[unlikely]]
+		return false;
 
-	headers.Add(alloc, alloc.DupToLower(name), alloc.DupZ(value));
+	AddHeaderLine(alloc, headers, line, colon);
 	return true;
 }
 
+void
+HeaderLineCopy::Copy(AllocatorPtr alloc, std::string_view input) noexcept
+{
+	assert(!IsDefined());
+
+	/* look for the empty line which terminates the header block
+	   to avoid copying the body */
+	std::size_t end = std::min(input.find("\n\r\n"), input.find("\n\n"));
+	if (end == input.npos) {
+		end = input.rfind('\n');
+		if (end == input.npos)
+			return;
+	}
+
+	/* include the newline character */
+	size = end + 1;
+
+	src = input.data();
+	dest = alloc.NewArray<char>(size);
+	std::copy_n(src, size, dest);
+}
+
 void
 header_parse_buffer(AllocatorPtr alloc, StringMap &headers,
 		    GrowingBuffer &&_gb) noexcept
@@ -8,6 +8,9 @@
 
 #pragma once
 
+#include <cassert>
+#include <cstddef>
+#include <span>
 #include <string_view>
 
 class AllocatorPtr;
@@ -21,6 +24,57 @@ bool
 header_parse_line(AllocatorPtr alloc, StringMap &headers,
 		  std::string_view line) noexcept;
 
+/**
+ * Like header_parse_line(), but the name and the value are not
+ * copied; they are converted and null-terminated in place and the
+ * #StringMap points into the given buffer, which must therefore live
+ * as long as the #StringMap.  The byte after the end of the line
+ * (usually the '\r' or '\n') must be writable, too; it is
+ * overwritten.
+ *
+ * @return true on success, false on error (the buffer is left
+ * unmodified then)
+ */
+bool
+header_parse_line_in_place(AllocatorPtr alloc, StringMap &headers,
+			   std::span<char> line) noexcept;
+
+/**
+ * A writable copy of the complete header lines in an input buffer
+ * for header_parse_line_in_place().  Copying the whole header block
+ * at once needs just one allocation and one memcpy() per chunk
+ * instead of two of each per header.
+ */
+class HeaderLineCopy {
+	const char *src = nullptr;
+	char *dest = nullptr;
+	std::size_t size = 0;
+
+public:
+	bool IsDefined() const noexcept {
+		return dest != nullptr;
+	}
+
+	/**
+	 * Copy the header lines at the beginning of the given input
+	 * buffer up to the end of the header block or, if the end is
+	 * not in the buffer, up to the last complete line.
+	 */
+	void Copy(AllocatorPtr alloc, std::string_view input) noexcept;
+
+	/**
+	 * Translate a line of the input buffer passed to Copy() to
+	 * its writable copy.
+	 */
+	std::span<char> Translate(std::string_view line) const noexcept {
+		assert(IsDefined());
+		assert(line.data() >= src);
+		assert(line.data() + line.size() < src + size);
+
+		return {dest + (line.data() - src), line.size()};
+	}
+};
+
 void
 header_parse_buffer(AllocatorPtr alloc, StringMap &headers,
 		    GrowingBuffer &&gb) noexcept;
@@ -77,7 +77,6 @@ void
 HttpCacheHeap::Compress() noexcept
 {
 	slice_pool.Compress();
-	rubber.Compress();
 }
 
 void
@@ -118,7 +117,8 @@ HttpCacheHeap::Unlock(HttpCacheDocument &document) noexcept
 
 UnusedIstreamPtr
 HttpCacheHeap::OpenStream(struct pool &_pool,
-			  HttpCacheDocument &document) noexcept
+			  HttpCacheDocument &document,
+			  PipeStock *pipe_stock) noexcept
 {
 	auto &item = (HttpCacheItem &)document;
 
@@ -126,7 +126,7 @@ HttpCacheHeap::OpenStream(struct pool &_pool,
 		/* don't lock the item */
 		return {};
 
-	return istream_unlock_new(_pool, item.OpenStream(_pool), item);
+	return istream_unlock_new(_pool, item.OpenStream(_pool, pipe_stock), item);
 }
 
 /*
@@ -135,14 +135,14 @@ HttpCacheHeap::OpenStream(struct pool &_pool,
  */
 
 HttpCacheHeap::HttpCacheHeap(struct pool &_pool, EventLoop &event_loop,
-			     size_t max_size) noexcept
+			     size_t max_size, CachePolicy policy) noexcept
 	:pool(_pool),
 	 slice_pool(1024, 65536, "http_cache_meta"),
 	 rubber(max_size, "http_cache_data"),
 	 /* leave 12.5% of the rubber allocator empty, to increase the
 	    chances that a hole can be found for a new allocation, to
 	    reduce the pressure that rubber_compress() creates */
-	 cache(event_loop, max_size * 7 / 8)
+	 cache(event_loop, max_size * 7 / 8, policy)
 {
 }
 
@@ -19,8 +19,10 @@ enum class HttpStatus : uint_least16_t;
 struct pool;
 class UnusedIstreamPtr;
 class EventLoop;
+class PipeStock;
 class StringMap;
 struct AllocatorStats;
+struct CacheStats;
 struct HttpCacheResponseInfo;
 struct HttpCacheDocument;
 
@@ -46,7 +48,7 @@ class HttpCacheHeap {
 
 public:
 	HttpCacheHeap(struct pool &pool, EventLoop &event_loop,
-		      size_t max_size) noexcept;
+		      size_t max_size, CachePolicy policy) noexcept;
 	~HttpCacheHeap() noexcept;
 
 	Rubber &GetRubber() noexcept {
@@ -58,6 +60,10 @@ public:
 	[[gnu::pure]]
 	AllocatorStats GetStats() const noexcept;
 
+	const CacheStats &GetCacheStats() const noexcept {
+		return cache.GetStats();
+	}
+
 	HttpCacheDocument *Get(const char *uri,
 			       StringMap &request_headers) noexcept;
 
@@ -71,7 +77,22 @@ public:
 	void Remove(HttpCacheDocument &document) noexcept;
 	void RemoveURL(const char *url, StringMap &headers) noexcept;
 
+	/**
+	 * Give unused memory back to the kernel.  This does not
+	 * compact the #Rubber allocator; call CompressStep() until it
+	 * returns false for that.
+	 */
 	void Compress() noexcept;
+
+	/**
+	 * Perform one slice of incremental #Rubber compaction.
+	 *
+	 * @return true if there is more work to do
+	 */
+	bool CompressStep() noexcept {
+		return rubber.CompressStep();
+	}
+
 	void Flush() noexcept;
 	void FlushTag(const std::string &tag) noexcept;
 
@@ -79,5 +100,6 @@ public:
 	void Unlock(HttpCacheDocument &document) noexcept;
 
 	UnusedIstreamPtr OpenStream(struct pool &_pool,
-				    HttpCacheDocument &document) noexcept;
+				    HttpCacheDocument &document,
+				    PipeStock *pipe_stock) noexcept;
 };
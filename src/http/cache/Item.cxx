@@ -38,10 +38,11 @@ HttpCacheItem::SetExpires(std::chrono::steady_clock::time_point steady_now,
 }
 
 UnusedIstreamPtr
-HttpCacheItem::OpenStream(struct pool &_pool) noexcept
+HttpCacheItem::OpenStream(struct pool &_pool,
+			  PipeStock *pipe_stock) noexcept
 {
 	return istream_rubber_new(_pool, body.GetRubber(), body.GetId(),
-				  0, size, false);
+				  0, size, false, pipe_stock);
 }
 
 void
@@ -11,6 +11,7 @@
 #include "util/IntrusiveList.hxx"
 
 class UnusedIstreamPtr;
+class PipeStock;
 
 class HttpCacheItem final : PoolHolder, public HttpCacheDocument, public CacheItem {
 	const size_t size;
@@ -46,7 +47,8 @@ public:
 		return body;
 	}
 
-	UnusedIstreamPtr OpenStream(struct pool &_pool) noexcept;
+	UnusedIstreamPtr OpenStream(struct pool &_pool,
+				    PipeStock *pipe_stock) noexcept;
 
 	/* virtual methods from class CacheItem */
 	void Destroy() noexcept override;
@@ -22,6 +22,7 @@
 #include "pool/Holder.hxx"
 #include "AllocatorPtr.hxx"
 #include "lib/fmt/RuntimeError.hxx"
+#include "event/DeferEvent.hxx"
 #include "event/FarTimerEvent.hxx"
 #include "event/Loop.hxx"
 #include "io/Logger.hxx"
@@ -259,10 +260,22 @@ class HttpCache {
 
 	FarTimerEvent compress_timer;
 
+	/**
+	 * Performs one slice of incremental #Rubber compaction
+	 * whenever the #EventLoop is idle, until it is complete.
+	 */
+	DeferEvent compress_step_event;
+
 	HttpCacheHeap heap;
 
 	ResourceLoader &resource_loader;
 
+	/**
+	 * Passed to istream_rubber_new() for zero-copy transmission
+	 * of cached bodies.  May be nullptr.
+	 */
+	PipeStock *const pipe_stock;
+
 	/**
 	 * A list of requests that are currently saving their contents to
 	 * the cache.
@@ -274,8 +287,8 @@ class HttpCache {
 
 public:
 	HttpCache(struct pool &_pool, size_t max_size,
-		  bool obey_no_cache,
-		  EventLoop &event_loop,
+		  CachePolicy policy, bool obey_no_cache,
+		  EventLoop &event_loop, PipeStock *_pipe_stock,
 		  ResourceLoader &_resource_loader);
 
 	HttpCache(const HttpCache &) = delete;
@@ -299,6 +312,10 @@ public:
 		return heap.GetStats();
 	}
 
+	const CacheStats &GetCacheStats() const noexcept {
+		return heap.GetCacheStats();
+	}
+
 	void Flush() noexcept {
 		heap.Flush();
 	}
@@ -431,8 +448,14 @@ private:
 
 	void OnCompressTimer() noexcept {
 		heap.Compress();
+		compress_step_event.ScheduleIdle();
 		compress_timer.Schedule(http_cache_compress_interval);
 	}
+
+	void OnCompressStep() noexcept {
+		if (heap.CompressStep())
+			compress_step_event.ScheduleIdle();
+	}
 };
 
 static void
@@ -755,14 +778,16 @@ HttpCacheRequest::HttpCacheRequest(PoolPtr &&_pool,
 
 inline
 HttpCache::HttpCache(struct pool &_pool, size_t max_size,
-		     bool _obey_no_cache,
-		     EventLoop &_event_loop,
+		     CachePolicy policy, bool _obey_no_cache,
+		     EventLoop &_event_loop, PipeStock *_pipe_stock,
 		     ResourceLoader &_resource_loader)
 	:pool(pool_new_dummy(&_pool, "http_cache")),
 	 event_loop(_event_loop),
 	 compress_timer(event_loop, BIND_THIS_METHOD(OnCompressTimer)),
-	 heap(pool, event_loop, max_size),
+	 compress_step_event(event_loop, BIND_THIS_METHOD(OnCompressStep)),
+	 heap(pool, event_loop, max_size, policy),
 	 resource_loader(_resource_loader),
+	 pipe_stock(_pipe_stock),
 	 obey_no_cache(_obey_no_cache)
 {
 	assert(max_size > 0);
@@ -772,14 +797,14 @@ HttpCache::HttpCache(struct pool &_pool, size_t max_size,
 
 HttpCache *
 http_cache_new(struct pool &pool, size_t max_size,
-	       bool obey_no_cache,
-	       EventLoop &event_loop,
+	       CachePolicy policy, bool obey_no_cache,
+	       EventLoop &event_loop, PipeStock *pipe_stock,
 	       ResourceLoader &resource_loader)
 {
 	assert(max_size > 0);
 
-	return new HttpCache(pool, max_size, obey_no_cache,
-			     event_loop, resource_loader);
+	return new HttpCache(pool, max_size, policy, obey_no_cache,
+			     event_loop, pipe_stock, resource_loader);
 }
 
 void
@@ -822,6 +847,12 @@ http_cache_get_stats(const HttpCache &cache) noexcept
 	return cache.GetStats();
 }
 
+CacheStats
+http_cache_get_cache_stats(const HttpCache &cache) noexcept
+{
+	return cache.GetCacheStats();
+}
+
 void
 http_cache_flush(HttpCache &cache) noexcept
 {
@@ -971,7 +1002,7 @@ HttpCache::Serve(struct pool &caller_pool,
 {
 	LogConcat(4, "HttpCache", "serve ", key);
 
-	auto body = heap.OpenStream(caller_pool, document);
+	auto body = heap.OpenStream(caller_pool, document, pipe_stock);
 
 	StringMap headers = body
 		? StringMap{ShallowCopy{}, caller_pool, document.response_headers}
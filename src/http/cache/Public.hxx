@@ -9,16 +9,19 @@
 #include <string>
 
 enum class HttpMethod : uint_least8_t;
+enum class CachePolicy : uint_least8_t;
 struct pool;
 class StopwatchPtr;
 struct ResourceRequestParams;
 class UnusedIstreamPtr;
 class EventLoop;
+class PipeStock;
 class ResourceLoader;
 struct ResourceAddress;
 class StringMap;
 class HttpResponseHandler;
 struct AllocatorStats;
+struct CacheStats;
 class HttpCache;
 class CancellablePointer;
 
@@ -27,8 +30,8 @@ class CancellablePointer;
  */
 HttpCache *
 http_cache_new(struct pool &pool, size_t max_size,
-	       bool obey_no_cache,
-	       EventLoop &event_loop,
+	       CachePolicy policy, bool obey_no_cache,
+	       EventLoop &event_loop, PipeStock *pipe_stock,
 	       ResourceLoader &resource_loader);
 
 void
@@ -41,6 +44,10 @@ http_cache_fork_cow(HttpCache &cache, bool inherit) noexcept;
 AllocatorStats
 http_cache_get_stats(const HttpCache &cache) noexcept;
 
+[[gnu::pure]]
+CacheStats
+http_cache_get_cache_stats(const HttpCache &cache) noexcept;
+
 void
 http_cache_flush(HttpCache &cache) noexcept;
 
@@ -7,6 +7,7 @@
 #include "Error.hxx"
 #include "Public.hxx"
 #include "http/Body.hxx"
+#include "http/Headers.hxx"
 #include "http/Status.hxx"
 #include "fs/FilteredSocket.hxx"
 #include "net/SocketProtocolError.hxx"
@@ -17,13 +18,14 @@
 #include "util/Cancellable.hxx"
 #include "util/DestructObserver.hxx"
 #include "util/Exception.hxx"
+#include "util/IntrusiveList.hxx"
 
 #include <cassert>
 #include <string_view>
 
 enum class HttpMethod : uint_least8_t;
 struct HttpServerRequest;
-class HttpHeaders;
+class HeaderLineCopy;
 
 struct HttpServerConnection final
 	: BufferedSocketHandler, IstreamSink, DestructAnchor {
@@ -189,8 +191,6 @@ struct HttpServerConnection final
 
 		HttpServerRequest *request = nullptr;
 
-		CancellablePointer cancel_ptr;
-
 		uint64_t bytes_received = 0;
 
 		void Reset() noexcept {
@@ -248,6 +248,62 @@ struct HttpServerConnection final
 		uint64_t bytes_sent = 0;
 	} response;
 
+	/**
+	 * A request which was received while the response to a
+	 * previous request was still being sent (HTTP pipelining).
+	 * It has been passed to the #HttpServerRequestHandler
+	 * already, but its response is held back until all previous
+	 * responses have been sent.
+	 *
+	 * This object is allocated from the request's pool.
+	 */
+	struct PipelinedRequest final
+		: IntrusiveListHook<IntrusiveHookMode::NORMAL> {
+
+		HttpServerRequest &request;
+
+		/**
+		 * The response submitted by the handler; the other
+		 * response fields are only valid if this is set.
+		 */
+		HttpStatus status{};
+
+		HttpHeaders headers;
+
+		UnusedIstreamPtr body;
+
+		const uint64_t bytes_received;
+
+		/**
+		 * The keep-alive setting requested by this request.
+		 */
+		const bool keep_alive;
+
+		PipelinedRequest(HttpServerRequest &_request,
+				 uint64_t _bytes_received,
+				 bool _keep_alive) noexcept
+			:request(_request),
+			 bytes_received(_bytes_received),
+			 keep_alive(_keep_alive) {}
+	};
+
+	/**
+	 * Requests which were received after #request; their
+	 * responses are sent in this order after the current one.
+	 */
+	IntrusiveList<PipelinedRequest> pipeline;
+
+	/**
+	 * The number of items in #pipeline.
+	 */
+	unsigned n_pipelined = 0;
+
+	/**
+	 * The maximum number of requests in #pipeline.  0 disables
+	 * pipelining.
+	 */
+	const unsigned pipeline_depth;
+
 	bool date_header;
 
 	/* connection settings */
@@ -258,6 +314,7 @@ struct HttpServerConnection final
 			     SocketAddress _local_address,
 			     SocketAddress _remote_address,
 			     bool _date_header,
+			     unsigned _pipeline_depth,
 			     HttpServerConnectionHandler &_handler,
 			     HttpServerRequestHandler &_request_handler) noexcept;
 
@@ -275,6 +332,16 @@ struct HttpServerConnection final
 	void IdleTimeoutCallback() noexcept;
 	void OnReadTimeout() noexcept;
 
+	/**
+	 * Pass a finished (or aborted) request to its logger.
+	 */
+	static void Log(HttpServerRequest &r, HttpStatus status,
+			int64_t length, uint64_t bytes_received,
+			uint64_t bytes_sent) noexcept;
+
+	/**
+	 * Log the current request.
+	 */
 	void Log() noexcept;
 
 	/**
@@ -290,10 +357,50 @@ struct HttpServerConnection final
 	/**
 	 * @return false if the connection has been closed
 	 */
-	bool HandleLine(std::string_view line) noexcept;
+	bool HandleLine(std::string_view line,
+			const HeaderLineCopy &copy) noexcept;
 
 	BufferedResult FeedHeaders(std::string_view b) noexcept;
 
+	/**
+	 * May another request be read and dispatched while the
+	 * response to the current one is still pending?  This is
+	 * only allowed while all previous requests have "safe"
+	 * methods (RFC 9112 9.3.2).
+	 */
+	[[gnu::pure]]
+	bool CanPipeline() const noexcept;
+
+	/**
+	 * Parse and dispatch a pipelined request from the input
+	 * buffer.  Only GET and HEAD requests without a body whose
+	 * headers are complete are handled here; everything else is
+	 * left in the buffer for the regular parser.
+	 *
+	 * @return BufferedResult::MORE if no request was consumed
+	 */
+	BufferedResult FeedPipelined(std::string_view b) noexcept;
+
+	/**
+	 * Make the first #pipeline item the current request, and
+	 * submit its response if the handler has already sent one.
+	 */
+	void StartPipelined() noexcept;
+
+	/**
+	 * Cancel all pipelined requests (e.g. because the
+	 * connection is being closed).
+	 */
+	void AbortPipeline() noexcept;
+
+	/**
+	 * Store the response to a pipelined request until it becomes
+	 * the current request.
+	 */
+	void QueueResponse(HttpServerRequest &r, HttpStatus status,
+			   HttpHeaders &&headers,
+			   UnusedIstreamPtr body) noexcept;
+
 	/**
 	 * @return false if the connection has been closed
 	 */
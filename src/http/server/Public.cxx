@@ -10,6 +10,7 @@
 #include "pool/pool.hxx"
 #include "pool/PSocketAddress.hxx"
 #include "istream/Bucket.hxx"
+#include "memory/ZeroCopyHold.hxx"
 #include "system/Error.hxx"
 #include "net/TimeoutError.hxx"
 #include "io/Iovec.hxx"
@@ -21,18 +22,25 @@
 #include <unistd.h>
 
 void
-HttpServerConnection::Log() noexcept
+HttpServerConnection::Log(HttpServerRequest &r, HttpStatus status,
+			  int64_t length, uint64_t bytes_received,
+			  uint64_t bytes_sent) noexcept
 {
-	auto &r = *request.request;
 	auto *logger = r.logger;
 	if (logger == nullptr)
 		return;
 
-	logger->LogHttpRequest(r,
-			       response.status,
-			       response.status != HttpStatus{} ? response.length : -1,
-			       request.bytes_received,
-			       response.bytes_sent);
+	logger->LogHttpRequest(r, status, length, bytes_received, bytes_sent);
+}
+
+void
+HttpServerConnection::Log() noexcept
+{
+	Log(*request.request,
+	    response.status,
+	    response.status != HttpStatus{} ? response.length : -1,
+	    request.bytes_received,
+	    response.bytes_sent);
 }
 
 HttpServerRequest *
@@ -42,8 +50,6 @@ http_server_request_new(HttpServerConnection *connection,
 {
 	assert(connection != nullptr);
 
-	connection->response.status = {};
-
 	auto pool = pool_new_linear(connection->pool,
 				    "http_server_request", 8192);
 	pool_set_major(pool);
@@ -71,49 +77,109 @@ HttpServerConnection::TryWriteBuckets2()
 
 	IstreamBucketList list;
 
+	/* we can send file buckets with sendfile(), unless the
+	   socket cannot do that (e.g. because all data is copied to
+	   the io_uring writer) */
+	if (socket->GetType() != FdType::FD_NONE)
+		list.EnableFile();
+
+	/* memory which may still be read by the kernel after
+	   ConsumeBucketList() (MSG_ZEROCOPY) */
+	ZeroCopyHoldList zero_copy_holds;
+	if (socket->HasZeroCopy())
+		list.EnableZeroCopy(zero_copy_holds);
+
 	try {
 		input.FillBucketList(list);
 	} catch (...) {
 		std::throw_with_nested(std::runtime_error("error on HTTP response stream"));
 	}
 
-	StaticVector<struct iovec, 64> v;
-	for (const auto &bucket : list) {
-		if (!bucket.IsBuffer())
+	/* write all buckets in order: consecutive buffers with one
+	   writev(), files with sendfile(); stop at the first short
+	   write and consume everything afterwards */
+	std::size_t total = 0;
+	bool blocking = false;
+
+	for (auto i = list.begin(), end = list.end(); i != end;) {
+		ssize_t nbytes;
+		std::size_t size;
+
+		if (i->IsFile()) {
+			const auto &file = i->GetFile();
+			size = file.size;
+
+			off_t offset = file.offset;
+			nbytes = socket->WriteFrom(file.fd, FdType::FD_FILE,
+						   &offset, size);
+			++i;
+		} else if (i->IsBuffer()) {
+			/* consecutive buffers which agree on
+			   MSG_ZEROCOPY */
+			const bool zero_copy = i->IsZeroCopy();
+			StaticVector<struct iovec, 64> v;
+			size = 0;
+
+			for (; i != end && i->IsBuffer() &&
+				     i->IsZeroCopy() == zero_copy &&
+				     !v.full(); ++i) {
+				v.push_back(MakeIovec(i->GetBuffer()));
+				size += i->GetBuffer().size();
+			}
+
+			nbytes = zero_copy && socket->ShouldZeroCopy(size)
+				? socket->WriteZeroCopy(v)
+				: socket->WriteV(v);
+		} else
 			break;
 
-		v.push_back(MakeIovec(bucket.GetBuffer()));
+		if (nbytes < 0) {
+			if (nbytes == WRITE_BLOCKING) [[likely]] {
+				blocking = true;
+				break;
+			}
 
-		if (v.full())
-			break;
-	}
+			if (nbytes == WRITE_DESTROYED)
+				return BucketResult::DESTROYED;
+
+			if (nbytes == WRITE_SOURCE_EOF || total > 0)
+				/* let input.Read() deal with it
+				   (e.g. report a truncated file) */
+				break;
+
+			SocketErrorErrno("write error on HTTP connection");
+			return BucketResult::DESTROYED;
+		}
+
+		total += nbytes;
 
-	if (v.empty()) {
-		return list.HasMore()
-			? BucketResult::UNAVAILABLE
-			: BucketResult::DEPLETED;
+		if ((std::size_t)nbytes < size)
+			break;
 	}
 
-	ssize_t nbytes = socket->WriteV(v);
-	if (nbytes < 0) {
-		if (nbytes == WRITE_BLOCKING) [[likely]]
+	if (total == 0) {
+		if (blocking)
 			return BucketResult::BLOCKING;
 
-		if (nbytes == WRITE_DESTROYED)
-			return BucketResult::DESTROYED;
-
-		SocketErrorErrno("write error on HTTP connection");
-		return BucketResult::DESTROYED;
+		return list.IsDepleted(0)
+			? BucketResult::DEPLETED
+			: BucketResult::UNAVAILABLE;
 	}
 
-	response.bytes_sent += nbytes;
-	response.length += nbytes;
+	response.bytes_sent += total;
+	response.length += total;
+
+	std::size_t consumed = input.ConsumeBucketList(total);
+	assert(consumed == total);
+
+	if (!zero_copy_holds.empty())
+		socket->HoldZeroCopy(zero_copy_holds);
 
-	std::size_t consumed = input.ConsumeBucketList(nbytes);
-	assert(consumed == (std::size_t)nbytes);
+	if (list.IsDepleted(consumed))
+		return BucketResult::DEPLETED;
 
-	return list.IsDepleted(consumed)
-		? BucketResult::DEPLETED
+	return blocking
+		? BucketResult::BLOCKING
 		: BucketResult::MORE;
 }
 
@@ -129,7 +195,7 @@ HttpServerConnection::TryWriteBuckets() noexcept
 
 		/* we clear this CancellablePointer here so CloseRequest()
 		   won't think we havn't sent a response yet */
-		request.cancel_ptr = nullptr;
+		request.request->cancel_ptr = nullptr;
 
 		Error(std::current_exception());
 		return BucketResult::DESTROYED;
@@ -290,6 +356,7 @@ HttpServerConnection::HttpServerConnection(struct pool &_pool,
 					   SocketAddress _local_address,
 					   SocketAddress _remote_address,
 					   bool _date_header,
+					   unsigned _pipeline_depth,
 					   HttpServerConnectionHandler &_handler,
 					   HttpServerRequestHandler &_request_handler) noexcept
 	:pool(&_pool), socket(std::move(_socket)),
@@ -302,6 +369,7 @@ HttpServerConnection::HttpServerConnection(struct pool &_pool,
 	 remote_address(DupAddress(*pool, _remote_address)),
 	 local_host_and_port(address_to_string(*pool, _local_address)),
 	 remote_host(address_to_host_string(*pool, _remote_address)),
+	 pipeline_depth(_pipeline_depth),
 	 date_header(_date_header)
 {
 	socket->Reinit(write_timeout, *this);
@@ -326,6 +394,7 @@ http_server_connection_new(struct pool &pool,
 			   SocketAddress local_address,
 			   SocketAddress remote_address,
 			   bool date_header,
+			   unsigned pipeline_depth,
 			   HttpServerConnectionHandler &handler,
 			   HttpServerRequestHandler &request_handler) noexcept
 {
@@ -334,7 +403,7 @@ http_server_connection_new(struct pool &pool,
 	return NewFromPool<HttpServerConnection>(pool, pool,
 						 std::move(socket),
 						 local_address, remote_address,
-						 date_header,
+						 date_header, pipeline_depth,
 						 handler, request_handler);
 }
 
@@ -352,10 +421,10 @@ HttpServerConnection::CloseRequest() noexcept
 	     request.read_state == Request::END)) {
 		if (HasInput())
 			CloseInput();
-		else if (request.cancel_ptr)
+		else if (_request->cancel_ptr)
 			/* don't call this if coming from
 			   _response_stream_abort() */
-			request.cancel_ptr.Cancel();
+			_request->cancel_ptr.Cancel();
 	}
 
 	_request->Destroy();
@@ -364,11 +433,36 @@ HttpServerConnection::CloseRequest() noexcept
 	assert(request.read_state != Request::BODY);
 }
 
+void
+HttpServerConnection::AbortPipeline() noexcept
+{
+	while (!pipeline.empty()) {
+		auto &p = pipeline.front();
+		pipeline.pop_front();
+		--n_pipelined;
+
+		auto &r = p.request;
+		r.stopwatch.RecordEvent("cancel");
+
+		if (p.status == HttpStatus{} && r.cancel_ptr)
+			/* the handler is still working on it */
+			r.cancel_ptr.Cancel();
+
+		/* nothing of a queued response has been sent */
+		Log(r, HttpStatus{}, -1, p.bytes_received, 0);
+
+		/* this also frees the response body (if any) */
+		p.~PipelinedRequest();
+		r.Destroy();
+	}
+}
+
 void
 HttpServerConnection::Done() noexcept
 {
 	assert(handler != nullptr);
 	assert(request.read_state == Request::START);
+	assert(pipeline.empty());
 
 	/* shut down the socket gracefully to allow the TCP stack to
 	   transfer remaining response data */
@@ -393,6 +487,8 @@ HttpServerConnection::Cancel() noexcept
 	if (request.read_state != Request::START)
 		CloseRequest();
 
+	AbortPipeline();
+
 	auto *_handler = std::exchange(handler, nullptr);
 
 	Delete();
@@ -409,6 +505,8 @@ HttpServerConnection::Error(std::exception_ptr e) noexcept
 	if (request.read_state != Request::START)
 		CloseRequest();
 
+	AbortPipeline();
+
 	auto *_handler = std::exchange(handler, nullptr);
 
 	Delete();
@@ -433,6 +531,8 @@ http_server_connection_close(HttpServerConnection *connection) noexcept
 	if (connection->request.read_state != HttpServerConnection::Request::START)
 		connection->CloseRequest();
 
+	connection->AbortPipeline();
+
 	connection->Delete();
 }
 
@@ -463,7 +563,8 @@ http_server_connection_graceful(HttpServerConnection *connection) noexcept
 		connection->Done();
 	else
 		/* a request is currently being handled; disable keep_alive so
-		   the connection will be closed after this last request */
+		   the connection will be closed after this last request
+		   (requests pipelined after it are aborted) */
 		connection->keep_alive = false;
 }
 
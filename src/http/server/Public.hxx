@@ -43,6 +43,11 @@ enum http_server_score {
 
 /**
  * @param date_header generate Date response headers?
+ *
+ * @param pipeline_depth the maximum number of pipelined requests
+ * which are dispatched while the response to a previous request is
+ * still being sent; 0 disables this (i.e. the next request is only
+ * parsed after the previous response has been finished)
  */
 HttpServerConnection *
 http_server_connection_new(struct pool &pool,
@@ -50,6 +55,7 @@ http_server_connection_new(struct pool &pool,
 			   SocketAddress local_address,
 			   SocketAddress remote_address,
 			   bool date_header,
+			   unsigned pipeline_depth,
 			   HttpServerConnectionHandler &handler,
 			   HttpServerRequestHandler &request_handler) noexcept;
 
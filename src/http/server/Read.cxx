@@ -120,6 +120,93 @@ ParseHttpMethod(const char *s) noexcept
 	return {};
 }
 
+/**
+ * Is this a "safe" request method (RFC 9110 9.2.1), i.e. one which
+ * does not modify state on the server?
+ */
+static constexpr bool
+IsSafeMethod(HttpMethod method) noexcept
+{
+	return method == HttpMethod::GET || method == HttpMethod::HEAD ||
+		method == HttpMethod::OPTIONS || method == HttpMethod::TRACE;
+}
+
+/**
+ * Longer request URIs and header lines are rejected.
+ */
+static constexpr std::size_t MAX_LINE_LENGTH = 8192;
+
+/**
+ * The maximum size of all request header lines.
+ */
+static constexpr std::size_t MAX_HEADERS_SIZE = 64 * 1024;
+
+struct RequestLine {
+	enum class Error {
+		NONE,
+		MALFORMED,
+		UNKNOWN_METHOD,
+		NO_VERSION,
+	};
+
+	HttpMethod method{};
+	std::string_view uri;
+	Error error = Error::NONE;
+};
+
+/**
+ * Split the request line into method and URI.  This does not
+ * consume anything.
+ */
+[[gnu::pure]]
+static RequestLine
+SplitRequestLine(std::string_view line) noexcept
+{
+	if (line.size() < 5) [[unlikely]]
+		return {.error = RequestLine::Error::MALFORMED};
+
+	const auto [method, rest] = ParseHttpMethod(line.data());
+	if (method == HttpMethod{})
+		return {.error = RequestLine::Error::UNKNOWN_METHOD};
+
+	line.remove_prefix(rest - line.data());
+
+	const auto space = line.find(' ');
+	if (space == line.npos || space + 6 > line.size() ||
+	    memcmp(line.data() + space + 1, "HTTP/", 5) != 0) [[unlikely]]
+		return {.method = method, .error = RequestLine::Error::NO_VERSION};
+
+	return {.method = method, .uri = line.substr(0, space)};
+}
+
+/**
+ * Add a header line to the request's header map.
+ *
+ * @return false if the line is too long
+ */
+static bool
+ParseHeaderLine(HttpServerRequest &r, const HeaderLineCopy &copy,
+		std::string_view line) noexcept
+{
+	if (line.size() >= MAX_LINE_LENGTH) [[unlikely]]
+		return false;
+
+	header_parse_line_in_place(*r.pool, r.headers, copy.Translate(line));
+	return true;
+}
+
+/**
+ * Does the request allow keeping the connection alive after the
+ * response?
+ */
+[[gnu::pure]]
+static bool
+IsKeepAlive(const StringMap &headers) noexcept
+{
+	const char *value = headers.Get("connection");
+	return value == nullptr || !http_list_contains_i(value, "close");
+}
+
 inline bool
 HttpServerConnection::ParseRequestLine(std::string_view line) noexcept
 {
@@ -127,24 +214,23 @@ HttpServerConnection::ParseRequestLine(std::string_view line) noexcept
 	assert(request.request == nullptr);
 	assert(!response.pending_drained);
 
-	if (line.size() < 5) [[unlikely]] {
+	auto [method, uri, error] = SplitRequestLine(line);
+
+	switch (error) {
+	case RequestLine::Error::NONE:
+		break;
+
+	case RequestLine::Error::MALFORMED:
 		ProtocolError("malformed request line");
 		return false;
-	}
 
-	const auto [method, rest] = ParseHttpMethod(line.data());
-	line.remove_prefix(rest - line.data());
-
-	if (method == HttpMethod{}) {
+	case RequestLine::Error::UNKNOWN_METHOD:
 		/* invalid request method */
 
 		ProtocolError("unrecognized request method");
 		return false;
-	}
 
-	const auto space = line.find(' ');
-	if (space == line.npos || space + 6 > line.size() ||
-	    memcmp(line.data() + space + 1, "HTTP/", 5) != 0) [[unlikely]] {
+	case RequestLine::Error::NO_VERSION: {
 		/* refuse HTTP 0.9 requests */
 		static constexpr auto msg =
 			"This server requires HTTP 1.1."sv;
@@ -154,10 +240,11 @@ HttpServerConnection::ParseRequestLine(std::string_view line) noexcept
 			Done();
 		return false;
 	}
+	}
 
-	auto uri = line.substr(0, space);
+	response.status = {};
 
-	if (uri.size() >= 8192) {
+	if (uri.size() >= MAX_LINE_LENGTH) {
 		request.SetError(HttpStatus::REQUEST_URI_TOO_LONG,
 				 "Request URI is too long\n");
 		request.ignore_headers = true;
@@ -195,8 +282,7 @@ HttpServerConnection::HeadersFinished() noexcept
 	if (value != nullptr && !StringIsEqual(value, "100-continue"))
 		request.SetError(HttpStatus::EXPECTATION_FAILED, "Unrecognized expectation\n");
 
-	value = r.headers.Get("connection");
-	keep_alive = value == nullptr || !http_list_contains_i(value, "close");
+	keep_alive = IsKeepAlive(r.headers);
 
 	request.upgrade = http_is_upgrade(r.headers);
 
@@ -268,7 +354,8 @@ HttpServerConnection::HeadersFinished() noexcept
  * @return false if the connection has been closed
  */
 inline bool
-HttpServerConnection::HandleLine(std::string_view line) noexcept
+HttpServerConnection::HandleLine(std::string_view line,
+				 const HeaderLineCopy &copy) noexcept
 {
 	assert(request.read_state == Request::START ||
 	       request.read_state == Request::HEADERS);
@@ -284,16 +371,12 @@ HttpServerConnection::HandleLine(std::string_view line) noexcept
 		if (request.ignore_headers)
 			return true;
 
-		if (line.size() >= 8192) {
+		if (!ParseHeaderLine(*request.request, copy, line)) {
 			request.SetError(HttpStatus::REQUEST_HEADER_FIELDS_TOO_LARGE,
 					 "Request header is too long\n");
 			request.ignore_headers = true;
-			return true;
 		}
 
-		header_parse_line(*request.request->pool,
-				  request.request->headers,
-				  line);
 		return true;
 	} else {
 		assert(request.read_state == Request::HEADERS);
@@ -309,7 +392,7 @@ HttpServerConnection::FeedHeaders(const std::string_view b) noexcept
 	assert(request.read_state == Request::START ||
 	       request.read_state == Request::HEADERS);
 
-	if (request.bytes_received >= 64 * 1024) {
+	if (request.bytes_received >= MAX_HEADERS_SIZE) {
 		assert(request.read_state == Request::HEADERS);
 
 		socket->DisposeConsumed(b.size());
@@ -329,17 +412,26 @@ HttpServerConnection::FeedHeaders(const std::string_view b) noexcept
 		return BufferedResult::OK;
 	}
 
+	/* the header lines are copied to the request pool once, and
+	   the request header map points into this copy */
+	HeaderLineCopy copy;
+
 	std::string_view remaining = b;
 	while (true) {
 		auto [line, _remaining] = Split(remaining, '\n');
 		if (_remaining.data() == nullptr)
 			break;
 
+		if (request.read_state == Request::HEADERS &&
+		    !request.ignore_headers && !line.empty() &&
+		    !copy.IsDefined())
+			copy.Copy(*request.request->pool, remaining);
+
 		remaining = _remaining;
 
 		line = StripRight(line);
 
-		if (!HandleLine(line))
+		if (!HandleLine(line, copy))
 			return BufferedResult::CLOSED;
 
 		if (request.read_state != Request::HEADERS)
@@ -355,6 +447,148 @@ HttpServerConnection::FeedHeaders(const std::string_view b) noexcept
 		: BufferedResult::OK;
 }
 
+/**
+ * Find the empty line which terminates the request headers.
+ *
+ * @return the number of bytes up to and including the empty line or
+ * 0 if it was not found
+ */
+[[gnu::pure]]
+static std::size_t
+FindEndOfHeaders(std::string_view b) noexcept
+{
+	std::size_t i = 0;
+
+	while (true) {
+		const auto lf = b.find('\n', i);
+		if (lf == b.npos)
+			return 0;
+
+		i = lf + 1;
+		if (i < b.size() && b[i] == '\n')
+			return i + 1;
+
+		if (i + 1 < b.size() && b[i] == '\r' && b[i + 1] == '\n')
+			return i + 2;
+	}
+}
+
+inline bool
+HttpServerConnection::CanPipeline() const noexcept
+{
+	assert(request.request != nullptr);
+
+	/* the pipelined requests are all GET or HEAD (see
+	   FeedPipelined()), so only the current one needs to be
+	   checked */
+	return pipeline_depth > 0 &&
+		n_pipelined < pipeline_depth &&
+		IsSafeMethod(request.request->method) &&
+		(pipeline.empty()
+		 ? keep_alive
+		 : pipeline.back().keep_alive);
+}
+
+/**
+ * May this request be handled while a previous response is still
+ * being sent?  This is only allowed for requests without a body
+ * which don't need special treatment by the regular parser.
+ */
+[[gnu::pure]]
+static bool
+IsPipelinable(const StringMap &headers) noexcept
+{
+	if (headers.Get("expect") != nullptr ||
+	    headers.Get("transfer-encoding") != nullptr ||
+	    http_is_upgrade(headers))
+		return false;
+
+	const char *content_length = headers.Get("content-length");
+	return content_length == nullptr ||
+		StringIsEqual(content_length, "0");
+}
+
+inline BufferedResult
+HttpServerConnection::FeedPipelined(const std::string_view b) noexcept
+{
+	assert(request.read_state == Request::END);
+	assert(request.request != nullptr);
+	assert(CanPipeline());
+
+	const std::size_t length = FindEndOfHeaders(b);
+	if (length == 0 || length >= MAX_HEADERS_SIZE)
+		return BufferedResult::MORE;
+
+	auto [line, headers_begin] = Split(b.substr(0, length), '\n');
+
+	/* errors are left to the regular parser, and only GET and
+	   HEAD are dispatched early; other methods may have side
+	   effects which a later request depends on (RFC 9112
+	   9.3.2) */
+	const auto request_line = SplitRequestLine(StripRight(line));
+	if (request_line.error != RequestLine::Error::NONE ||
+	    (request_line.method != HttpMethod::GET &&
+	     request_line.method != HttpMethod::HEAD) ||
+	    request_line.uri.size() >= MAX_LINE_LENGTH)
+		return BufferedResult::MORE;
+
+	auto &r = *http_server_request_new(this, request_line.method,
+					   request_line.uri);
+
+	/* the header lines are copied to the request pool once, and
+	   the request header map points into this copy */
+	HeaderLineCopy copy;
+
+	std::string_view remaining = headers_begin;
+	while (true) {
+		auto [header_line, _remaining] = Split(remaining, '\n');
+		header_line = StripRight(header_line);
+		if (header_line.empty())
+			break;
+
+		if (!copy.IsDefined())
+			copy.Copy(*r.pool, remaining);
+
+		if (!ParseHeaderLine(r, copy, header_line)) {
+			r.Destroy();
+			return BufferedResult::MORE;
+		}
+
+		remaining = _remaining;
+	}
+
+	if (!IsPipelinable(r.headers)) {
+		/* let the regular parser deal with it after the
+		   current response has been sent */
+		r.Destroy();
+		return BufferedResult::MORE;
+	}
+
+	if (r.headers.Get("content-length") != nullptr)
+		r.body = istream_null_new(r.pool);
+
+	const bool pipelined_keep_alive = IsKeepAlive(r.headers);
+
+	socket->DisposeConsumed(length);
+
+	r.stopwatch.RecordEvent("request_headers");
+	handler->RequestHeadersFinished(r);
+
+	auto *p = NewFromPool<PipelinedRequest>(r.pool, r, length,
+						pipelined_keep_alive);
+	pipeline.push_back(*p);
+	++n_pipelined;
+
+	const DestructObserver destructed(*this);
+
+	request_handler.HandleHttpRequest(r, r.stopwatch, r.cancel_ptr);
+	if (destructed)
+		return BufferedResult::CLOSED;
+
+	/* there may be more pipelined requests */
+	return BufferedResult::AGAIN;
+}
+
 inline bool
 HttpServerConnection::SubmitRequest()
 {
@@ -369,7 +603,7 @@ HttpServerConnection::SubmitRequest()
 		request.in_handler = true;
 		request_handler.HandleHttpRequest(*request.request,
 						  request.request->stopwatch,
-						  request.cancel_ptr);
+						  request.request->cancel_ptr);
 		if (destructed)
 			return false;
 
@@ -379,7 +613,7 @@ HttpServerConnection::SubmitRequest()
 		    socket->IsConnected()) {
 			/* enable splice() if the handler supports
 			   it */
-			socket->SetDirect(request_body_reader->CheckDirect(socket->GetType()));
+			socket->SetDirect(request_body_reader->CheckDirect(socket->GetReadType()));
 
 			ScheduleReadTimeoutTimer();
 		}
@@ -412,6 +646,11 @@ HttpServerConnection::Feed(std::span<const std::byte> b) noexcept
 
 			if (!SubmitRequest())
 				result = BufferedResult::CLOSED;
+			else if (request.read_state == Request::END &&
+				 CanPipeline() && !socket->IsEmpty())
+				/* more (pipelined) requests are
+				   waiting in the input buffer */
+				result = BufferedResult::AGAIN;
 		}
 
 		return result;
@@ -420,6 +659,15 @@ HttpServerConnection::Feed(std::span<const std::byte> b) noexcept
 		return FeedRequestBody(b);
 
 	case Request::END:
+		if (CanPipeline()) {
+			/* the client is pipelining: dispatch the next
+			   request while the response to this one is
+			   still pending */
+			result = FeedPipelined(ToStringView(b));
+			if (result != BufferedResult::MORE)
+				return result;
+		}
+
 		/* check if the connection was closed by the client while we
 		   were processing the request */
 
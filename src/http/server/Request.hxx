@@ -6,6 +6,7 @@
 
 #include "stopwatch.hxx"
 #include "http/IncomingRequest.hxx"
+#include "util/Cancellable.hxx"
 
 struct HttpServerConnection;
 
@@ -14,6 +15,15 @@ struct HttpServerRequest final : public IncomingHttpRequest {
 
 	RootStopwatchPtr stopwatch;
 
+	/**
+	 * Passed to HttpServerRequestHandler::HandleHttpRequest().
+	 * It is a member of this object (and not of the connection)
+	 * because the handler may keep using it while the connection
+	 * is still busy with the responses to previous (pipelined)
+	 * requests.
+	 */
+	CancellablePointer cancel_ptr;
+
 	HttpServerRequest(PoolPtr &&_pool, HttpServerConnection &_connection,
 			  SocketAddress _local_address,
 			  SocketAddress _remote_address,
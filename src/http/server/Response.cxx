@@ -121,7 +121,7 @@ HttpServerConnection::OnError(std::exception_ptr ep) noexcept
 
 	/* we clear this cancel_ptr here so http_server_request_close()
 	   won't think we havn't sent a response yet */
-	request.cancel_ptr = nullptr;
+	request.request->cancel_ptr = nullptr;
 
 	Error(NestException(ep,
 			    std::runtime_error("error on HTTP response stream")));
@@ -186,6 +186,13 @@ HttpServerConnection::ResponseIstreamFinished()
 	request.Reset();
 
 	if (keep_alive) {
+		if (!pipeline.empty()) {
+			/* the next request has already been
+			   dispatched; send its response now */
+			StartPipelined();
+			return true;
+		}
+
 		/* handle pipelined request (if any), or set up events for
 		   next request */
 
@@ -196,6 +203,8 @@ HttpServerConnection::ResponseIstreamFinished()
 		/* keepalive disabled and response is finished: we must close
 		   the connection */
 
+		AbortPipeline();
+
 		if (socket->IsDrained()) {
 			Done();
 			return false;
@@ -120,7 +120,7 @@ HttpServerConnection::ReadRequestBody() noexcept
 		return;
 
 	if (socket->IsConnected())
-		socket->SetDirect(request_body_reader->CheckDirect(socket->GetType()));
+		socket->SetDirect(request_body_reader->CheckDirect(socket->GetReadType()));
 
 	socket->Read();
 }
@@ -181,12 +181,80 @@ HttpServerConnection::SubmitResponse(HttpStatus status,
 	DeferWrite();
 }
 
+void
+HttpServerConnection::QueueResponse(HttpServerRequest &r, HttpStatus status,
+				    HttpHeaders &&headers,
+				    UnusedIstreamPtr body) noexcept
+{
+	assert(http_status_is_valid(status));
+
+	for (auto &p : pipeline) {
+		if (&p.request == &r) {
+			assert(p.status == HttpStatus{});
+
+			r.stopwatch.RecordEvent("response_queued");
+
+			p.status = status;
+			p.headers = std::move(headers);
+			p.body = std::move(body);
+			return;
+		}
+	}
+
+	/* not reachable: every request is either the current one or
+	   in the pipeline */
+	assert(false);
+}
+
+void
+HttpServerConnection::StartPipelined() noexcept
+{
+	assert(request.read_state == Request::START);
+	assert(request.request == nullptr);
+	assert(!pipeline.empty());
+
+	auto &p = pipeline.front();
+	pipeline.pop_front();
+	--n_pipelined;
+
+	request.request = &p.request;
+	request.read_state = Request::END;
+#ifndef NDEBUG
+	request.body_state = Request::BodyState::NONE;
+#endif
+	request.in_handler = false;
+	request.upgrade = false;
+	request.expect_100_continue = false;
+	request.bytes_received = p.bytes_received;
+	keep_alive = p.keep_alive;
+	response.status = {};
+
+	/* more requests may be waiting in the input buffer because
+	   the pipeline was full */
+	socket->DeferRead();
+
+	const auto status = p.status;
+	auto headers = std::move(p.headers);
+	auto body = std::move(p.body);
+	p.~PipelinedRequest();
+
+	if (status != HttpStatus{})
+		SubmitResponse(status, std::move(headers), std::move(body));
+}
+
 void
 HttpServerRequest::SendResponse(HttpStatus status,
 				HttpHeaders &&response_headers,
 				UnusedIstreamPtr response_body) noexcept
 {
-	assert(connection.request.request == this);
+	if (connection.request.request != this) {
+		/* a pipelined request: its response has to wait until
+		   all previous responses have been sent */
+		connection.QueueResponse(*this, status,
+					 std::move(response_headers),
+					 std::move(response_body));
+		return;
+	}
 
 	connection.SubmitResponse(status, std::move(response_headers),
 				  std::move(response_body));
@@ -193,6 +193,7 @@ AutoPipeIstream::OnDirect(FdType type, FileDescriptor fd, off_t offset,
 			: IstreamDirectResult::END;
 
 	input.ConsumeDirect(nbytes);
+	pipe.OnSpliced(nbytes);
 
 	assert(piped == 0);
 	piped = (std::size_t)nbytes;
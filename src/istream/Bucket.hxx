@@ -4,28 +4,59 @@
 
 #pragma once
 
+#include "io/FileDescriptor.hxx"
 #include "util/StaticVector.hxx"
 
 #include <span>
 
+#include <sys/types.h>
+
+class ZeroCopyHoldList;
+
 class IstreamBucket {
 public:
 	enum class Type {
 		BUFFER,
+
+		/**
+		 * A range of a regular file.  The consumer may
+		 * transfer it with sendfile() or splice().  Only
+		 * lists with IstreamBucketList::EnableFile() may
+		 * contain such buckets.
+		 */
+		FILE,
+	};
+
+	struct File {
+		FileDescriptor fd;
+		off_t offset;
+		std::size_t size;
 	};
 
 private:
 	Type type;
 
+	/**
+	 * Only for #Type::BUFFER: may the consumer pass this buffer
+	 * to the kernel with MSG_ZEROCOPY?  See
+	 * IstreamBucketList::EnableZeroCopy().
+	 */
+	bool zero_copy = false;
+
 	union {
 		std::span<const std::byte> buffer;
+		File file;
 	};
 
 public:
-	explicit IstreamBucket(std::span<const std::byte> _buffer) noexcept
-		:type(Type::BUFFER),
+	explicit IstreamBucket(std::span<const std::byte> _buffer,
+			       bool _zero_copy=false) noexcept
+		:type(Type::BUFFER), zero_copy(_zero_copy),
 		 buffer(_buffer) {}
 
+	IstreamBucket(FileDescriptor fd, off_t offset, std::size_t size) noexcept
+		:type(Type::FILE),
+		 file{fd, offset, size} {}
 
 	Type GetType() const noexcept {
 		return type;
@@ -40,6 +71,39 @@ public:
 
 		return buffer;
 	}
+
+	/**
+	 * Is this a buffer which may be sent with MSG_ZEROCOPY?
+	 */
+	bool IsZeroCopy() const noexcept {
+		return zero_copy;
+	}
+
+	bool IsFile() const noexcept {
+		return type == Type::FILE;
+	}
+
+	const File &GetFile() const noexcept {
+		assert(type == Type::FILE);
+
+		return file;
+	}
+
+	/**
+	 * Returns the number of bytes described by this bucket,
+	 * regardless of its type.
+	 */
+	std::size_t GetSize() const noexcept {
+		switch (type) {
+		case Type::BUFFER:
+			return buffer.size();
+
+		case Type::FILE:
+			return file.size;
+		}
+
+		return 0;
+	}
 };
 
 class IstreamBucketList {
@@ -48,6 +112,17 @@ class IstreamBucketList {
 
 	bool more = false;
 
+	/**
+	 * Does the consumer accept #IstreamBucket::Type::FILE?
+	 */
+	bool file_enabled = false;
+
+	/**
+	 * If set, then the consumer may send buffers with
+	 * MSG_ZEROCOPY.  See EnableZeroCopy().
+	 */
+	ZeroCopyHoldList *zero_copy_holds = nullptr;
+
 public:
 	IstreamBucketList() = default;
 
@@ -62,6 +137,44 @@ public:
 		return more;
 	}
 
+	/**
+	 * Announce that the consumer can handle
+	 * #IstreamBucket::Type::FILE buckets.  Without this, producers
+	 * must not push them.
+	 */
+	void EnableFile() noexcept {
+		file_enabled = true;
+	}
+
+	bool IsFileEnabled() const noexcept {
+		return file_enabled;
+	}
+
+	/**
+	 * Announce that the consumer may pass buffers to the kernel
+	 * with MSG_ZEROCOPY, which means the kernel may read them
+	 * after ConsumeBucketList() has returned.
+	 *
+	 * A producer which can guarantee that may push buckets with
+	 * PushZeroCopy().  Memory which gets released by the
+	 * following ConsumeBucketList() call must instead be moved
+	 * to the given #ZeroCopyHoldList, which the consumer keeps
+	 * until the kernel has completed the send.  Memory which
+	 * remains with the producer must not be modified or freed
+	 * for as long as the kernel may read from it.
+	 */
+	void EnableZeroCopy(ZeroCopyHoldList &holds) noexcept {
+		zero_copy_holds = &holds;
+	}
+
+	bool IsZeroCopyEnabled() const noexcept {
+		return zero_copy_holds != nullptr;
+	}
+
+	ZeroCopyHoldList *GetZeroCopyHolds() const noexcept {
+		return zero_copy_holds;
+	}
+
 	bool IsEmpty() const noexcept {
 		return list.empty();
 	}
@@ -92,6 +205,29 @@ public:
 		list.emplace_back(buffer);
 	}
 
+	void PushZeroCopy(std::span<const std::byte> buffer) noexcept {
+		assert(IsZeroCopyEnabled());
+
+		if (IsFull()) {
+			SetMore();
+			return;
+		}
+
+		list.emplace_back(buffer, true);
+	}
+
+	void PushFile(FileDescriptor fd, off_t offset, std::size_t size) noexcept {
+		assert(IsFileEnabled());
+		assert(size > 0);
+
+		if (IsFull()) {
+			SetMore();
+			return;
+		}
+
+		list.emplace_back(fd, offset, size);
+	}
+
 	List::const_iterator begin() const noexcept {
 		return list.begin();
 	}
@@ -117,9 +253,21 @@ public:
 		return size;
 	}
 
+	/**
+	 * Returns the number of bytes in all buckets, including
+	 * non-buffer buckets.
+	 */
+	[[gnu::pure]]
+	size_t GetTotalSize() const noexcept {
+		size_t size = 0;
+		for (const auto &bucket : list)
+			size += bucket.GetSize();
+		return size;
+	}
+
 	[[gnu::pure]]
 	bool IsDepleted(size_t consumed) const noexcept {
-		return !HasMore() && consumed == GetTotalBufferSize();
+		return !HasMore() && consumed == GetTotalSize();
 	}
 
 	void SpliceFrom(IstreamBucketList &&src) noexcept {
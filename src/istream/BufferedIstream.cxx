@@ -252,6 +252,7 @@ BufferedIstream::OnDirect(FdType type, FileDescriptor fd, off_t offset,
 	}
 
 	in_pipe += nbytes;
+	pipe.OnSpliced(nbytes);
 	input.ConsumeDirect(nbytes);
 	return IstreamDirectResult::OK;
 }
@@ -4,11 +4,13 @@
 
 #include "DechunkIstream.hxx"
 #include "FacadeIstream.hxx"
+#include "Bucket.hxx"
 #include "UnusedPtr.hxx"
 #include "New.hxx"
 #include "http/ChunkParser.hxx"
 #include "event/DeferEvent.hxx"
 #include "util/DestructObserver.hxx"
+#include "util/StaticVector.hxx"
 
 #include <algorithm>
 
@@ -53,6 +55,35 @@ class DechunkIstream final : public FacadeIstream, DestructAnchor {
 	 */
 	size_t pending_verbatim;
 
+	/**
+	 * Describes one data bucket passed to the caller by
+	 * _FillBucketList(), for _ConsumeBucketList().
+	 */
+	struct BucketChunk {
+		/**
+		 * The number of framing bytes in the input before
+		 * this data bucket.
+		 */
+		size_t framing;
+
+		/**
+		 * The size of this data bucket.
+		 */
+		size_t size;
+
+		/**
+		 * The state of our #HttpChunkParser at the beginning
+		 * of this data bucket.
+		 */
+		HttpChunkParser parser;
+	};
+
+	/**
+	 * The data buckets returned by the last _FillBucketList()
+	 * call.  When this is full, _FillBucketList() stops early.
+	 */
+	StaticVector<BucketChunk, 16> bucket_chunks;
+
 	/**
 	 * This event is used to defer an DechunkHandler::OnDechunkEnd()
 	 * call.
@@ -101,9 +132,15 @@ public:
 
 	off_t _GetAvailable(bool partial) noexcept override;
 	void _Read() noexcept override;
+	void _FillBucketList(IstreamBucketList &list) override;
+	size_t _ConsumeBucketList(size_t nbytes) noexcept override;
 
 protected:
 	/* virtual methods from class IstreamHandler */
+	bool OnIstreamReady() noexcept override {
+		return InvokeReady();
+	}
+
 	size_t OnData(std::span<const std::byte> src) noexcept override;
 	void OnEof() noexcept override;
 	void OnError(std::exception_ptr ep) noexcept override;
@@ -412,6 +449,113 @@ DechunkIstream::_Read() noexcept
 		 !IsEofPending());
 }
 
+void
+DechunkIstream::_FillBucketList(IstreamBucketList &list)
+{
+	bucket_chunks.clear();
+
+	if (verbatim || IsEofPending() || parser.HasEnded()) {
+		/* these are handled only by the OnData() code path */
+		list.SetMore();
+		return;
+	}
+
+	IstreamBucketList tmp;
+
+	try {
+		input.FillBucketList(tmp);
+	} catch (...) {
+		Destroy();
+		throw;
+	}
+
+	/* work with a copy of our HttpChunkParser; the real one is
+	   updated by _ConsumeBucketList() */
+	HttpChunkParser p(parser);
+	size_t framing = 0;
+	bool full = false;
+
+	for (const auto &bucket : tmp) {
+		if (!bucket.IsBuffer())
+			break;
+
+		auto b = bucket.GetBuffer();
+		while (!b.empty()) {
+			std::span<const std::byte> data;
+
+			try {
+				data = p.Parse(b);
+			} catch (...) {
+				Destroy();
+				throw;
+			}
+
+			framing += data.data() - b.data();
+			b = b.subspan(data.data() - b.data());
+
+			if (data.empty())
+				/* the rest of this bucket is framing or
+				   the end chunk has been parsed */
+				break;
+
+			if (list.IsFull() || bucket_chunks.full()) {
+				full = true;
+				break;
+			}
+
+			/* pass the whole payload without copying and
+			   without stepping through the parser */
+			list.Push(data);
+			bucket_chunks.push_back({framing, data.size(), p});
+			framing = 0;
+
+			p.Consume(data.size());
+			b = b.subspan(data.size());
+		}
+
+		if (full || p.HasEnded())
+			break;
+	}
+
+	/* the end chunk is always handled by the OnData() code path,
+	   because it needs to invoke the #DechunkHandler */
+	list.SetMore();
+}
+
+size_t
+DechunkIstream::_ConsumeBucketList(size_t nbytes) noexcept
+{
+	size_t consumed = 0, input_consumed = 0;
+
+	for (const auto &i : bucket_chunks) {
+		if (nbytes == 0)
+			break;
+
+		const size_t n = std::min(nbytes, i.size);
+		input_consumed += i.framing + n;
+		consumed += n;
+		nbytes -= n;
+
+		parser = i.parser;
+		parser.Consume(n);
+
+		if (n < i.size)
+			break;
+	}
+
+	bucket_chunks.clear();
+
+	if (input_consumed > 0) {
+		[[maybe_unused]] size_t input_consumed2 =
+			input.ConsumeBucketList(input_consumed);
+		assert(input_consumed2 == input_consumed);
+	}
+
+	seen_data -= std::min(seen_data, consumed);
+
+	return Consumed(consumed);
+}
+
 /*
  * constructor
  *
@@ -6,6 +6,7 @@
 #include "istream.hxx"
 #include "New.hxx"
 #include "Result.hxx"
+#include "Bucket.hxx"
 #include "lib/fmt/RuntimeError.hxx"
 #include "lib/fmt/SystemError.hxx"
 #include "io/Buffered.hxx"
@@ -102,6 +103,8 @@ private:
 		TryRead();
 	}
 
+	void _FillBucketList(IstreamBucketList &list) override;
+	std::size_t _ConsumeBucketList(std::size_t nbytes) noexcept override;
 	void _ConsumeDirect(std::size_t nbytes) noexcept override;
 
 	int _AsFd() noexcept override;
@@ -243,6 +246,49 @@ FileIstream::_Skip(off_t length) noexcept
 	return result;
 }
 
+void
+FileIstream::_FillBucketList(IstreamBucketList &list)
+{
+	if (!list.IsFileEnabled()) {
+		/* the consumer needs to call _Read() */
+		list.SetMore();
+		return;
+	}
+
+	/* data which was read into the buffer before needs to be
+	   submitted first */
+	if (auto r = buffer.Read(); !r.empty())
+		list.Push(r);
+
+	if (offset < end_offset) {
+		const std::size_t size = GetMaxRead();
+		list.PushFile(fd, offset, size);
+
+		if (offset + off_t(size) < end_offset)
+			list.SetMore();
+	}
+}
+
+std::size_t
+FileIstream::_ConsumeBucketList(std::size_t nbytes) noexcept
+{
+	retry_event.Cancel();
+
+	std::size_t consumed = 0;
+
+	if (auto r = buffer.Read(); !r.empty()) {
+		consumed = std::min(nbytes, r.size());
+		buffer.Consume(consumed);
+		nbytes -= consumed;
+	}
+
+	const std::size_t from_file = std::min<off_t>(nbytes, end_offset - offset);
+	offset += from_file;
+	consumed += from_file;
+
+	return Consumed(consumed);
+}
+
 void
 FileIstream::_ConsumeDirect(std::size_t nbytes) noexcept
 {
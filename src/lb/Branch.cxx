@@ -12,11 +12,35 @@ LbGotoIf::LbGotoIf(LbGotoMap &goto_map, const LbGotoIfConfig &_config)
 {
 }
 
+static std::vector<LbGotoIf>
+ToInstance(LbGotoMap &goto_map, const LbBranchConfig &config)
+{
+	std::vector<LbGotoIf> conditions;
+	conditions.reserve(config.conditions.size());
+
+	for (const auto &i : config.conditions)
+		conditions.emplace_back(goto_map, i);
+
+	return conditions;
+}
+
+static std::vector<const LbConditionConfig *>
+ToConditions(const LbBranchConfig &config) noexcept
+{
+	std::vector<const LbConditionConfig *> conditions;
+	conditions.reserve(config.conditions.size());
+
+	for (const auto &i : config.conditions)
+		conditions.push_back(&i.condition);
+
+	return conditions;
+}
+
 LbBranch::LbBranch(LbGotoMap &goto_map,
 		   const LbBranchConfig &_config)
 	:config(_config),
-	 fallback(goto_map.GetInstance(config.fallback))
+	 fallback(goto_map.GetInstance(config.fallback)),
+	 conditions(ToInstance(goto_map, config)),
+	 matcher(ToConditions(config))
 {
-	for (const auto &i : config.conditions)
-		conditions.emplace_back(goto_map, i);
 }
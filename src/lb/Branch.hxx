@@ -6,8 +6,9 @@
 
 #include "Goto.hxx"
 #include "GotoConfig.hxx"
+#include "BranchMatcher.hxx"
 
-#include <list>
+#include <vector>
 
 class LbGotoMap;
 struct LbGotoIfConfig;
@@ -41,7 +42,12 @@ class LbBranch {
 
 	LbGoto fallback;
 
-	std::list<LbGotoIf> conditions;
+	std::vector<LbGotoIf> conditions;
+
+	/**
+	 * Finds the first matching item of #conditions.
+	 */
+	const LbBranchMatcher matcher;
 
 public:
 	LbBranch(LbGotoMap &goto_map, const LbBranchConfig &_config);
@@ -53,9 +59,9 @@ public:
 	template<typename R>
 	[[gnu::pure]]
 	const LbGoto &FindRequestLeaf(const R &request) const noexcept {
-		for (const auto &i : conditions)
-			if (i.MatchRequest(request))
-				return i.GetDestination().FindRequestLeaf(request);
+		const std::size_t i = matcher.FindRequest(request);
+		if (i < conditions.size())
+			return conditions[i].GetDestination().FindRequestLeaf(request);
 
 		return fallback.FindRequestLeaf(request);
 	}
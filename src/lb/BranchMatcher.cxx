@@ -0,0 +1,482 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#include "BranchMatcher.hxx"
+#include "net/IPv4Address.hxx"
+
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+
+using std::string_view_literals::operator""sv;
+
+/**
+ * A parsed address mask which can be inserted into #LbAddressTrie.
+ */
+struct LbAddressMask {
+	std::array<uint8_t, 16> address;
+
+	/**
+	 * AF_INET or AF_INET6.
+	 */
+	int family;
+
+	unsigned prefix_length;
+
+	/**
+	 * Parse an address mask in the form "ADDRESS[/PREFIX]".  This
+	 * supports only a subset of the #MaskedSocketAddress syntax;
+	 * everything else (e.g. IPv4-mapped IPv6 addresses or local
+	 * socket paths) is left to #MaskedSocketAddress.
+	 *
+	 * @return false if the mask is not supported
+	 */
+	bool Parse(std::string_view s) noexcept;
+};
+
+bool
+LbAddressMask::Parse(std::string_view s) noexcept
+{
+	std::string_view prefix{};
+
+	if (const auto slash = s.find('/'); slash != s.npos) {
+		prefix = s.substr(slash + 1);
+		s = s.substr(0, slash);
+	}
+
+	if (s.size() > 2 && s.front() == '[' && s.back() == ']')
+		s = s.substr(1, s.size() - 2);
+
+	char buffer[INET6_ADDRSTRLEN];
+	if (s.empty() || s.size() >= sizeof(buffer))
+		return false;
+
+	*std::copy(s.begin(), s.end(), buffer) = 0;
+
+	unsigned max_prefix_length;
+	if (inet_pton(AF_INET, buffer, address.data()) == 1) {
+		family = AF_INET;
+		max_prefix_length = 32;
+	} else if (inet_pton(AF_INET6, buffer, address.data()) == 1) {
+		struct in6_addr in6;
+		std::copy_n(address.begin(), sizeof(in6), (uint8_t *)&in6);
+		if (IN6_IS_ADDR_V4MAPPED(&in6))
+			return false;
+
+		family = AF_INET6;
+		max_prefix_length = 128;
+	} else
+		return false;
+
+	if (prefix.data() == nullptr) {
+		prefix_length = max_prefix_length;
+		return true;
+	}
+
+	if (prefix.empty() || prefix.size() > 3)
+		return false;
+
+	prefix_length = 0;
+	for (const char ch : prefix) {
+		if (ch < '0' || ch > '9')
+			return false;
+
+		prefix_length = prefix_length * 10 + (ch - '0');
+	}
+
+	return prefix_length <= max_prefix_length;
+}
+
+/**
+ * A binary trie of address prefixes, one per address family.  Each
+ * node stores the lowest condition index of all masks ending there.
+ */
+class LbAddressTrie {
+	struct Node {
+		/**
+		 * Indexes into the node vector; 0 means "no child"
+		 * (the root is never a child).
+		 */
+		std::array<uint32_t, 2> children{};
+
+		std::size_t index = LbBranchMatcher::NONE;
+	};
+
+	std::vector<Node> ipv4{1}, ipv6{1};
+
+public:
+	void Insert(const LbAddressMask &mask, std::size_t index) noexcept {
+		Insert(mask.family == AF_INET ? ipv4 : ipv6,
+		       mask.address.data(), mask.prefix_length, index);
+	}
+
+	[[gnu::pure]]
+	std::size_t Find(SocketAddress address) const noexcept;
+
+private:
+	static constexpr unsigned GetBit(const uint8_t *address,
+					 unsigned i) noexcept {
+		return (address[i / 8] >> (7 - i % 8)) & 1;
+	}
+
+	static void Insert(std::vector<Node> &nodes, const uint8_t *address,
+			   unsigned prefix_length, std::size_t index) noexcept;
+
+	[[gnu::pure]]
+	static std::size_t Find(const std::vector<Node> &nodes,
+				const uint8_t *address, unsigned n_bits) noexcept;
+};
+
+void
+LbAddressTrie::Insert(std::vector<Node> &nodes, const uint8_t *address,
+		      unsigned prefix_length, std::size_t index) noexcept
+{
+	uint32_t node = 0;
+
+	for (unsigned i = 0; i < prefix_length; ++i) {
+		const unsigned bit = GetBit(address, i);
+		uint32_t child = nodes[node].children[bit];
+		if (child == 0) {
+			child = nodes.size();
+			nodes.emplace_back();
+			nodes[node].children[bit] = child;
+		}
+
+		node = child;
+	}
+
+	nodes[node].index = std::min(nodes[node].index, index);
+}
+
+std::size_t
+LbAddressTrie::Find(const std::vector<Node> &nodes,
+		    const uint8_t *address, unsigned n_bits) noexcept
+{
+	std::size_t best = nodes.front().index;
+
+	uint32_t node = 0;
+	for (unsigned i = 0; i < n_bits; ++i) {
+		node = nodes[node].children[GetBit(address, i)];
+		if (node == 0)
+			break;
+
+		best = std::min(best, nodes[node].index);
+	}
+
+	return best;
+}
+
+std::size_t
+LbAddressTrie::Find(SocketAddress address) const noexcept
+{
+	/* same as LbConditionConfig::MatchAddress() */
+	IPv4Address ipv4_buffer;
+	if (address.IsV4Mapped()) {
+		ipv4_buffer = address.UnmapV4();
+		address = ipv4_buffer;
+	}
+
+	switch (address.GetFamily()) {
+	case AF_INET:
+		return Find(ipv4,
+			    (const uint8_t *)&((const struct sockaddr_in *)address.GetAddress())->sin_addr,
+			    32);
+
+	case AF_INET6:
+		return Find(ipv6,
+			    (const uint8_t *)&((const struct sockaddr_in6 *)address.GetAddress())->sin6_addr,
+			    128);
+
+	default:
+		return LbBranchMatcher::NONE;
+	}
+}
+
+/**
+ * Several regular expressions combined into one, which finds the
+ * lowest index of all matching expressions with a single
+ * pcre2_match() call.
+ *
+ * Each expression is wrapped in an anchored lookahead, followed by a
+ * (*MARK) with its position.  Alternatives are tried in order, so
+ * the first one which matches anywhere in the subject wins, and
+ * pcre2_get_mark() tells which one it was.
+ */
+class LbRegexSet {
+	pcre2_code *code = nullptr;
+
+	/**
+	 * Reused for all matches; this is fine because beng-lb is
+	 * single-threaded.
+	 */
+	pcre2_match_data *match_data = nullptr;
+
+	/**
+	 * Maps the alternative number (the mark) to the condition
+	 * index.
+	 */
+	std::vector<std::size_t> members;
+
+public:
+	/**
+	 * Throws on error.
+	 */
+	LbRegexSet(std::span<const LbConditionConfig *const> conditions,
+		   std::span<const std::size_t> _members);
+
+	~LbRegexSet() noexcept {
+		pcre2_match_data_free(match_data);
+		pcre2_code_free(code);
+	}
+
+	LbRegexSet(const LbRegexSet &) = delete;
+	LbRegexSet &operator=(const LbRegexSet &) = delete;
+
+	/**
+	 * Can this expression be embedded in a combined one?  This
+	 * rejects constructs which might leak out of the surrounding
+	 * group (e.g. an unterminated "\Q" or an extended-mode
+	 * comment) or interfere with the (*MARK) (backtracking
+	 * control verbs and "\K").
+	 */
+	[[gnu::pure]]
+	static bool CanCombine(std::string_view source) noexcept {
+		return !source.empty() &&
+			source.find("\\Q"sv) == source.npos &&
+			source.find("\\K"sv) == source.npos &&
+			source.find("(*"sv) == source.npos &&
+			source.find('#') == source.npos;
+	}
+
+	[[gnu::pure]]
+	std::size_t Find(std::string_view s) const noexcept;
+};
+
+LbRegexSet::LbRegexSet(std::span<const LbConditionConfig *const> conditions,
+		       std::span<const std::size_t> _members)
+	:members(_members.begin(), _members.end())
+{
+	std::string pattern = "(?:";
+
+	for (std::size_t i = 0; i < members.size(); ++i) {
+		if (i > 0)
+			pattern += '|';
+
+		pattern += "(?=[\\s\\S]*?(?:"sv;
+		pattern += conditions[members[i]]->source;
+		pattern += "))(*MARK:"sv;
+		pattern += std::to_string(i);
+		pattern += ')';
+	}
+
+	pattern += ')';
+
+	/* the same options as UniqueRegex, plus PCRE2_ANCHORED for
+	   the lookahead chain */
+	int error_number;
+	PCRE2_SIZE error_offset;
+	code = pcre2_compile((PCRE2_SPTR)pattern.data(), pattern.size(),
+			     PCRE2_ANCHORED|PCRE2_DOTALL|PCRE2_NO_AUTO_CAPTURE,
+			     &error_number, &error_offset, nullptr);
+	if (code == nullptr)
+		throw std::runtime_error("Failed to combine regular expressions");
+
+	pcre2_jit_compile(code, PCRE2_JIT_COMPLETE);
+
+	match_data = pcre2_match_data_create_from_pattern(code, nullptr);
+	if (match_data == nullptr) {
+		pcre2_code_free(code);
+		throw std::bad_alloc();
+	}
+}
+
+std::size_t
+LbRegexSet::Find(std::string_view s) const noexcept
+{
+	if (pcre2_match(code, (PCRE2_SPTR)s.data(), s.size(), 0, 0,
+			match_data, nullptr) < 0)
+		return LbBranchMatcher::NONE;
+
+	const PCRE2_SPTR mark = pcre2_get_mark(match_data);
+	if (mark == nullptr)
+		return LbBranchMatcher::NONE;
+
+	const std::size_t i = strtoul((const char *)mark, nullptr, 10);
+	if (i >= members.size())
+		return LbBranchMatcher::NONE;
+
+	return members[i];
+}
+
+LbBranchMatcher::Group::Group(const LbConditionConfig &condition,
+			      std::size_t index) noexcept
+	:attribute(&condition.attribute_reference), first(index),
+	 type(GroupType::SINGLE), single(&condition)
+{
+}
+
+LbBranchMatcher::Group::Group(GroupType _type,
+			      std::span<const LbConditionConfig *const> conditions,
+			      std::span<const std::size_t> members)
+	:attribute(&conditions[members.front()]->attribute_reference),
+	 first(members.front()), type(_type)
+{
+	switch (type) {
+	case GroupType::SINGLE:
+		assert(false);
+		gcc_unreachable();
+
+	case GroupType::EXACT:
+		for (const std::size_t i : members)
+			/* emplace() keeps the first (lowest) index */
+			exact.emplace(std::get<std::string>(conditions[i]->value), i);
+		break;
+
+	case GroupType::REGEX:
+		regex = std::make_unique<LbRegexSet>(conditions, members);
+		break;
+
+	case GroupType::ADDRESS:
+		addresses = std::make_unique<LbAddressTrie>();
+		for (const std::size_t i : members) {
+			LbAddressMask mask;
+			if (!mask.Parse(conditions[i]->source))
+				throw std::invalid_argument("Unsupported address mask");
+
+			addresses->Insert(mask, i);
+		}
+		break;
+	}
+}
+
+LbBranchMatcher::Group::Group(Group &&) noexcept = default;
+
+LbBranchMatcher::Group &
+LbBranchMatcher::Group::operator=(Group &&) noexcept = default;
+
+LbBranchMatcher::Group::~Group() noexcept = default;
+
+std::size_t
+LbBranchMatcher::Group::FindString(std::string_view s) const noexcept
+{
+	switch (type) {
+	case GroupType::EXACT:
+		if (const auto i = exact.find(s); i != exact.end())
+			return i->second;
+		return NONE;
+
+	case GroupType::REGEX:
+		return regex->Find(s);
+
+	case GroupType::SINGLE:
+	case GroupType::ADDRESS:
+		break;
+	}
+
+	assert(false);
+	gcc_unreachable();
+}
+
+std::size_t
+LbBranchMatcher::Group::FindAddress(SocketAddress address) const noexcept
+{
+	assert(type == GroupType::ADDRESS);
+
+	return addresses->Find(address);
+}
+
+LbBranchMatcher::GroupType
+LbBranchMatcher::GetGroupType(const LbConditionConfig &condition) noexcept
+{
+	if (condition.negate)
+		return GroupType::SINGLE;
+
+	struct Helper {
+		const std::string &source;
+
+		GroupType operator()(const std::string &) const noexcept {
+			return GroupType::EXACT;
+		}
+
+		GroupType operator()(const UniqueRegex &) const noexcept {
+			return LbRegexSet::CanCombine(source)
+				? GroupType::REGEX
+				: GroupType::SINGLE;
+		}
+
+		GroupType operator()(const MaskedSocketAddress &) const noexcept {
+			LbAddressMask mask;
+			return mask.Parse(source)
+				? GroupType::ADDRESS
+				: GroupType::SINGLE;
+		}
+	};
+
+	return std::visit(Helper{condition.source}, condition.value);
+}
+
+LbBranchMatcher::LbBranchMatcher(std::span<const LbConditionConfig *const> conditions)
+{
+	struct Pending {
+		GroupType type;
+		const LbAttributeReference &attribute;
+		std::vector<std::size_t> members;
+	};
+
+	std::vector<Pending> pending;
+
+	for (std::size_t i = 0; i < conditions.size(); ++i) {
+		const auto &condition = *conditions[i];
+		const auto type = GetGroupType(condition);
+		if (type == GroupType::SINGLE) {
+			groups.emplace_back(condition, i);
+			continue;
+		}
+
+		auto p = std::find_if(pending.begin(), pending.end(),
+				      [type, &condition](const Pending &j){
+					      return j.type == type &&
+						      j.attribute == condition.attribute_reference;
+				      });
+		if (p == pending.end()) {
+			pending.push_back({type, condition.attribute_reference, {}});
+			p = std::prev(pending.end());
+		}
+
+		p->members.push_back(i);
+	}
+
+	for (const auto &i : pending) {
+		if (i.members.size() > 1) {
+			try {
+				groups.emplace_back(i.type, conditions, i.members);
+				continue;
+			} catch (...) {
+				/* cannot be combined; fall back to
+				   evaluating each condition on its
+				   own */
+			}
+		}
+
+		for (const std::size_t j : i.members)
+			groups.emplace_back(*conditions[j], j);
+	}
+
+	std::sort(groups.begin(), groups.end(),
+		  [](const Group &a, const Group &b){
+			  return a.GetFirst() < b.GetFirst();
+		  });
+}
+
+LbBranchMatcher::~LbBranchMatcher() noexcept = default;
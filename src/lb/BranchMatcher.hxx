@@ -0,0 +1,174 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#pragma once
+
+#include "ConditionConfig.hxx"
+#include "net/SocketAddress.hxx"
+
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class LbRegexSet;
+class LbAddressTrie;
+
+/**
+ * Finds the first matching condition of a branch without evaluating
+ * all conditions one after another.
+ *
+ * At configuration load time, non-negated conditions on the same
+ * attribute are combined into groups: string comparisons into a hash
+ * map, regular expressions into one combined regular expression and
+ * address masks into a prefix trie.  Each group yields the lowest
+ * index of its matching members.  Groups are visited in the order of
+ * their lowest member index, so the search stops as soon as no
+ * remaining group can beat the best match; this keeps first-match
+ * semantics.  Everything else (e.g. negated conditions) is evaluated
+ * as before.
+ */
+class LbBranchMatcher {
+public:
+	static constexpr std::size_t NONE = std::numeric_limits<std::size_t>::max();
+
+private:
+	enum class GroupType {
+		/**
+		 * A single condition which is evaluated with
+		 * LbConditionConfig::MatchRequest().
+		 */
+		SINGLE,
+
+		EXACT,
+		REGEX,
+		ADDRESS,
+	};
+
+	struct StringHash {
+		using is_transparent = void;
+
+		[[gnu::pure]]
+		std::size_t operator()(std::string_view s) const noexcept {
+			return std::hash<std::string_view>{}(s);
+		}
+	};
+
+	class Group {
+		const LbAttributeReference *attribute;
+
+		/**
+		 * The lowest index of all members.
+		 */
+		std::size_t first;
+
+		GroupType type;
+
+		/**
+		 * Only for #GroupType::SINGLE.
+		 */
+		const LbConditionConfig *single = nullptr;
+
+		/**
+		 * Only for #GroupType::EXACT: maps the value to the
+		 * lowest index of all conditions comparing with it.
+		 */
+		std::unordered_map<std::string, std::size_t,
+				   StringHash, std::equal_to<>> exact;
+
+		std::unique_ptr<LbRegexSet> regex;
+		std::unique_ptr<LbAddressTrie> addresses;
+
+	public:
+		Group(const LbConditionConfig &condition,
+		      std::size_t index) noexcept;
+
+		/**
+		 * Throws if the group cannot be built (e.g. because
+		 * the regular expressions cannot be combined).
+		 */
+		Group(GroupType _type,
+		      std::span<const LbConditionConfig *const> conditions,
+		      std::span<const std::size_t> members);
+
+		Group(Group &&) noexcept;
+		Group &operator=(Group &&) noexcept;
+		~Group() noexcept;
+
+		std::size_t GetFirst() const noexcept {
+			return first;
+		}
+
+		template<typename R>
+		[[gnu::pure]]
+		std::size_t FindRequest(const R &request) const noexcept {
+			switch (type) {
+			case GroupType::SINGLE:
+				return single->MatchRequest(request) ? first : NONE;
+
+			case GroupType::ADDRESS:
+				return FindAddress(request.remote_address);
+
+			case GroupType::EXACT:
+			case GroupType::REGEX:
+				break;
+			}
+
+			const char *s = attribute->GetRequestAttribute(request);
+			if (s == nullptr)
+				s = "";
+
+			return FindString(s);
+		}
+
+	private:
+		[[gnu::pure]]
+		std::size_t FindString(std::string_view s) const noexcept;
+
+		[[gnu::pure]]
+		std::size_t FindAddress(SocketAddress address) const noexcept;
+	};
+
+	/**
+	 * Sorted by Group::GetFirst().
+	 */
+	std::vector<Group> groups;
+
+public:
+	explicit LbBranchMatcher(std::span<const LbConditionConfig *const> conditions);
+	~LbBranchMatcher() noexcept;
+
+	LbBranchMatcher(const LbBranchMatcher &) = delete;
+	LbBranchMatcher &operator=(const LbBranchMatcher &) = delete;
+
+	/**
+	 * @return the index of the first matching condition or #NONE
+	 */
+	template<typename R>
+	[[gnu::pure]]
+	std::size_t FindRequest(const R &request) const noexcept {
+		std::size_t best = NONE;
+
+		for (const auto &i : groups) {
+			if (i.GetFirst() >= best)
+				/* no remaining group can find an earlier
+				   condition */
+				break;
+
+			const std::size_t index = i.FindRequest(request);
+			if (index < best)
+				best = index;
+		}
+
+		return best;
+	}
+
+private:
+	[[gnu::pure]]
+	static GroupType GetGroupType(const LbConditionConfig &condition) noexcept;
+};
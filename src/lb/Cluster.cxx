@@ -10,6 +10,7 @@
 #include "MonitorRef.hxx"
 #include "fs/Stock.hxx"
 #include "fs/Balancer.hxx"
+#include "fs/Prewarm.hxx"
 #include "fs/Handler.hxx"
 #include "ssl/SslSocketFilterFactory.hxx"
 #include "cluster/StickyCache.hxx"
@@ -34,6 +35,9 @@
 #include "lib/avahi/Explorer.hxx"
 #endif
 
+static constexpr Event::Duration LB_PREWARM_CONNECT_TIMEOUT =
+	std::chrono::seconds(20);
+
 #ifdef HAVE_AVAHI
 
 class LbCluster::StickyRing final
@@ -111,6 +115,14 @@ LbCluster::LbCluster(const LbClusterConfig &_config,
 		auto &failure = failure_manager.Make(address);
 
 		static_members.emplace_back(std::move(address), failure);
+
+		if (config.prewarm > 0)
+			prewarm.emplace_front(fs_stock,
+					      static_members.back().address,
+					      socket_filter_factory.get(),
+					      failure, last_demand,
+					      LB_PREWARM_CONNECT_TIMEOUT,
+					      config.prewarm);
 	}
 
 	if (monitors != nullptr)
@@ -187,6 +199,8 @@ LbCluster::ConnectStaticHttp(AllocatorPtr alloc,
 {
 	assert(config.protocol == LbProtocol::HTTP);
 
+	last_demand = fs_balancer.GetEventLoop().SteadyNow();
+
 	fs_balancer.Get(alloc, parent_stopwatch,
 			fairness_hash,
 			config.transparent_source,
@@ -31,6 +31,7 @@ class FailureManager;
 class BalancerMap;
 class FilteredSocketStock;
 class FilteredSocketBalancer;
+class FilteredSocketPrewarm;
 class StickyCache;
 namespace Avahi { class ServiceExplorer; }
 class StopwatchPtr;
@@ -69,6 +70,18 @@ class LbCluster final
 
 	std::vector<StaticMember> static_members;
 
+	/**
+	 * The time of the most recent HTTP request to a static
+	 * member.  This is the "demand" for #prewarm.
+	 */
+	Event::TimePoint last_demand{};
+
+	/**
+	 * Pre-opened connections to static members.  Only used if
+	 * #LbClusterConfig::prewarm is enabled.
+	 */
+	std::forward_list<FilteredSocketPrewarm> prewarm;
+
 #ifdef HAVE_AVAHI
 	/**
 	 * This #AvahiServiceExplorer locates Zeroconf nodes.
@@ -91,6 +91,14 @@ struct LbClusterConfig {
 
 	bool mangle_via = false;
 
+	/**
+	 * If non-zero, then this number of idle HTTP connections to
+	 * each static member is kept open while there is demand.
+	 *
+	 * @see FilteredSocketPrewarm
+	 */
+	unsigned prewarm = 0;
+
 #ifdef HAVE_AVAHI
 	/**
 	 * Enable the #StickyCache for Zeroconf?  By default, consistent
@@ -34,6 +34,11 @@ struct LbAttributeReference {
 		return type == Type::REMOTE_ADDRESS;
 	}
 
+	[[gnu::pure]]
+	bool operator==(const LbAttributeReference &other) const noexcept {
+		return type == other.type && name == other.name;
+	}
+
 	template<typename R>
 	[[gnu::pure]]
 	const char *GetRequestAttribute(const R &request) const noexcept {
@@ -65,20 +70,27 @@ struct LbConditionConfig {
 
 	std::variant<std::string, UniqueRegex, MaskedSocketAddress> value;
 
+	/**
+	 * The regular expression or the address mask as specified in
+	 * the configuration file; used by #LbBranchMatcher to combine
+	 * conditions.  Empty for string comparisons.
+	 */
+	std::string source;
+
 	LbConditionConfig(LbAttributeReference &&a, bool _negate,
 			  const char *_string) noexcept
 		:attribute_reference(std::move(a)),
 		 negate(_negate), value(_string) {}
 
 	LbConditionConfig(LbAttributeReference &&a, bool _negate,
-			  UniqueRegex &&_regex) noexcept
+			  UniqueRegex &&_regex, const char *_source) noexcept
 		:attribute_reference(std::move(a)),
-		 negate(_negate), value(std::move(_regex)) {}
+		 negate(_negate), value(std::move(_regex)), source(_source) {}
 
 	LbConditionConfig(LbAttributeReference &&a, bool _negate,
-			  MaskedSocketAddress &&_mask) noexcept
+			  MaskedSocketAddress &&_mask, const char *_source) noexcept
 		:attribute_reference(std::move(a)),
-		 negate(_negate), value(std::move(_mask)) {}
+		 negate(_negate), value(std::move(_mask)), source(_source) {}
 
 	LbConditionConfig(LbConditionConfig &&other) = default;
 
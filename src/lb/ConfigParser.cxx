@@ -655,6 +655,9 @@ LbConfigParser::Cluster::ParseLine(FileLineParser &line)
 	} else if (StringIsEqual(word, "mangle_via")) {
 		config.mangle_via = line.NextBool();
 
+		line.ExpectEnd();
+	} else if (StringIsEqual(word, "prewarm")) {
+		config.prewarm = line.NextPositiveInteger();
 		line.ExpectEnd();
 	} else if (StringIsEqual(word, "fallback")) {
 		if (config.fallback.IsDefined())
@@ -717,6 +720,17 @@ LbConfigParser::Cluster::Finish()
 	if (config.protocol != LbProtocol::HTTP && config.ssl)
 		throw LineParser::Error{"SSL/TLS only available with HTTP"};
 
+	if (config.prewarm > 0) {
+		if (config.protocol != LbProtocol::HTTP)
+			throw LineParser::Error{"prewarm only available with HTTP"};
+
+		if (config.transparent_source)
+			throw LineParser::Error{"prewarm not available with transparent source"};
+
+		if (config.HasZeroConf())
+			throw LineParser::Error{"prewarm not available with Zeroconf"};
+	}
+
 #ifdef HAVE_AVAHI
 	if (config.HasZeroConf() &&
 	    !ValidateZeroconfSticky(config.sticky_mode))
@@ -801,7 +815,7 @@ ParseCondition(FileLineParser &line)
 		if (s == nullptr)
 			throw LineParser::Error("Value expected");
 
-		return {std::move(a), negate, MaskedSocketAddress{s}};
+		return {std::move(a), negate, MaskedSocketAddress{s}, s};
 	}
 
 	bool re, negate;
@@ -828,7 +842,8 @@ ParseCondition(FileLineParser &line)
 		throw LineParser::Error("Regular expression expected");
 
 	if (re)
-		return {std::move(a), negate, UniqueRegex(string, false, false)};
+		return {std::move(a), negate, UniqueRegex(string, false, false),
+			string};
 	else
 		return {std::move(a), negate, string};
 }
@@ -940,6 +955,23 @@ LbConfigParser::CreateBranch(FileLineParser &line)
 	SetChild(std::make_unique<Branch>(*this, name));
 }
 
+/**
+ * Is this a lower-case HTTP header name?
+ */
+[[gnu::pure]]
+static bool
+IsValidHeaderName(const char *p) noexcept
+{
+	if (*p == 0)
+		return false;
+
+	for (; *p != 0; ++p)
+		if (!IsLowerAlphaASCII(*p) && !IsDigitASCII(*p) && *p != '-')
+			return false;
+
+	return true;
+}
+
 void
 LbConfigParser::LuaHandler::ParseLine(FileLineParser &line)
 {
@@ -955,6 +987,30 @@ LbConfigParser::LuaHandler::ParseLine(FileLineParser &line)
 			throw LineParser::Error("Duplicate 'function'");
 
 		config.function = line.ExpectValueAndEnd();
+	} else if (StringIsEqual(word, "cache_vary")) {
+		if (config.cache_vary.IsDefined())
+			throw LineParser::Error("Duplicate 'cache_vary'");
+
+		auto &vary = config.cache_vary;
+
+		do {
+			const char *name = line.ExpectValue();
+			if (StringIsEqual(name, "uri"))
+				vary.uri = true;
+			else if (StringIsEqual(name, "path"))
+				vary.path = true;
+			else if (StringIsEqual(name, "method"))
+				vary.method = true;
+			else if (StringIsEqual(name, "has_body"))
+				vary.has_body = true;
+			else if (StringIsEqual(name, "remote_host"))
+				vary.remote_host = true;
+			else if (IsValidHeaderName(name))
+				vary.headers.emplace_back(name);
+			else
+				throw FmtRuntimeError("Invalid cache_vary attribute: {}",
+						      name);
+		} while (!line.IsEnd());
 	} else
 		throw LineParser::Error("Unknown option");
 }
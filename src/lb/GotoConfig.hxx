@@ -14,7 +14,9 @@
 #include <string>
 #include <list>
 #include <map>
+#include <string_view>
 #include <variant>
+#include <vector>
 
 struct LbClusterConfig;
 struct LbBranchConfig;
@@ -122,6 +124,33 @@ struct LbBranchConfig {
 #endif
 };
 
+/**
+ * The request attributes a #LbLuaHandlerConfig depends on (the
+ * "cache_vary" setting).
+ */
+struct LbLuaCacheVary {
+	bool uri = false, path = false, method = false;
+	bool has_body = false, remote_host = false;
+
+	/**
+	 * Lower-case names of request headers.
+	 */
+	std::vector<std::string> headers;
+
+	bool IsDefined() const noexcept {
+		return uri || path || method || has_body || remote_host ||
+			!headers.empty();
+	}
+
+	[[gnu::pure]]
+	bool HasHeader(std::string_view name) const noexcept {
+		for (const auto &i : headers)
+			if (i == name)
+				return true;
+		return false;
+	}
+};
+
 /**
  * An HTTP request handler implemented in Lua.
  */
@@ -131,6 +160,13 @@ struct LbLuaHandlerConfig {
 	std::filesystem::path path;
 	std::string function;
 
+	/**
+	 * If defined, then the handler promises that its decision
+	 * depends only on these request attributes, and the decision
+	 * is memoized in a #LbLuaCache.
+	 */
+	LbLuaCacheVary cache_vary;
+
 	explicit LbLuaHandlerConfig(const char *_name) noexcept
 		:name(_name) {}
 
@@ -42,6 +42,9 @@ LbGotoMap::FlushCaches() noexcept
 {
 	for (auto &i : translation_handlers)
 		i.second.FlushCache();
+
+	for (auto &i : lua_handlers)
+		i.second.FlushCache();
 }
 
 void
@@ -60,6 +63,19 @@ LbGotoMap::GetAllocatedTranslationCacheMemory() const noexcept
 	return result;
 }
 
+std::vector<std::pair<const char *, LbLuaCacheStats>>
+LbGotoMap::GetLuaCacheStats() const noexcept
+{
+	std::vector<std::pair<const char *, LbLuaCacheStats>> result;
+
+	for (const auto &[config, handler] : lua_handlers)
+		if (handler.HasCache())
+			result.emplace_back(config->name.c_str(),
+					    handler.GetCacheStats());
+
+	return result;
+}
+
 LbGoto
 LbGotoMap::GetInstance(const char *name)
 {
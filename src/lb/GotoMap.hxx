@@ -6,9 +6,12 @@
 
 #include "Context.hxx"
 #include "LuaInitHook.hxx"
+#include "LuaCacheStats.hxx"
 
 #include <cstddef>
 #include <map>
+#include <utility>
+#include <vector>
 
 struct LbConfig;
 struct LbGoto;
@@ -66,6 +69,12 @@ public:
 	[[gnu::pure]]
 	std::size_t GetAllocatedTranslationCacheMemory() const noexcept;
 
+	/**
+	 * Collect the statistics of all #LbLuaHandler decision
+	 * caches, keyed by handler name.
+	 */
+	std::vector<std::pair<const char *, LbLuaCacheStats>> GetLuaCacheStats() const noexcept;
+
 	LbGoto GetInstance(const char *name);
 	LbGoto GetInstance(const LbGotoConfig &config);
 
@@ -120,7 +120,7 @@ NewLbHttpConnection(LbInstance &instance,
 							      ? (SocketAddress)local_address
 							      : nullptr,
 							      address,
-							      false,
+							      false, 0,
 							      *connection,
 							      *connection);
 
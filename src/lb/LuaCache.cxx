@@ -0,0 +1,115 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#include "LuaCache.hxx"
+#include "GotoConfig.hxx"
+#include "http/IncomingRequest.hxx"
+#include "http/Method.hxx"
+#include "pool/pool.hxx"
+
+using std::string_view_literals::operator""sv;
+
+LbLuaCache::Item::Item(const LbGoto &src) noexcept
+	:destination(src)
+{
+	if (src.resolve_connect != nullptr) {
+		resolve_connect = src.resolve_connect;
+		destination.resolve_connect = nullptr;
+	}
+}
+
+LbLuaCacheStats
+LbLuaCache::GetStats() const noexcept
+{
+	LbLuaCacheStats result = stats;
+	result.allocated_memory = 0;
+
+	cache.ForEach([&result](const std::string &key, const Item &item){
+		result.allocated_memory += key.length() + item.GetAllocatedMemory();
+	});
+
+	return result;
+}
+
+/**
+ * Append one value to the cache key.  The length prefix makes the
+ * key unambiguous even if values contain separator characters, and
+ * a missing value (nullptr) is different from an empty one.
+ */
+static void
+AppendKeyValue(std::string &key, std::string_view value) noexcept
+{
+	key += std::to_string(value.size());
+	key += ':';
+	key += value;
+}
+
+static void
+AppendKeyValue(std::string &key, const char *value) noexcept
+{
+	if (value == nullptr)
+		key += '-';
+	else
+		AppendKeyValue(key, std::string_view{value});
+}
+
+std::string
+LbLuaCache::MakeKey(const IncomingHttpRequest &request) const noexcept
+{
+	std::string key;
+
+	if (vary.uri)
+		AppendKeyValue(key, request.uri);
+
+	if (vary.path) {
+		std::string_view path = request.uri;
+		if (const auto q = path.find('?'); q != path.npos)
+			path = path.substr(0, q);
+		AppendKeyValue(key, path);
+	}
+
+	if (vary.method)
+		AppendKeyValue(key, http_method_to_string(request.method));
+
+	if (vary.has_body)
+		key += request.HasBody() ? "B"sv : "-"sv;
+
+	if (vary.remote_host)
+		AppendKeyValue(key, request.remote_host);
+
+	for (const auto &i : vary.headers)
+		AppendKeyValue(key, request.headers.Get(i.c_str()));
+
+	return key;
+}
+
+const LbGoto *
+LbLuaCache::Get(struct pool &pool, const std::string &key) noexcept
+{
+	const Item *item = cache.Get(key);
+	if (item == nullptr) {
+		++stats.misses;
+		logger(5, "miss");
+		return nullptr;
+	}
+
+	++stats.hits;
+	logger(5, "hit '", key, "'");
+
+	/* return a copy so the item may be evicted while the request
+	   is still using it */
+	auto *g = NewFromPool<LbGoto>(pool, item->destination);
+	if (!item->resolve_connect.empty())
+		g->resolve_connect = p_strdup(pool,
+					      item->resolve_connect.c_str());
+	return g;
+}
+
+void
+LbLuaCache::Put(const std::string &key, const LbGoto &destination) noexcept
+{
+	logger(5, "store '", key, "'");
+
+	cache.PutOrReplace(key, Item(destination));
+}
@@ -0,0 +1,84 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#pragma once
+
+#include "Goto.hxx"
+#include "LuaCacheStats.hxx"
+#include "io/Logger.hxx"
+#include "util/Cache.hxx"
+
+#include <string>
+
+struct pool;
+struct LbLuaCacheVary;
+struct IncomingHttpRequest;
+
+/**
+ * Memoizes the #LbGoto decisions of a #LbLuaHandler.  The key is
+ * made of the request attributes listed in the #LbLuaCacheVary; the
+ * handler promises that its decision depends on nothing else.
+ */
+class LbLuaCache final {
+	const LLogger logger;
+
+	const LbLuaCacheVary &vary;
+
+	struct Item {
+		/**
+		 * The decision, with #LbGoto::resolve_connect cleared;
+		 * the #resolve_connect string is stored separately.
+		 */
+		LbGoto destination;
+
+		std::string resolve_connect;
+
+		Item(const LbGoto &src) noexcept;
+
+		size_t GetAllocatedMemory() const noexcept {
+			return sizeof(*this) + resolve_connect.length();
+		}
+	};
+
+	typedef ::Cache<std::string, Item, 8192, 16381> Cache;
+	Cache cache;
+
+	/**
+	 * Only the counters are maintained here;
+	 * #LbLuaCacheStats::allocated_memory is calculated by
+	 * GetStats().
+	 */
+	LbLuaCacheStats stats{};
+
+public:
+	explicit LbLuaCache(const LbLuaCacheVary &_vary) noexcept
+		:logger("lua_cache"), vary(_vary) {}
+
+	[[gnu::pure]]
+	LbLuaCacheStats GetStats() const noexcept;
+
+	void Clear() noexcept {
+		cache.Clear();
+	}
+
+	/**
+	 * Build the cache key for the given request.
+	 */
+	[[gnu::pure]]
+	std::string MakeKey(const IncomingHttpRequest &request) const noexcept;
+
+	/**
+	 * Look up a decision.  On a hit, a copy is allocated from the
+	 * given pool.
+	 *
+	 * @return the decision or nullptr on a miss
+	 */
+	const LbGoto *Get(struct pool &pool, const std::string &key) noexcept;
+
+	void Put(const std::string &key, const LbGoto &destination) noexcept;
+
+	void CountUncacheable() noexcept {
+		++stats.uncacheable;
+	}
+};
@@ -0,0 +1,33 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+struct LbLuaCacheStats {
+	/**
+	 * Number of requests which were handled without invoking
+	 * Lua.
+	 */
+	uint64_t hits;
+
+	/**
+	 * Number of requests which had to be handled by Lua.
+	 */
+	uint64_t misses;
+
+	/**
+	 * Number of decisions which were not stored because they
+	 * were not a plain #LbGoto (e.g. a response was generated by
+	 * Lua).
+	 */
+	uint64_t uncacheable;
+
+	/**
+	 * Number of bytes allocated by the cache.
+	 */
+	std::size_t allocated_memory;
+};
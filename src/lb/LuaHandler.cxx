@@ -3,6 +3,7 @@
 // author: Max Kellermann <mk@cm4all.com>
 
 #include "LuaHandler.hxx"
+#include "LuaCache.hxx"
 #include "LuaGoto.hxx"
 #include "GotoConfig.hxx"
 #include "Goto.hxx"
@@ -24,16 +25,32 @@ extern "C" {
 #include <lualib.h>
 }
 
+#include <assert.h>
+#include <string.h>
+
 using namespace Lua;
 
 struct LbLuaRequestData {
 	IncomingHttpRequest &request;
 	HttpResponseHandler &handler;
+
+	/**
+	 * If the decision is going to be cached, then only these
+	 * attributes may be accessed.
+	 */
+	const LbLuaCacheVary *const vary;
+
 	bool stale = false;
 
+	/**
+	 * Has the Lua code generated a response?
+	 */
+	bool responded = false;
+
 	explicit LbLuaRequestData(IncomingHttpRequest &_request,
-				  HttpResponseHandler &_handler)
-		:request(_request), handler(_handler) {}
+				  HttpResponseHandler &_handler,
+				  const LbLuaCacheVary *_vary)
+		:request(_request), handler(_handler), vary(_vary) {}
 };
 
 static constexpr char lua_request_class[] = "lb.http_request";
@@ -41,9 +58,10 @@ typedef Lua::Class<LbLuaRequestData, lua_request_class> LbLuaRequest;
 
 static LbLuaRequestData *
 NewLuaRequest(lua_State *L, IncomingHttpRequest &request,
-	      HttpResponseHandler &handler)
+	      HttpResponseHandler &handler,
+	      const LbLuaCacheVary *vary)
 {
-	return LbLuaRequest::New(L, request, handler);
+	return LbLuaRequest::New(L, request, handler, vary);
 }
 
 static LbLuaRequestData &
@@ -69,6 +87,10 @@ GetHeader(lua_State *L)
 
 	const char *name = lua_tostring(L, 2);
 
+	if (data.vary != nullptr && !data.vary->HasHeader(name))
+		return luaL_error(L, "Header '%s' not listed in cache_vary",
+				  name);
+
 	const char *value = data.request.headers.Get(name);
 	if (value != nullptr) {
 		Lua::Push(L, value);
@@ -111,6 +133,7 @@ SendMessage(lua_State *L)
 		msg = nullptr;
 
 	data.stale = true;
+	data.responded = true;
 	data.handler.InvokeResponse(data.request.pool, status,
 				    p_strdup(data.request.pool, msg));
 	return 0;
@@ -160,16 +183,37 @@ LbLuaRequestIndex(lua_State *L)
 		}
 	}
 
+	const auto *vary = data.vary;
+
 	if (strcmp(name, "uri") == 0) {
+		if (vary != nullptr && !vary->uri)
+			return luaL_error(L, "Attribute '%s' not listed in cache_vary", name);
+
 		Lua::Push(L, data.request.uri);
 		return 1;
+	} else if (strcmp(name, "path") == 0) {
+		if (vary != nullptr && !vary->path)
+			return luaL_error(L, "Attribute '%s' not listed in cache_vary", name);
+
+		const char *uri = data.request.uri;
+		lua_pushlstring(L, uri, strcspn(uri, "?"));
+		return 1;
 	} else if (strcmp(name, "method") == 0) {
+		if (vary != nullptr && !vary->method)
+			return luaL_error(L, "Attribute '%s' not listed in cache_vary", name);
+
 		Lua::Push(L, http_method_to_string(data.request.method));
 		return 1;
 	} else if (strcmp(name, "has_body") == 0) {
+		if (vary != nullptr && !vary->has_body)
+			return luaL_error(L, "Attribute '%s' not listed in cache_vary", name);
+
 		Lua::Push(L, data.request.HasBody());
 		return 1;
 	} else if (strcmp(name, "remote_host") == 0) {
+		if (vary != nullptr && !vary->remote_host)
+			return luaL_error(L, "Attribute '%s' not listed in cache_vary", name);
+
 		Lua::Push(L, data.request.remote_host);
 		return 1;
 	}
@@ -212,21 +256,60 @@ LbLuaHandler::LbLuaHandler(LuaInitHook &init_hook,
 	LbLuaRequest::Register(L);
 	Lua::SetTable(L, -3, "__index", LbLuaRequestIndex);
 	lua_pop(L, 1);
+
+	if (config.cache_vary.IsDefined())
+		cache = std::make_unique<LbLuaCache>(config.cache_vary);
 }
 
 LbLuaHandler::~LbLuaHandler()
 {
 }
 
+LbLuaCacheStats
+LbLuaHandler::GetCacheStats() const noexcept
+{
+	assert(cache);
+
+	return cache->GetStats();
+}
+
+void
+LbLuaHandler::FlushCache() noexcept
+{
+	if (cache)
+		cache->Clear();
+}
+
 const LbGoto *
 LbLuaHandler::HandleRequest(IncomingHttpRequest &request,
 			    HttpResponseHandler &handler)
+{
+	if (!cache)
+		return InvokeLua(request, handler);
+
+	const auto key = cache->MakeKey(request);
+	if (const auto *g = cache->Get(request.pool, key))
+		return g;
+
+	const auto *g = InvokeLua(request, handler);
+	if (g != nullptr)
+		cache->Put(key, *g);
+	else
+		cache->CountUncacheable();
+
+	return g;
+}
+
+inline const LbGoto *
+LbLuaHandler::InvokeLua(IncomingHttpRequest &request,
+			HttpResponseHandler &handler)
 {
 	auto *L = state.get();
 	const Lua::ScopeCheckStack check_stack(L);
 
 	function.Push(L);
-	auto *data = NewLuaRequest(L, request, handler);
+	auto *data = NewLuaRequest(L, request, handler,
+				   cache ? &config.cache_vary : nullptr);
 	AtScopeExit(data) { data->stale = true; };
 
 	if (lua_pcall(L, 1, 1, 0))
@@ -234,6 +317,12 @@ LbLuaHandler::HandleRequest(IncomingHttpRequest &request,
 
 	AtScopeExit(L) { lua_pop(L, 1); };
 
+	if (data->responded)
+		/* the return value is ignored by the caller after a
+		   response has been sent, and it must not be
+		   cached */
+		return nullptr;
+
 	if (lua_isnil(L, -1))
 		return nullptr;
 
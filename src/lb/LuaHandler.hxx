@@ -7,11 +7,15 @@
 #include "lua/State.hxx"
 #include "lua/Value.hxx"
 
+#include <memory>
+
 struct LbGoto;
+struct LbLuaCacheStats;
 struct LbLuaHandlerConfig;
 struct IncomingHttpRequest;
 class HttpResponseHandler;
 class LuaInitHook;
+class LbLuaCache;
 
 class LbLuaHandler final {
 	const LbLuaHandlerConfig &config;
@@ -19,6 +23,11 @@ class LbLuaHandler final {
 	Lua::State state;
 	Lua::Value function;
 
+	/**
+	 * Memoized decisions; only if "cache_vary" is configured.
+	 */
+	std::unique_ptr<LbLuaCache> cache;
+
 public:
 	LbLuaHandler(LuaInitHook &init_hook, const LbLuaHandlerConfig &config);
 	~LbLuaHandler();
@@ -27,6 +36,22 @@ public:
 		return config;
 	}
 
+	bool HasCache() const noexcept {
+		return cache != nullptr;
+	}
+
+	/**
+	 * Only valid if HasCache() returns true.
+	 */
+	[[gnu::pure]]
+	LbLuaCacheStats GetCacheStats() const noexcept;
+
+	void FlushCache() noexcept;
+
 	const LbGoto *HandleRequest(IncomingHttpRequest &request,
 				    HttpResponseHandler &handler);
+
+private:
+	const LbGoto *InvokeLua(IncomingHttpRequest &request,
+				HttpResponseHandler &handler);
 };
@@ -26,6 +26,8 @@
 #include "memory/GrowingBuffer.hxx"
 #include "stopwatch.hxx"
 
+using std::string_view_literals::operator""sv;
+
 class LbPrometheusExporter::AppendRequest final
 	: public HttpResponseHandler, Cancellable
 {
@@ -127,6 +129,34 @@ WriteStats(GrowingBuffer &buffer, const LbInstance &instance) noexcept
 			Prometheus::Write(buffer, process,
 					  listener.GetConfig().name.c_str(),
 					  *stats);
+
+	const auto lua_caches = instance.goto_map.GetLuaCacheStats();
+	if (lua_caches.empty())
+		return;
+
+	buffer.Write("# HELP beng_proxy_lua_cache_hits Number of Lua handler decisions served from the cache\n"
+		     "# TYPE beng_proxy_lua_cache_hits counter\n"sv);
+	for (const auto &[name, stats] : lua_caches)
+		buffer.Fmt("beng_proxy_lua_cache_hits{{process=\"{}\",handler=\"{}\"}} {}\n",
+			   process, name, stats.hits);
+
+	buffer.Write("# HELP beng_proxy_lua_cache_misses Number of Lua handler invocations due to a cache miss\n"
+		     "# TYPE beng_proxy_lua_cache_misses counter\n"sv);
+	for (const auto &[name, stats] : lua_caches)
+		buffer.Fmt("beng_proxy_lua_cache_misses{{process=\"{}\",handler=\"{}\"}} {}\n",
+			   process, name, stats.misses);
+
+	buffer.Write("# HELP beng_proxy_lua_cache_uncacheable Number of Lua handler invocations which did not return a cacheable decision\n"
+		     "# TYPE beng_proxy_lua_cache_uncacheable counter\n"sv);
+	for (const auto &[name, stats] : lua_caches)
+		buffer.Fmt("beng_proxy_lua_cache_uncacheable{{process=\"{}\",handler=\"{}\"}} {}\n",
+			   process, name, stats.uncacheable);
+
+	buffer.Write("# HELP beng_proxy_lua_cache_size Number of bytes allocated by the Lua handler decision cache\n"
+		     "# TYPE beng_proxy_lua_cache_size gauge\n"sv);
+	for (const auto &[name, stats] : lua_caches)
+		buffer.Fmt("beng_proxy_lua_cache_size{{process=\"{}\",handler=\"{}\"}} {}\n",
+			   process, name, stats.allocated_memory);
 }
 
 void
@@ -3,6 +3,7 @@
 // author: Max Kellermann <mk@cm4all.com>
 
 #include "GrowingBuffer.hxx"
+#include "ZeroCopyHold.hxx"
 #include "pool/pool.hxx"
 #include "istream/Bucket.hxx"
 
@@ -52,6 +53,31 @@ GrowingBuffer::BufferPtr::Pop() noexcept
 	Check();
 }
 
+GrowingBuffer::BufferPtr
+GrowingBuffer::BufferPtr::Detach() noexcept
+{
+	assert(buffer != nullptr);
+
+	Check();
+
+	BufferPtr result = std::move(*this);
+	*this = std::move(result->next);
+
+	Check();
+	return result;
+}
+
+/**
+ * Keeps a #GrowingBuffer::Buffer alive while the kernel may read
+ * from it (MSG_ZEROCOPY).
+ */
+struct GrowingBuffer::Hold final : ZeroCopyHold {
+	BufferPtr buffer;
+
+	explicit Hold(BufferPtr &&_buffer) noexcept
+		:buffer(std::move(_buffer)) {}
+};
+
 std::span<std::byte>
 GrowingBuffer::Buffer::Write() noexcept
 {
@@ -388,13 +414,36 @@ GrowingBuffer::ConsumeBucketList(size_type nbytes) noexcept
 void
 GrowingBufferReader::FillBucketList(IstreamBucketList &list) const noexcept
 {
-	ForEachBuffer([&list](std::span<const std::byte> b){
-		list.Push(b);
+	const bool zero_copy = list.IsZeroCopyEnabled();
+
+	ForEachBuffer([&list, zero_copy](std::span<const std::byte> b){
+		if (zero_copy)
+			list.PushZeroCopy(b);
+		else
+			list.Push(b);
 	});
 }
 
+inline void
+GrowingBufferReader::UnshareHead(ZeroCopyHoldList &holds) noexcept
+{
+	assert(buffer);
+	assert(position > 0);
+	assert(position < buffer->fill);
+
+	GrowingBuffer::BufferPtr copy;
+	copy.Allocate().WriteSome({buffer->data + position,
+				   buffer->fill - position});
+	copy->next = std::move(buffer->next);
+
+	holds.Add(*new GrowingBuffer::Hold(std::move(buffer)));
+	buffer = std::move(copy);
+	position = 0;
+}
+
 GrowingBufferReader::size_type
-GrowingBufferReader::ConsumeBucketList(size_type nbytes) noexcept
+GrowingBufferReader::ConsumeBucketList(size_type nbytes,
+				       ZeroCopyHoldList *holds) noexcept
 {
 	size_type result = 0;
 	while (nbytes > 0 && buffer) {
@@ -402,13 +451,19 @@ GrowingBufferReader::ConsumeBucketList(size_type nbytes) noexcept
 		if (nbytes < available) {
 			position += nbytes;
 			result += nbytes;
+
+			if (holds != nullptr)
+				UnshareHead(*holds);
 			break;
 		}
 
 		result += available;
 		nbytes -= available;
 
-		buffer.Pop();
+		if (holds != nullptr)
+			holds->Add(*new GrowingBuffer::Hold(buffer.Detach()));
+		else
+			buffer.Pop();
 		position = 0;
 	}
 
@@ -16,6 +16,7 @@
 #include <utility>
 
 class IstreamBucketList;
+class ZeroCopyHoldList;
 
 /**
  * An auto-growing buffer you can write to.
@@ -24,6 +25,7 @@ class GrowingBuffer {
 	friend class GrowingBufferReader;
 
 	struct Buffer;
+	struct Hold;
 
 	using size_type = std::size_t;
 
@@ -64,6 +66,12 @@ class GrowingBuffer {
 
 		void Pop() noexcept;
 
+		/**
+		 * Like Pop(), but instead of freeing the first
+		 * buffer, return it (without its successors).
+		 */
+		BufferPtr Detach() noexcept;
+
 		const Buffer *get() const noexcept {
 			return buffer;
 		}
@@ -303,10 +311,31 @@ public:
 	 */
 	void Skip(size_type length) noexcept;
 
+	/**
+	 * If zero-copy is enabled on the #IstreamBucketList, the
+	 * buffers are pushed with IstreamBucketList::PushZeroCopy();
+	 * the caller must then pass the list's #ZeroCopyHoldList to
+	 * ConsumeBucketList().
+	 */
 	void FillBucketList(IstreamBucketList &list) const noexcept;
-	size_type ConsumeBucketList(size_type nbytes) noexcept;
+
+	/**
+	 * @param holds if not nullptr, then consumed buffers are
+	 * moved there instead of being freed, because the kernel may
+	 * still read from them (MSG_ZEROCOPY)
+	 */
+	size_type ConsumeBucketList(size_type nbytes,
+				    ZeroCopyHoldList *holds=nullptr) noexcept;
 
 private:
+	/**
+	 * The first buffer has been consumed partially and its
+	 * consumed part may still be read by the kernel: copy the
+	 * rest to a new buffer and move the old one to the
+	 * #ZeroCopyHoldList.
+	 */
+	void UnshareHead(ZeroCopyHoldList &holds) noexcept;
+
 	template<typename F>
 	void ForEachBuffer(F &&f) const {
 		buffer.ForEachBuffer(position, std::forward<F>(f));
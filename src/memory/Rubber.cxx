@@ -8,10 +8,13 @@
 #include "system/VmaName.hxx"
 #include "stats/AllocatorStats.hxx"
 
+#include <algorithm>
+
 #include <assert.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
 struct RubberObject {
 	/**
@@ -34,6 +37,14 @@ struct RubberObject {
 	 */
 	size_t size;
 
+	/**
+	 * Have pages of this object been passed to vmsplice()?  If
+	 * yes, the kernel may still be referencing them (e.g. in a
+	 * pipe or in a socket's send queue), and they must not be
+	 * modified in place; see Rubber::Unshare().
+	 */
+	bool shared;
+
 #ifndef NDEBUG
 	bool allocated;
 #endif
@@ -41,6 +52,7 @@ struct RubberObject {
 	void Init(size_t _offset, size_t _size) noexcept {
 		offset = _offset;
 		size = _size;
+		shared = false;
 #ifndef NDEBUG
 		allocated = true;
 #endif
@@ -50,6 +62,7 @@ struct RubberObject {
 		next = previous = 0;
 		offset = 0;
 		size = _size;
+		shared = false;
 	}
 
 	constexpr size_t GetEndOffset() const noexcept {
@@ -197,6 +210,24 @@ struct RubberTable {
 
 static constexpr size_t RUBBER_ALIGN = 0x20;
 
+/**
+ * The granularity of vmsplice() sharing and of discarding unused
+ * pages.
+ */
+static constexpr size_t RUBBER_PAGE_SIZE = 4096;
+
+static constexpr size_t
+AlignRubberPageDown(size_t size) noexcept
+{
+	return size & ~(RUBBER_PAGE_SIZE - 1);
+}
+
+static constexpr size_t
+AlignRubberPageUp(size_t size) noexcept
+{
+	return AlignRubberPageDown(size + RUBBER_PAGE_SIZE - 1);
+}
+
 [[gnu::const]]
 static inline void *
 align_page_size_ptr(void *p) noexcept
@@ -508,6 +539,7 @@ void
 Rubber::AddToHoleList(Hole &hole) noexcept
 {
 	holes[LookupHoleThreshold(hole.size)].push_front(hole);
+	++n_holes;
 }
 
 void
@@ -693,6 +725,9 @@ Rubber::MoveLast(size_t max_object_size) noexcept
 		RemoveHole(*hole2);
 	}
 
+	if (o.shared)
+		Unshare(o);
+
 	/* remove this object from the ordered linked list */
 	table->Unlink(id);
 
@@ -704,7 +739,7 @@ Rubber::MoveLast(size_t max_object_size) noexcept
 	UseHole(*hole, id, size);
 
 	/* move data to that hole */
-	memcpy(WriteAt(new_offset), ReadAt(old_offset), size);
+	MoveData(old_offset, new_offset, size);
 
 	return true;
 }
@@ -793,6 +828,10 @@ Rubber::Shrink(unsigned id, size_t new_size) noexcept
 	if (new_size == o->size)
 		return;
 
+	if (o->shared)
+		/* the new hole may overlap with shared pages */
+		Unshare(*o);
+
 	const size_t hole_offset = o->offset + new_size;
 	const size_t hole_size = o->size - new_size;
 
@@ -849,6 +888,9 @@ Rubber::Remove(unsigned id) noexcept
 	auto &o = table->entries[id];
 	assert(o.allocated);
 
+	if (o.shared)
+		DiscardShared(o);
+
 	const unsigned previous_id = o.previous;
 	const unsigned next_id = o.next;
 
@@ -872,17 +914,137 @@ Rubber::GetBruttoSize() const noexcept
 	return table->GetBruttoSize();
 }
 
-inline void
+size_t
+Rubber::MoveData(size_t src, size_t dest, size_t size) noexcept
+{
+	assert(dest < src);
+	assert(size > 0);
+
+	compress_moved += size;
+
+#ifdef MREMAP_DONTUNMAP
+	/* only whole "huge pages" are remapped: remapping at a finer
+	   granularity would split transparent huge pages and
+	   fragment the VMA, which costs more than it saves; the
+	   allocation is huge-page aligned, so aligning offsets is
+	   enough */
+	const size_t delta = src - dest;
+	const size_t end = src + size;
+	size_t position = AlignHugePageUp(src);
+	const size_t page_end = AlignHugePageDown(end);
+
+	if (size >= REMAP_THRESHOLD && delta % HUGE_PAGE_SIZE == 0 &&
+	    position < page_end && n_remaps < MAX_REMAPS) {
+		/* copy the partial huge page at the start */
+		const size_t head = position - src;
+		memmove(WriteAt(dest), ReadAt(src), head);
+
+		/* move whole huge pages in chunks which do not
+		   overlap with their destination; MREMAP_DONTUNMAP
+		   leaves empty pages behind, which is what we want */
+		while (position < page_end && n_remaps < MAX_REMAPS) {
+			const size_t n = std::min(page_end - position, delta);
+			if (mremap(WriteAt(position), n, n,
+				   MREMAP_MAYMOVE|MREMAP_FIXED|MREMAP_DONTUNMAP,
+				   WriteAt(position - delta)) == MAP_FAILED)
+				/* not supported by this kernel or out of
+				   VMAs: copy the rest */
+				break;
+
+			position += n;
+			compress_remapped += n;
+			++n_remaps;
+		}
+
+		/* copy the partial huge page at the end (and
+		   whatever could not be remapped) */
+		memmove(WriteAt(position - delta), ReadAt(position),
+			end - position);
+		return head + end - position;
+	}
+#endif
+
+	memmove(WriteAt(dest), ReadAt(src), size);
+	return size;
+}
+
+inline size_t
 Rubber::MoveData(RubberObject &o, size_t new_offset) noexcept
 {
 	assert(new_offset <= o.offset);
 	assert(o.size > 0);
 
 	if (o.offset == new_offset)
-		return;
+		return 0;
 
-	memmove(WriteAt(new_offset), ReadAt(o.offset), o.size);
+	if (o.shared)
+		/* the source pages may still be referenced by the
+		   kernel, and they will be overwritten; neither
+		   memmove() nor mremap() must touch them */
+		Unshare(o);
+
+	const size_t copied = MoveData(o.offset, new_offset, o.size);
 	o.offset = new_offset;
+	return copied;
+}
+
+std::span<const std::byte>
+Rubber::Share(unsigned id, size_t start, size_t end) noexcept
+{
+	auto &o = table->entries[id];
+	assert(o.allocated);
+	assert(start <= end);
+	assert(end <= o.size);
+
+	/* the partial pages at both ends may be shared with
+	   neighbouring objects or holes, which may be modified at
+	   any time */
+	const size_t begin = AlignRubberPageUp(o.offset + start);
+	const size_t page_end = AlignRubberPageDown(o.offset + end);
+	if (begin >= page_end)
+		return {};
+
+	o.shared = true;
+	return {(const std::byte *)ReadAt(begin), page_end - begin};
+}
+
+void
+Rubber::DiscardShared(RubberObject &o) noexcept
+{
+	assert(o.shared);
+	o.shared = false;
+
+	const size_t begin = AlignRubberPageUp(o.offset);
+	const size_t end = AlignRubberPageDown(o.GetEndOffset());
+	if (begin < end)
+		/* not DiscardPages(), which may use MADV_FREE: writing
+		   to such a page may keep the old page */
+		madvise(WriteAt(begin), end - begin, MADV_DONTNEED);
+}
+
+void
+Rubber::Unshare(RubberObject &o) noexcept
+{
+	assert(o.shared);
+	o.shared = false;
+
+	size_t position = AlignRubberPageUp(o.offset);
+	const size_t end = AlignRubberPageDown(o.GetEndOffset());
+
+	/* MADV_DONTNEED replaces the pages with fresh zero pages;
+	   copy the contents back from a small bounce buffer */
+	std::byte buffer[16 * RUBBER_PAGE_SIZE];
+
+	while (position < end) {
+		const size_t n = std::min(end - position, sizeof(buffer));
+		void *p = WriteAt(position);
+
+		memcpy(buffer, p, n);
+		madvise(p, n, MADV_DONTNEED);
+		memcpy(p, buffer, n);
+
+		position += n;
+	}
 }
 
 AllocatorStats
@@ -891,6 +1053,9 @@ Rubber::GetStats() const noexcept
 	AllocatorStats stats;
 	stats.brutto_size = GetBruttoSize();
 	stats.netto_size = GetNettoSize();
+	stats.n_holes = n_holes;
+	stats.compress_moved = compress_moved;
+	stats.compress_remapped = compress_remapped;
 	return stats;
 }
 
@@ -910,6 +1075,7 @@ Rubber::Compress() noexcept
 
 	for (auto &i : holes)
 		i.clear();
+	n_holes = 0;
 
 	/* relocate all items, eliminate spaces */
 
@@ -925,9 +1091,96 @@ Rubber::Compress() noexcept
 	assert(offset == netto_size + table->GetSize());
 	assert(netto_size == GetBruttoSize());
 
-	/* tell the kernel that we won't need the data after our last
-	   allocation */
-	const size_t allocated = AlignHugePageUp(offset);
+	DiscardTail();
+}
+
+inline void
+Rubber::DiscardTail() noexcept
+{
+	const size_t allocated = AlignHugePageUp(table->GetTailOffset());
 	if (allocated < table.size())
 		DiscardPages(WriteAt(allocated), table.size() - allocated);
 }
+
+inline Rubber::Hole *
+Rubber::FindCompressHole() noexcept
+{
+	/* the lists are ordered by size, and the first hole of the
+	   first non-empty list is (nearly) the largest one; this is
+	   usually the one we slid down in the previous iteration */
+	for (auto &i : holes) {
+		if (i.empty())
+			continue;
+
+		auto &hole = i.front();
+		return hole.size >= RUBBER_PAGE_SIZE
+			? &hole
+			: nullptr;
+	}
+
+	return nullptr;
+}
+
+size_t
+Rubber::SlideDown(Hole &hole) noexcept
+{
+	[[maybe_unused]] const size_t hole_offset = OffsetOf(hole);
+	const size_t hole_size = hole.size;
+	const unsigned id = hole.next_id;
+
+	auto &o = table->entries[id];
+	assert(o.allocated);
+	assert(hole_offset + hole_size == o.offset);
+
+	RemoveHole(hole);
+
+	/* the object is always moved by the whole hole size;
+	   MoveData() can remap it only if that is a multiple of the
+	   huge page size.  Moving it by less would leave a small
+	   hole in front of it, and closing that hole later would
+	   copy the whole object anyway. */
+	const size_t copied = MoveData(o, o.offset - hole_size);
+
+	if (o.next != 0)
+		AddHoleAfter(id, o.GetEndOffset(), hole_size);
+
+	return copied;
+}
+
+bool
+Rubber::CompressStep(size_t max_copy) noexcept
+{
+	assert(netto_size + GetTotalHoleSize() == GetBruttoSize());
+
+	size_t copied = 0;
+
+	while (true) {
+		auto *hole = FindCompressHole();
+		if (hole == nullptr) {
+			/* done */
+			DiscardTail();
+			return false;
+		}
+
+		if (copied >= max_copy)
+			return true;
+
+		/* first try to fill a hole with the last object, which
+		   also shrinks the brutto size */
+		const size_t tail_size = table->GetTail().size;
+		if (MoveLast(max_copy - copied)) {
+			copied += tail_size;
+			continue;
+		}
+
+		if (copied > 0 &&
+		    table->entries[hole->next_id].size > max_copy - copied)
+			/* this object doesn't fit into this step's budget;
+			   continue in the next one */
+			return true;
+
+		copied += SlideDown(*hole);
+
+		assert(netto_size + GetTotalHoleSize() == GetBruttoSize());
+	}
+}
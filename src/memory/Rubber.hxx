@@ -9,7 +9,9 @@
 
 #include <array>
 #include <algorithm>
+#include <cstddef>
 #include <cstdint>
+#include <span>
 
 #include <assert.h>
 #include <stddef.h>
@@ -73,7 +75,51 @@ class Rubber {
 	 */
 	std::array<HoleList, N_HOLE_THRESHOLDS> holes;
 
+	/**
+	 * The number of #Hole instances in all #holes lists.
+	 */
+	size_t n_holes = 0;
+
+	/**
+	 * The total number of bytes relocated by compaction.
+	 */
+	size_t compress_moved = 0;
+
+	/**
+	 * The part of #compress_moved which was relocated by
+	 * remapping pages instead of copying.
+	 */
+	size_t compress_remapped = 0;
+
+	/**
+	 * The number of successful mremap() calls.  Each one may
+	 * split the mapping into more VMAs.
+	 */
+	unsigned n_remaps = 0;
+
+	/**
+	 * Objects at least this large are relocated with mremap()
+	 * (if the distance is a multiple of the huge page size).
+	 * Smaller objects cannot span a whole huge page anyway, and
+	 * they are cheaper to copy.
+	 */
+	static constexpr size_t REMAP_THRESHOLD = 4 * 1024 * 1024;
+
+	/**
+	 * After this many mremap() calls, all data is copied.  Each
+	 * call can add two VMAs (the destination splits the existing
+	 * mapping), and the kernel limits their number per process
+	 * (vm.max_map_count, 65530 by default); this keeps one
+	 * #Rubber well below that.
+	 */
+	static constexpr unsigned MAX_REMAPS = 1024;
+
 public:
+	/**
+	 * The default copy budget for CompressStep().
+	 */
+	static constexpr size_t DEFAULT_COMPRESS_STEP = 4 * 1024 * 1024;
+
 	/**
 	 * Throws std::bad_alloc on error.
 	 */
@@ -112,6 +158,24 @@ public:
 
 	void Compress() noexcept;
 
+	/**
+	 * Perform one slice of incremental compaction.  Unlike
+	 * Compress(), this does not relocate all objects at once;
+	 * it fills holes with the last object or slides objects
+	 * down into the largest holes until the given number of
+	 * bytes has been copied.  Holes smaller than a page are
+	 * left alone unless a larger hole sweeps over them.
+	 *
+	 * Between two calls, the allocator may be used normally.
+	 *
+	 * @param max_copy the maximum number of bytes to be copied
+	 * (the first relocation is always done, even if it exceeds
+	 * this budget)
+	 * @return true if there is more work to do, false if
+	 * compaction is complete
+	 */
+	bool CompressStep(size_t max_copy=DEFAULT_COMPRESS_STEP) noexcept;
+
 	/**
 	 * Add a new object with the specified size.  Use Write() to
 	 * actually copy data to the object.
@@ -152,6 +216,25 @@ public:
 	[[gnu::pure]]
 	const void *Read(unsigned id) const noexcept;
 
+	/**
+	 * Prepare a range of the object for vmsplice().  Returns the
+	 * whole pages within the range; the partial pages at both
+	 * ends are shared with other allocations and must be copied
+	 * by the caller.
+	 *
+	 * From now on, the object is marked "shared": before it is
+	 * moved, shrunk or removed, its pages are replaced with new
+	 * ones, leaving the old ones to the kernel.  The object must
+	 * not be modified with Write() anymore.
+	 *
+	 * @param start the start offset within the object
+	 * @param end the end offset within the object
+	 * @return the page-aligned part of the range (empty if the
+	 * range does not contain a whole page)
+	 */
+	std::span<const std::byte> Share(unsigned id,
+					 size_t start, size_t end) noexcept;
+
 private:
 	[[gnu::pure]]
 	void *WriteAt(size_t offset) noexcept {
@@ -245,7 +328,55 @@ private:
 	void ReplaceWithHole(RubberObject &o,
 			     unsigned previous_id, unsigned next_id) noexcept;
 
-	void MoveData(RubberObject &o, size_t new_offset) noexcept;
+	/**
+	 * Copy data to a lower offset.  Whole huge pages of large
+	 * ranges are moved with mremap() instead of memmove(); the
+	 * unaligned head and tail are copied.
+	 *
+	 * @return the number of bytes which were copied (i.e. not
+	 * remapped)
+	 */
+	size_t MoveData(size_t src, size_t dest, size_t size) noexcept;
+
+	size_t MoveData(RubberObject &o, size_t new_offset) noexcept;
+
+	/**
+	 * Give the whole pages of a "shared" object (see Share())
+	 * new physical memory, preserving their contents.  The old
+	 * pages remain with the kernel for as long as it references
+	 * them.
+	 */
+	void Unshare(RubberObject &o) noexcept;
+
+	/**
+	 * Like Unshare(), but discard the contents (because the
+	 * object is being removed).
+	 */
+	void DiscardShared(RubberObject &o) noexcept;
+
+	/**
+	 * Find the largest hole which is worth being eliminated by
+	 * CompressStep().
+	 *
+	 * @return the hole or nullptr if there is none
+	 */
+	[[gnu::pure]]
+	Hole *FindCompressHole() noexcept;
+
+	/**
+	 * Move the object following the given hole to the start of
+	 * the hole, effectively moving the hole after the object
+	 * (where it may be merged with the next one).
+	 *
+	 * @return the number of bytes copied
+	 */
+	size_t SlideDown(Hole &hole) noexcept;
+
+	/**
+	 * Tell the kernel that we won't need the data after our last
+	 * allocation.
+	 */
+	void DiscardTail() noexcept;
 
 	HoleList &GetHoleList(size_t size) noexcept {
 		return holes[LookupHoleThreshold(size)];
@@ -256,7 +387,10 @@ private:
 	}
 
 	void RemoveHole(Hole &hole) noexcept {
+		assert(n_holes > 0);
+
 		hole.unlink();
+		--n_holes;
 	}
 };
 
@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#pragma once
+
+#include "util/IntrusiveList.hxx"
+
+/**
+ * Owns memory which was (or is about to be) passed to the kernel
+ * with MSG_ZEROCOPY.  The kernel may read from it until the send
+ * operation completes, and only after that, this object gets
+ * destroyed.
+ */
+class ZeroCopyHold : public IntrusiveListHook<IntrusiveHookMode::NORMAL> {
+public:
+	virtual ~ZeroCopyHold() noexcept = default;
+};
+
+/**
+ * A list of #ZeroCopyHold instances.  Destroying the list destroys
+ * all holds (i.e. frees the memory).
+ */
+class ZeroCopyHoldList {
+	IntrusiveList<ZeroCopyHold> list;
+
+public:
+	ZeroCopyHoldList() = default;
+
+	ZeroCopyHoldList(const ZeroCopyHoldList &) = delete;
+	ZeroCopyHoldList &operator=(const ZeroCopyHoldList &) = delete;
+
+	~ZeroCopyHoldList() noexcept {
+		Clear();
+	}
+
+	bool empty() const noexcept {
+		return list.empty();
+	}
+
+	/**
+	 * Take ownership of the given (heap-allocated) hold.
+	 */
+	void Add(ZeroCopyHold &hold) noexcept {
+		list.push_back(hold);
+	}
+
+	/**
+	 * Move all holds from the given list to this one.
+	 */
+	void MoveFrom(ZeroCopyHoldList &src) noexcept {
+		while (!src.list.empty()) {
+			auto &hold = src.list.front();
+			src.list.pop_front();
+			list.push_back(hold);
+		}
+	}
+
+	void Clear() noexcept {
+		list.clear_and_dispose([](ZeroCopyHold *hold){
+			delete hold;
+		});
+	}
+};
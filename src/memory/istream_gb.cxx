@@ -6,6 +6,7 @@
 #include "istream/istream.hxx"
 #include "istream/UnusedPtr.hxx"
 #include "istream/New.hxx"
+#include "istream/Bucket.hxx"
 #include "GrowingBuffer.hxx"
 #include "util/ConstBuffer.hxx"
 
@@ -14,6 +15,13 @@
 class GrowingBufferIstream final : public Istream {
 	GrowingBufferReader reader;
 
+	/**
+	 * The #ZeroCopyHoldList of the most recent
+	 * _FillBucketList() call; it receives all buffers consumed
+	 * by _ConsumeBucketList().
+	 */
+	ZeroCopyHoldList *zero_copy_holds = nullptr;
+
 public:
 	GrowingBufferIstream(struct pool &p, GrowingBuffer &&_gb)
 		:Istream(p), reader(std::move(_gb)) {
@@ -59,11 +67,13 @@ public:
 	}
 
 	void _FillBucketList(IstreamBucketList &list) override {
+		zero_copy_holds = list.GetZeroCopyHolds();
 		reader.FillBucketList(list);
 	}
 
 	size_t _ConsumeBucketList(size_t nbytes) noexcept override {
-		size_t consumed = reader.ConsumeBucketList(nbytes);
+		size_t consumed = reader.ConsumeBucketList(nbytes,
+							   std::exchange(zero_copy_holds, nullptr));
 		return Consumed(consumed);
 	}
 };
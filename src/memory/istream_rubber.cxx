@@ -8,12 +8,20 @@
 #include "istream/Bucket.hxx"
 #include "istream/UnusedPtr.hxx"
 #include "istream/New.hxx"
+#include "istream/Handler.hxx"
+#include "istream/Result.hxx"
+#include "pipe/Lease.hxx"
+#include "system/Error.hxx"
+#include "util/Compiler.h"
 #include "util/ConstBuffer.hxx"
 
 #include <algorithm>
 
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdint.h>
+#include <sys/uio.h>
 
 class RubberIstream final : public Istream {
 	Rubber &rubber;
@@ -23,27 +31,98 @@ class RubberIstream final : public Istream {
 	size_t position;
 	const size_t end;
 
+	/**
+	 * The pipe which receives pages with vmsplice().  Only used
+	 * if a #PipeStock was passed to the constructor and the
+	 * handler accepts #FdType::FD_PIPE.
+	 */
+	PipeLease pipe;
+
+	const bool have_pipe_stock;
+
+	/**
+	 * The number of bytes in the #pipe.  They have already been
+	 * accounted for in #position.
+	 */
+	size_t piped = 0;
+
+	bool direct = false;
+
+	/**
+	 * Ranges smaller than this are submitted with OnData();
+	 * vmsplice() is not worth the overhead (and the cost of
+	 * Rubber::Unshare()) for small objects.
+	 */
+	static constexpr size_t VMSPLICE_THRESHOLD = 64 * 1024;
+
 public:
 	RubberIstream(struct pool &p, Rubber &_rubber, unsigned _id,
 		      size_t start, size_t _end,
-		      bool _auto_remove) noexcept
+		      bool _auto_remove, PipeStock *_pipe_stock) noexcept
 		:Istream(p), rubber(_rubber), id(_id), auto_remove(_auto_remove),
-		 position(start), end(_end) {}
+		 position(start), end(_end),
+		 pipe(_pipe_stock), have_pipe_stock(_pipe_stock != nullptr) {}
 
 	~RubberIstream() noexcept override {
+		/* reuse the pipe only if it's empty */
+		pipe.Release(piped == 0);
+
 		if (auto_remove)
 			rubber.Remove(id);
 	}
 
+private:
+	bool CanVmsplice() const noexcept {
+		return direct && end - position >= VMSPLICE_THRESHOLD;
+	}
+
+	/**
+	 * Pass the contents of the #pipe to the handler.
+	 */
+	IstreamDirectResult ConsumePipe() noexcept;
+
+	/**
+	 * Submit data with vmsplice() (and the partial pages at the
+	 * start with OnData()).
+	 *
+	 * @return false if the handler blocks or if this object has
+	 * been destroyed
+	 */
+	bool Vmsplice() noexcept;
+
+	/**
+	 * Submit data with OnData().
+	 *
+	 * @return false if the handler blocks or if this object has
+	 * been destroyed
+	 */
+	bool ReadData(size_t max_length) noexcept;
+
+	/**
+	 * Push the whole pages of the remaining range as
+	 * MSG_ZEROCOPY buckets and the partial pages at both ends
+	 * as regular buffers.
+	 */
+	void FillZeroCopy(IstreamBucketList &list) noexcept;
+
+public:
 	/* virtual methods from class Istream */
 
+	void _SetDirect(FdTypeMask mask) noexcept override {
+		direct = have_pipe_stock &&
+			(mask & FdTypeMask(FdType::FD_PIPE)) != 0;
+	}
+
 	off_t _GetAvailable(bool) noexcept override {
-		return end - position;
+		return end - position + piped;
 	}
 
 	off_t _Skip(off_t nbytes) noexcept override {
 		assert(position <= end);
 
+		if (piped > 0)
+			return -1;
+
 		const size_t remaining = end - position;
 		if (nbytes > off_t(remaining))
 			nbytes = remaining;
@@ -53,48 +132,208 @@ public:
 		return nbytes;
 	}
 
-	void _Read() noexcept override {
-		assert(position <= end);
+	void _Read() noexcept override;
 
-		const std::byte *data = (const std::byte *)rubber.Read(id);
-		const size_t remaining = end - position;
+	void _FillBucketList(IstreamBucketList &list) override {
+		if (piped > 0)
+			/* let the handler call _Read(), which will
+			   submit the pipe */
+			return Istream::_FillBucketList(list);
 
-		if (remaining > 0) {
-			size_t nbytes = InvokeData({data + position, remaining});
-			if (nbytes == 0)
-				return;
+		const size_t remaining = end - position;
 
-			position += nbytes;
-		}
+		if (list.IsZeroCopyEnabled() &&
+		    remaining >= VMSPLICE_THRESHOLD)
+			/* MSG_ZEROCOPY is preferred over vmsplice(),
+			   because it doesn't need a pipe */
+			return FillZeroCopy(list);
 
-		if (position == end)
-			DestroyEof();
-	}
+		if (CanVmsplice())
+			return Istream::_FillBucketList(list);
 
-	void _FillBucketList(IstreamBucketList &list) override {
 		const uint8_t *data = (const uint8_t *)rubber.Read(id);
-		const size_t remaining = end - position;
 
 		if (remaining > 0)
 			list.Push(ConstBuffer<void>(data + position, remaining));
 	}
 
 	size_t _ConsumeBucketList(size_t nbytes) noexcept override {
+		assert(piped == 0);
+
 		const size_t remaining = end - position;
 		size_t consumed = std::min(nbytes, remaining);
 		position += consumed;
 		return Consumed(consumed);
 	}
+
+	void _ConsumeDirect(size_t nbytes) noexcept override {
+		assert(nbytes <= piped);
+
+		piped -= nbytes;
+	}
 };
 
+inline void
+RubberIstream::FillZeroCopy(IstreamBucketList &list) noexcept
+{
+	assert(piped == 0);
+	assert(position < end);
+
+	const std::byte *data = (const std::byte *)rubber.Read(id);
+	const std::span<const std::byte> range{data + position, data + end};
+
+	/* once shared, Rubber will never modify those pages
+	   again, so there is nothing to hold until the kernel
+	   completes the send */
+	const auto pages = rubber.Share(id, position, end);
+	if (pages.empty()) {
+		list.Push(range);
+		return;
+	}
+
+	if (pages.data() > range.data())
+		list.Push(range.first(pages.data() - range.data()));
+
+	list.PushZeroCopy(pages);
+
+	if (pages.data() + pages.size() < range.data() + range.size())
+		list.Push(range.subspan(pages.data() + pages.size() - range.data()));
+}
+
+IstreamDirectResult
+RubberIstream::ConsumePipe() noexcept
+{
+	assert(pipe.IsDefined());
+	assert(piped > 0);
+
+	auto result = InvokeDirect(FdType::FD_PIPE, pipe.GetReadFd(),
+				   IstreamHandler::NO_OFFSET, piped);
+	switch (result) {
+	case IstreamDirectResult::BLOCKING:
+	case IstreamDirectResult::CLOSED:
+		break;
+
+	case IstreamDirectResult::END:
+		/* must not happen */
+		assert(false);
+		gcc_unreachable();
+
+	case IstreamDirectResult::ERRNO:
+		if (errno != EAGAIN) {
+			DestroyError(std::make_exception_ptr(MakeErrno("read from pipe failed")));
+			result = IstreamDirectResult::CLOSED;
+		}
+
+		break;
+
+	case IstreamDirectResult::OK:
+		break;
+	}
+
+	return result;
+}
+
+inline bool
+RubberIstream::ReadData(size_t max_length) noexcept
+{
+	assert(max_length > 0);
+	assert(max_length <= end - position);
+
+	const std::byte *data = (const std::byte *)rubber.Read(id);
+
+	size_t nbytes = InvokeData({data + position, max_length});
+	if (nbytes == 0)
+		return false;
+
+	position += nbytes;
+	return nbytes == max_length;
+}
+
+inline bool
+RubberIstream::Vmsplice() noexcept
+{
+	assert(piped == 0);
+
+	const auto pages = rubber.Share(id, position, end);
+	if (pages.empty()) {
+		/* no whole page left; submit the rest with OnData() */
+		direct = false;
+		return ReadData(end - position);
+	}
+
+	const std::byte *data = (const std::byte *)rubber.Read(id);
+	if (pages.data() > data + position)
+		/* the partial page at the start can't be passed to
+		   vmsplice() */
+		return ReadData(pages.data() - (data + position));
+
+	try {
+		pipe.EnsureCreated();
+	} catch (...) {
+		/* fall back to copying */
+		direct = false;
+		return true;
+	}
+
+	const struct iovec iov{
+		const_cast<std::byte *>(pages.data()),
+		pages.size(),
+	};
+
+	const ssize_t nbytes = vmsplice(pipe.GetWriteFd().Get(), &iov, 1,
+					SPLICE_F_NONBLOCK);
+	if (nbytes <= 0) {
+		/* the pipe is empty, so this should never fail; fall
+		   back to copying */
+		direct = false;
+		return true;
+	}
+
+	position += nbytes;
+	piped = nbytes;
+	pipe.OnSpliced(nbytes);
+
+	return ConsumePipe() == IstreamDirectResult::OK && piped == 0;
+}
+
+void
+RubberIstream::_Read() noexcept
+{
+	assert(position <= end);
+
+	while (true) {
+		if (piped > 0) {
+			/* the handler needs to consume the pipe before
+			   we refill it */
+			if (ConsumePipe() != IstreamDirectResult::OK ||
+			    piped > 0)
+				return;
+		}
+
+		if (position == end) {
+			DestroyEof();
+			return;
+		}
+
+		if (CanVmsplice()) {
+			if (!Vmsplice())
+				return;
+		} else {
+			if (!ReadData(end - position))
+				return;
+		}
+	}
+}
+
 UnusedIstreamPtr
 istream_rubber_new(struct pool &pool, Rubber &rubber,
 		   unsigned id, size_t start, size_t end,
-		   bool auto_remove) noexcept
+		   bool auto_remove, PipeStock *pipe_stock) noexcept
 {
 	assert(id > 0);
 	assert(start <= end);
 
 	return NewIstreamPtr<RubberIstream>(pool, rubber, id,
-					    start, end, auto_remove);
+					    start, end, auto_remove,
+					    pipe_stock);
 }
@@ -10,16 +10,20 @@
 struct pool;
 class UnusedIstreamPtr;
 class Rubber;
+class PipeStock;
 
 /**
  * #Istream implementation which reads from a rubber allocation.
  *
  * @param auto_remove shall the allocation be removed when this
  * istream is closed?
+ * @param pipe_stock if not nullptr, then large objects are submitted
+ * to handlers accepting #FdType::FD_PIPE by passing the rubber pages
+ * to vmsplice() instead of copying them (see Rubber::Share())
  */
 UnusedIstreamPtr
 istream_rubber_new(struct pool &pool, Rubber &rubber,
 		   unsigned id, size_t start, size_t end,
-		   bool auto_remove) noexcept;
+		   bool auto_remove, PipeStock *pipe_stock=nullptr) noexcept;
 
 #endif
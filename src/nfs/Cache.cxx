@@ -11,6 +11,7 @@
 #include "pool/Holder.hxx"
 #include "AllocatorPtr.hxx"
 #include "memory/Rubber.hxx"
+#include "memory/SlicePool.hxx"
 #include "memory/istream_rubber.hxx"
 #include "memory/sink_rubber.hxx"
 #include "istream_unlock.hxx"
@@ -91,6 +92,16 @@ class NfsCache {
 
 	Rubber rubber;
 
+	/**
+	 * Buffers for #NfsIstream.
+	 */
+	SlicePool buffer_pool;
+
+	/**
+	 * See istream_nfs_new().
+	 */
+	const size_t read_ahead;
+
 	Cache cache;
 
 	FarTimerEvent compress_timer;
@@ -102,8 +113,8 @@ class NfsCache {
 	IntrusiveList<NfsCacheStore> requests;
 
 public:
-	NfsCache(struct pool &_pool, size_t max_size, NfsStock &_stock,
-		 EventLoop &_event_loop);
+	NfsCache(struct pool &_pool, size_t max_size, size_t _read_ahead,
+		 NfsStock &_stock, EventLoop &_event_loop);
 
 	auto &GetPool() const noexcept {
 		return pool;
@@ -119,15 +130,22 @@ public:
 
 	void ForkCow(bool inherit) noexcept {
 		rubber.ForkCow(inherit);
+		buffer_pool.ForkCow(inherit);
 	}
 
 	void Flush() {
 		cache.Flush();
 		rubber.Compress();
+		buffer_pool.Compress();
 	}
 
 	auto GetStats() const noexcept {
-		return pool_children_stats(pool) + rubber.GetStats();
+		return pool_children_stats(pool) + rubber.GetStats() +
+			buffer_pool.GetStats();
+	}
+
+	const CacheStats &GetCacheStats() const noexcept {
+		return cache.GetStats();
 	}
 
 	void Put(const char *key, CacheItem &item) noexcept {
@@ -147,6 +165,7 @@ public:
 private:
 	void OnCompressTimer() noexcept {
 		rubber.Compress();
+		buffer_pool.Compress();
 		compress_timer.Schedule(nfs_cache_compress_interval);
 	}
 };
@@ -357,22 +376,24 @@ NfsCacheRequest::OnNfsStockError(std::exception_ptr ep) noexcept
  */
 
 inline
-NfsCache::NfsCache(struct pool &_pool, size_t max_size,
+NfsCache::NfsCache(struct pool &_pool, size_t max_size, size_t _read_ahead,
 		   NfsStock &_stock, EventLoop &_event_loop)
 	:pool(pool_new_dummy(&_pool, "nfs_cache_slice")),
 	 stock(_stock),
 	 event_loop(_event_loop),
 	 rubber(max_size, "nfs_cache_rubber"),
+	 buffer_pool(NFS_BUFFER_SIZE, 16, "nfs_buffers"),
+	 read_ahead(_read_ahead),
 	 cache(event_loop, max_size * 7 / 8),
 	 compress_timer(event_loop, BIND_THIS_METHOD(OnCompressTimer)) {
 	compress_timer.Schedule(nfs_cache_compress_interval);
 }
 
 NfsCache *
-nfs_cache_new(struct pool &_pool, size_t max_size,
+nfs_cache_new(struct pool &_pool, size_t max_size, size_t read_ahead,
 	      NfsStock &stock, EventLoop &event_loop)
 {
-	return new NfsCache(_pool, max_size, stock, event_loop);
+	return new NfsCache(_pool, max_size, read_ahead, stock, event_loop);
 }
 
 void
@@ -389,6 +410,12 @@ nfs_cache_get_stats(const NfsCache &cache) noexcept
 	return cache.GetStats();
 }
 
+CacheStats
+nfs_cache_get_cache_stats(const NfsCache &cache) noexcept
+{
+	return cache.GetCacheStats();
+}
+
 void
 nfs_cache_fork_cow(NfsCache &cache, bool inherit) noexcept
 {
@@ -469,7 +496,8 @@ NfsCache::OpenFile(struct pool &caller_pool,
 	assert(start <= end);
 	assert(end <= st.stx_size);
 
-	auto body = istream_nfs_new(caller_pool, file, start, end);
+	auto body = istream_nfs_new(caller_pool, file, start, end,
+				    buffer_pool, read_ahead);
 	if (st.stx_size > cacheable_size_limit || start != 0 || end != st.stx_size) {
 		/* don't cache */
 		LogConcat(4, "NfsCache", "nocache ", key);
@@ -18,6 +18,7 @@ struct NfsCacheHandle;
 class CancellablePointer;
 struct statx;
 struct AllocatorStats;
+struct CacheStats;
 
 class NfsCacheHandler {
 public:
@@ -30,10 +31,12 @@ public:
  * A cache for NFS files.
  *
  * Throws on error.
+ *
+ * @param read_ahead see istream_nfs_new()
  */
 NfsCache *
-nfs_cache_new(struct pool &pool, size_t max_size, NfsStock &stock,
-	      EventLoop &event_loop);
+nfs_cache_new(struct pool &pool, size_t max_size, size_t read_ahead,
+	      NfsStock &stock, EventLoop &event_loop);
 
 void
 nfs_cache_free(NfsCache *cache) noexcept;
@@ -42,6 +45,10 @@ nfs_cache_free(NfsCache *cache) noexcept;
 AllocatorStats
 nfs_cache_get_stats(const NfsCache &cache) noexcept;
 
+[[gnu::pure]]
+CacheStats
+nfs_cache_get_cache_stats(const NfsCache &cache) noexcept;
+
 void
 nfs_cache_fork_cow(NfsCache &cache, bool inherit) noexcept;
 
@@ -56,8 +56,9 @@ class NfsFileHandle final
 		IDLE,
 
 		/**
-		 * A request by this handle is pending inside libnfs.  This
-		 * object can only be freed when all libnfs operations
+		 * One or more requests by this handle are pending
+		 * inside libnfs (see #n_pending).  This object can
+		 * only be freed when all libnfs operations
 		 * referencing this object are finished.
 		 */
 		PENDING,
@@ -65,10 +66,11 @@ class NfsFileHandle final
 		/**
 		 * istream_close() has been called by the istream handler
 		 * while the state was #PENDING.  This object cannot be
-		 * destroyed until libnfs has released the reference to this
-		 * object (queued async call with private_data pointing to
-		 * this object).  As soon as libnfs calls back, the object
-		 * will finally be destroyed.
+		 * destroyed until libnfs has released all references to
+		 * this object (queued async calls with private_data
+		 * pointing to this object).  As soon as libnfs has called
+		 * back for the last one, the object will finally be
+		 * destroyed.
 		 */
 		PENDING_CLOSED,
 
@@ -78,6 +80,12 @@ class NfsFileHandle final
 	NfsClientOpenFileHandler *open_handler;
 	NfsClientReadFileHandler *read_handler;
 
+	/**
+	 * The number of nfs_pread_async() calls which have not yet
+	 * called back.
+	 */
+	unsigned n_pending = 0;
+
 public:
 	explicit NfsFileHandle(NfsFile &_file) noexcept
 		:file(_file) {}
@@ -126,13 +134,24 @@ public:
 	void Read(uint64_t offset, size_t length,
 		  NfsClientReadFileHandler &handler) noexcept;
 
-	void ReadCallback(int status, struct nfs_context *nfs,
-			  void *data) noexcept;
+	void ReadCallback(uint64_t offset, int status,
+			  struct nfs_context *nfs, void *data) noexcept;
 
 	/* virtual methods from class Cancellable */
 	void Cancel() noexcept override;
 };
 
+/**
+ * One nfs_pread_async() call.  A pointer to this object is passed to
+ * libnfs as "private_data"; it tells the callback which part of the
+ * file has been read, which allows multiple concurrent reads on one
+ * #NfsFileHandle.
+ */
+struct NfsFileRead {
+	NfsFileHandle &handle;
+	const uint64_t offset;
+};
+
 /**
  * Wrapper for a libnfs file handle (#nfsfh).  Can feed multiple
  * #NfsFileHandle objects that are accessing the file at the same
@@ -669,17 +688,24 @@ NfsClient::UpdateEvent() noexcept
 }
 
 inline void
-NfsFileHandle::ReadCallback(int status, struct nfs_context *nfs,
-			    void *data) noexcept
+NfsFileHandle::ReadCallback(uint64_t offset, int status,
+			    struct nfs_context *nfs, void *data) noexcept
 {
 	assert(state == PENDING || state == PENDING_CLOSED);
+	assert(n_pending > 0);
 
-	const bool closed = state == PENDING_CLOSED;
-	state = IDLE;
+	if (--n_pending > 0) {
+		if (state == PENDING_CLOSED)
+			/* wait for the remaining callbacks */
+			return;
+	} else {
+		const bool closed = state == PENDING_CLOSED;
+		state = IDLE;
 
-	if (closed) {
-		Release();
-		return;
+		if (closed) {
+			Release();
+			return;
+		}
 	}
 
 	if (status < 0) {
@@ -688,15 +714,19 @@ NfsFileHandle::ReadCallback(int status, struct nfs_context *nfs,
 		return;
 	}
 
-	read_handler->OnNfsRead(data, status);
+	read_handler->OnNfsRead(offset, data, status);
 }
 
 static void
 nfs_read_cb(int status, struct nfs_context *nfs,
 	    void *data, void *private_data) noexcept
 {
-	auto &handle = *(NfsFileHandle *)private_data;
-	handle.ReadCallback(status, nfs, data);
+	auto *read = (NfsFileRead *)private_data;
+	auto &handle = read->handle;
+	const uint64_t offset = read->offset;
+	delete read;
+
+	handle.ReadCallback(offset, status, nfs, data);
 }
 
 /*
@@ -1129,8 +1159,8 @@ NfsFileHandle::Close() noexcept
 		break;
 
 	case PENDING:
-		/* a request is still pending; postpone the close until libnfs
-		   has called back */
+		/* requests are still pending; postpone the close until
+		   libnfs has called back */
 		state = PENDING_CLOSED;
 		break;
 	}
@@ -1146,17 +1176,22 @@ inline void
 NfsFileHandle::Read(uint64_t offset, size_t length,
 		    NfsClientReadFileHandler &handler) noexcept
 {
-	assert(state == IDLE);
+	assert(state == IDLE || state == PENDING);
+	assert(state == IDLE || read_handler == &handler);
+
+	auto *read = new NfsFileRead{*this, offset};
 
 	try {
-		file.ReadAsync(offset, length, nfs_read_cb, this);
+		file.ReadAsync(offset, length, nfs_read_cb, read);
 	} catch (...) {
+		delete read;
 		handler.OnNfsReadError(std::current_exception());
 		return;
 	}
 
 	read_handler = &handler;
 	state = PENDING;
+	++n_pending;
 }
 
 void
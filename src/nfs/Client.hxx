@@ -34,6 +34,10 @@ nfs_client_open_file(NfsClient &client,
 void
 nfs_client_close_file(NfsFileHandle &handle) noexcept;
 
+/**
+ * Read a portion of the file.  This may be called again (with the
+ * same handler) while previous reads are still pending.
+ */
 void
 nfs_client_read_file(NfsFileHandle &handle,
 		     uint64_t offset, size_t length,
@@ -7,6 +7,7 @@
 #include <exception>
 
 #include <stddef.h>
+#include <stdint.h>
 
 struct statx;
 class NfsClient;
@@ -55,9 +56,14 @@ public:
 class NfsClientReadFileHandler {
 public:
 	/**
-	 * Data has been read from the file.
+	 * Data has been read from the file.  If several reads are
+	 * pending, their completions may arrive in any order.
+	 *
+	 * @param offset the offset which was passed to
+	 * nfs_client_read_file()
 	 */
-	virtual void OnNfsRead(const void *data, size_t length) noexcept = 0;
+	virtual void OnNfsRead(uint64_t offset,
+			       const void *data, size_t length) noexcept = 0;
 
 	/**
 	 * An I/O error has occurred while reading.
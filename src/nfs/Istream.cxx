@@ -8,50 +8,105 @@
 #include "istream/istream.hxx"
 #include "istream/UnusedPtr.hxx"
 #include "istream/New.hxx"
-#include "pool/pool.hxx"
-#include "util/ForeignFifoBuffer.hxx"
+#include "memory/SlicePool.hxx"
+#include "util/DestructObserver.hxx"
 
+#include <algorithm>
+#include <array>
+#include <span>
 #include <stdexcept>
 
 #include <assert.h>
 #include <string.h>
 
-static constexpr size_t NFS_BUFFER_SIZE = 32768;
+/**
+ * The maximum number of concurrent "pread" calls of one
+ * #NfsIstream.
+ */
+static constexpr unsigned NFS_MAX_READS = 32;
 
-class NfsIstream final : public Istream, NfsClientReadFileHandler {
+class NfsIstream final : public Istream, NfsClientReadFileHandler, DestructAnchor {
 	NfsFileHandle *handle;
 
+	SlicePool &buffer_pool;
+
 	/**
-	 * The offset of the next "pread" call on the NFS server.
+	 * One "pread" call on the NFS server.
 	 */
-	uint64_t offset;
+	struct Chunk {
+		/**
+		 * The received data; allocated only after the read
+		 * has completed and only if it has not been consumed
+		 * right away.
+		 */
+		SliceAllocation buffer;
+
+		/**
+		 * The file offset of this read.
+		 */
+		uint64_t offset;
+
+		/**
+		 * The number of bytes requested from the server.
+		 */
+		size_t size;
+
+		/**
+		 * The number of bytes which have already been
+		 * consumed (or skipped).  This may be non-zero even
+		 * before the read has completed if _Skip() has been
+		 * called.
+		 */
+		size_t position;
+
+		/**
+		 * Has the server replied to this read?
+		 */
+		bool complete;
+
+		size_t GetRemaining() const noexcept {
+			return size - position;
+		}
+	};
 
 	/**
-	 * The number of bytes that are remaining on the NFS server, not
-	 * including the amount of data that is already pending.
+	 * A ring buffer of reads in file order; the first one is at
+	 * #head.  Replies may arrive in any order, but data is
+	 * submitted to the #IstreamHandler only from the head.
 	 */
-	uint64_t remaining;
+	std::array<Chunk, NFS_MAX_READS> chunks;
+
+	unsigned head = 0, n_chunks = 0;
 
 	/**
-	 * The number of bytes currently scheduled by nfs_pread_async().
+	 * The current number of concurrent reads.  It starts with 1
+	 * and is doubled each time the handler has consumed a chunk
+	 * (i.e. it keeps up with the reads), up to #max_window.
 	 */
-	size_t pending_read = 0;
+	unsigned window = 1;
+
+	const unsigned max_window;
 
 	/**
-	 * The number of bytes that shall be discarded from the
-	 * nfs_pread_async() result.  This is non-zero if istream_skip()
-	 * has been called while a read call was pending.
+	 * The offset of the next "pread" call on the NFS server.
 	 */
-	size_t discard_read = 0;
+	uint64_t offset;
 
-	ForeignFifoBuffer<std::byte> buffer;
+	/**
+	 * The number of bytes that are remaining on the NFS server, not
+	 * including the amount of data that is already pending.
+	 */
+	uint64_t remaining;
 
 public:
 	NfsIstream(struct pool &p, NfsFileHandle &_handle,
-		   uint64_t start, uint64_t end)
+		   uint64_t start, uint64_t end,
+		   SlicePool &_buffer_pool, size_t read_ahead)
 		:Istream(p), handle(&_handle),
-		 offset(start), remaining(end - start),
-		 buffer(nullptr) {}
+		 buffer_pool(_buffer_pool),
+		 max_window(std::clamp<size_t>(read_ahead / buffer_pool.GetSliceSize(),
+					       1, NFS_MAX_READS)),
+		 offset(start), remaining(end - start) {}
 
 	~NfsIstream() noexcept override {
 		if (handle != nullptr)
@@ -59,90 +114,175 @@ public:
 	}
 
 private:
-	void ScheduleRead();
+	Chunk &At(unsigned i) noexcept {
+		assert(i < n_chunks);
+
+		return chunks[(head + i) % chunks.size()];
+	}
+
+	const Chunk &At(unsigned i) const noexcept {
+		assert(i < n_chunks);
+
+		return chunks[(head + i) % chunks.size()];
+	}
+
+	Chunk &Head() noexcept {
+		return At(0);
+	}
+
+	Chunk &FindChunk(uint64_t read_offset) noexcept;
+
+	/**
+	 * Remove the (completely consumed) head chunk and grow the
+	 * window.
+	 */
+	void PopChunk() noexcept;
+
+	/**
+	 * Fill the window with new "pread" calls.
+	 */
+	void ScheduleReads() noexcept;
 
 	/**
-	 * Check for end-of-file, and if there's more data to read, schedule
-	 * another read call.
-	 *
-	 * The input buffer must be empty.
+	 * Check for end-of-file, and if there's more data to read,
+	 * schedule more read calls.
 	 */
-	void ScheduleReadOrEof();
+	void ScheduleReadsOrEof() noexcept;
 
-	void Feed(const void *data, size_t length);
+	/**
+	 * Submit data from completed chunks to the handler (in file
+	 * order), then refill the window.
+	 */
+	void ReadFromChunks() noexcept;
 
-	void ReadFromBuffer();
+	void Abort(std::exception_ptr ep) noexcept {
+		nfs_client_close_file(*std::exchange(handle, nullptr));
+		DestroyError(ep);
+	}
 
 	/* virtual methods from class Istream */
 
 	off_t _GetAvailable(bool) noexcept override {
-		return remaining + pending_read - discard_read +
-			buffer.GetAvailable();
+		uint64_t available = remaining;
+		for (unsigned i = 0; i < n_chunks; ++i)
+			available += At(i).GetRemaining();
+		return available;
 	}
 
 	off_t _Skip(off_t length) noexcept override;
 
 	void _Read() noexcept override {
-		if (!buffer.empty())
-			ReadFromBuffer();
-		else
-			ScheduleReadOrEof();
+		ReadFromChunks();
 	}
 
 	/* virtual methods from class NfsClientReadFileHandler */
-	void OnNfsRead(const void *data, size_t length) noexcept override;
+	void OnNfsRead(uint64_t read_offset,
+		       const void *data, size_t length) noexcept override;
 	void OnNfsReadError(std::exception_ptr ep) noexcept override;
 };
 
-void
-NfsIstream::ScheduleReadOrEof()
+NfsIstream::Chunk &
+NfsIstream::FindChunk(uint64_t read_offset) noexcept
 {
-	assert(buffer.empty());
+	for (unsigned i = 0;; ++i) {
+		auto &chunk = At(i);
+		if (chunk.offset == read_offset)
+			return chunk;
+	}
+}
 
-	if (pending_read > 0)
-		return;
+inline void
+NfsIstream::PopChunk() noexcept
+{
+	auto &chunk = Head();
+	assert(chunk.complete);
+	assert(chunk.GetRemaining() == 0);
 
-	if (remaining > 0) {
-		/* read more */
+	if (chunk.buffer.IsDefined())
+		chunk.buffer.Free();
 
-		ScheduleRead();
-	} else {
-		/* end of file */
+	head = (head + 1) % chunks.size();
+	--n_chunks;
 
-		nfs_client_close_file(*std::exchange(handle, nullptr));
-		DestroyEof();
-	}
+	/* the handler has consumed a whole chunk; allow more
+	   concurrent reads */
+	window = std::min(window * 2, max_window);
 }
 
-inline void
-NfsIstream::Feed(const void *data, size_t length)
+void
+NfsIstream::ScheduleReads() noexcept
 {
-	assert(length > 0);
-
-	if (buffer.IsNull()) {
-		const uint64_t total_size = remaining + length;
-		const size_t buffer_size = total_size > NFS_BUFFER_SIZE
-			? NFS_BUFFER_SIZE
-			: (size_t)total_size;
-		buffer.SetBuffer(PoolAlloc<std::byte>(GetPool(), buffer_size),
-				 buffer_size);
+	const DestructObserver destructed(*this);
+	const size_t slice_size = buffer_pool.GetSliceSize();
+
+	while (n_chunks < window && remaining > 0) {
+		const size_t nbytes = std::min<uint64_t>(remaining, slice_size);
+
+		auto &chunk = chunks[(head + n_chunks) % chunks.size()];
+		assert(!chunk.buffer.IsDefined());
+		chunk.offset = offset;
+		chunk.size = nbytes;
+		chunk.position = 0;
+		chunk.complete = false;
+		++n_chunks;
+
+		offset += nbytes;
+		remaining -= nbytes;
+
+		/* this may invoke OnNfsReadError() synchronously */
+		nfs_client_read_file(*handle, chunk.offset, nbytes, *this);
+		if (destructed)
+			return;
 	}
+}
+
+void
+NfsIstream::ScheduleReadsOrEof() noexcept
+{
+	if (n_chunks == 0 && remaining == 0) {
+		/* end of file */
 
-	auto w = buffer.Write();
-	assert(w.size() >= length);
+		nfs_client_close_file(*std::exchange(handle, nullptr));
+		DestroyEof();
+		return;
+	}
 
-	memcpy(w.data(), data, length);
-	buffer.Append(length);
+	ScheduleReads();
 }
 
 void
-NfsIstream::ReadFromBuffer()
+NfsIstream::ReadFromChunks() noexcept
 {
-	assert(buffer.IsDefined());
+	const DestructObserver destructed(*this);
+
+	while (n_chunks > 0) {
+		auto &chunk = Head();
+		if (!chunk.complete)
+			/* waiting for the server */
+			break;
+
+		if (chunk.GetRemaining() > 0) {
+			assert(chunk.buffer.IsDefined());
+
+			const std::span<const std::byte> src{
+				(const std::byte *)chunk.buffer.data + chunk.position,
+				chunk.GetRemaining(),
+			};
+
+			const size_t nbytes = InvokeData(src);
+			if (destructed)
+				return;
+
+			chunk.position += nbytes;
+			if (chunk.GetRemaining() > 0)
+				/* the handler is blocking */
+				break;
+		}
 
-	size_t buffer_remaining = ConsumeFromBuffer(buffer);
-	if (buffer_remaining == 0 && pending_read == 0)
-		ScheduleReadOrEof();
+		PopChunk();
+	}
+
+	ScheduleReadsOrEof();
 }
 
 /*
@@ -151,56 +291,57 @@ NfsIstream::ReadFromBuffer()
  */
 
 void
-NfsIstream::OnNfsRead(const void *data, size_t _length) noexcept
+NfsIstream::OnNfsRead(uint64_t read_offset,
+		      const void *data, size_t length) noexcept
 {
-	assert(pending_read > 0);
-	assert(discard_read <= pending_read);
-	assert(_length <= pending_read);
+	auto &chunk = FindChunk(read_offset);
+	assert(!chunk.complete);
+	assert(length <= chunk.size);
 
-	if (_length < pending_read) {
-		nfs_client_close_file(*std::exchange(handle, nullptr));
-		DestroyError(std::make_exception_ptr(std::runtime_error("premature end of file")));
+	if (length < chunk.size) {
+		Abort(std::make_exception_ptr(std::runtime_error("premature end of file")));
 		return;
 	}
 
-	const size_t discard = discard_read;
-	const size_t length = pending_read - discard;
-	pending_read = 0;
-	discard_read = 0;
+	chunk.complete = true;
 
-	if (length > 0)
-		Feed((const char *)data + discard, length);
-	ReadFromBuffer();
-}
+	std::span<const std::byte> src{
+		(const std::byte *)data + chunk.position,
+		chunk.GetRemaining(),
+	};
 
-void
-NfsIstream::OnNfsReadError(std::exception_ptr ep) noexcept
-{
-	assert(pending_read > 0);
+	if (!src.empty() && &chunk == &Head()) {
+		/* this is the chunk the handler is waiting for: submit
+		   it directly from libnfs's buffer, and copy only what
+		   the handler doesn't accept */
+		const DestructObserver destructed(*this);
 
-	nfs_client_close_file(*std::exchange(handle, nullptr));
-	DestroyError(ep);
-}
+		const size_t nbytes = InvokeData(src);
+		if (destructed)
+			return;
 
-inline void
-NfsIstream::ScheduleRead()
-{
-	assert(pending_read == 0);
+		chunk.position += nbytes;
+		src = src.subspan(nbytes);
+	}
 
-	const size_t max = buffer.IsDefined()
-		? buffer.Write().size()
-		: NFS_BUFFER_SIZE;
-	size_t nbytes = remaining > max
-		? max
-		: (size_t)remaining;
+	if (!src.empty()) {
+		chunk.buffer = buffer_pool.Alloc();
+		assert(chunk.buffer.size >= chunk.size);
 
-	const uint64_t read_offset = offset;
+		memcpy((std::byte *)chunk.buffer.data + chunk.position,
+		       src.data(), src.size());
+	}
 
-	offset += nbytes;
-	remaining -= nbytes;
-	pending_read = nbytes;
+	if (&chunk == &Head())
+		ReadFromChunks();
+}
 
-	nfs_client_read_file(*handle, read_offset, nbytes, *this);
+void
+NfsIstream::OnNfsReadError(std::exception_ptr ep) noexcept
+{
+	assert(n_chunks > 0);
+
+	Abort(ep);
 }
 
 /*
@@ -211,37 +352,33 @@ NfsIstream::ScheduleRead()
 off_t
 NfsIstream::_Skip(off_t _length) noexcept
 {
-	assert(discard_read <= pending_read);
-
 	uint64_t length = _length;
 
 	uint64_t result = 0;
 
-	if (buffer.IsDefined()) {
-		const uint64_t buffer_available = buffer.GetAvailable();
-		const uint64_t consume = length < buffer_available
-			? length
-			: buffer_available;
-		buffer.Consume(consume);
+	/* skip data in the window; data of pending reads will be
+	   discarded when it arrives */
+	for (unsigned i = 0; i < n_chunks && length > 0; ++i) {
+		auto &chunk = At(i);
+		const size_t consume = std::min<uint64_t>(length,
+							  chunk.GetRemaining());
+		chunk.position += consume;
 		result += consume;
 		length -= consume;
 	}
 
-	const uint64_t pending_available =
-		pending_read - discard_read;
-	uint64_t consume = length < pending_available
-		? length
-		: pending_available;
-	discard_read += consume;
-	result += consume;
-	length -= consume;
+	if (length > 0) {
+		/* skipping beyond the window: this is not a sequential
+		   read, so start over with a small window */
+		if (length > remaining)
+			length = remaining;
 
-	if (length > remaining)
-		length = remaining;
+		remaining -= length;
+		offset += length;
+		result += length;
 
-	remaining -= length;
-	offset += length;
-	result += length;
+		window = 1;
+	}
 
 	Consumed(result);
 	return result;
@@ -254,9 +391,11 @@ NfsIstream::_Skip(off_t _length) noexcept
 
 UnusedIstreamPtr
 istream_nfs_new(struct pool &pool, NfsFileHandle &handle,
-		uint64_t start, uint64_t end)
+		uint64_t start, uint64_t end,
+		SlicePool &buffer_pool, size_t read_ahead)
 {
 	assert(start <= end);
 
-	return NewIstreamPtr<NfsIstream>(pool, handle, start, end);
+	return NewIstreamPtr<NfsIstream>(pool, handle, start, end,
+					 buffer_pool, read_ahead);
 }
@@ -4,15 +4,32 @@
 
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
 struct pool;
 class UnusedIstreamPtr;
 class NfsFileHandle;
+class SlicePool;
+
+/**
+ * The recommended slice size of the #SlicePool passed to
+ * istream_nfs_new().  This is the size of each "pread" call on the
+ * NFS server.
+ */
+static constexpr size_t NFS_BUFFER_SIZE = 128 * 1024;
 
 /*
  * #Istream implementation which reads a file from a NFS server.
+ *
+ * @param buffer_pool the received data is copied to slices from
+ * this pool
+ * @param read_ahead the maximum number of bytes which may be
+ * requested from the server (with concurrent "pread" calls) before
+ * the #IstreamHandler has consumed them; the window starts with one
+ * slice and grows while the handler keeps up
  */
 UnusedIstreamPtr
 istream_nfs_new(struct pool &pool, NfsFileHandle &handle,
-		uint64_t start, uint64_t end);
+		uint64_t start, uint64_t end,
+		SlicePool &buffer_pool, size_t read_ahead);
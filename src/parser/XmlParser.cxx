@@ -281,22 +281,24 @@ XmlParser::Feed(const char *start, size_t length) noexcept
 
 		case State::ATTR_VALUE_COMPAT:
 			/* wait till the value is finished */
-			do {
-				if (!IsWhitespaceOrNull(*buffer) && *buffer != '>') {
-					if (!attr_value.Write(buffer, 1)) {
-						state = State::ELEMENT_TAG;
-						break;
-					}
+			p = buffer;
+			while (p < end && !IsWhitespaceOrNull(*p) && *p != '>')
+				++p;
 
-					++buffer;
-				} else {
-					attr.value_end = attr.end =
-						position + (off_t)(buffer - start);
-					InvokeAttributeFinished();
-					state = State::ELEMENT_TAG;
-					break;
-				}
-			} while (buffer < end);
+			/* copy the whole run at once */
+			if (p > buffer && !attr_value.Write(buffer, p - buffer)) {
+				state = State::ELEMENT_TAG;
+				break;
+			}
+
+			buffer = p;
+
+			if (buffer < end) {
+				attr.value_end = attr.end =
+					position + (off_t)(buffer - start);
+				InvokeAttributeFinished();
+				state = State::ELEMENT_TAG;
+			}
 
 			break;
 
@@ -376,9 +378,21 @@ XmlParser::Feed(const char *start, size_t length) noexcept
 		case State::CDATA_SECTION:
 			/* copy CDATA section contents */
 
-			/* XXX this loop can be optimized with memchr() */
 			p = buffer;
 			while (buffer < end) {
+				if (cdend_match == 0) {
+					/* skip everything up to the next
+					   ']', which may start the CDEnd */
+					const char *q = (const char *)
+						memchr(buffer, ']', end - buffer);
+					if (q == nullptr) {
+						buffer = end;
+						break;
+					}
+
+					buffer = q;
+				}
+
 				if (*buffer == ']' && cdend_match < 2) {
 					if (buffer > p) {
 						/* flush buffer */
@@ -404,6 +418,23 @@ XmlParser::Feed(const char *start, size_t length) noexcept
 					p = ++buffer;
 					state = State::NONE;
 					break;
+				} else if (*buffer == ']') {
+					/* "]]]": the first ']' is data, and
+					   the other two may still begin the
+					   CDEnd */
+					assert(cdend_match == 2);
+
+					nbytes = handler.OnXmlCdata("]", false,
+								    position + buffer - start - 2);
+					assert(nbytes <= 1);
+
+					if (nbytes == 0) {
+						nbytes = buffer - start;
+						position += (off_t)nbytes;
+						return nbytes;
+					}
+
+					p = ++buffer;
 				} else {
 					if (cdend_match > 0) {
 						/* we had a partial match, and now we have to
@@ -411,7 +442,7 @@ XmlParser::Feed(const char *start, size_t length) noexcept
 						assert(cdend_match < 3);
 
 						nbytes = handler.OnXmlCdata({"]]", cdend_match}, false,
-									    position + buffer - start);
+									    position + buffer - start - cdend_match);
 						assert(nbytes <= cdend_match);
 
 						cdend_match -= nbytes;
@@ -139,6 +139,28 @@ public:
 	 */
 	size_t Feed(const char *start, size_t length) noexcept;
 
+	off_t GetPosition() const noexcept {
+		return position;
+	}
+
+	/**
+	 * Is the parser outside of any markup?  Parsing can be
+	 * resumed from here by a parser which has been reset with
+	 * Reset().
+	 */
+	bool IsIdle() const noexcept {
+		return state == State::NONE;
+	}
+
+	/**
+	 * Return to the initial state; the next Feed() call passes
+	 * data beginning at the specified source offset.
+	 */
+	void Reset(off_t _position) noexcept {
+		position = _position;
+		state = State::NONE;
+	}
+
 	void Script() noexcept {
 		assert(state == State::NONE ||
 		       state == State::INSIDE);
@@ -7,7 +7,17 @@
 #include "stock/Item.hxx"
 #include "system/Error.hxx"
 
+#include <algorithm>
+
 #include <assert.h>
+#include <fcntl.h>
+
+static std::size_t
+GetPipeCapacity(FileDescriptor fd) noexcept
+{
+	int result = fcntl(fd.Get(), F_GETPIPE_SZ);
+	return result > 0 ? std::size_t(result) : 0;
+}
 
 void
 PipeLease::Release(bool reuse) noexcept
@@ -17,16 +27,32 @@ PipeLease::Release(bool reuse) noexcept
 
 	if (stock != nullptr) {
 		assert(item != nullptr);
+
+		if (capacity > initial_capacity) {
+			stock->ReleaseGrow(capacity - initial_capacity);
+
+			/* don't let idle pipes in the stock hold the
+			   grown buffer; the kernel accounts it against
+			   pipe-user-pages-soft; if shrinking fails,
+			   discard the pipe */
+			if (reuse &&
+			    fcntl(write_fd.Get(), F_SETPIPE_SZ,
+				  (int)initial_capacity) < 0)
+				reuse = false;
+		}
+
 		item->Put(!reuse);
 		item = nullptr;
 
 		read_fd.SetUndefined();
 		write_fd.SetUndefined();
+		capacity = initial_capacity = 0;
 	} else {
 		if (read_fd.IsDefined())
 			read_fd.Close();
 		if (write_fd.IsDefined())
 			write_fd.Close();
+		capacity = 0;
 	}
 }
 
@@ -48,4 +74,39 @@ PipeLease::Create()
 		if (!FileDescriptor::CreatePipeNonBlock(read_fd, write_fd))
 			throw MakeErrno("pipe() failed");
 	}
+
+	capacity = initial_capacity = GetPipeCapacity(write_fd);
+}
+
+void
+PipeLease::OnSpliced(std::size_t nbytes) noexcept
+{
+	assert(IsDefined());
+
+	if (stock == nullptr)
+		return;
+
+	stock->AddSplice(nbytes);
+
+	const std::size_t max_size = stock->GetMaxPipeSize();
+	if (capacity == 0 || nbytes < capacity || capacity >= max_size)
+		return;
+
+	const std::size_t new_size = std::min(capacity * 2, max_size);
+	if (!stock->TryGrow(new_size - capacity))
+		/* too many grown pipes already */
+		return;
+
+	const int result = fcntl(write_fd.Get(), F_SETPIPE_SZ, (int)new_size);
+	if (result < 0) {
+		stock->ReleaseGrow(new_size - capacity);
+		return;
+	}
+
+	/* the kernel rounds up to a power of two pages */
+	assert(std::size_t(result) >= new_size);
+	stock->AddGrown(std::size_t(result) - new_size);
+
+	capacity = result;
+	stock->AddGrow();
 }
@@ -6,6 +6,7 @@
 
 #include "io/FileDescriptor.hxx"
 
+#include <cstddef>
 #include <utility>
 
 class PipeStock;
@@ -17,6 +18,18 @@ class PipeLease {
 	FileDescriptor read_fd = FileDescriptor::Undefined();
 	FileDescriptor write_fd = FileDescriptor::Undefined();
 
+	/**
+	 * The capacity of the pipe (F_GETPIPE_SZ) or 0 if unknown.
+	 */
+	std::size_t capacity = 0;
+
+	/**
+	 * The capacity of the pipe when it was obtained from the
+	 * #PipeStock.  Grown pipes are shrunk back to this size
+	 * before they are returned.
+	 */
+	std::size_t initial_capacity = 0;
+
 public:
 	explicit PipeLease(PipeStock *_stock) noexcept
 		:stock(_stock) {}
@@ -24,7 +37,9 @@ public:
 	PipeLease(PipeLease &&src) noexcept
 		:stock(src.stock), item(std::exchange(src.item, nullptr)),
 		 read_fd(std::exchange(src.read_fd, FileDescriptor::Undefined())),
-		 write_fd(std::exchange(src.write_fd, FileDescriptor::Undefined())) {}
+		 write_fd(std::exchange(src.write_fd, FileDescriptor::Undefined())),
+		 capacity(std::exchange(src.capacity, 0)),
+		 initial_capacity(std::exchange(src.initial_capacity, 0)) {}
 
 	PipeLease &operator=(PipeLease &&src) noexcept {
 		using std::swap;
@@ -32,6 +47,8 @@ public:
 		swap(item, src.item);
 		swap(read_fd, src.read_fd);
 		swap(write_fd, src.write_fd);
+		swap(capacity, src.capacity);
+		swap(initial_capacity, src.initial_capacity);
 		return *this;
 	}
 
@@ -73,4 +90,18 @@ public:
 	FileDescriptor GetWriteFd() noexcept {
 		return write_fd;
 	}
+
+	std::size_t GetCapacity() const noexcept {
+		return capacity;
+	}
+
+	/**
+	 * Account for a splice() into this pipe.  If the transfer
+	 * filled the pipe, the pipe is enlarged (up to
+	 * PipeStock::GetMaxPipeSize() and within the stock's budget
+	 * for grown pipes), so the next transfers need fewer system
+	 * calls.  The pipe is shrunk back (or discarded) when it is
+	 * returned to the #PipeStock.
+	 */
+	void OnSpliced(std::size_t nbytes) noexcept;
 };
@@ -7,6 +7,8 @@
 #include "system/Error.hxx"
 #include "io/UniqueFileDescriptor.hxx"
 
+#include <fcntl.h>
+
 struct PipeStockItem final : StockItem {
 	UniqueFileDescriptor fds[2];
 
@@ -38,6 +40,11 @@ PipeStock::Create(CreateStockItem c, StockRequest,
 		throw MakeErrno(e, "pipe() failed");
 	}
 
+	if (initial_size > 0)
+		/* failure is not fatal; the kernel may refuse sizes
+		   above /proc/sys/fs/pipe-max-size */
+		fcntl(item->fds[1].Get(), F_SETPIPE_SZ, (int)initial_size);
+
 	item->InvokeCreateSuccess(get_handler);
 }
 
@@ -7,16 +7,134 @@
 #include "stock/Stock.hxx"
 #include "stock/Class.hxx"
 
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
 class FileDescriptor;
 
+struct PipeStockStats {
+	/**
+	 * Number of splice()/vmsplice() calls which moved data into
+	 * pipes from this stock.
+	 */
+	uint64_t n_splices = 0;
+
+	/**
+	 * Number of bytes moved by these calls.
+	 */
+	uint64_t spliced_bytes = 0;
+
+	/**
+	 * Number of times a pipe was enlarged because a transfer
+	 * filled it.
+	 */
+	uint64_t n_grows = 0;
+
+	/**
+	 * Number of times a pipe was not enlarged because the
+	 * budget for grown pipes was exhausted.
+	 */
+	uint64_t n_grow_refused = 0;
+};
+
 /**
  * Anonymous pipe pooling, to speed to istream_pipe.
  */
 class PipeStock final : public Stock, StockClass {
+	/**
+	 * The capacity of new pipes (F_SETPIPE_SZ).  0 means the
+	 * kernel default.
+	 */
+	const std::size_t initial_size;
+
+	/**
+	 * Pipes which get filled by a single transfer are enlarged
+	 * up to this capacity (see PipeLease::OnSpliced()).  0
+	 * disables this.
+	 */
+	const std::size_t max_size;
+
+	/**
+	 * The maximum total number of bytes by which leased pipes
+	 * may be grown beyond their initial capacity.  Pipe buffers
+	 * are accounted against /proc/sys/fs/pipe-user-pages-soft
+	 * (16384 pages by default), and after exceeding it, the
+	 * kernel gives all new pipes a minimal buffer.
+	 */
+	static constexpr std::size_t MAX_GROWN_BYTES = 16 * 1024 * 1024;
+
+	/**
+	 * The total number of bytes by which currently leased pipes
+	 * have been grown (see PipeLease::OnSpliced()).
+	 */
+	std::size_t grown_bytes = 0;
+
+	PipeStockStats stats;
+
 public:
-	explicit PipeStock(EventLoop &event_loop)
-		:Stock(event_loop, *this, "pipe", 0, 64,
-		       Event::Duration::zero()) {}
+	/**
+	 * @param _initial_size the capacity of new pipes; 0 for the
+	 * kernel default
+	 * @param _max_size the maximum capacity for adaptive growth;
+	 * 0 disables growing
+	 */
+	explicit PipeStock(EventLoop &event_loop, const char *name="pipe",
+			   std::size_t _initial_size=0,
+			   std::size_t _max_size=0)
+		:Stock(event_loop, *this, name, 0, 64,
+		       Event::Duration::zero()),
+		 initial_size(_initial_size), max_size(_max_size) {}
+
+	std::size_t GetMaxPipeSize() const noexcept {
+		return max_size;
+	}
+
+	const PipeStockStats &GetStats() const noexcept {
+		return stats;
+	}
+
+	void AddSplice(std::size_t nbytes) noexcept {
+		++stats.n_splices;
+		stats.spliced_bytes += nbytes;
+	}
+
+	void AddGrow() noexcept {
+		++stats.n_grows;
+	}
+
+	/**
+	 * Reserve budget for growing a pipe by the given number of
+	 * bytes.
+	 *
+	 * @return false if the budget is exhausted
+	 */
+	bool TryGrow(std::size_t delta) noexcept {
+		if (grown_bytes + delta > MAX_GROWN_BYTES) {
+			++stats.n_grow_refused;
+			return false;
+		}
+
+		grown_bytes += delta;
+		return true;
+	}
+
+	/**
+	 * Like TryGrow(), but unconditionally (e.g. because the
+	 * kernel has rounded up the size).
+	 */
+	void AddGrown(std::size_t delta) noexcept {
+		grown_bytes += delta;
+	}
+
+	/**
+	 * Return budget reserved by TryGrow() or AddGrown(), e.g.
+	 * because the pipe has been shrunk or released.
+	 */
+	void ReleaseGrow(std::size_t delta) noexcept {
+		assert(grown_bytes >= delta);
+		grown_bytes -= delta;
+	}
 
 private:
 	/* virtual methods from class StockClass */
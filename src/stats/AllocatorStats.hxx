@@ -17,23 +17,50 @@ struct AllocatorStats {
 	 */
 	std::size_t netto_size;
 
+	/**
+	 * Number of unused gaps between allocations.  Together with
+	 * the difference between #brutto_size and #netto_size, this
+	 * describes how fragmented the allocator is.
+	 */
+	std::size_t n_holes = 0;
+
+	/**
+	 * Total number of bytes relocated by compaction.
+	 */
+	std::size_t compress_moved = 0;
+
+	/**
+	 * The part of #compress_moved which was relocated by
+	 * remapping pages instead of copying.
+	 */
+	std::size_t compress_remapped = 0;
+
 	static constexpr AllocatorStats Zero() {
-		return { 0, 0 };
+		return { 0, 0, 0, 0, 0 };
 	}
 
 	void Clear() {
 		brutto_size = 0;
 		netto_size = 0;
+		n_holes = 0;
+		compress_moved = 0;
+		compress_remapped = 0;
 	}
 
 	AllocatorStats &operator+=(const AllocatorStats other) {
 		brutto_size += other.brutto_size;
 		netto_size += other.netto_size;
+		n_holes += other.n_holes;
+		compress_moved += other.compress_moved;
+		compress_remapped += other.compress_remapped;
 		return *this;
 	}
 
 	constexpr AllocatorStats operator+(const AllocatorStats other) const {
 		return { brutto_size + other.brutto_size,
-			netto_size + other.netto_size };
+			netto_size + other.netto_size,
+			n_holes + other.n_holes,
+			compress_moved + other.compress_moved,
+			compress_remapped + other.compress_remapped };
 	}
 };
@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+/**
+ * Counters describing the work done by a #Cache.
+ */
+struct CacheStats {
+	/**
+	 * Number of lookups which found a valid item.
+	 */
+	uint64_t hits;
+
+	/**
+	 * Number of lookups which did not find a valid item.
+	 */
+	uint64_t misses;
+
+	/**
+	 * Number of items removed to make room for new ones.
+	 */
+	uint64_t evictions;
+
+	/**
+	 * Number of new items evicted by the admission filter
+	 * instead of a more popular old item (see
+	 * #CachePolicy::TINY_LFU).
+	 */
+	uint64_t admission_rejected;
+
+	/**
+	 * Number of expiry passes (see Cache::ExpireCallback()).
+	 */
+	uint64_t expire_passes;
+
+	/**
+	 * Number of items examined by expiry passes.
+	 */
+	uint64_t expire_checked;
+
+	/**
+	 * Number of items removed by expiry passes.
+	 */
+	uint64_t expire_removed;
+
+	/**
+	 * Total time spent in expiry passes.
+	 */
+	std::chrono::steady_clock::duration expire_duration;
+
+	/**
+	 * Duration of the most expensive expiry pass.
+	 */
+	std::chrono::steady_clock::duration expire_max_duration;
+
+	static constexpr CacheStats Zero() noexcept {
+		return {};
+	}
+
+	CacheStats &operator+=(const CacheStats &other) noexcept {
+		hits += other.hits;
+		misses += other.misses;
+		evictions += other.evictions;
+		admission_rejected += other.admission_rejected;
+		expire_passes += other.expire_passes;
+		expire_checked += other.expire_checked;
+		expire_removed += other.expire_removed;
+		expire_duration += other.expire_duration;
+		expire_max_duration = std::max(expire_max_duration,
+					       other.expire_max_duration);
+		return *this;
+	}
+};
@@ -0,0 +1,49 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#include "BaseTrie.hxx"
+
+#include <cassert>
+
+void
+TranslationBaseTrie::Add(std::string_view key)
+{
+	Node *node = &root;
+
+	for (std::string_view::size_type position = 0;;) {
+		const auto slash = key.find('/', position);
+		if (slash == key.npos)
+			break;
+
+		const auto segment = key.substr(position, slash - position);
+		auto i = node->children.find(segment);
+		if (i == node->children.end())
+			i = node->children.emplace(std::string{segment},
+						   Node{}).first;
+
+		node = &i->second;
+		position = slash + 1;
+	}
+
+	++node->n_keys;
+}
+
+bool
+TranslationBaseTrie::Node::Remove(std::string_view key,
+				   std::string_view::size_type position) noexcept
+{
+	const auto slash = key.find('/', position);
+	if (slash == key.npos) {
+		assert(n_keys > 0);
+		--n_keys;
+	} else {
+		auto i = children.find(key.substr(position, slash - position));
+		assert(i != children.end());
+
+		if (i->second.Remove(key, slash + 1))
+			children.erase(i);
+	}
+
+	return IsEmpty();
+}
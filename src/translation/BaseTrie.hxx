@@ -0,0 +1,97 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <string_view>
+
+/**
+ * A trie of cache keys split at slashes.  It is used by the
+ * translation cache to remember which URI prefixes have a BASE
+ * response, so a lookup needs to query the cache only for those
+ * prefixes instead of for each path segment.
+ *
+ * Keys may be added multiple times; each node counts how often its
+ * key was added.
+ */
+class TranslationBaseTrie {
+	struct Node {
+		std::map<std::string, Node, std::less<>> children;
+
+		/**
+		 * How often was the key ending at this node added?
+		 */
+		std::size_t n_keys = 0;
+
+		[[gnu::pure]]
+		const Node *Find(std::string_view segment) const noexcept {
+			auto i = children.find(segment);
+			return i != children.end()
+				? &i->second
+				: nullptr;
+		}
+
+		bool IsEmpty() const noexcept {
+			return n_keys == 0 && children.empty();
+		}
+
+		/**
+		 * @return true if this node has become empty and
+		 * shall be removed
+		 */
+		bool Remove(std::string_view key,
+			    std::string_view::size_type position) noexcept;
+	};
+
+	Node root;
+
+public:
+	bool empty() const noexcept {
+		return root.IsEmpty();
+	}
+
+	/**
+	 * Add a key.  Only the part up to the last slash is
+	 * significant (BASE keys end with a slash).
+	 *
+	 * Throws std::bad_alloc on error.
+	 */
+	void Add(std::string_view key);
+
+	/**
+	 * Remove a key which was previously passed to Add().
+	 */
+	void Remove(std::string_view key) noexcept {
+		root.Remove(key, 0);
+	}
+
+	/**
+	 * Invoke a function for each prefix of the given key (ending
+	 * with a slash, but not the key itself) which was added,
+	 * shortest first.  The function receives the length of the
+	 * prefix; it must not modify this object.
+	 */
+	template<typename F>
+	void ForEachPrefix(std::string_view key, F &&f) const {
+		const Node *node = &root;
+
+		for (std::string_view::size_type position = 0;;) {
+			const auto slash = key.find('/', position);
+			if (slash == key.npos || slash + 1 == key.size())
+				break;
+
+			node = node->Find(key.substr(position,
+						     slash - position));
+			if (node == nullptr)
+				break;
+
+			if (node->n_keys > 0)
+				f(slash + 1);
+
+			position = slash + 1;
+		}
+	}
+};
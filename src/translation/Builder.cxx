@@ -5,11 +5,23 @@
 #include "Builder.hxx"
 #include "Stock.hxx"
 #include "Cache.hxx"
+#include "SnapshotFile.hxx"
 #include "net/SocketAddress.hxx"
 #include "stats/AllocatorStats.hxx"
+#include "stats/CacheStats.hxx"
+#include "io/BufferedOutputStream.hxx"
+#include "io/BufferedReader.hxx"
+#include "io/FdReader.hxx"
+#include "io/FdOutputStream.hxx"
+#include "io/FileWriter.hxx"
+#include "io/Logger.hxx"
+#include "io/UniqueFileDescriptor.hxx"
 
 #include <cassert>
 #include <cstring>
+#include <stdexcept>
+
+#include <sys/socket.h>
 
 class SocketAddress;
 class TranslationStock;
@@ -33,8 +45,9 @@ SocketAddressCompare::operator()(SocketAddress a,
 	return a.GetSize() < b.GetSize();
 }
 
-TranslationStockBuilder::TranslationStockBuilder(unsigned _limit) noexcept
-	:limit(_limit)
+TranslationStockBuilder::TranslationStockBuilder(unsigned _limit,
+						 bool _multiplex) noexcept
+	:limit(_limit), multiplex(_multiplex)
 {
 }
 
@@ -47,7 +60,7 @@ TranslationStockBuilder::Get(SocketAddress address,
 	auto e = m.try_emplace(address, nullptr);
 	if (e.second)
 		e.first->second = std::make_shared<TranslationStock>
-			(event_loop, address, limit);
+			(event_loop, address, limit, multiplex);
 
 	return e.first->second;
 }
@@ -80,6 +93,17 @@ TranslationCacheBuilder::GetStats() const noexcept
 	return stats;
 }
 
+CacheStats
+TranslationCacheBuilder::GetCacheStats() const noexcept
+{
+	CacheStats stats = CacheStats::Zero();
+
+	for (const auto &i : m)
+		stats += i.second->GetCacheStats();
+
+	return stats;
+}
+
 void
 TranslationCacheBuilder::Flush() noexcept
 {
@@ -87,6 +111,127 @@ TranslationCacheBuilder::Flush() noexcept
 		i.second->Flush();
 }
 
+template<typename T>
+static T
+ReadT(BufferedReader &r)
+{
+	T value;
+	r.ReadFull(std::as_writable_bytes(std::span{&value, 1}));
+	return value;
+}
+
+/**
+ * Skip a size-prefixed buffer in a snapshot file.
+ */
+static void
+SkipSnapshotBuffer(BufferedReader &r, std::size_t size)
+{
+	while (size > 0) {
+		std::byte buffer[4096];
+		const std::size_t n = std::min(size, sizeof(buffer));
+		r.ReadFull({buffer, n});
+		size -= n;
+	}
+}
+
+/**
+ * Skip a list of snapshot items for a translation server which is no
+ * longer configured.
+ */
+static void
+SkipSnapshotList(BufferedReader &r)
+{
+	/* the generation */
+	SkipSnapshotBuffer(r, ReadT<uint32_t>(r));
+
+	while (true) {
+		const auto magic = ReadT<uint32_t>(r);
+		if (magic == MAGIC_TCACHE_END_OF_LIST)
+			break;
+		else if (magic != MAGIC_TCACHE_ITEM)
+			throw std::runtime_error("Malformed translation cache snapshot");
+
+		ReadT<int64_t>(r);
+
+		/* the request and the response */
+		for (unsigned i = 0; i < 2; ++i)
+			SkipSnapshotBuffer(r, ReadT<uint32_t>(r));
+	}
+}
+
+void
+TranslationCacheBuilder::SaveSnapshot(const char *path) noexcept
+try {
+	LogConcat(5, "TranslationCache", "saving snapshot to ", path);
+
+	FileWriter fw(path);
+	FdOutputStream fos(fw.GetFileDescriptor());
+
+	{
+		BufferedOutputStream bos(fos);
+		bos.WriteT<uint32_t>(MAGIC_TCACHE_FILE);
+		bos.WriteT<uint32_t>(TCACHE_SNAPSHOT_VERSION);
+
+		for (const auto &[address, cache] : m) {
+			bos.WriteT<uint32_t>(MAGIC_TCACHE_SERVER);
+			bos.WriteT<uint32_t>(address.GetSize());
+			bos.Write(address.GetAddress(), address.GetSize());
+
+			cache->Save(bos);
+		}
+
+		bos.WriteT<uint32_t>(MAGIC_TCACHE_END_OF_FILE);
+		bos.Flush();
+	}
+
+	fw.Commit();
+} catch (...) {
+	LogConcat(2, "TranslationCache", "Failed to save snapshot: ",
+		  std::current_exception());
+}
+
+void
+TranslationCacheBuilder::LoadSnapshot(const char *path) noexcept
+{
+	UniqueFileDescriptor fd;
+	if (!fd.OpenReadOnly(path))
+		return;
+
+	try {
+		FdReader fr(fd);
+		BufferedReader r(fr);
+
+		if (ReadT<uint32_t>(r) != MAGIC_TCACHE_FILE ||
+		    ReadT<uint32_t>(r) != TCACHE_SNAPSHOT_VERSION)
+			throw std::runtime_error("Unsupported file format");
+
+		while (true) {
+			const auto magic = ReadT<uint32_t>(r);
+			if (magic == MAGIC_TCACHE_END_OF_FILE)
+				break;
+			else if (magic != MAGIC_TCACHE_SERVER)
+				throw std::runtime_error("Malformed translation cache snapshot");
+
+			struct sockaddr_storage ss;
+			const auto size = ReadT<uint32_t>(r);
+			if (size == 0 || size > sizeof(ss))
+				throw std::runtime_error("Malformed translation cache snapshot");
+
+			r.ReadFull({(std::byte *)&ss, size});
+
+			const SocketAddress address((const struct sockaddr *)&ss,
+						    size);
+			if (auto i = m.find(address); i != m.end())
+				i->second->Load(r);
+			else
+				SkipSnapshotList(r);
+		}
+	} catch (...) {
+		LogConcat(1, "TranslationCache", "Failed to load snapshot: ",
+			  std::current_exception());
+	}
+}
+
 void
 TranslationCacheBuilder::Invalidate(const TranslateRequest &request,
 				    std::span<const TranslationCommand> vary,
@@ -101,12 +246,16 @@ TranslationCacheBuilder::Get(SocketAddress address,
 			     EventLoop &event_loop) noexcept
 {
 	auto e = m.try_emplace(address, nullptr);
-	if (e.second)
+	if (e.second) {
 		e.first->second = std::make_shared<TranslationCache>
 			(pool, event_loop,
 			 // TODO: refactor to std::shared_ptr?
 			 *builder.Get(address, event_loop),
 			 max_size, false);
 
+		if (snapshot)
+			e.first->second->EnableSnapshot(snapshot_generation);
+	}
+
 	return e.first->second;
 }
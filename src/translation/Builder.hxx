@@ -14,8 +14,11 @@
 #include <map>
 #include <memory>
 #include <span>
+#include <string>
+#include <string_view>
 
 struct AllocatorStats;
+struct CacheStats;
 class EventLoop;
 class SocketAddress;
 class TranslationStock;
@@ -37,11 +40,17 @@ public:
 class TranslationStockBuilder final : public TranslationServiceBuilder {
 	const unsigned limit;
 
+	/**
+	 * Attempt to negotiate multiplexed connections?
+	 */
+	const bool multiplex;
+
 	std::map<SocketAddress, std::shared_ptr<TranslationStock>,
 		 SocketAddressCompare> m;
 
 public:
-	explicit TranslationStockBuilder(unsigned _limit) noexcept;
+	explicit TranslationStockBuilder(unsigned _limit,
+					 bool _multiplex=false) noexcept;
 	~TranslationStockBuilder() noexcept;
 
 	std::shared_ptr<TranslationService> Get(SocketAddress address,
@@ -55,6 +64,17 @@ class TranslationCacheBuilder final : public TranslationServiceBuilder {
 
 	const unsigned max_size;
 
+	/**
+	 * Shall new caches keep data for snapshots?  See
+	 * EnableSnapshot().
+	 */
+	bool snapshot = false;
+
+	/**
+	 * The generation passed to TranslationCache::EnableSnapshot().
+	 */
+	std::string snapshot_generation;
+
 	std::map<SocketAddress, std::shared_ptr<TranslationCache>,
 		 SocketAddressCompare> m;
 
@@ -68,8 +88,36 @@ public:
 
 	AllocatorStats GetStats() const noexcept;
 
+	CacheStats GetCacheStats() const noexcept;
+
 	void Flush() noexcept;
 
+	/**
+	 * Enable snapshots in all caches created from now on.  This
+	 * must be called before the first Get() call.
+	 *
+	 * @param generation an opaque string identifying the state of
+	 * the translation servers; snapshots written with a different
+	 * generation are discarded by LoadSnapshot()
+	 */
+	void EnableSnapshot(std::string_view generation) {
+		snapshot = true;
+		snapshot_generation = generation;
+	}
+
+	/**
+	 * Save a snapshot of all caches to the specified file.
+	 * Errors are logged.
+	 */
+	void SaveSnapshot(const char *path) noexcept;
+
+	/**
+	 * Load a snapshot file written by SaveSnapshot() and restore
+	 * the items of all caches which exist in the file.  A missing
+	 * file is silently ignored; other errors are logged.
+	 */
+	void LoadSnapshot(const char *path) noexcept;
+
 	void Invalidate(const TranslateRequest &request,
 			std::span<const TranslationCommand> vary,
 			const char *site) noexcept;
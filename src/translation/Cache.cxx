@@ -3,8 +3,12 @@
 // author: Max Kellermann <mk@cm4all.com>
 
 #include "Cache.hxx"
+#include "BaseTrie.hxx"
 #include "Layout.hxx"
+#include "Marshal.hxx"
+#include "SnapshotFile.hxx"
 #include "translation/Handler.hxx"
+#include "translation/Parser.hxx"
 #include "translation/Request.hxx"
 #include "translation/Response.hxx"
 #include "translation/Protocol.hxx"
@@ -23,11 +27,19 @@
 #include "memory/SlicePool.hxx"
 #include "stats/AllocatorStats.hxx"
 #include "lib/pcre/UniqueRegex.hxx"
+#include "event/CoarseTimerEvent.hxx"
+#include "io/BufferedOutputStream.hxx"
+#include "io/BufferedReader.hxx"
 #include "io/Logger.hxx"
+#include "util/Cancellable.hxx"
 #include "util/djbhash.h"
+#include "util/IntrusiveGrowingHashSet.hxx"
 #include "util/IntrusiveHashSet.hxx"
 #include "util/IntrusiveList.hxx"
 
+#include <algorithm>
+#include <utility>
+
 #include <time.h>
 #include <string.h>
 #include <stdlib.h>
@@ -46,6 +58,34 @@ static constexpr std::size_t MAX_READ_FILE = 256;
 
 struct TranslateCachePerHost;
 struct TranslateCachePerSite;
+struct TranslateCachePerValue;
+struct TranslateCacheItem;
+class TranslateCacheIndex;
+
+/**
+ * Links a #TranslateCacheItem into a #TranslateCacheIndex.
+ */
+struct TranslateCacheIndexHook final
+	: IntrusiveListHook<IntrusiveHookMode::NORMAL>
+{
+	TranslateCacheItem &item;
+
+	/**
+	 * The list this item lives in, or nullptr if it is not
+	 * indexed.
+	 */
+	TranslateCachePerValue *per_value = nullptr;
+
+	explicit TranslateCacheIndexHook(TranslateCacheItem &_item) noexcept
+		:item(_item) {}
+
+	TranslateCacheIndexHook(const TranslateCacheIndexHook &) = delete;
+
+	/**
+	 * Remove the item from the index (if it is indexed).
+	 */
+	void Erase() noexcept;
+};
 
 struct TranslateCacheItem final : PoolHolder, CacheItem {
 	using SiblingsHook = IntrusiveListHook<IntrusiveHookMode::NORMAL>;
@@ -68,6 +108,25 @@ struct TranslateCacheItem final : PoolHolder, CacheItem {
 	SiblingsHook per_site_siblings;
 	TranslateCachePerSite *per_site = nullptr;
 
+	/**
+	 * Index by the URI part of the cache key; all items with a
+	 * URI are indexed.
+	 */
+	TranslateCacheIndexHook per_uri{*this};
+
+	/**
+	 * Index by LISTENER_TAG; only items which had
+	 * VARY=LISTENER_TAG in the response are indexed.
+	 */
+	TranslateCacheIndexHook per_listener_tag{*this};
+
+	/**
+	 * If this item has a BASE, it is registered in this trie with
+	 * #base_key.  nullptr if it is not registered.
+	 */
+	TranslationBaseTrie *base_trie = nullptr;
+	const char *base_key;
+
 	struct {
 		const char *param;
 		std::span<const std::byte> session;
@@ -94,6 +153,22 @@ struct TranslateCacheItem final : PoolHolder, CacheItem {
 
 	UniqueRegex regex, inverse_regex;
 
+	/**
+	 * The marshalled request which produced this item, to be
+	 * written to a snapshot file (see TranslationCache::Save()).
+	 * Only parameters the response depends on are included.
+	 * nullptr if snapshots are disabled or if this item shall not
+	 * be saved.
+	 */
+	std::span<const std::byte> snapshot_request{};
+
+	/**
+	 * The raw response packets as received from the translation
+	 * server, to be written to a snapshot file.  nullptr if
+	 * #snapshot_request is nullptr.
+	 */
+	std::span<const std::byte> snapshot_response{};
+
 	TranslateCacheItem(PoolPtr &&_pool,
 			   std::chrono::steady_clock::time_point now,
 			   std::chrono::seconds max_age) noexcept
@@ -311,6 +386,160 @@ struct TranslateCachePerSite
 	};
 };
 
+/**
+ * A list of #TranslateCacheItem instances (by their
+ * #TranslateCacheIndexHook) which share one value in a
+ * #TranslateCacheIndex.
+ */
+struct TranslateCachePerValue final : IntrusiveGrowingHashSetHook {
+	using ItemList = IntrusiveList<TranslateCacheIndexHook>;
+
+	ItemList items;
+
+	TranslateCacheIndex &index;
+
+	/**
+	 * The hashmap key.
+	 */
+	const std::string value;
+
+	TranslateCachePerValue(TranslateCacheIndex &_index,
+			       const char *_value) noexcept
+		:index(_index), value(_value) {}
+
+	TranslateCachePerValue(const TranslateCachePerValue &) = delete;
+
+	void Erase(TranslateCacheIndexHook &hook) noexcept;
+
+	struct Hash {
+		[[gnu::pure]]
+		std::size_t operator()(const char *key) const noexcept {
+			assert(key != nullptr);
+
+			return djb_hash_string(key);
+		}
+
+		[[gnu::pure]]
+		std::size_t operator()(const TranslateCachePerValue &value) const noexcept {
+			return (*this)(value.value.c_str());
+		}
+	};
+
+	struct Equal {
+		[[gnu::pure]]
+		bool operator()(const char *a,
+				const TranslateCachePerValue &b) const noexcept {
+			assert(a != nullptr);
+
+			return a == b.value;
+		}
+
+		[[gnu::pure]]
+		bool operator()(const TranslateCachePerValue &a,
+				const TranslateCachePerValue &b) const noexcept {
+			return a.value == b.value;
+		}
+	};
+};
+
+/**
+ * An inverted index which maps the value of one request parameter to
+ * all #TranslateCacheItem instances stored with it.  This allows
+ * INVALIDATE to find matching items without traversing the whole
+ * cache.
+ */
+class TranslateCacheIndex {
+	using Set = IntrusiveGrowingHashSet<TranslateCachePerValue,
+					    TranslateCachePerValue::Hash,
+					    TranslateCachePerValue::Equal>;
+	Set values;
+
+public:
+	TranslateCacheIndex() noexcept = default;
+	TranslateCacheIndex(const TranslateCacheIndex &) = delete;
+
+	~TranslateCacheIndex() noexcept {
+		assert(values.empty());
+	}
+
+	void Add(TranslateCacheIndexHook &hook, const char *value) noexcept;
+
+	/**
+	 * Called by TranslateCachePerValue::Erase() when its list has
+	 * become empty.
+	 */
+	void Dispose(TranslateCachePerValue &per_value) noexcept;
+
+	/**
+	 * Remove all items with the given value which match the
+	 * INVALIDATE request.
+	 *
+	 * @param value the value from the #TranslateRequest; nullptr
+	 * never matches (strict mode)
+	 * @return the number of items removed
+	 */
+	unsigned Invalidate(Cache &cache, const char *value,
+			    const TranslateRequest &request,
+			    std::span<const TranslationCommand> vary) noexcept;
+};
+
+struct tcache;
+
+/**
+ * A request loaded from a snapshot file which is sent to the
+ * translation server after the restored item has been put into the
+ * cache, to revalidate it: a cacheable response replaces the item,
+ * an uncacheable one removes it.  This takes care of invalidations
+ * which were missed while this process was not running.
+ */
+class TranslateCacheWarmRequest final
+	: PoolHolder, public IntrusiveListHook<IntrusiveHookMode::NORMAL>,
+	  TranslateHandler
+{
+	struct tcache &tcache;
+
+	const TranslateRequest request;
+
+	/**
+	 * The key of the restored item.
+	 */
+	const char *const key;
+
+public:
+	CancellablePointer cancel_ptr;
+
+	TranslateCacheWarmRequest(PoolPtr &&_pool,
+				  struct tcache &_tcache,
+				  const TranslateRequest &_request,
+				  const char *_key) noexcept
+		:PoolHolder(std::move(_pool)),
+		 tcache(_tcache),
+		 request(_request), key(_key) {}
+
+	void Start() noexcept;
+
+	void Cancel() noexcept {
+		cancel_ptr.Cancel();
+		Destroy();
+	}
+
+	void Destroy() noexcept {
+		this->~TranslateCacheWarmRequest();
+	}
+
+private:
+	void Finish() noexcept;
+
+	/* virtual methods from TranslateHandler */
+	void OnTranslateResponse(UniquePoolPtr<TranslateResponse> response) noexcept override;
+
+	void OnTranslateError(std::exception_ptr error) noexcept override {
+		LogConcat(4, "TranslationCache", "revalidation request failed: ",
+			  error);
+		Finish();
+	}
+};
+
 struct tcache {
 	const PoolPtr pool;
 	SlicePool slice_pool;
@@ -333,10 +562,53 @@ struct tcache {
 	using PerSiteSet = IntrusiveHashSet<TranslateCachePerSite, N_BUCKETS>;
 	PerSiteSet per_site;
 
+	/**
+	 * Inverted indexes for INVALIDATE=URI and
+	 * INVALIDATE=LISTENER_TAG.
+	 */
+	TranslateCacheIndex per_uri, per_listener_tag;
+
+	/**
+	 * The keys of all items with a BASE.  This allows
+	 * tcache_lookup() to query only those URI prefixes which
+	 * can possibly match.
+	 */
+	TranslationBaseTrie base_trie;
+
 	Cache cache;
 
 	TranslationService &next;
 
+	/**
+	 * The maximum number of concurrent revalidation requests for
+	 * items restored from a snapshot file.  Restored items may be
+	 * stale, so this shall not take too long, but the translation
+	 * server shall not be flooded after a restart.
+	 */
+	static constexpr std::size_t WARM_CONCURRENCY = 16;
+
+	using WarmRequestList = IntrusiveList<TranslateCacheWarmRequest,
+					      IntrusiveListBaseHookTraits<TranslateCacheWarmRequest>>;
+
+	/**
+	 * Revalidation requests for items restored from a snapshot
+	 * file which have not yet been started.
+	 */
+	WarmRequestList warm_queue;
+
+	/**
+	 * The revalidation requests which are currently running; at
+	 * most #WARM_CONCURRENCY.
+	 */
+	WarmRequestList warm_running;
+
+	std::size_t n_warm_running = 0;
+
+	/**
+	 * Starts more requests from #warm_queue.
+	 */
+	CoarseTimerEvent warm_timer;
+
 	/**
 	 * This flag may be set to false when initializing the translation
 	 * cache.  All responses will be regarded "non cacheable".  It
@@ -344,12 +616,29 @@ struct tcache {
 	 */
 	bool active;
 
+	/**
+	 * Keep a copy of each cacheable request and response for
+	 * TranslationCache::Save()?
+	 */
+	bool snapshot = false;
+
+	/**
+	 * The generation which is written to snapshots and compared
+	 * when loading them.  See TranslationCache::EnableSnapshot().
+	 */
+	std::string snapshot_generation;
+
 	tcache(struct pool &_pool, EventLoop &event_loop,
 	       TranslationService &_next, unsigned max_size,
 	       bool handshake_cacheable);
 	tcache(struct tcache &) = delete;
 
-	~tcache() noexcept = default;
+	~tcache() noexcept {
+		CancelWarmRequests();
+	}
+
+	void StartWarmRequests() noexcept;
+	void CancelWarmRequests() noexcept;
 
 	TranslateCachePerHost &MakePerHost(const char *host) noexcept;
 	TranslateCachePerSite &MakePerSite(const char *site) noexcept;
@@ -382,6 +671,12 @@ struct TranslateCacheRequest final : TranslateHandler {
 
 	TranslateHandler *handler;
 
+	/**
+	 * The raw response packets for the snapshot (only if
+	 * tcache::snapshot is enabled).
+	 */
+	std::span<const std::byte> raw_response{};
+
 	TranslateCacheRequest(AllocatorPtr _alloc, struct tcache &_tcache,
 			      const TranslateRequest &_request, const char *_key,
 			      bool _cacheable,
@@ -394,6 +689,14 @@ struct TranslateCacheRequest final : TranslateHandler {
 	TranslateCacheRequest(TranslateCacheRequest &) = delete;
 
 	/* virtual methods from TranslateHandler */
+	bool WantTranslateRawResponse() const noexcept override {
+		return cacheable && tcache->snapshot;
+	}
+
+	void OnTranslateRawResponse(GrowingBuffer &&src) noexcept override {
+		raw_response = src.Dup(alloc.GetPool());
+	}
+
 	void OnTranslateResponse(UniquePoolPtr<TranslateResponse> response) noexcept override;
 	void OnTranslateError(std::exception_ptr error) noexcept override;
 };
@@ -495,6 +798,54 @@ TranslateCachePerSite::Erase(TranslateCacheItem &item) noexcept
 		Dispose();
 }
 
+void
+TranslateCacheIndex::Add(TranslateCacheIndexHook &hook,
+			 const char *value) noexcept
+{
+	assert(value != nullptr);
+	assert(hook.per_value == nullptr);
+
+	auto [position, inserted] = values.insert_check(value);
+
+	TranslateCachePerValue *per_value;
+	if (inserted) {
+		per_value = new TranslateCachePerValue(*this, value);
+		values.insert(position, *per_value);
+	} else
+		per_value = &*position;
+
+	per_value->items.push_back(hook);
+	hook.per_value = per_value;
+}
+
+void
+TranslateCacheIndex::Dispose(TranslateCachePerValue &per_value) noexcept
+{
+	assert(per_value.items.empty());
+
+	values.erase(values.iterator_to(per_value));
+	delete &per_value;
+}
+
+void
+TranslateCachePerValue::Erase(TranslateCacheIndexHook &hook) noexcept
+{
+	assert(hook.per_value == this);
+
+	items.erase(items.iterator_to(hook));
+	hook.per_value = nullptr;
+
+	if (items.empty())
+		index.Dispose(*this);
+}
+
+inline void
+TranslateCacheIndexHook::Erase() noexcept
+{
+	if (per_value != nullptr)
+		per_value->Erase(*this);
+}
+
 static const char *
 tcache_uri_key(AllocatorPtr alloc, const char *uri, const char *host,
 	       HttpStatus status,
@@ -1032,28 +1383,30 @@ tcache_lookup(AllocatorPtr alloc, struct tcache &tcache,
 	if (item != nullptr || request.uri == nullptr)
 		return item;
 
-	/* no match - look for matching BASE responses */
-
-	char *uri = alloc.Dup(key);
-	char *slash = strrchr(uri, '/');
-
-	if (slash != nullptr && slash[1] == 0) {
-		/* if the URI already ends with a slash, don't repeat the
-		   original lookup - cut off this slash, and try again */
-		*slash = 0;
-		slash = strrchr(uri, '/');
-	}
-
-	while (slash != nullptr) {
-		/* truncate string after slash */
-		slash[1] = 0;
-
-		item = tcache_get(tcache, request, uri, true);
+	/* no match - look for matching BASE responses; the trie
+	   knows which prefixes of the key have one.  Collect them
+	   first, because tcache_get() may remove expired items (and
+	   thus modify the trie). */
+
+	const std::string_view key_sv{key};
+	const std::size_t n_slashes = std::count(key_sv.begin(), key_sv.end(),
+						 '/');
+	if (n_slashes == 0)
+		return nullptr;
+
+	auto *lengths = alloc.NewArray<std::size_t>(n_slashes);
+	std::size_t n = 0;
+	tcache.base_trie.ForEachPrefix(key_sv, [lengths, &n](std::size_t length){
+		lengths[n++] = length;
+	});
+
+	/* try the longest prefix first */
+	while (n > 0) {
+		item = tcache_get(tcache, request,
+				  alloc.DupZ(key_sv.substr(0, lengths[--n])),
+				  true);
 		if (item != nullptr)
 			return item;
-
-		*slash = 0;
-		slash = strrchr(uri, '/');
 	}
 
 	return nullptr;
@@ -1157,6 +1510,49 @@ TranslateCachePerSite::Invalidate(const TranslateRequest &request,
 	return n_removed;
 }
 
+unsigned
+TranslateCacheIndex::Invalidate(Cache &cache, const char *value,
+				const TranslateRequest &request,
+				std::span<const TranslationCommand> vary) noexcept
+{
+	if (value == nullptr)
+		/* in strict mode, nullptr doesn't match anything */
+		return 0;
+
+	auto i = values.find(value);
+	if (i == values.end())
+		return 0;
+
+	auto &per_value = *i;
+	assert(&per_value.index == this);
+
+	unsigned n_removed = 0;
+
+	per_value.items.remove_and_dispose_if([&request, vary](const TranslateCacheIndexHook &hook){
+		return hook.item.InvalidateMatch(vary, request);
+	},
+		[&cache, &n_removed, &per_value](TranslateCacheIndexHook *hook){
+			assert(hook->per_value == &per_value);
+			hook->per_value = nullptr;
+
+			cache.Remove(hook->item);
+			++n_removed;
+		});
+
+	if (per_value.items.empty())
+		Dispose(per_value);
+
+	return n_removed;
+}
+
+[[gnu::pure]]
+static bool
+Contains(std::span<const TranslationCommand> vary,
+	 TranslationCommand command) noexcept
+{
+	return std::find(vary.begin(), vary.end(), command) != vary.end();
+}
+
 void
 tcache::Invalidate(const TranslateRequest &request,
 		   std::span<const TranslationCommand> vary,
@@ -1164,12 +1560,24 @@ tcache::Invalidate(const TranslateRequest &request,
 {
 	TranslationCacheInvalidate data{&request, vary, site};
 
+	/* use the most selective index which covers this
+	   invalidation; only fall back to traversing the whole cache
+	   if there is none */
+
 	[[maybe_unused]]
-	unsigned removed = site != nullptr
-		? InvalidateSite(request, vary, site)
-		: (std::find(vary.begin(), vary.end(), TranslationCommand::HOST) != vary.end()
-		   ? InvalidateHost(request, vary)
-		   : cache.RemoveAllMatch(tcache_invalidate_match, &data));
+	unsigned removed;
+	if (site != nullptr)
+		removed = InvalidateSite(request, vary, site);
+	else if (Contains(vary, TranslationCommand::URI))
+		removed = per_uri.Invalidate(cache, request.uri, request, vary);
+	else if (Contains(vary, TranslationCommand::HOST))
+		removed = InvalidateHost(request, vary);
+	else if (Contains(vary, TranslationCommand::LISTENER_TAG))
+		removed = per_listener_tag.Invalidate(cache, request.listener_tag,
+						      request, vary);
+	else
+		removed = cache.RemoveAllMatch(tcache_invalidate_match, &data);
+
 	LogConcat(4, "TranslationCache", "invalidated ", removed, " cache items");
 }
 
@@ -1181,11 +1589,61 @@ TranslationCache::Invalidate(const TranslateRequest &request,
 	cache->Invalidate(request, vary, site);
 }
 
+/**
+ * Marshal a copy of the request for TranslationCache::Save(), but
+ * omit all parameters the response does not depend on (i.e. which
+ * are neither part of the cache key nor listed in VARY).
+ *
+ * @return the marshalled request or nullptr if this item shall not
+ * be saved
+ */
+static std::span<const std::byte>
+tcache_snapshot_request(AllocatorPtr alloc, const TranslateRequest &src,
+			const TranslateCacheItem &item) noexcept
+try {
+	if (src.layout.data() != nullptr ||
+	    item.response.VaryContains(TranslationCommand::SESSION) ||
+	    item.response.VaryContains(TranslationCommand::REALM_SESSION) ||
+	    item.response.VaryContains(TranslationCommand::USER))
+		/* the layout cannot be restored, and session and user
+		   data shall not be written to disk */
+		return {};
+
+	TranslateRequest r = src;
+	r.alt_host = nullptr;
+	r.args = nullptr;
+	r.session = {};
+	r.realm_session = {};
+	r.recover_session = nullptr;
+	r.user = nullptr;
+
+	r.param = item.request.param;
+	r.listener_tag = item.request.listener_tag;
+	r.local_address = item.request.local_address;
+	r.remote_host = item.request.remote_host;
+	r.accept_language = item.request.accept_language;
+	r.user_agent = item.request.user_agent;
+	r.query_string = item.request.query_string;
+	r.internal_redirect = item.request.internal_redirect;
+	r.enotdir = item.request.enotdir;
+
+	return MarshalTranslateRequest(TRANSLATION_PROTOCOL_VERSION, r)
+		.Dup(alloc.GetPool());
+} catch (...) {
+	return {};
+}
+
 /**
  * Throws std::runtime_error on error.
+ *
+ * @param raw_response the raw response packets for the snapshot;
+ * nullptr if snapshots are disabled
  */
 static const TranslateCacheItem *
-tcache_store(TranslateCacheRequest &tcr, const TranslateResponse &response)
+tcache_store(struct tcache &tcache, const TranslateRequest &request,
+	     const char *request_key, bool find_base,
+	     const TranslateResponse &response,
+	     std::span<const std::byte> raw_response)
 {
 	auto max_age = response.max_age;
 	constexpr std::chrono::seconds max_max_age = std::chrono::hours(24);
@@ -1193,67 +1651,67 @@ tcache_store(TranslateCacheRequest &tcr, const TranslateResponse &response)
 		/* limit to one day */
 		max_age = max_max_age;
 
-	auto item = NewFromPool<TranslateCacheItem>(pool_new_slice(tcr.tcache->pool, "tcache_item",
-								   &tcr.tcache->slice_pool),
-						    tcr.tcache->cache.SteadyNow(),
+	auto item = NewFromPool<TranslateCacheItem>(pool_new_slice(tcache.pool, "tcache_item",
+								   &tcache.slice_pool),
+						    tcache.cache.SteadyNow(),
 						    max_age);
 
 	const AllocatorPtr alloc(item->GetPool());
 
 	item->request.param =
-		tcache_vary_copy(alloc, tcr.request.param,
+		tcache_vary_copy(alloc, request.param,
 				 response, TranslationCommand::PARAM);
 
 	item->request.session =
-		tcache_vary_copy(alloc, tcr.request.session,
+		tcache_vary_copy(alloc, request.session,
 				 response, TranslationCommand::SESSION);
 
 	item->request.realm_session =
-		tcache_vary_copy(alloc, tcr.request.realm_session,
+		tcache_vary_copy(alloc, request.realm_session,
 				 response, TranslationCommand::REALM_SESSION);
 
 	item->request.listener_tag =
-		tcache_vary_copy(alloc, tcr.request.listener_tag,
+		tcache_vary_copy(alloc, request.listener_tag,
 				 response, TranslationCommand::LISTENER_TAG);
 
 	item->request.local_address =
-		!tcr.request.local_address.IsNull() &&
+		!request.local_address.IsNull() &&
 		(response.VaryContains(TranslationCommand::LOCAL_ADDRESS) ||
 		 response.VaryContains(TranslationCommand::LOCAL_ADDRESS_STRING))
-		? DupAddress(alloc, tcr.request.local_address)
+		? DupAddress(alloc, request.local_address)
 		: nullptr;
 
-	tcache_vary_copy(alloc, tcr.request.remote_host,
+	tcache_vary_copy(alloc, request.remote_host,
 			 response, TranslationCommand::REMOTE_HOST);
 	item->request.remote_host =
-		tcache_vary_copy(alloc, tcr.request.remote_host,
+		tcache_vary_copy(alloc, request.remote_host,
 				 response, TranslationCommand::REMOTE_HOST);
-	item->request.host = tcache_vary_copy(alloc, tcr.request.host,
+	item->request.host = tcache_vary_copy(alloc, request.host,
 					      response, TranslationCommand::HOST);
 	item->request.accept_language =
-		tcache_vary_copy(alloc, tcr.request.accept_language,
+		tcache_vary_copy(alloc, request.accept_language,
 				 response, TranslationCommand::LANGUAGE);
 	item->request.user_agent =
-		tcache_vary_copy(alloc, tcr.request.user_agent,
+		tcache_vary_copy(alloc, request.user_agent,
 				 response, TranslationCommand::USER_AGENT);
 	item->request.query_string =
-		tcache_vary_copy(alloc, tcr.request.query_string,
+		tcache_vary_copy(alloc, request.query_string,
 				 response, TranslationCommand::QUERY_STRING);
 	item->request.internal_redirect =
-		tcache_vary_copy(alloc, tcr.request.internal_redirect,
+		tcache_vary_copy(alloc, request.internal_redirect,
 				 response, TranslationCommand::INTERNAL_REDIRECT);
 	item->request.enotdir =
-		tcache_vary_copy(alloc, tcr.request.enotdir,
+		tcache_vary_copy(alloc, request.enotdir,
 				 response, TranslationCommand::ENOTDIR_);
 	item->request.user =
-		tcache_vary_copy(alloc, tcr.request.user,
+		tcache_vary_copy(alloc, request.user,
 				 response, TranslationCommand::USER);
 
 	const char *key;
 
 	try {
 		key = tcache_store_response(alloc, item->response, response,
-					    tcr.request);
+					    request);
 	} catch (...) {
 		item->Destroy();
 		throw;
@@ -1263,7 +1721,7 @@ tcache_store(TranslateCacheRequest &tcr, const TranslateResponse &response)
 	       item->response.address.IsValidBase());
 
 	if (key == nullptr)
-		key = alloc.Dup(tcr.key);
+		key = alloc.Dup(request_key);
 
 	LogConcat(4, "TranslationCache", "store ", key);
 
@@ -1287,14 +1745,45 @@ tcache_store(TranslateCacheRequest &tcr, const TranslateResponse &response)
 		}
 	}
 
+	if (raw_response.data() != nullptr) {
+		item->snapshot_request = tcache_snapshot_request(alloc,
+								 request,
+								 *item);
+		if (item->snapshot_request.data() != nullptr)
+			item->snapshot_response = alloc.Dup(raw_response);
+	}
+
 	if (response.VaryContains(TranslationCommand::HOST))
-		tcache_add_per_host(*tcr.tcache, item);
+		tcache_add_per_host(tcache, item);
 
 	if (response.site != nullptr)
-		tcache_add_per_site(*tcr.tcache, item);
+		tcache_add_per_site(tcache, item);
+
+	if (const char *uri = strchr(key, '/'); uri != nullptr)
+		/* the part tcache_uri_match() compares */
+		tcache.per_uri.Add(item->per_uri, uri);
+
+	if (item->request.listener_tag != nullptr)
+		tcache.per_listener_tag.Add(item->per_listener_tag,
+						 item->request.listener_tag);
+
+	if (item->response.base != nullptr && *key != 0 &&
+	    key[strlen(key) - 1] == '/') {
+		/* only keys ending with a slash are looked up by
+		   tcache_lookup() */
+		try {
+			tcache.base_trie.Add(key);
+		} catch (...) {
+			item->Destroy();
+			throw;
+		}
+
+		item->base_trie = &tcache.base_trie;
+		item->base_key = key;
+	}
 
-	TranslateCacheMatchContext match_ctx{tcr.request, tcr.find_base};
-	tcr.tcache->cache.PutMatch(key, *item, tcache_item_match, &match_ctx);
+	TranslateCacheMatchContext match_ctx{request, find_base};
+	tcache.cache.PutMatch(key, *item, tcache_item_match, &match_ctx);
 	return item;
 }
 
@@ -1339,7 +1828,8 @@ try {
 	if (!cacheable) {
 		LogConcat(4, "TranslationCache", "ignore ", key);
 	} else if (tcache_response_evaluate(response)) {
-		tcache_store(*this, response);
+		tcache_store(*tcache, request, key, find_base, response,
+			     raw_response);
 	} else {
 		LogConcat(4, "TranslationCache", "nocache ", key);
 	}
@@ -1496,6 +1986,12 @@ TranslateCacheItem::Destroy() noexcept
 	if (per_site != nullptr)
 		per_site->Erase(*this);
 
+	per_uri.Erase();
+	per_listener_tag.Erase();
+
+	if (base_trie != nullptr)
+		base_trie->Remove(base_key);
+
 	pool_trash(pool);
 	this->~TranslateCacheItem();
 }
@@ -1512,7 +2008,9 @@ tcache::tcache(struct pool &_pool, EventLoop &event_loop,
 	:pool(pool_new_dummy(&_pool, "translate_cache")),
 	 slice_pool(4096, 32768, "translate_cache"),
 	 cache(event_loop, max_size),
-	 next(_next), active(handshake_cacheable)
+	 next(_next),
+	 warm_timer(event_loop, BIND_THIS_METHOD(StartWarmRequests)),
+	 active(handshake_cacheable)
 {
 	assert(max_size > 0);
 }
@@ -1540,6 +2038,12 @@ TranslationCache::GetStats() const noexcept
 	return pool_children_stats(cache->pool);
 }
 
+CacheStats
+TranslationCache::GetCacheStats() const noexcept
+{
+	return cache->cache.GetStats();
+}
+
 void
 TranslationCache::Flush() noexcept
 {
@@ -1547,6 +2051,299 @@ TranslationCache::Flush() noexcept
 	cache->slice_pool.Compress();
 }
 
+/*
+ * snapshot
+ *
+ */
+
+void
+TranslationCache::EnableSnapshot(std::string_view generation)
+{
+	cache->snapshot = true;
+	cache->snapshot_generation = generation;
+}
+
+void
+TranslationCache::Save(BufferedOutputStream &os) const
+{
+	const auto steady_now = cache->cache.SteadyNow();
+	const auto system_now = cache->cache.SystemNow();
+
+	const auto &generation = cache->snapshot_generation;
+	os.WriteT<uint32_t>(generation.size());
+	os.Write(generation.data(), generation.size());
+
+	unsigned n = 0;
+
+	cache->cache.ForEach([&](const CacheItem &_item){
+		const auto &item = (const TranslateCacheItem &)_item;
+		if (item.snapshot_request.data() == nullptr ||
+		    item.snapshot_response.data() == nullptr ||
+		    item.GetExpires() <= steady_now)
+			return;
+
+		const int64_t expires =
+			std::chrono::duration_cast<std::chrono::seconds>((system_now + (item.GetExpires() - steady_now)).time_since_epoch()).count();
+
+		os.WriteT<uint32_t>(MAGIC_TCACHE_ITEM);
+		os.WriteT<int64_t>(expires);
+		os.WriteT<uint32_t>(item.snapshot_request.size());
+		os.Write(item.snapshot_request.data(),
+			 item.snapshot_request.size());
+		os.WriteT<uint32_t>(item.snapshot_response.size());
+		os.Write(item.snapshot_response.data(),
+			 item.snapshot_response.size());
+		++n;
+	});
+
+	os.WriteT<uint32_t>(MAGIC_TCACHE_END_OF_LIST);
+
+	LogConcat(5, "TranslationCache", "saved ", n, " cache items");
+}
+
+static std::span<const std::byte>
+ReadSnapshotBuffer(AllocatorPtr alloc, BufferedReader &r)
+{
+	uint32_t size;
+	r.ReadFull(std::as_writable_bytes(std::span{&size, 1}));
+	if (size == 0 || size > 1024 * 1024)
+		throw std::runtime_error("Malformed translation cache snapshot");
+
+	const std::span<std::byte> buffer{alloc.NewArray<std::byte>(size), size};
+	r.ReadFull(buffer);
+	return buffer;
+}
+
+/**
+ * Read the generation string of a snapshot list.
+ *
+ * Throws on error.
+ */
+static std::string
+ReadSnapshotGeneration(BufferedReader &r)
+{
+	uint32_t size;
+	r.ReadFull(std::as_writable_bytes(std::span{&size, 1}));
+	if (size > 4096)
+		throw std::runtime_error("Malformed translation cache snapshot");
+
+	std::string generation(size, '\0');
+	if (size > 0)
+		r.ReadFull(std::as_writable_bytes(std::span{generation}));
+	return generation;
+}
+
+/**
+ * Parse the raw response packets of a snapshot item.
+ *
+ * Throws on error.
+ */
+static UniquePoolPtr<TranslateResponse>
+ParseSnapshotResponse(AllocatorPtr alloc, const TranslateRequest &request,
+		      std::span<const std::byte> src)
+{
+	auto response = UniquePoolPtr<TranslateResponse>::Make(alloc.GetPool());
+	TranslateParser parser(alloc, request, *response);
+
+	while (!src.empty()) {
+		const std::size_t nbytes = parser.Feed(src);
+		if (nbytes == 0)
+			break;
+
+		src = src.subspan(nbytes);
+
+		if (parser.Process() == TranslateParser::Result::DONE) {
+			if (!src.empty())
+				break;
+
+			return response;
+		}
+	}
+
+	throw std::runtime_error("Malformed translation cache snapshot response");
+}
+
+/**
+ * Restore one item from a snapshot file.
+ *
+ * Throws on error.
+ *
+ * @return the key of the restored item
+ */
+static const char *
+tcache_restore(struct tcache &tcache, AllocatorPtr alloc,
+	       const TranslateRequest &request,
+	       std::span<const std::byte> raw_response,
+	       std::chrono::seconds ttl)
+{
+	if (!tcache_request_evaluate(request))
+		throw std::runtime_error("Request is not cacheable");
+
+	auto response = ParseSnapshotResponse(alloc, request, raw_response);
+	if (!tcache_response_evaluate(*response))
+		throw std::runtime_error("Response is not cacheable");
+
+	/* the item expires when it would have expired if this
+	   process had not been restarted */
+	response->max_age = ttl;
+
+	const auto *item =
+		tcache_store(tcache, request, tcache_request_key(alloc, request),
+			     false, *response,
+			     tcache.snapshot ? raw_response : std::span<const std::byte>{});
+	return alloc.Dup(item->GetKey());
+}
+
+void
+TranslationCache::Load(BufferedReader &r)
+{
+	const int64_t now =
+		std::chrono::duration_cast<std::chrono::seconds>(cache->cache.SystemNow().time_since_epoch()).count();
+
+	/* a snapshot from a different generation of the translation
+	   server may contain any number of stale items, which would
+	   be served until revalidation catches up; discard them */
+	const bool stale = ReadSnapshotGeneration(r) != cache->snapshot_generation;
+
+	unsigned n_restored = 0, n_expired = 0, n_stale = 0, n_failed = 0;
+
+	while (true) {
+		uint32_t magic;
+		r.ReadFull(std::as_writable_bytes(std::span{&magic, 1}));
+		if (magic == MAGIC_TCACHE_END_OF_LIST)
+			break;
+		else if (magic != MAGIC_TCACHE_ITEM)
+			throw std::runtime_error("Malformed translation cache snapshot");
+
+		int64_t expires;
+		r.ReadFull(std::as_writable_bytes(std::span{&expires, 1}));
+
+		auto pool = pool_new_linear(cache->pool, "tcache_warm", 4096);
+		const AllocatorPtr alloc(pool);
+
+		const auto raw_request = ReadSnapshotBuffer(alloc, r);
+		const auto raw_response = ReadSnapshotBuffer(alloc, r);
+
+		if (stale) {
+			++n_stale;
+			continue;
+		}
+
+		if (expires <= now) {
+			/* the remaining TTL has elapsed while we were
+			   down */
+			++n_expired;
+			continue;
+		}
+
+		TranslateRequest request;
+		const char *key;
+
+		try {
+			request = UnmarshalTranslateRequest(alloc, raw_request);
+			key = tcache_restore(*cache, alloc, request, raw_response,
+					     std::chrono::seconds{expires - now});
+		} catch (...) {
+			LogConcat(3, "TranslationCache",
+				  "failed to restore snapshot item: ",
+				  std::current_exception());
+			++n_failed;
+			continue;
+		}
+
+		/* the restored item is usable right away; revalidate
+		   it in the background */
+		auto *w = NewFromPool<TranslateCacheWarmRequest>(std::move(pool),
+								 *cache,
+								 request, key);
+		cache->warm_queue.push_back(*w);
+		++n_restored;
+	}
+
+	LogConcat(4, "TranslationCache",
+		  "restored ", n_restored, " snapshot items, discarded ",
+		  n_expired, " expired, ", n_stale, " stale and ",
+		  n_failed, " malformed items");
+
+	if (!cache->warm_queue.empty())
+		cache->warm_timer.Schedule(Event::Duration::zero());
+}
+
+void
+tcache::StartWarmRequests() noexcept
+{
+	while (n_warm_running < WARM_CONCURRENCY && !warm_queue.empty()) {
+		auto &w = warm_queue.front();
+		warm_queue.pop_front();
+		warm_running.push_back(w);
+		++n_warm_running;
+
+		/* this may complete synchronously; Finish() will
+		   schedule more */
+		w.Start();
+	}
+}
+
+void
+tcache::CancelWarmRequests() noexcept
+{
+	warm_timer.Cancel();
+
+	warm_running.clear_and_dispose([](TranslateCacheWarmRequest *w){
+		w->Cancel();
+	});
+	n_warm_running = 0;
+
+	/* these have not been started yet, so there's nothing to
+	   cancel */
+	warm_queue.clear_and_dispose([](TranslateCacheWarmRequest *w){
+		w->Destroy();
+	});
+}
+
+void
+TranslateCacheWarmRequest::Start() noexcept
+{
+	/* bypass the cache lookup, which would find the item which
+	   shall be revalidated */
+	const AllocatorPtr alloc(GetPool());
+	tcache_miss(alloc, tcache, request,
+		    tcache_request_key(alloc, request), true,
+		    nullptr, *this, cancel_ptr);
+}
+
+void
+TranslateCacheWarmRequest::OnTranslateResponse(UniquePoolPtr<TranslateResponse> response) noexcept
+{
+	/* a cacheable response has already replaced the restored
+	   item (see TranslateCacheRequest); an uncacheable one means
+	   the restored item is stale */
+	if (!tcache_response_evaluate(*response)) {
+		LogConcat(4, "TranslationCache", "revalidation: remove ", key);
+
+		TranslateCacheMatchContext match_ctx{request, false};
+		tcache.cache.RemoveMatch(key, tcache_item_match, &match_ctx);
+	}
+
+	response.reset();
+	Finish();
+}
+
+void
+TranslateCacheWarmRequest::Finish() noexcept
+{
+	auto &_tcache = tcache;
+	assert(_tcache.n_warm_running > 0);
+	_tcache.warm_running.erase(_tcache.warm_running.iterator_to(*this));
+	--_tcache.n_warm_running;
+	Destroy();
+
+	/* start the next one from the timer, because this may have
+	   been called from within StartWarmRequests() */
+	if (!_tcache.warm_queue.empty())
+		_tcache.warm_timer.Schedule(Event::Duration::zero());
+}
+
 
 /*
  * methods
@@ -8,10 +8,14 @@
 
 #include <memory>
 #include <span>
+#include <string_view>
 
 enum class TranslationCommand : uint16_t;
 class EventLoop;
+class BufferedOutputStream;
+class BufferedReader;
 struct AllocatorStats;
+struct CacheStats;
 
 struct tcache;
 
@@ -37,6 +41,9 @@ public:
 	[[gnu::pure]]
 	AllocatorStats GetStats() const noexcept;
 
+	[[gnu::pure]]
+	CacheStats GetCacheStats() const noexcept;
+
 	/**
 	 * Flush all items from the cache.
 	 */
@@ -53,6 +60,38 @@ public:
 			std::span<const TranslationCommand> vary,
 			const char *site) noexcept;
 
+	/**
+	 * Keep a copy of each cacheable request and of the raw
+	 * response, to be able to Save() a snapshot later.  This must
+	 * be called before the first request.
+	 *
+	 * @param generation an opaque string identifying the state of
+	 * the translation server; it is written to the snapshot, and
+	 * Load() discards snapshots with a different generation
+	 */
+	void EnableSnapshot(std::string_view generation={});
+
+	/**
+	 * Write the generation and the requests and raw responses of
+	 * all cache items to the snapshot file, terminated by
+	 * #MAGIC_TCACHE_END_OF_LIST.
+	 *
+	 * Throws on I/O error.
+	 */
+	void Save(BufferedOutputStream &os) const;
+
+	/**
+	 * Read a list written by Save() and restore all items whose
+	 * expiry has not yet passed.  If the list was written with a
+	 * different generation (see EnableSnapshot()), all of its
+	 * items are discarded.  Afterwards, the restored items are
+	 * revalidated in the background, a few requests at a time,
+	 * to catch invalidations which happened in the meantime.
+	 *
+	 * Throws on error.
+	 */
+	void Load(BufferedReader &r);
+
 	/* virtual methods from class TranslationService */
 	void SendRequest(AllocatorPtr alloc,
 			 const TranslateRequest &request,
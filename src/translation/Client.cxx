@@ -24,8 +24,6 @@
 #include <assert.h>
 #include <string.h>
 
-static const uint8_t PROTOCOL_VERSION = 3;
-
 class TranslateClient final : BufferedSocketHandler, Cancellable {
 	static constexpr Event::Duration read_timeout = std::chrono::minutes{1};
 	static constexpr Event::Duration write_timeout = std::chrono::seconds{10};
@@ -46,6 +44,14 @@ class TranslateClient final : BufferedSocketHandler, Cancellable {
 
 	TranslateParser parser;
 
+	/**
+	 * A copy of all response packets; only used if
+	 * TranslateHandler::WantTranslateRawResponse() returns true.
+	 */
+	GrowingBuffer raw_response;
+
+	const bool want_raw_response;
+
 public:
 	TranslateClient(AllocatorPtr alloc, EventLoop &event_loop,
 			StopwatchPtr &&_stopwatch,
@@ -142,6 +148,9 @@ try {
 			/* need more data */
 			break;
 
+		if (want_raw_response)
+			raw_response.Write(src.first(nbytes));
+
 		src = src.subspan(nbytes);
 		socket.DisposeConsumed(nbytes);
 
@@ -156,7 +165,12 @@ try {
 			{
 				auto &_handler = handler;
 				auto _response = std::move(response);
+				auto _raw_response = std::move(raw_response);
+				const bool _want_raw_response = want_raw_response;
 				Destroy();
+
+				if (_want_raw_response)
+					_handler.OnTranslateRawResponse(std::move(_raw_response));
 				_handler.OnTranslateResponse(std::move(_response));
 			}
 
@@ -225,7 +239,8 @@ TranslateClient::TranslateClient(AllocatorPtr alloc, EventLoop &event_loop,
 	 request(std::move(_request)),
 	 handler(_handler),
 	 response(UniquePoolPtr<TranslateResponse>::Make(alloc.GetPool())),
-	 parser(alloc, request2, *response)
+	 parser(alloc, request2, *response),
+	 want_raw_response(_handler.WantTranslateRawResponse())
 {
 	socket.Init(fd, FdType::FD_SOCKET, write_timeout, *this);
 
@@ -251,7 +266,7 @@ try {
 	       (request.content_type_lookup.data() != nullptr &&
 		request.suffix != nullptr));
 
-	GrowingBuffer gb = MarshalTranslateRequest(PROTOCOL_VERSION,
+	GrowingBuffer gb = MarshalTranslateRequest(TRANSLATION_PROTOCOL_VERSION,
 						   request);
 
 	alloc.New<TranslateClient>(alloc, event_loop,
@@ -9,9 +9,27 @@
 #include <exception>
 
 struct TranslateResponse;
+class GrowingBuffer;
 
 class TranslateHandler {
 public:
+	/**
+	 * Does this handler want a copy of the raw response packets
+	 * (see OnTranslateRawResponse())?  Collecting them costs
+	 * memory, so this is disabled by default.
+	 */
+	virtual bool WantTranslateRawResponse() const noexcept {
+		return false;
+	}
+
+	/**
+	 * Receives the raw response packets as received from the
+	 * translation server.  This is only called if
+	 * WantTranslateRawResponse() returns true, right before
+	 * OnTranslateResponse().
+	 */
+	virtual void OnTranslateRawResponse(GrowingBuffer &&) noexcept {}
+
 	virtual void OnTranslateResponse(UniquePoolPtr<TranslateResponse> response) noexcept = 0;
 	virtual void OnTranslateError(std::exception_ptr error) noexcept = 0;
 };
@@ -6,9 +6,16 @@
 #include "Request.hxx"
 #include "Layout.hxx"
 #include "translation/Protocol.hxx"
+#include "http/Status.hxx"
+#include "pool/PSocketAddress.hxx"
 #include "lib/fmt/RuntimeError.hxx"
 #include "net/ToString.hxx"
 #include "util/SpanCast.hxx"
+#include "AllocatorPtr.hxx"
+
+#include <stdexcept>
+
+#include <string.h>
 
 void
 TranslationMarshaller::Write(TranslationCommand command,
@@ -148,3 +155,207 @@ MarshalTranslateRequest(uint8_t PROTOCOL_VERSION,
 
 	return m.Commit();
 }
+
+static const char *
+DupString(AllocatorPtr alloc, std::span<const std::byte> payload) noexcept
+{
+	return alloc.DupZ(ToStringView(payload));
+}
+
+static std::span<const std::byte>
+DupBuffer(AllocatorPtr alloc, std::span<const std::byte> payload) noexcept
+{
+	/* Dup() would return {nullptr,0} for an empty payload, but
+	   here, a present-but-empty payload must remain distinct
+	   from "packet not present" */
+	if (payload.empty())
+		return {alloc.NewArray<std::byte>(1), std::size_t{}};
+
+	return alloc.Dup(payload);
+}
+
+TranslateRequest
+UnmarshalTranslateRequest(AllocatorPtr alloc,
+			  std::span<const std::byte> src)
+{
+	TranslateRequest request;
+
+	bool begin = false;
+
+	while (true) {
+		TranslationHeader header;
+		if (src.size() < sizeof(header))
+			throw std::runtime_error("Truncated translation request");
+
+		memcpy(&header, src.data(), sizeof(header));
+		src = src.subspan(sizeof(header));
+
+		if (src.size() < header.length)
+			throw std::runtime_error("Truncated translation request");
+
+		const auto payload = src.first(header.length);
+		src = src.subspan(header.length);
+
+		if (!begin) {
+			if (header.command != TranslationCommand::BEGIN)
+				throw std::runtime_error("BEGIN expected");
+
+			begin = true;
+			continue;
+		}
+
+		switch (header.command) {
+		case TranslationCommand::END:
+			if (!src.empty())
+				throw std::runtime_error("Garbage after END");
+
+			return request;
+
+		case TranslationCommand::ERROR_DOCUMENT:
+			request.error_document = DupBuffer(alloc, payload);
+			break;
+
+		case TranslationCommand::STATUS:
+			{
+				uint16_t status;
+				if (payload.size() != sizeof(status))
+					throw std::runtime_error("Malformed STATUS");
+
+				memcpy(&status, payload.data(), sizeof(status));
+				request.status = static_cast<HttpStatus>(status);
+			}
+
+			break;
+
+		case TranslationCommand::LISTENER_TAG:
+			request.listener_tag = DupString(alloc, payload);
+			break;
+
+		case TranslationCommand::LOCAL_ADDRESS:
+			if (payload.size() < sizeof(sa_family_t))
+				throw std::runtime_error("Malformed LOCAL_ADDRESS");
+
+			request.local_address =
+				DupAddress(alloc,
+					   SocketAddress{(const struct sockaddr *)payload.data(),
+							 static_cast<SocketAddress::size_type>(payload.size())});
+			break;
+
+		case TranslationCommand::LOCAL_ADDRESS_STRING:
+			/* redundant, ignore */
+			break;
+
+		case TranslationCommand::REMOTE_HOST:
+			request.remote_host = DupString(alloc, payload);
+			break;
+
+		case TranslationCommand::HOST:
+			request.host = DupString(alloc, payload);
+			break;
+
+		case TranslationCommand::ALT_HOST:
+			request.alt_host = DupString(alloc, payload);
+			break;
+
+		case TranslationCommand::USER_AGENT:
+			request.user_agent = DupString(alloc, payload);
+			break;
+
+		case TranslationCommand::LANGUAGE:
+			request.accept_language = DupString(alloc, payload);
+			break;
+
+		case TranslationCommand::URI:
+			request.uri = DupString(alloc, payload);
+			break;
+
+		case TranslationCommand::ARGS:
+			request.args = DupString(alloc, payload);
+			break;
+
+		case TranslationCommand::QUERY_STRING:
+			request.query_string = DupString(alloc, payload);
+			break;
+
+		case TranslationCommand::WIDGET_TYPE:
+			request.widget_type = DupString(alloc, payload);
+			break;
+
+		case TranslationCommand::PARAM:
+			request.param = DupString(alloc, payload);
+			break;
+
+		case TranslationCommand::INTERNAL_REDIRECT:
+			request.internal_redirect = DupBuffer(alloc, payload);
+			break;
+
+		case TranslationCommand::CHECK:
+			request.check = DupBuffer(alloc, payload);
+			break;
+
+		case TranslationCommand::CHECK_HEADER:
+			request.check_header = DupString(alloc, payload);
+			break;
+
+		case TranslationCommand::WANT_FULL_URI:
+			request.want_full_uri = DupBuffer(alloc, payload);
+			break;
+
+		case TranslationCommand::WANT:
+			if (payload.size() % sizeof(TranslationCommand) != 0)
+				throw std::runtime_error("Malformed WANT");
+
+			{
+				auto *want = alloc.NewArray<TranslationCommand>(payload.size() / sizeof(TranslationCommand));
+				memcpy(want, payload.data(), payload.size());
+				request.want = {want, payload.size() / sizeof(TranslationCommand)};
+			}
+
+			break;
+
+		case TranslationCommand::FILE_NOT_FOUND:
+			request.file_not_found = DupBuffer(alloc, payload);
+			break;
+
+		case TranslationCommand::CONTENT_TYPE_LOOKUP:
+			request.content_type_lookup = DupBuffer(alloc, payload);
+			break;
+
+		case TranslationCommand::SUFFIX:
+			request.suffix = DupString(alloc, payload);
+			break;
+
+		case TranslationCommand::ENOTDIR_:
+			request.enotdir = DupBuffer(alloc, payload);
+			break;
+
+		case TranslationCommand::DIRECTORY_INDEX:
+			request.directory_index = DupBuffer(alloc, payload);
+			break;
+
+		case TranslationCommand::PROBE_PATH_SUFFIXES:
+			request.probe_path_suffixes = DupBuffer(alloc, payload);
+			break;
+
+		case TranslationCommand::PROBE_SUFFIX:
+			request.probe_suffix = DupString(alloc, payload);
+			break;
+
+		case TranslationCommand::READ_FILE:
+			request.read_file = DupBuffer(alloc, payload);
+			break;
+
+		case TranslationCommand::POOL:
+			request.pool = DupString(alloc, payload);
+			break;
+
+		case TranslationCommand::PATH_EXISTS:
+			request.path_exists = true;
+			break;
+
+		default:
+			throw FmtRuntimeError("Unsupported translate command {}",
+					      (unsigned)header.command);
+		}
+	}
+}
@@ -15,6 +15,12 @@
 enum class TranslationCommand : uint16_t;
 struct TranslateRequest;
 class SocketAddress;
+class AllocatorPtr;
+
+/**
+ * The translation protocol version implemented by this client.
+ */
+static constexpr uint8_t TRANSLATION_PROTOCOL_VERSION = 3;
 
 class TranslationMarshaller {
 	GrowingBuffer buffer;
@@ -70,3 +76,15 @@ public:
 GrowingBuffer
 MarshalTranslateRequest(uint8_t PROTOCOL_VERSION,
 			const TranslateRequest &request);
+
+/**
+ * Parse a request which was generated by MarshalTranslateRequest().
+ * This supports only the subset of packets which may appear in
+ * cacheable requests (see TranslationCache::Save()).  All strings
+ * and buffers are copied to the given allocator.
+ *
+ * Throws on error.
+ */
+TranslateRequest
+UnmarshalTranslateRequest(AllocatorPtr alloc,
+			  std::span<const std::byte> src);
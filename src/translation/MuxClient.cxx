@@ -0,0 +1,563 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#include "MuxClient.hxx"
+#include "MuxProtocol.hxx"
+#include "Marshal.hxx"
+#include "translation/Parser.hxx"
+#include "translation/Protocol.hxx"
+#include "translation/Request.hxx"
+#include "translation/Response.hxx"
+#include "translation/Handler.hxx"
+#include "pool/pool.hxx"
+#include "pool/LeakDetector.hxx"
+#include "system/Error.hxx"
+#include "net/UniqueSocketDescriptor.hxx"
+#include "net/TimeoutError.hxx"
+#include "net/SocketProtocolError.hxx"
+#include "util/Cancellable.hxx"
+#include "util/Exception.hxx"
+#include "io/Logger.hxx"
+#include "stopwatch.hxx"
+#include "AllocatorPtr.hxx"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <assert.h>
+#include <string.h>
+
+static GrowingBuffer
+MarshalMuxHello() noexcept
+{
+	std::array<std::byte, 1 + sizeof(TRANSLATION_MUX_MAGIC)> payload;
+	payload[0] = static_cast<std::byte>(TRANSLATION_PROTOCOL_VERSION);
+	memcpy(payload.data() + 1, TRANSLATION_MUX_MAGIC,
+	       sizeof(TRANSLATION_MUX_MAGIC));
+
+	TranslationMarshaller m;
+	m.Write(TranslationCommand::BEGIN,
+		std::span<const std::byte>{payload});
+	m.Write(TranslationCommand::END);
+	return m.Commit();
+}
+
+class TranslationMuxConnection::Request final
+	: public IntrusiveListHook<IntrusiveHookMode::NORMAL>,
+	  Cancellable, PoolLeakDetector
+{
+	TranslationMuxConnection &connection;
+
+	const AllocatorPtr alloc;
+
+	StopwatchPtr stopwatch;
+
+	const TranslateRequest &request;
+
+	TranslateHandler &handler;
+
+	/**
+	 * The caller's #CancellablePointer; only needed for
+	 * resubmitting the request in Close().
+	 */
+	CancellablePointer &caller_cancel_ptr;
+
+	UniquePoolPtr<TranslateResponse> response;
+
+	TranslateParser parser;
+
+	/**
+	 * A copy of all response packets; only used if
+	 * TranslateHandler::WantTranslateRawResponse() returns true.
+	 */
+	GrowingBuffer raw_response;
+
+	/**
+	 * The beginning of a packet header which was split by a read
+	 * or frame boundary; the parser needs the whole header at
+	 * once.
+	 */
+	std::array<std::byte, sizeof(TranslationHeader)> partial_header;
+
+	/**
+	 * The number of valid bytes in #partial_header.
+	 */
+	std::size_t partial_header_size = 0;
+
+	const bool want_raw_response;
+
+public:
+	const uint32_t id;
+
+	Request(TranslationMuxConnection &_connection, uint32_t _id,
+		AllocatorPtr _alloc,
+		const TranslateRequest &_request,
+		const StopwatchPtr &parent_stopwatch,
+		TranslateHandler &_handler,
+		CancellablePointer &_cancel_ptr) noexcept
+		:PoolLeakDetector(_alloc),
+		 connection(_connection),
+		 alloc(_alloc),
+		 stopwatch(parent_stopwatch, "translate",
+			   _request.GetDiagnosticName()),
+		 request(_request),
+		 handler(_handler),
+		 caller_cancel_ptr(_cancel_ptr),
+		 response(UniquePoolPtr<TranslateResponse>::Make(alloc.GetPool())),
+		 parser(alloc, request, *response),
+		 want_raw_response(_handler.WantTranslateRawResponse()),
+		 id(_id)
+	{
+		_cancel_ptr = *this;
+	}
+
+	/**
+	 * Feed payload from a frame into the response parser.
+	 *
+	 * @return true if the response is complete (and this object
+	 * has been destroyed)
+	 */
+	bool Feed(std::span<const std::byte> src);
+
+private:
+	/**
+	 * Feed data into the response parser; a partial packet
+	 * header at the end is copied to #partial_header.
+	 *
+	 * @return true if the response is complete (and this object
+	 * has been destroyed)
+	 */
+	bool FeedParser(std::span<const std::byte> src);
+
+public:
+	void Abort(std::exception_ptr e) noexcept {
+		stopwatch.RecordEvent("error");
+
+		auto &_handler = handler;
+		Destroy();
+		_handler.OnTranslateError(std::move(e));
+	}
+
+	void Resubmit(TranslationMuxHandler &mux_handler) noexcept {
+		auto _alloc = alloc;
+		const auto &_request = request;
+		auto _stopwatch = std::move(stopwatch);
+		auto &_handler = handler;
+		auto &_cancel_ptr = caller_cancel_ptr;
+		Destroy();
+
+		mux_handler.OnTranslationMuxFallback(_alloc, _request,
+						     _stopwatch,
+						     _handler, _cancel_ptr);
+	}
+
+private:
+	void Destroy() noexcept {
+		this->~Request();
+	}
+
+	/* virtual methods from class Cancellable */
+	void Cancel() noexcept override {
+		stopwatch.RecordEvent("cancel");
+
+		auto &c = connection;
+		const auto _id = id;
+		c.RemoveRequest(*this);
+		Destroy();
+
+		/* if negotiation fails, this cancel frame will be
+		   discarded together with the request frame */
+		c.WriteCancel(_id);
+	}
+};
+
+inline bool
+TranslationMuxConnection::Request::Feed(std::span<const std::byte> src)
+{
+	if (partial_header_size > 0) {
+		/* complete the packet header from the previous
+		   chunk */
+		const std::size_t n = std::min(src.size(),
+					       partial_header.size() - partial_header_size);
+		memcpy(partial_header.data() + partial_header_size,
+		       src.data(), n);
+		partial_header_size += n;
+		src = src.subspan(n);
+
+		if (partial_header_size < partial_header.size())
+			return false;
+
+		partial_header_size = 0;
+
+		if (FeedParser(partial_header))
+			return true;
+
+		assert(partial_header_size == 0);
+	}
+
+	return FeedParser(src);
+}
+
+inline bool
+TranslationMuxConnection::Request::FeedParser(std::span<const std::byte> src)
+{
+	while (!src.empty()) {
+		size_t nbytes = parser.Feed(src);
+		if (nbytes == 0) {
+			/* the parser needs the whole packet header;
+			   keep this fragment until the next chunk of
+			   this request arrives */
+			assert(src.size() < partial_header.size());
+			memcpy(partial_header.data(), src.data(), src.size());
+			partial_header_size = src.size();
+			break;
+		}
+
+		if (want_raw_response)
+			raw_response.Write(src.first(nbytes));
+
+		src = src.subspan(nbytes);
+
+		switch (parser.Process()) {
+		case TranslateParser::Result::MORE:
+			break;
+
+		case TranslateParser::Result::DONE:
+			stopwatch.RecordEvent("response");
+
+			connection.RemoveRequest(*this);
+
+			{
+				auto &_handler = handler;
+				auto _response = std::move(response);
+				auto _raw_response = std::move(raw_response);
+				const bool _want_raw_response = want_raw_response;
+				Destroy();
+
+				if (_want_raw_response)
+					_handler.OnTranslateRawResponse(std::move(_raw_response));
+				_handler.OnTranslateResponse(std::move(_response));
+			}
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+TranslationMuxConnection::TranslationMuxConnection(EventLoop &event_loop,
+						   UniqueSocketDescriptor &&fd,
+						   TranslationMuxHandler &_handler) noexcept
+	:handler(_handler),
+	 socket(event_loop),
+	 read_timer(event_loop, BIND_THIS_METHOD(OnReadTimeout)),
+	 idle_timer(event_loop, BIND_THIS_METHOD(OnIdleTimeout)),
+	 output(MarshalMuxHello())
+{
+	assert(output.GetSize() == hello.size());
+	output.CopyTo(hello.data());
+
+	socket.Init(fd.Release(), FdType::FD_SOCKET, write_timeout, *this);
+	socket.ScheduleRead();
+	socket.DeferWrite();
+
+	read_timer.Schedule(read_timeout);
+}
+
+TranslationMuxConnection::~TranslationMuxConnection() noexcept
+{
+	assert(requests.empty());
+
+	socket.Close();
+	socket.Destroy();
+}
+
+void
+TranslationMuxConnection::SendRequest(AllocatorPtr alloc,
+				      const TranslateRequest &request,
+				      const StopwatchPtr &parent_stopwatch,
+				      TranslateHandler &_handler,
+				      CancellablePointer &cancel_ptr) noexcept
+try {
+	GrowingBuffer gb = MarshalTranslateRequest(TRANSLATION_PROTOCOL_VERSION,
+						   request);
+
+	const uint32_t id = next_request_id++;
+	if (next_request_id == 0)
+		next_request_id = 1;
+
+	auto *r = alloc.New<Request>(*this, id, alloc, request,
+				     parent_stopwatch,
+				     _handler, cancel_ptr);
+	requests.push_back(*r);
+
+	/* before negotiation has completed, this will be queued
+	   after the hello; if negotiation fails, the whole output
+	   buffer is discarded */
+	WriteFrame(id, std::move(gb));
+	UpdateReadTimer();
+} catch (...) {
+	_handler.OnTranslateError(std::current_exception());
+}
+
+void
+TranslationMuxConnection::WriteFrame(uint32_t id,
+				     GrowingBuffer &&payload) noexcept
+{
+	const TranslationMuxHeader header{
+		.id = id,
+		.length = static_cast<uint32_t>(payload.GetSize()),
+	};
+
+	output.WriteT(header);
+	output.AppendMoveFrom(std::move(payload));
+	socket.ScheduleWrite();
+}
+
+void
+TranslationMuxConnection::WriteCancel(uint32_t id) noexcept
+{
+	WriteFrame(id, {});
+}
+
+bool
+TranslationMuxConnection::TryWrite() noexcept
+{
+	while (true) {
+		auto src = output.Read();
+		if (src.empty()) {
+			socket.UnscheduleWrite();
+			return true;
+		}
+
+		ssize_t nbytes = socket.Write(src.data(), src.size());
+		if (nbytes < 0) [[unlikely]] {
+			if (nbytes == WRITE_BLOCKING) [[likely]]
+				return true;
+
+			Fail(std::make_exception_ptr(MakeErrno("write error to translation server")));
+			return false;
+		}
+
+		output.Consume(nbytes);
+
+		if (static_cast<std::size_t>(nbytes) < src.size()) {
+			socket.ScheduleWrite();
+			return true;
+		}
+	}
+}
+
+inline TranslationMuxConnection::Request *
+TranslationMuxConnection::FindRequest(uint32_t id) noexcept
+{
+	/* the number of concurrent requests is small, and most
+	   responses arrive in order, so a linear search from the
+	   front is cheap enough */
+	auto i = std::find_if(requests.begin(), requests.end(),
+			      [id](const Request &r){ return r.id == id; });
+	return i != requests.end() ? &*i : nullptr;
+}
+
+void
+TranslationMuxConnection::RemoveRequest(Request &request) noexcept
+{
+	if (current == &request)
+		current = nullptr;
+
+	requests.erase(requests.iterator_to(request));
+	UpdateReadTimer();
+
+	handler.OnTranslationMuxAvailable();
+}
+
+void
+TranslationMuxConnection::UpdateReadTimer() noexcept
+{
+	if (negotiated && requests.empty()) {
+		read_timer.Cancel();
+		idle_timer.Schedule(idle_timeout);
+	} else {
+		idle_timer.Cancel();
+
+		if (!read_timer.IsPending())
+			read_timer.Schedule(read_timeout);
+	}
+}
+
+void
+TranslationMuxConnection::Close(bool supported) noexcept
+{
+	current = nullptr;
+	read_timer.Cancel();
+	idle_timer.Cancel();
+
+	while (!requests.empty()) {
+		auto &r = requests.front();
+		requests.pop_front();
+		r.Resubmit(handler);
+	}
+
+	handler.OnTranslationMuxClosed(supported);
+}
+
+void
+TranslationMuxConnection::Fail(std::exception_ptr e) noexcept
+{
+	/* translation requests have no side effects, so all pending
+	   requests can safely be resubmitted on a classic
+	   connection, even those which may have been seen by the
+	   server already */
+	LogConcat(2, "translation",
+		  NestException(e,
+				std::runtime_error("Multiplexed translation server connection failed")));
+	Close(true);
+}
+
+void
+TranslationMuxConnection::OnReadTimeout() noexcept
+{
+	Fail(std::make_exception_ptr(TimeoutError{}));
+}
+
+void
+TranslationMuxConnection::OnIdleTimeout() noexcept
+{
+	assert(negotiated);
+	assert(requests.empty());
+
+	/* not an error: the next request will open a new
+	   connection */
+	Close(true);
+}
+
+inline BufferedResult
+TranslationMuxConnection::FeedHello(std::span<const std::byte> src) noexcept
+{
+	assert(!negotiated);
+	assert(hello_received < hello.size());
+
+	const std::size_t n = std::min(src.size(),
+				       hello.size() - hello_received);
+	if (memcmp(src.data(), hello.data() + hello_received, n) != 0) {
+		/* the server has answered with something else: it
+		   does not support multiplexing */
+		Close(false);
+		return BufferedResult::CLOSED;
+	}
+
+	hello_received += n;
+	socket.DisposeConsumed(n);
+
+	if (hello_received < hello.size())
+		return BufferedResult::MORE;
+
+	negotiated = true;
+	read_timer.Cancel();
+	UpdateReadTimer();
+
+	return BufferedResult::AGAIN;
+}
+
+inline BufferedResult
+TranslationMuxConnection::FeedFrames(std::span<const std::byte> src) noexcept
+{
+	assert(negotiated);
+
+	while (!src.empty()) {
+		if (frame_remaining == 0) {
+			TranslationMuxHeader header;
+			if (src.size() < sizeof(header))
+				return BufferedResult::MORE;
+
+			memcpy(&header, src.data(), sizeof(header));
+			src = src.subspan(sizeof(header));
+			socket.DisposeConsumed(sizeof(header));
+
+			current = FindRequest(header.id);
+
+			if (header.length == 0) {
+				/* the server has aborted this request */
+				if (current != nullptr) {
+					auto &r = *current;
+					RemoveRequest(r);
+					r.Abort(std::make_exception_ptr(std::runtime_error("Translation server aborted the request")));
+				}
+
+				continue;
+			}
+
+			frame_remaining = header.length;
+			continue;
+		}
+
+		const auto chunk = src.first(std::min<std::size_t>(src.size(),
+								   frame_remaining));
+		src = src.subspan(chunk.size());
+		frame_remaining -= chunk.size();
+		socket.DisposeConsumed(chunk.size());
+
+		if (current == nullptr)
+			/* discard data for unknown (canceled)
+			   requests */
+			continue;
+
+		auto &r = *current;
+
+		try {
+			r.Feed(chunk);
+		} catch (...) {
+			/* this request's response is malformed; the
+			   frame boundaries are still intact, so
+			   only this request is failed */
+			RemoveRequest(r);
+			r.Abort(std::current_exception());
+		}
+	}
+
+	return BufferedResult::MORE;
+}
+
+BufferedResult
+TranslationMuxConnection::OnBufferedData()
+{
+	auto r = socket.ReadBuffer();
+	assert(!r.empty());
+
+	if (!negotiated)
+		return FeedHello(r);
+
+	if (!requests.empty())
+		/* the server is alive: restart the timeout */
+		read_timer.Schedule(read_timeout);
+
+	return FeedFrames(r);
+}
+
+bool
+TranslationMuxConnection::OnBufferedClosed() noexcept
+{
+	if (negotiated && requests.empty() && frame_remaining == 0) {
+		/* the server has closed an idle connection; this is
+		   not an error */
+		Close(true);
+		return false;
+	}
+
+	Fail(std::make_exception_ptr(SocketClosedPrematurelyError()));
+	return false;
+}
+
+bool
+TranslationMuxConnection::OnBufferedWrite()
+{
+	return TryWrite();
+}
+
+void
+TranslationMuxConnection::OnBufferedError(std::exception_ptr e) noexcept
+{
+	Fail(std::move(e));
+}
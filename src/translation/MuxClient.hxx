@@ -0,0 +1,199 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#pragma once
+
+#include "event/net/BufferedSocket.hxx"
+#include "event/CoarseTimerEvent.hxx"
+#include "memory/GrowingBuffer.hxx"
+#include "util/IntrusiveList.hxx"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+
+class AllocatorPtr;
+class StopwatchPtr;
+class CancellablePointer;
+class UniqueSocketDescriptor;
+struct TranslateRequest;
+class TranslateHandler;
+
+class TranslationMuxHandler {
+public:
+	/**
+	 * This request could not be completed on the multiplexed
+	 * connection, either because the server has rejected
+	 * multiplexing or because the connection has failed.  The
+	 * caller shall resubmit this request using the classic
+	 * protocol.  This is called once for each pending request,
+	 * followed by OnTranslationMuxClosed().
+	 */
+	virtual void OnTranslationMuxFallback(AllocatorPtr alloc,
+					      const TranslateRequest &request,
+					      const StopwatchPtr &parent_stopwatch,
+					      TranslateHandler &handler,
+					      CancellablePointer &cancel_ptr) noexcept = 0;
+
+	/**
+	 * A request has been finished or canceled, and the
+	 * connection can accept another one.
+	 */
+	virtual void OnTranslationMuxAvailable() noexcept = 0;
+
+	/**
+	 * The connection has been closed and shall be destroyed.
+	 * All pending requests have already been passed to
+	 * OnTranslationMuxFallback().
+	 *
+	 * @param supported false if the server has explicitly
+	 * rejected multiplexing; true if the connection has merely
+	 * failed (or if multiplexing has not been negotiated yet)
+	 */
+	virtual void OnTranslationMuxClosed(bool supported) noexcept = 0;
+};
+
+/**
+ * A connection to a translation server which transmits many requests
+ * concurrently, each wrapped in frames tagged with a request id.  It
+ * starts with a negotiation request; if the server does not support
+ * multiplexing or if the connection fails, all pending requests are
+ * handed back to the #TranslationMuxHandler.
+ */
+class TranslationMuxConnection final : BufferedSocketHandler {
+	static constexpr Event::Duration read_timeout = std::chrono::minutes{1};
+	static constexpr Event::Duration write_timeout = std::chrono::seconds{10};
+
+	/**
+	 * Close the connection after it has been idle for this long.
+	 */
+	static constexpr Event::Duration idle_timeout = std::chrono::minutes{1};
+
+	/**
+	 * The size of the negotiation request: #BEGIN with protocol
+	 * version and magic, followed by #END.
+	 */
+	static constexpr std::size_t HELLO_SIZE = 4 + 1 + 4 + 4;
+
+	TranslationMuxHandler &handler;
+
+	BufferedSocket socket;
+
+	/**
+	 * Fires when the server does not respond to pending requests
+	 * (or to the negotiation request).
+	 */
+	CoarseTimerEvent read_timer;
+
+	/**
+	 * Closes the connection when there have been no requests for
+	 * a while.
+	 */
+	CoarseTimerEvent idle_timer;
+
+	/**
+	 * Data waiting to be sent to the server.
+	 */
+	GrowingBuffer output;
+
+	/**
+	 * The negotiation request which was sent to the server; the
+	 * server is expected to echo it.
+	 */
+	std::array<std::byte, HELLO_SIZE> hello;
+
+	class Request;
+	using RequestList =
+		IntrusiveList<Request,
+			      IntrusiveListBaseHookTraits<Request>,
+			      true>;
+
+	RequestList requests;
+
+	/**
+	 * The request which receives the payload of the current
+	 * frame.  nullptr if there is no current frame or if the
+	 * frame belongs to a request which is not (anymore) known,
+	 * e.g. because it was canceled.
+	 */
+	Request *current = nullptr;
+
+	/**
+	 * The number of payload bytes remaining in the current frame.
+	 */
+	uint32_t frame_remaining = 0;
+
+	uint32_t next_request_id = 1;
+
+	/**
+	 * The number of #hello bytes which have been received and
+	 * verified so far.
+	 */
+	std::size_t hello_received = 0;
+
+	/**
+	 * Has the server confirmed multiplexing?
+	 */
+	bool negotiated = false;
+
+public:
+	TranslationMuxConnection(EventLoop &event_loop,
+				 UniqueSocketDescriptor &&fd,
+				 TranslationMuxHandler &_handler) noexcept;
+	~TranslationMuxConnection() noexcept;
+
+	TranslationMuxConnection(const TranslationMuxConnection &) = delete;
+	TranslationMuxConnection &operator=(const TranslationMuxConnection &) = delete;
+
+	bool IsIdle() const noexcept {
+		return requests.empty();
+	}
+
+	std::size_t GetRequestCount() const noexcept {
+		return requests.size();
+	}
+
+	void SendRequest(AllocatorPtr alloc,
+			 const TranslateRequest &request,
+			 const StopwatchPtr &parent_stopwatch,
+			 TranslateHandler &handler,
+			 CancellablePointer &cancel_ptr) noexcept;
+
+private:
+	void WriteFrame(uint32_t id, GrowingBuffer &&payload) noexcept;
+	void WriteCancel(uint32_t id) noexcept;
+
+	bool TryWrite() noexcept;
+
+	[[gnu::pure]]
+	Request *FindRequest(uint32_t id) noexcept;
+
+	void RemoveRequest(Request &request) noexcept;
+
+	void UpdateReadTimer() noexcept;
+
+	/**
+	 * Close the connection and let the #TranslationMuxHandler
+	 * resubmit all pending requests.
+	 *
+	 * @param supported false if the server has rejected
+	 * multiplexing
+	 */
+	void Close(bool supported) noexcept;
+
+	void Fail(std::exception_ptr e) noexcept;
+
+	void OnReadTimeout() noexcept;
+	void OnIdleTimeout() noexcept;
+
+	BufferedResult FeedHello(std::span<const std::byte> src) noexcept;
+	BufferedResult FeedFrames(std::span<const std::byte> src) noexcept;
+
+	/* virtual methods from class BufferedSocketHandler */
+	BufferedResult OnBufferedData() override;
+	bool OnBufferedClosed() noexcept override;
+	bool OnBufferedWrite() override;
+	void OnBufferedError(std::exception_ptr e) noexcept override;
+};
@@ -0,0 +1,33 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+/*
+ * Definitions for the multiplexed translation protocol extension.
+ * See doc/translation.rst for a description.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+/**
+ * The magic string appended to the protocol version in the
+ * negotiation request's #BEGIN packet.  A server which supports
+ * multiplexing echoes the whole negotiation request verbatim.
+ */
+static constexpr char TRANSLATION_MUX_MAGIC[] = {'M', 'U', 'X', '1'};
+
+/**
+ * After successful negotiation, all data on the connection is
+ * wrapped in frames which begin with this header.  It is followed by
+ * #length bytes of regular translation packets belonging to the
+ * request identified by #id.  A frame with #length=0 cancels (sent by
+ * the client) or aborts (sent by the server) the request.
+ */
+struct TranslationMuxHeader {
+	uint32_t id;
+	uint32_t length;
+};
+
+static_assert(sizeof(TranslationMuxHeader) == 8);
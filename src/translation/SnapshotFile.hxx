@@ -0,0 +1,29 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+/*
+ * Definitions for the translation cache snapshot file format.
+ *
+ * The file begins with #MAGIC_TCACHE_FILE and
+ * #TCACHE_SNAPSHOT_VERSION.  For each translation server, there is
+ * a #MAGIC_TCACHE_SERVER record (followed by the size and the raw
+ * socket address and the size and the generation string of the
+ * translation cache), followed by any number of #MAGIC_TCACHE_ITEM
+ * records (followed by the absolute expiry time in seconds since
+ * the epoch (int64_t), the size and the marshalled request, and the
+ * size and the raw response packets), terminated by
+ * #MAGIC_TCACHE_END_OF_LIST.  The file ends with
+ * #MAGIC_TCACHE_END_OF_FILE.  All integers are in host byte order.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+static constexpr uint32_t MAGIC_TCACHE_FILE = 1912384652;
+static constexpr uint32_t TCACHE_SNAPSHOT_VERSION = 3;
+static constexpr uint32_t MAGIC_TCACHE_SERVER = 2039485731;
+static constexpr uint32_t MAGIC_TCACHE_ITEM = 1387234569;
+static constexpr uint32_t MAGIC_TCACHE_END_OF_LIST = 1663249801;
+static constexpr uint32_t MAGIC_TCACHE_END_OF_FILE = 1209348875;
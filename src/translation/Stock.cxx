@@ -20,6 +20,7 @@
 #include "stopwatch.hxx"
 #include "AllocatorPtr.hxx"
 
+#include <assert.h>
 #include <string.h>
 #include <errno.h>
 
@@ -146,6 +147,68 @@ private:
 	}
 };
 
+/**
+ * A request which waits for a slot on the multiplexed connection.
+ */
+class TranslationStock::MuxWaiting final
+	: public IntrusiveListHook<IntrusiveHookMode::NORMAL>,
+	  Cancellable, PoolLeakDetector
+{
+	const AllocatorPtr alloc;
+
+	StopwatchPtr stopwatch;
+
+	const TranslateRequest &request;
+
+	TranslateHandler &handler;
+
+	CancellablePointer &caller_cancel_ptr;
+
+public:
+	MuxWaiting(AllocatorPtr _alloc,
+		   const TranslateRequest &_request,
+		   const StopwatchPtr &parent_stopwatch,
+		   TranslateHandler &_handler,
+		   CancellablePointer &_cancel_ptr) noexcept
+		:PoolLeakDetector(_alloc),
+		 alloc(_alloc),
+		 stopwatch(parent_stopwatch, "translate_wait"),
+		 request(_request),
+		 handler(_handler),
+		 caller_cancel_ptr(_cancel_ptr)
+	{
+		_cancel_ptr = *this;
+	}
+
+	/**
+	 * Remove this object from the list, destroy it and submit
+	 * the request.
+	 */
+	void Submit(TranslationStock &stock) noexcept {
+		auto _alloc = alloc;
+		const auto &_request = request;
+		auto _stopwatch = std::move(stopwatch);
+		auto &_handler = handler;
+		auto &_cancel_ptr = caller_cancel_ptr;
+		unlink();
+		Destroy();
+
+		stock.SendMuxRequest(_alloc, _request, _stopwatch,
+				     _handler, _cancel_ptr);
+	}
+
+private:
+	void Destroy() noexcept {
+		this->~MuxWaiting();
+	}
+
+	/* virtual methods from class Cancellable */
+	void Cancel() noexcept override {
+		unlink();
+		Destroy();
+	}
+};
+
 /*
  * stock callback
  *
@@ -190,6 +253,103 @@ TranslationStock::Create(CreateStockItem c, StockRequest,
 	connection->InvokeCreateSuccess(handler);
 }
 
+TranslationStock::~TranslationStock() noexcept
+{
+	assert(mux_waiting.empty());
+}
+
+void
+TranslationStock::SendClassicRequest(AllocatorPtr alloc,
+				     const TranslateRequest &request,
+				     const StopwatchPtr &parent_stopwatch,
+				     TranslateHandler &handler,
+				     CancellablePointer &cancel_ptr) noexcept
+{
+	auto r = alloc.New<Request>(*this, alloc, request,
+				    parent_stopwatch,
+				    handler, cancel_ptr);
+	r->Start();
+}
+
+void
+TranslationStock::SendMuxRequest(AllocatorPtr alloc,
+				 const TranslateRequest &request,
+				 const StopwatchPtr &parent_stopwatch,
+				 TranslateHandler &handler,
+				 CancellablePointer &cancel_ptr) noexcept
+{
+	assert(!IsMuxFull());
+
+	if (mux_state == MuxState::DISABLED) {
+		SendClassicRequest(alloc, request, parent_stopwatch,
+				   handler, cancel_ptr);
+		return;
+	}
+
+	if (!mux) {
+		try {
+			mux = std::make_unique<TranslationMuxConnection>(GetEventLoop(),
+									 CreateConnectStreamSocket(address),
+									 *this);
+		} catch (...) {
+			/* this may be a temporary problem; don't
+			   disable multiplexing, but let the classic
+			   code path handle (and report) it */
+			LogConcat(2, "translation", std::current_exception());
+			SendClassicRequest(alloc, request, parent_stopwatch,
+					   handler, cancel_ptr);
+			return;
+		}
+	}
+
+	mux->SendRequest(alloc, request, parent_stopwatch,
+			 handler, cancel_ptr);
+}
+
+void
+TranslationStock::OnMuxWaitingDefer() noexcept
+{
+	while (!mux_waiting.empty() && !IsMuxFull())
+		mux_waiting.front().Submit(*this);
+}
+
+void
+TranslationStock::OnTranslationMuxFallback(AllocatorPtr alloc,
+					   const TranslateRequest &request,
+					   const StopwatchPtr &parent_stopwatch,
+					   TranslateHandler &handler,
+					   CancellablePointer &cancel_ptr) noexcept
+{
+	SendClassicRequest(alloc, request, parent_stopwatch,
+			   handler, cancel_ptr);
+}
+
+void
+TranslationStock::OnTranslationMuxAvailable() noexcept
+{
+	if (!mux_waiting.empty())
+		mux_waiting_defer.Schedule();
+}
+
+void
+TranslationStock::OnTranslationMuxClosed(bool supported) noexcept
+{
+	if (!supported && mux_state != MuxState::DISABLED) {
+		char buffer[256];
+		ToString(buffer, sizeof(buffer), address);
+		LogConcat(3, "translation",
+			  "server does not support multiplexing, falling back: ",
+			  buffer);
+
+		mux_state = MuxState::DISABLED;
+	}
+
+	mux.reset();
+
+	if (!mux_waiting.empty())
+		mux_waiting_defer.Schedule();
+}
+
 void
 TranslationStock::SendRequest(AllocatorPtr alloc,
 			      const TranslateRequest &request,
@@ -197,8 +357,22 @@ TranslationStock::SendRequest(AllocatorPtr alloc,
 			      TranslateHandler &handler,
 			      CancellablePointer &cancel_ptr) noexcept
 {
-	auto r = alloc.New<Request>(*this, alloc, request,
-				    parent_stopwatch,
-				    handler, cancel_ptr);
-	r->Start();
+	if (mux_state == MuxState::DISABLED) {
+		SendClassicRequest(alloc, request, parent_stopwatch,
+				   handler, cancel_ptr);
+		return;
+	}
+
+	if (IsMuxFull() || !mux_waiting.empty()) {
+		/* honor the limit; the request will be submitted as
+		   soon as another one finishes */
+		auto *w = alloc.New<MuxWaiting>(alloc, request,
+						parent_stopwatch,
+						handler, cancel_ptr);
+		mux_waiting.push_back(*w);
+		return;
+	}
+
+	SendMuxRequest(alloc, request, parent_stopwatch,
+		       handler, cancel_ptr);
 }
@@ -5,30 +5,83 @@
 #pragma once
 
 #include "Service.hxx"
+#include "MuxClient.hxx"
 #include "stock/Stock.hxx"
 #include "stock/Class.hxx"
+#include "event/DeferEvent.hxx"
 #include "net/AllocatedSocketAddress.hxx"
+#include "util/IntrusiveList.hxx"
+
+#include <memory>
 
 struct TranslateRequest;
 class TranslateHandler;
 
-class TranslationStock final : public TranslationService, StockClass {
+class TranslationStock final
+	: public TranslationService, StockClass, TranslationMuxHandler
+{
 	class Connection;
 	class Request;
+	class MuxWaiting;
 
 	Stock stock;
 
 	const AllocatedSocketAddress address;
 
+	/**
+	 * The maximum number of concurrent requests on the
+	 * multiplexed connection; 0 means no limit.  This is the same
+	 * as the #Stock limit for classic connections.
+	 */
+	const unsigned limit;
+
+	/**
+	 * The multiplexed connection to the translation server.  It
+	 * is created on demand and shared by all requests.
+	 */
+	std::unique_ptr<TranslationMuxConnection> mux;
+
+	/**
+	 * Requests which are waiting for a slot on the multiplexed
+	 * connection because #limit has been reached.
+	 */
+	IntrusiveList<MuxWaiting,
+		      IntrusiveListBaseHookTraits<MuxWaiting>> mux_waiting;
+
+	/**
+	 * Submits requests from #mux_waiting.
+	 */
+	DeferEvent mux_waiting_defer;
+
+	enum class MuxState : uint_least8_t {
+		/**
+		 * Multiplexing is disabled by configuration or
+		 * because the server has explicitly rejected it; use
+		 * the classic one-request-per-connection protocol.
+		 */
+		DISABLED,
+
+		/**
+		 * Multiplexing is enabled; it will be negotiated on
+		 * the next connection.
+		 */
+		ENABLED,
+	} mux_state;
+
 public:
 	TranslationStock(EventLoop &event_loop, SocketAddress _address,
-			 unsigned limit) noexcept
-		:stock(event_loop, *this, "translation", limit, 8,
+			 unsigned _limit, bool multiplex=false) noexcept
+		:stock(event_loop, *this, "translation", _limit, 8,
 		       Event::Duration::zero()),
-		 address(_address)
+		 address(_address),
+		 limit(_limit),
+		 mux_waiting_defer(event_loop, BIND_THIS_METHOD(OnMuxWaitingDefer)),
+		 mux_state(multiplex ? MuxState::ENABLED : MuxState::DISABLED)
 	{
 	}
 
+	~TranslationStock() noexcept;
+
 	auto &GetEventLoop() const noexcept {
 		return stock.GetEventLoop();
 	}
@@ -50,6 +103,34 @@ public:
 			 CancellablePointer &cancel_ptr) noexcept override;
 
 private:
+	[[gnu::pure]]
+	bool IsMuxFull() const noexcept {
+		return limit > 0 && mux && mux->GetRequestCount() >= limit;
+	}
+
+	void SendMuxRequest(AllocatorPtr alloc,
+			    const TranslateRequest &request,
+			    const StopwatchPtr &parent_stopwatch,
+			    TranslateHandler &handler,
+			    CancellablePointer &cancel_ptr) noexcept;
+
+	void OnMuxWaitingDefer() noexcept;
+
+	void SendClassicRequest(AllocatorPtr alloc,
+				const TranslateRequest &request,
+				const StopwatchPtr &parent_stopwatch,
+				TranslateHandler &handler,
+				CancellablePointer &cancel_ptr) noexcept;
+
+	/* virtual methods from class TranslationMuxHandler */
+	void OnTranslationMuxFallback(AllocatorPtr alloc,
+				      const TranslateRequest &request,
+				      const StopwatchPtr &parent_stopwatch,
+				      TranslateHandler &handler,
+				      CancellablePointer &cancel_ptr) noexcept override;
+	void OnTranslationMuxAvailable() noexcept override;
+	void OnTranslationMuxClosed(bool supported) noexcept override;
+
 	/* virtual methods from class StockClass */
 	void Create(CreateStockItem c, StockRequest request,
 		    StockGetHandler &handler,
@@ -0,0 +1,609 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#pragma once
+
+#include "util/Cast.hxx"
+#include "util/MemberPointer.hxx"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+/**
+ * The hook for #IntrusiveGrowingHashSet.  Besides the chain pointers,
+ * it caches the item's hash value, which allows moving the item to a
+ * bigger bucket array without calling the hash function again, and
+ * allows skipping most non-matching chain entries without calling
+ * the (possibly expensive) equality function.
+ */
+class IntrusiveGrowingHashSetHook {
+	template<typename T, typename Hash, typename Equal,
+		 typename HookTraits>
+	friend class IntrusiveGrowingHashSet;
+
+	IntrusiveGrowingHashSetHook *next;
+
+	/**
+	 * Points to the "next" pointer of the previous chain
+	 * element or to the bucket head; nullptr if this item is not
+	 * linked.
+	 */
+	IntrusiveGrowingHashSetHook **pprev = nullptr;
+
+	std::size_t hash;
+
+public:
+	IntrusiveGrowingHashSetHook() noexcept = default;
+
+	/* copying an item does not copy its membership */
+	IntrusiveGrowingHashSetHook(const IntrusiveGrowingHashSetHook &) noexcept {}
+
+	IntrusiveGrowingHashSetHook &operator=(const IntrusiveGrowingHashSetHook &) noexcept {
+		return *this;
+	}
+
+	~IntrusiveGrowingHashSetHook() noexcept {
+		assert(!is_linked());
+	}
+
+	bool is_linked() const noexcept {
+		return pprev != nullptr;
+	}
+
+private:
+	void Link(IntrusiveGrowingHashSetHook *&head) noexcept {
+		assert(!is_linked());
+
+		next = head;
+		if (next != nullptr)
+			next->pprev = &next;
+		pprev = &head;
+		head = this;
+	}
+
+	void Unlink() noexcept {
+		assert(is_linked());
+
+		*pprev = next;
+		if (next != nullptr)
+			next->pprev = pprev;
+		pprev = nullptr;
+	}
+};
+
+/**
+ * For classes which embed #IntrusiveGrowingHashSetHook as a base
+ * class.
+ */
+template<typename T>
+struct IntrusiveGrowingHashSetBaseHookTraits {
+	static constexpr T *Cast(IntrusiveGrowingHashSetHook *node) noexcept {
+		return static_cast<T *>(node);
+	}
+
+	static constexpr auto &ToHook(T &t) noexcept {
+		return static_cast<IntrusiveGrowingHashSetHook &>(t);
+	}
+};
+
+/**
+ * For classes which embed #IntrusiveGrowingHashSetHook as a member.
+ */
+template<auto member>
+struct IntrusiveGrowingHashSetMemberHookTraits {
+	using T = MemberPointerContainerType<decltype(member)>;
+
+	static constexpr T *Cast(IntrusiveGrowingHashSetHook *node) noexcept {
+		return &ContainerCast(*node, member);
+	}
+
+	static constexpr auto &ToHook(T &t) noexcept {
+		return t.*member;
+	}
+};
+
+/**
+ * An intrusive hash set whose bucket array grows with the number of
+ * items.  Unlike #IntrusiveHashSet, the number of buckets is not a
+ * compile-time constant, so the chains stay short no matter how many
+ * items are inserted.
+ *
+ * Growing does not happen all at once: when the load factor exceeds
+ * 1, a new bucket array twice as big is allocated, and each following
+ * insert() moves a few buckets from the old array to the new one.
+ * Lookups check both arrays until the old one has been drained.
+ * This way, no single call has to move all items.
+ *
+ * The interface mimics #IntrusiveHashSet, but iterators can only be
+ * dereferenced and compared; use for_each() to visit all items.
+ *
+ * @param Hash a function object which calculates the hash of an item
+ * or a key
+ * @param Equal a function object which compares a key (or an item)
+ * with an item
+ */
+template<typename T, typename Hash, typename Equal,
+	 typename HookTraits=IntrusiveGrowingHashSetBaseHookTraits<T>>
+class IntrusiveGrowingHashSet {
+	using Hook = IntrusiveGrowingHashSetHook;
+
+	/**
+	 * The number of buckets allocated by the first insert().
+	 */
+	static constexpr std::size_t INITIAL_BUCKETS = 64;
+
+	/**
+	 * The number of old buckets moved by each insert() while
+	 * growing.  The new array has twice as many buckets as the
+	 * old one, and it will not grow again before it is full, so
+	 * any value of at least 1 guarantees that growing has
+	 * finished by then.
+	 */
+	static constexpr std::size_t REHASH_STEP = 4;
+
+	struct FreeDeleter {
+		void operator()(Hook **p) const noexcept {
+			std::free(p);
+		}
+	};
+
+	struct Table {
+		std::unique_ptr<Hook *[], FreeDeleter> buckets;
+
+		/**
+		 * The number of buckets; always a power of two (or
+		 * zero if nothing has been allocated yet).
+		 */
+		std::size_t n_buckets = 0;
+
+		/**
+		 * The number of bits to shift the mixed hash value
+		 * right to get the bucket index.
+		 */
+		unsigned shift;
+
+		void Allocate(std::size_t n) noexcept {
+			assert(std::has_single_bit(n));
+
+			/* calloc() instead of "new" because big
+			   allocations get fresh (zeroed) pages from
+			   the kernel, so this does not need to clear
+			   the whole array, which would be just the
+			   kind of stall this class is meant to
+			   avoid */
+			buckets.reset(static_cast<Hook **>(std::calloc(n, sizeof(Hook *))));
+			if (!buckets)
+				/* out of memory; same as "new" in a
+				   "noexcept" function */
+				std::terminate();
+			n_buckets = n;
+			shift = 64 - std::countr_zero(n);
+		}
+
+		void Free() noexcept {
+			buckets.reset();
+			n_buckets = 0;
+		}
+
+		bool IsDefined() const noexcept {
+			return n_buckets > 0;
+		}
+
+		/**
+		 * Map a hash value to a bucket index.  This uses
+		 * Fibonacci hashing, so weak hash functions whose
+		 * low bits are not well-distributed still spread
+		 * evenly.
+		 */
+		constexpr std::size_t IndexOf(std::size_t hash) const noexcept {
+			return (uint_least64_t(hash) * UINT64_C(0x9e3779b97f4a7c15)) >> shift;
+		}
+
+		Hook *&GetBucket(std::size_t hash) const noexcept {
+			return buckets[IndexOf(hash)];
+		}
+	};
+
+	[[no_unique_address]]
+	Hash hash;
+
+	[[no_unique_address]]
+	Equal equal;
+
+	/**
+	 * The bucket array which receives new items.
+	 */
+	Table table;
+
+	/**
+	 * The bucket array which is being drained while growing;
+	 * undefined if no growing is in progress.
+	 */
+	Table old_table;
+
+	/**
+	 * The index of the next #old_table bucket to be moved to
+	 * #table.
+	 */
+	std::size_t rehash_position;
+
+	std::size_t counter = 0;
+
+public:
+	class iterator {
+		friend class IntrusiveGrowingHashSet;
+
+		Hook *hook;
+
+		/**
+		 * The key hash calculated by insert_check(); it is
+		 * reused by insert(iterator, T&).
+		 */
+		std::size_t hash = 0;
+
+		constexpr explicit iterator(Hook *_hook) noexcept
+			:hook(_hook) {}
+
+		constexpr iterator(Hook *_hook, std::size_t _hash) noexcept
+			:hook(_hook), hash(_hash) {}
+
+	public:
+		constexpr bool operator==(const iterator &other) const noexcept {
+			return hook == other.hook;
+		}
+
+		T &operator*() const noexcept {
+			return *HookTraits::Cast(hook);
+		}
+
+		T *operator->() const noexcept {
+			return HookTraits::Cast(hook);
+		}
+	};
+
+	IntrusiveGrowingHashSet() noexcept = default;
+
+	IntrusiveGrowingHashSet(const IntrusiveGrowingHashSet &) = delete;
+	IntrusiveGrowingHashSet &operator=(const IntrusiveGrowingHashSet &) = delete;
+
+	~IntrusiveGrowingHashSet() noexcept {
+		assert(empty());
+	}
+
+	[[nodiscard]]
+	constexpr bool empty() const noexcept {
+		return counter == 0;
+	}
+
+	[[nodiscard]]
+	constexpr std::size_t size() const noexcept {
+		return counter;
+	}
+
+	/**
+	 * Returns the number of buckets of the current bucket array.
+	 */
+	[[nodiscard]]
+	constexpr std::size_t bucket_count() const noexcept {
+		return table.n_buckets;
+	}
+
+	/**
+	 * Is a bucket array still being drained?
+	 */
+	[[nodiscard]]
+	constexpr bool is_rehashing() const noexcept {
+		return old_table.IsDefined();
+	}
+
+	[[nodiscard]]
+	constexpr const Equal &key_eq() const noexcept {
+		return equal;
+	}
+
+	[[nodiscard]]
+	constexpr iterator end() const noexcept {
+		return iterator{nullptr};
+	}
+
+	[[nodiscard]]
+	static constexpr iterator iterator_to(T &item) noexcept {
+		return iterator{&ToHook(item)};
+	}
+
+	void insert(T &item) noexcept {
+		Insert(item, hash(std::as_const(item)));
+	}
+
+	/**
+	 * Look up the given key before inserting a new item.
+	 *
+	 * @return an iterator to the existing item and false, or an
+	 * iterator to be passed to insert(iterator, T&) and true if
+	 * no such item exists
+	 */
+	template<typename K>
+	[[nodiscard]]
+	std::pair<iterator, bool> insert_check(const K &key) const noexcept {
+		const std::size_t key_hash = hash(key);
+		auto i = Find(key, key_hash);
+		return {iterator{i.hook, key_hash}, i == end()};
+	}
+
+	/**
+	 * Insert an item after insert_check() has returned true.  The
+	 * item is linked with the key hash calculated by
+	 * insert_check(), which must be the same as the item's hash.
+	 */
+	void insert(iterator position, T &item) noexcept {
+		assert(position == end());
+		assert(hash(std::as_const(item)) == position.hash);
+
+		Insert(item, position.hash);
+	}
+
+	void erase(iterator i) noexcept {
+		assert(i != end());
+		assert(i.hook->is_linked());
+		assert(counter > 0);
+
+		i.hook->Unlink();
+		--counter;
+	}
+
+	template<typename D>
+	void erase_and_dispose(iterator i, D &&disposer) noexcept {
+		T &item = *i;
+		erase(i);
+		disposer(&item);
+	}
+
+	template<typename D>
+	void clear_and_dispose(D &&disposer) noexcept {
+		ClearAndDispose(old_table, disposer);
+		old_table.Free();
+		ClearAndDispose(table, disposer);
+		counter = 0;
+	}
+
+	/**
+	 * Remove and dispose all items matching the given predicate.
+	 *
+	 * @return the number of removed items
+	 */
+	template<typename P, typename D>
+	std::size_t remove_and_dispose_if(P &&pred, D &&disposer) noexcept {
+		std::size_t n = 0;
+		ForEachBucket([&](Hook *&bucket){
+			n += RemoveAndDisposeIf(bucket, [&pred](T &item){
+				return pred(std::as_const(item));
+			}, disposer);
+		});
+		return n;
+	}
+
+	/**
+	 * Remove and dispose all items with the given key matching
+	 * the given predicate.
+	 *
+	 * @return the number of removed items
+	 */
+	template<typename K, typename P, typename D>
+	std::size_t remove_and_dispose_if(const K &key, P &&pred,
+					  D &&disposer) noexcept {
+		const std::size_t key_hash = hash(key);
+		std::size_t n = 0;
+		ForEachBucket(key_hash, [&](Hook *&bucket){
+			n += RemoveAndDisposeIf(bucket, [&](T &item){
+				return ToHook(item).hash == key_hash &&
+					equal(key, std::as_const(item)) &&
+					pred(std::as_const(item));
+			}, disposer);
+		});
+		return n;
+	}
+
+	template<typename K>
+	[[nodiscard]] [[gnu::pure]]
+	iterator find(const K &key) const noexcept {
+		return Find(key, hash(key));
+	}
+
+	/**
+	 * Like find(), but dispose all items with the given key for
+	 * which the #expired predicate returns true, and return the
+	 * first one matching the #match predicate.
+	 */
+	template<typename K, typename E, typename D, typename P>
+	[[nodiscard]]
+	iterator expire_find_if(const K &key, E &&expired, D &&disposer,
+				P &&match) noexcept {
+		const std::size_t key_hash = hash(key);
+		Hook *result = nullptr;
+		ForEachBucket(key_hash, [&](Hook *&bucket){
+			for (Hook *i = bucket, *next; result == nullptr && i != nullptr; i = next) {
+				next = i->next;
+
+				if (i->hash != key_hash)
+					continue;
+
+				T &item = *HookTraits::Cast(i);
+				if (!equal(key, std::as_const(item)))
+					continue;
+
+				if (expired(std::as_const(item))) {
+					i->Unlink();
+					--counter;
+					disposer(&item);
+				} else if (match(std::as_const(item)))
+					result = i;
+			}
+		});
+		return iterator{result};
+	}
+
+	/**
+	 * Invoke the given function for each item.  The function
+	 * must not modify this container.
+	 */
+	template<typename F>
+	void for_each(F &&f) {
+		ForEachBucket([&f](Hook *bucket){
+			for (Hook *i = bucket; i != nullptr; i = i->next)
+				f(*HookTraits::Cast(i));
+		});
+	}
+
+	template<typename F>
+	void for_each(F &&f) const {
+		ForEachBucket([&f](Hook *bucket){
+			for (Hook *i = bucket; i != nullptr; i = i->next)
+				f(std::as_const(*HookTraits::Cast(i)));
+		});
+	}
+
+private:
+	static constexpr Hook &ToHook(T &t) noexcept {
+		return HookTraits::ToHook(t);
+	}
+
+	/**
+	 * Make room for one more item: allocate a bigger bucket
+	 * array if the current one is full, and move a few buckets
+	 * from the old one.
+	 */
+	void Grow() noexcept {
+		if (!table.IsDefined()) {
+			table.Allocate(INITIAL_BUCKETS);
+			return;
+		}
+
+		if (is_rehashing())
+			RehashStep();
+		else if (counter >= table.n_buckets) {
+			old_table = std::move(table);
+			table.Allocate(old_table.n_buckets * 2);
+			rehash_position = 0;
+			RehashStep();
+		}
+	}
+
+	void Insert(T &item, std::size_t item_hash) noexcept {
+		Grow();
+
+		auto &h = ToHook(item);
+		h.hash = item_hash;
+		h.Link(table.GetBucket(item_hash));
+		++counter;
+	}
+
+	template<typename K>
+	[[gnu::pure]]
+	iterator Find(const K &key, std::size_t key_hash) const noexcept {
+		Hook *result = nullptr;
+		ForEachBucket(key_hash, [&](Hook *bucket){
+			if (result == nullptr)
+				result = FindInBucket(bucket, key_hash, key);
+		});
+		return iterator{result};
+	}
+
+	void RehashStep() noexcept {
+		assert(is_rehashing());
+
+		const std::size_t end = std::min(rehash_position + REHASH_STEP,
+						 old_table.n_buckets);
+
+		for (; rehash_position < end; ++rehash_position) {
+			auto &bucket = old_table.buckets[rehash_position];
+			while (bucket != nullptr) {
+				Hook *h = bucket;
+				h->Unlink();
+				h->Link(table.GetBucket(h->hash));
+			}
+		}
+
+		if (rehash_position == old_table.n_buckets)
+			old_table.Free();
+	}
+
+	/**
+	 * Invoke the given function for each bucket which may
+	 * contain items with the given hash.
+	 */
+	template<typename F>
+	void ForEachBucket(std::size_t h, F &&f) const noexcept {
+		if (!table.IsDefined())
+			return;
+
+		if (is_rehashing()) {
+			const std::size_t i = old_table.IndexOf(h);
+			if (i >= rehash_position)
+				f(old_table.buckets[i]);
+		}
+
+		f(table.GetBucket(h));
+	}
+
+	template<typename F>
+	void ForEachBucket(F &&f) const noexcept {
+		if (is_rehashing())
+			for (std::size_t i = rehash_position; i < old_table.n_buckets; ++i)
+				f(old_table.buckets[i]);
+
+		for (std::size_t i = 0; i < table.n_buckets; ++i)
+			f(table.buckets[i]);
+	}
+
+	template<typename K>
+	[[gnu::pure]]
+	Hook *FindInBucket(Hook *bucket, std::size_t key_hash,
+			   const K &key) const noexcept {
+		for (Hook *i = bucket; i != nullptr; i = i->next)
+			if (i->hash == key_hash &&
+			    equal(key, std::as_const(*HookTraits::Cast(i))))
+				return i;
+
+		return nullptr;
+	}
+
+	template<typename P, typename D>
+	std::size_t RemoveAndDisposeIf(Hook *&bucket, P &&pred,
+				       D &&disposer) noexcept {
+		std::size_t n = 0;
+		for (Hook *i = bucket, *next; i != nullptr; i = next) {
+			next = i->next;
+
+			T &item = *HookTraits::Cast(i);
+			if (pred(item)) {
+				i->Unlink();
+				--counter;
+				++n;
+				disposer(&item);
+			}
+		}
+
+		return n;
+	}
+
+	template<typename D>
+	static void ClearAndDispose(Table &t, D &&disposer) noexcept {
+		for (std::size_t i = 0; i < t.n_buckets; ++i) {
+			auto &bucket = t.buckets[i];
+			while (bucket != nullptr) {
+				Hook *h = bucket;
+				h->Unlink();
+				disposer(HookTraits::Cast(h));
+			}
+		}
+	}
+};
@@ -8,6 +8,7 @@
 #include "Output.hxx"
 #include "Input.hxx"
 #include "Lease.hxx"
+#include "ShmChannel.hxx"
 #include "was/async/Control.hxx"
 #include "was/async/Error.hxx"
 #include "http/ResponseHandler.hxx"
@@ -49,6 +50,12 @@ class WasClient final
 
 	WasLease &lease;
 
+	/**
+	 * The shared-memory data channel to the WAS child process
+	 * (optional).
+	 */
+	WasShmChannel *const shm;
+
 	Was::Control control;
 
 	WasMetricsHandler *const metrics_handler;
@@ -66,9 +73,12 @@ class WasClient final
 	FineTimerEvent submit_response_timer;
 
 	struct Request {
-		WasOutput *body;
+		WasOutput *body = nullptr;
 
-		explicit Request(WasOutput *_body) noexcept:body(_body) {}
+		/**
+		 * Is the #body being sent over the shared-memory ring?
+		 */
+		bool shm = false;
 
 		void ClearBody() noexcept {
 			if (body != nullptr)
@@ -139,6 +149,7 @@ public:
 		  StopwatchPtr &&_stopwatch,
 		  SocketDescriptor control_fd,
 		  FileDescriptor input_fd, FileDescriptor output_fd,
+		  WasShmChannel *_shm,
 		  WasLease &_lease,
 		  HttpMethod method, UnusedIstreamPtr body,
 		  WasMetricsHandler *_metrics_handler,
@@ -619,6 +630,20 @@ WasClient::OnWasControlPacket(enum was_command cmd,
 			return false;
 		}
 
+		if (!payload.empty()) {
+			/* the body is sent over the shared-memory
+			   ring */
+			if (shm == nullptr ||
+			    ToStringView(payload) != WAS_SHM_DATA_PAYLOAD) {
+				stopwatch.RecordEvent("control_error");
+				AbortResponseHeaders(std::make_exception_ptr(WasProtocolError("malformed DATA")));
+				return false;
+			}
+
+			was_input_use_ring(*response.body,
+					   shm->GetResponseRing());
+		}
+
 		response.pending = true;
 		break;
 
@@ -868,6 +893,7 @@ WasClient::WasClient(struct pool &_pool, struct pool &_caller_pool,
 		     StopwatchPtr &&_stopwatch,
 		     SocketDescriptor control_fd,
 		     FileDescriptor input_fd, FileDescriptor output_fd,
+		     WasShmChannel *_shm,
 		     WasLease &_lease,
 		     HttpMethod method, UnusedIstreamPtr body,
 		     WasMetricsHandler *_metrics_handler,
@@ -877,19 +903,28 @@ WasClient::WasClient(struct pool &_pool, struct pool &_caller_pool,
 	 alloc(_pool), caller_pool(_caller_pool),
 	 stopwatch(std::move(_stopwatch)),
 	 lease(_lease),
+	 shm(_shm),
 	 control(event_loop, control_fd, *this),
 	 metrics_handler(_metrics_handler),
 	 handler(_handler),
 	 submit_response_timer(event_loop,
 			       BIND_THIS_METHOD(OnSubmitResponseTimer)),
-	 request(body
-		 ? was_output_new(_pool, event_loop, output_fd,
-				  std::move(body), *this)
-		 : nullptr),
 	 response(http_method_is_empty(method)
 		  ? nullptr
 		  : was_input_new(_pool, event_loop, input_fd, *this))
 {
+	if (body) {
+		/* use the shared-memory ring only if the child
+		   process has attached to it */
+		request.shm = shm != nullptr && shm->IsAttached();
+		request.body = request.shm
+			? was_output_new(_pool, event_loop,
+					 shm->GetRequestRing(),
+					 std::move(body), *this)
+			: was_output_new(_pool, event_loop, output_fd,
+					 std::move(body), *this);
+	}
+
 	cancel_ptr = *this;
 }
 
@@ -901,6 +936,7 @@ SendRequest(Was::Control &control,
 	    const char *script_name, const char *path_info,
 	    const char *query_string,
 	    const StringMap &headers, WasOutput *request_body,
+	    bool request_body_shm,
 	    std::span<const char *const> params)
 {
 	const uint32_t method32 = (uint32_t)method;
@@ -920,9 +956,13 @@ SendRequest(Was::Control &control,
 		control.SendArray(WAS_COMMAND_PARAMETER, params) &&
 		(remote_host == nullptr ||
 		 control.SendString(WAS_COMMAND_REMOTE_HOST, remote_host)) &&
-		control.SendEmpty(request_body != nullptr
-				  ? WAS_COMMAND_DATA
-				  : WAS_COMMAND_NO_DATA) &&
+		(request_body == nullptr
+		 ? control.SendEmpty(WAS_COMMAND_NO_DATA)
+		 : (request_body_shm
+		    ? control.Send(WAS_COMMAND_DATA,
+				   WAS_SHM_DATA_PAYLOAD.data(),
+				   WAS_SHM_DATA_PAYLOAD.size())
+		    : control.SendEmpty(WAS_COMMAND_DATA))) &&
 		(request_body == nullptr || was_output_check_length(*request_body));
 }
 
@@ -937,7 +977,8 @@ WasClient::SendRequest(const char *remote_host,
 	::SendRequest(control, metrics_handler != nullptr,
 		      remote_host,
 		      method, uri, script_name, path_info,
-		      query_string, headers, request.body,
+		      query_string, headers,
+		      request.body, request.shm,
 		      params);
 }
 
@@ -946,6 +987,7 @@ was_client_request(struct pool &caller_pool, EventLoop &event_loop,
 		   StopwatchPtr stopwatch,
 		   SocketDescriptor control_fd,
 		   FileDescriptor input_fd, FileDescriptor output_fd,
+		   WasShmChannel *shm,
 		   WasLease &lease,
 		   const char *remote_host,
 		   HttpMethod method, const char *uri,
@@ -963,6 +1005,7 @@ was_client_request(struct pool &caller_pool, EventLoop &event_loop,
 	auto client = NewFromPool<WasClient>(caller_pool, caller_pool, caller_pool,
 					     event_loop, std::move(stopwatch),
 					     control_fd, input_fd, output_fd,
+					     shm,
 					     lease, method, std::move(body),
 					     metrics_handler,
 					     handler, cancel_ptr);
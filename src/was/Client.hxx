@@ -14,6 +14,7 @@ class FileDescriptor;
 class SocketDescriptor;
 class EventLoop;
 class UnusedIstreamPtr;
+class WasShmChannel;
 class WasLease;
 class StringMap;
 class WasMetricsHandler;
@@ -31,6 +32,8 @@ class CancellablePointer;
  * @param control_fd a control socket to the WAS server
  * @param input_fd a data pipe for the response body
  * @param output_fd a data pipe for the request body
+ * @param shm an optional shared-memory data channel which is used
+ * instead of the pipes if the WAS server has attached to it
  * @param lease the lease for both sockets
  * @param method the HTTP request method
  * @param uri the request URI path
@@ -50,6 +53,7 @@ was_client_request(struct pool &pool, EventLoop &event_loop,
 		   StopwatchPtr stopwatch,
 		   SocketDescriptor control_fd,
 		   FileDescriptor input_fd, FileDescriptor output_fd,
+		   WasShmChannel *shm,
 		   WasLease &lease,
 		   const char *remote_host,
 		   HttpMethod method, const char *uri,
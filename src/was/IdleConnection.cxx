@@ -57,6 +57,17 @@ WasIdleConnection::DiscardControl(size_t size)
 inline void
 WasIdleConnection::DiscardInput(uint64_t remaining)
 {
+	if (shm != nullptr && shm->GetResponseRing().IsInUse()) {
+		/* everything the peer has sent is in the ring
+		   already */
+		auto &ring = shm->GetResponseRing();
+		if (!ring.Discard(remaining))
+			throw std::runtime_error("Bogus PREMATURE payload");
+
+		ring.SetInUse(false);
+		return;
+	}
+
 	while (remaining > 0) {
 		uint8_t buffer[16384];
 		size_t size = std::min(remaining, uint64_t(sizeof(buffer)));
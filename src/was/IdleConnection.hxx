@@ -4,10 +4,12 @@
 
 #pragma once
 
+#include "ShmChannel.hxx"
 #include "was/async/Socket.hxx"
 #include "event/SocketEvent.hxx"
 
 #include <exception>
+#include <memory>
 #include <utility>
 
 /**
@@ -27,6 +29,12 @@ public:
 class WasIdleConnection {
 	WasSocket socket;
 
+	/**
+	 * The optional shared-memory data channel to the WAS child
+	 * process.
+	 */
+	std::unique_ptr<WasShmChannel> shm;
+
 	SocketEvent event;
 
 	WasIdleConnectionHandler &handler;
@@ -50,8 +58,10 @@ public:
 		return event.GetEventLoop();
 	}
 
-	void Open(WasSocket &&_socket) noexcept {
+	void Open(WasSocket &&_socket,
+		  std::unique_ptr<WasShmChannel> &&_shm={}) noexcept {
 		socket = std::move(_socket);
+		shm = std::move(_shm);
 		event.Open(socket.control);
 	}
 
@@ -59,6 +69,10 @@ public:
 		return socket;
 	}
 
+	WasShmChannel *GetShm() const noexcept {
+		return shm.get();
+	}
+
 	void Stop(uint64_t _received) noexcept {
 		assert(!stopping);
 
@@ -105,7 +119,9 @@ private:
 	void DiscardControl(size_t size);
 
 	/**
-	 * Discard the given amount of data from the input pipe.
+	 * Discard the given amount of data from the input pipe (or
+	 * from the shared-memory ring if the response body was
+	 * received over it).
 	 *
 	 * Throws on error.
 	 */
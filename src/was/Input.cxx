@@ -3,6 +3,7 @@
 // author: Max Kellermann <mk@cm4all.com>
 
 #include "Input.hxx"
+#include "ShmChannel.hxx"
 #include "was/async/Error.hxx"
 #include "event/PipeEvent.hxx"
 #include "event/DeferEvent.hxx"
@@ -33,6 +34,18 @@ class WasInput final : Istream {
 
 	SliceFifoBuffer buffer;
 
+	/**
+	 * If set, then the body is received over this shared-memory
+	 * ring instead of the pipe, and #event monitors its data
+	 * eventfd.  Data is passed to the #IstreamHandler right from
+	 * the ring, and #buffer is unused.
+	 */
+	WasShmRing *ring = nullptr;
+
+	/**
+	 * The number of bytes received from the pipe; in ring mode,
+	 * the number of bytes consumed from the ring.
+	 */
 	uint64_t received = 0, length;
 
 	bool direct = false;
@@ -74,6 +87,20 @@ public:
 		defer_read.Cancel();
 	}
 
+	void UseRing(WasShmRing &_ring) noexcept {
+		assert(!enabled);
+		assert(ring == nullptr);
+		assert(received == 0);
+		assert(!buffer.IsDefined());
+
+		event.Cancel();
+		event.ReleaseFileDescriptor();
+		event.Open(_ring.GetDataEvent());
+
+		ring = &_ring;
+		ring->SetInUse(true);
+	}
+
 	bool SetLength(uint64_t _length) noexcept;
 	void PrematureThrow(uint64_t _length);
 	void Premature(uint64_t _length) noexcept;
@@ -101,6 +128,11 @@ private:
 		event.Cancel();
 		event.ReleaseFileDescriptor();
 
+		if (ring != nullptr)
+			/* everything has been consumed from the ring; it
+			   may be used by the next request */
+			ring->SetInUse(false);
+
 		return handler.WasInputRelease();
 	}
 
@@ -181,6 +213,93 @@ private:
 		return true;
 	}
 
+	/**
+	 * Returns the data in the ring which belongs to this body.
+	 *
+	 * Throws #WasProtocolError if the peer has corrupted the
+	 * ring.
+	 */
+	std::span<const std::byte> ReadRing() const {
+		assert(ring != nullptr);
+
+		auto r = ring->Read();
+		if (known_length && r.size() > length - received)
+			r = r.first(length - received);
+		return r;
+	}
+
+	/**
+	 * Like ReadRing(), but return only the amount of data which
+	 * was seen by the most recent ReadRing() call.
+	 */
+	std::size_t GetRingAvailable() const noexcept {
+		assert(ring != nullptr);
+
+		std::size_t n = ring->GetAvailable();
+		if (known_length && n > length - received)
+			n = length - received;
+		return n;
+	}
+
+	/**
+	 * Consume data from the shared-memory ring.  The pipe (i.e.
+	 * the ring) is released only after everything has been
+	 * consumed, because the next request's body will be appended
+	 * to the same ring.
+	 *
+	 * @return false if the handler blocks or if this object has been
+	 * destroyed
+	 */
+	bool SubmitRing() noexcept {
+		std::span<const std::byte> r;
+		try {
+			r = ReadRing();
+		} catch (...) {
+			AbortError(std::current_exception());
+			return false;
+		}
+
+		if (!r.empty()) {
+			std::size_t nbytes = InvokeData(r);
+			if (nbytes == 0)
+				return false;
+
+			ring->Consume(nbytes);
+			received += nbytes;
+
+			if (nbytes < r.size())
+				return false;
+		}
+
+		if (HasPipe() && !CheckReleasePipe())
+			return false;
+
+		if (CheckEof())
+			return false;
+
+		return true;
+	}
+
+	void TryRing() noexcept {
+		if (!SubmitRing())
+			return;
+
+		/* the ring is empty: wait for the doorbell */
+		bool wait;
+		try {
+			wait = ring->WaitForData();
+		} catch (...) {
+			AbortError(std::current_exception());
+			return;
+		}
+
+		if (wait)
+			ScheduleRead();
+		else
+			/* data has arrived meanwhile */
+			defer_read.Schedule();
+	}
+
 	/*
 	 * socket i/o
 	 *
@@ -195,7 +314,9 @@ private:
 	bool TryDirect() noexcept;
 
 	void TryRead() noexcept {
-		if (direct) {
+		if (ring != nullptr) {
+			TryRing();
+		} else if (direct) {
 			if (SubmitBuffer() && buffer.empty())
 				TryDirect();
 		} else {
@@ -216,13 +337,17 @@ private:
 		if (known_length)
 			return length - received + buffer.GetAvailable();
 		else if (partial)
-			return buffer.GetAvailable();
+			return ring != nullptr
+				? GetRingAvailable()
+				: buffer.GetAvailable();
 		else
 			return -1;
 	}
 
 	void _Read() noexcept override {
-		if (SubmitBuffer())
+		if (ring != nullptr)
+			TryRing();
+		else if (SubmitBuffer())
 			TryRead();
 	}
 
@@ -231,6 +356,13 @@ private:
 	void _ConsumeDirect(std::size_t nbytes) noexcept override;
 
 	void _Close() noexcept override {
+		if (ring != nullptr && HasPipe() && CanRelease() &&
+		    !ReleasePipe())
+			/* everything has been consumed; release the ring
+			   now, or else the #WasInputHandler would have to
+			   stop the peer */
+			return;
+
 		buffer.FreeIfDefined();
 		event.Cancel();
 
@@ -365,6 +497,9 @@ WasInput::EventCallback(unsigned) noexcept
 {
 	assert(HasPipe());
 
+	if (ring != nullptr)
+		WasShmRing::ClearEvent(GetPipe());
+
 	TryRead();
 }
 
@@ -391,6 +526,16 @@ was_input_new(struct pool &pool, EventLoop &event_loop, FileDescriptor fd,
 				     handler);
 }
 
+WasInput *
+was_input_new(struct pool &pool, EventLoop &event_loop, WasShmRing &ring,
+	      WasInputHandler &handler) noexcept
+{
+	auto *input = was_input_new(pool, event_loop, ring.GetDataEvent(),
+				    handler);
+	input->UseRing(ring);
+	return input;
+}
+
 inline void
 WasInput::Free(std::exception_ptr ep) noexcept
 {
@@ -417,6 +562,12 @@ was_input_free_unused(WasInput *input) noexcept
 	input->DestroyUnused();
 }
 
+void
+was_input_use_ring(WasInput &input, WasShmRing &ring) noexcept
+{
+	input.UseRing(ring);
+}
+
 UnusedIstreamPtr
 was_input_enable(WasInput &input) noexcept
 {
@@ -480,6 +631,17 @@ WasInput::PrematureThrow(uint64_t _length)
 
 	uint64_t remaining = _length - received;
 
+	if (ring != nullptr) {
+		/* the peer has appended everything to the ring
+		   already */
+		if (!ring->Discard(remaining))
+			throw WasProtocolError("announced premature length is too large");
+
+		received = _length;
+		ring->SetInUse(false);
+		return;
+	}
+
 	while (remaining > 0) {
 		uint8_t discard_buffer[4096];
 		std::size_t size = std::min(remaining, uint64_t(sizeof(discard_buffer)));
@@ -542,6 +704,41 @@ was_input_premature_throw(WasInput *input, uint64_t length)
 void
 WasInput::_FillBucketList(IstreamBucketList &list)
 {
+	if (ring != nullptr) {
+		if (!HasPipe())
+			return;
+
+		std::span<const std::byte> r;
+		try {
+			r = ReadRing();
+		} catch (...) {
+			handler.WasInputError();
+			Destroy();
+			throw;
+		}
+
+		if (r.empty() && CanRelease()) {
+			/* everything has been consumed; release the
+			   ring before reporting the end of the body */
+			if (!ReleasePipe()) {
+				handler.WasInputError();
+				Destroy();
+				throw std::runtime_error("WAS peer failed");
+			}
+
+			return;
+		}
+
+		if (!r.empty())
+			list.Push(r);
+
+		/* always announce more data, even if this is the
+		   rest: end-of-file can only be reported after
+		   ReleasePipe() */
+		list.SetMore();
+		return;
+	}
+
 	auto r = buffer.Read();
 	if (r.empty()) {
 		if (!HasPipe())
@@ -585,6 +782,13 @@ WasInput::_FillBucketList(IstreamBucketList &list)
 std::size_t
 WasInput::_ConsumeBucketList(std::size_t nbytes) noexcept
 {
+	if (ring != nullptr) {
+		const std::size_t consumed = std::min(GetRingAvailable(), nbytes);
+		ring->Consume(consumed);
+		received += consumed;
+		return Consumed(consumed);
+	}
+
 	std::size_t consumed = std::min(buffer.GetAvailable(), nbytes);
 
 	buffer.Consume(consumed);
@@ -13,6 +13,7 @@ class FileDescriptor;
 class EventLoop;
 class UnusedIstreamPtr;
 class WasInput;
+class WasShmRing;
 
 class WasInputHandler {
 public:
@@ -65,6 +66,23 @@ WasInput *
 was_input_new(struct pool &pool, EventLoop &event_loop, FileDescriptor fd,
 	      WasInputHandler &handler) noexcept;
 
+/**
+ * Like was_input_new(), but receive the body over a shared-memory
+ * ring (see #WasShmChannel) instead of a pipe.
+ */
+WasInput *
+was_input_new(struct pool &pool, EventLoop &event_loop, WasShmRing &ring,
+	      WasInputHandler &handler) noexcept;
+
+/**
+ * Switch to receiving the body over a shared-memory ring instead of
+ * the pipe.  This must be called before any data has been received,
+ * i.e. right after the peer has announced it with
+ * #WAS_COMMAND_DATA.
+ */
+void
+was_input_use_ring(WasInput &input, WasShmRing &ring) noexcept;
+
 /**
  * @param error the error reported to the istream handler
  */
@@ -40,7 +40,8 @@ was_launch(SpawnService &spawn_service,
 	   const char *executable_path,
 	   std::span<const char *const> args,
 	   const ChildOptions &options,
-	   UniqueFileDescriptor stderr_fd)
+	   UniqueFileDescriptor stderr_fd,
+	   std::size_t shm_capacity)
 {
 	auto s = WasSocket::CreatePair();
 
@@ -48,6 +49,20 @@ was_launch(SpawnService &spawn_service,
 	process.input.SetNonBlocking();
 	process.output.SetNonBlocking();
 
+	if (shm_capacity > 0) {
+		/* the handshake is queued on the control socket
+		   before the child starts, so it is the first packet
+		   the child sees */
+		try {
+			process.shm = WasShmChannel::Create(shm_capacity);
+			process.shm->SendHandshake(process.control);
+		} catch (...) {
+			/* the shared-memory channel is optional; fall
+			   back to the pipes */
+			process.shm.reset();
+		}
+	}
+
 	process.handle = WasLaunch(spawn_service, name, executable_path, args,
 				   options, std::move(stderr_fd),
 				   std::move(s.second));
@@ -4,9 +4,11 @@
 
 #pragma once
 
+#include "ShmChannel.hxx"
 #include "was/async/Socket.hxx"
 #include "spawn/ProcessHandle.hxx"
 
+#include <cstddef>
 #include <memory>
 #include <span>
 
@@ -17,6 +19,13 @@ struct ChildOptions;
 struct WasProcess : WasSocket {
 	std::unique_ptr<ChildProcessHandle> handle;
 
+	/**
+	 * The shared-memory data channel offered to the child
+	 * process (if enabled).  It may be used only after the child
+	 * has attached to it (see WasShmChannel::IsAttached()).
+	 */
+	std::unique_ptr<WasShmChannel> shm;
+
 	WasProcess() = default;
 
 	explicit WasProcess(WasSocket &&_socket) noexcept
@@ -27,6 +36,10 @@ struct WasProcess : WasSocket {
  * Launch WAS child processes.
  *
  * Throws std::runtime_error on error.
+ *
+ * @param shm_capacity if non-zero, then offer a shared-memory data
+ * channel with rings of this size to the child process (see
+ * #WasShmChannel)
  */
 WasProcess
 was_launch(SpawnService &spawn_service,
@@ -34,4 +47,5 @@ was_launch(SpawnService &spawn_service,
 	   const char *executable_path,
 	   std::span<const char *const> args,
 	   const ChildOptions &options,
-	   UniqueFileDescriptor stderr_fd);
+	   UniqueFileDescriptor stderr_fd,
+	   std::size_t shm_capacity=0);
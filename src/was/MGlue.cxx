@@ -142,6 +142,7 @@ MultiWasRequest::OnStockItemReady(StockItem &item) noexcept
 			   std::move(stopwatch),
 			   socket.control,
 			   socket.input, socket.output,
+			   connection->GetShm(),
 			   *this,
 			   remote_host,
 			   pending_request.method, pending_request.uri,
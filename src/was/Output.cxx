@@ -3,6 +3,7 @@
 // author: Max Kellermann <mk@cm4all.com>
 
 #include "Output.hxx"
+#include "ShmChannel.hxx"
 #include "was/async/Error.hxx"
 #include "event/PipeEvent.hxx"
 #include "event/DeferEvent.hxx"
@@ -22,6 +23,8 @@
 
 #include <was/protocol.h>
 
+#include <algorithm> // for std::copy_n()
+
 #include <sys/uio.h>
 #include <errno.h>
 #include <string.h>
@@ -36,6 +39,13 @@ class WasOutput final : PoolLeakDetector, IstreamSink, DestructAnchor {
 
 	WasOutputHandler &handler;
 
+	/**
+	 * If set, then the body is copied to this shared-memory ring
+	 * instead of being written to the pipe, and #event monitors
+	 * the ring's space eventfd.
+	 */
+	WasShmRing *const ring;
+
 	uint64_t sent = 0;
 
 	uint64_t total_length;
@@ -47,15 +57,19 @@ class WasOutput final : PoolLeakDetector, IstreamSink, DestructAnchor {
 public:
 	WasOutput(struct pool &pool, EventLoop &event_loop, FileDescriptor fd,
 		  UnusedIstreamPtr _input,
-		  WasOutputHandler &_handler) noexcept
+		  WasOutputHandler &_handler,
+		  WasShmRing *_ring=nullptr) noexcept
 		:PoolLeakDetector(pool),
 		 IstreamSink(std::move(_input)),
 		 event(event_loop, BIND_THIS_METHOD(WriteEventCallback), fd),
 		 defer_write(event_loop, BIND_THIS_METHOD(OnDeferredWrite)),
 		 timeout_event(event_loop, BIND_THIS_METHOD(OnTimeout)),
-		 handler(_handler)
+		 handler(_handler), ring(_ring)
 	{
-		input.SetDirect(ISTREAM_TO_PIPE);
+		/* splice() is only possible into the pipe; the ring is
+		   filled by copying from buffers */
+		if (ring == nullptr)
+			input.SetDirect(ISTREAM_TO_PIPE);
 
 		defer_write.Schedule();
 	}
@@ -110,10 +124,82 @@ private:
 	}
 
 	void ScheduleWrite() noexcept {
-		event.ScheduleWrite();
+		if (ring == nullptr) {
+			event.ScheduleWrite();
+		} else if (WaitForRingSpace()) {
+			event.ScheduleRead();
+		} else {
+			/* the ring has room (again) */
+			defer_write.Schedule();
+			return;
+		}
+
 		timeout_event.Schedule(was_output_timeout);
 	}
 
+	void CancelWrite() noexcept {
+		if (ring == nullptr)
+			event.CancelWrite();
+		else
+			event.CancelRead();
+	}
+
+	/**
+	 * Wrapper for WasShmRing::WaitForSpace() which does not
+	 * throw; if the peer has corrupted the ring, it returns
+	 * false, and the next WriteToRing() call reports the error.
+	 */
+	bool WaitForRingSpace() noexcept {
+		try {
+			return ring->WaitForSpace();
+		} catch (...) {
+			return false;
+		}
+	}
+
+	/**
+	 * Copy data to the ring.
+	 *
+	 * Throws #WasProtocolError if the peer has corrupted the
+	 * ring.
+	 *
+	 * @return the number of bytes copied
+	 */
+	std::size_t WriteToRing(std::span<const std::byte> src) {
+		assert(ring != nullptr);
+
+		const auto w = ring->Write();
+		const std::size_t nbytes = std::min(src.size(), w.size());
+		if (nbytes > 0) {
+			std::copy_n(src.begin(), nbytes, w.begin());
+			ring->Append(nbytes);
+		}
+
+		return nbytes;
+	}
+
+	/**
+	 * Copy buffers to the ring.
+	 *
+	 * Throws #WasProtocolError if the peer has corrupted the
+	 * ring.
+	 *
+	 * @return the number of bytes copied
+	 */
+	std::size_t WriteToRing(std::span<const struct iovec> v) {
+		std::size_t total = 0;
+
+		for (const auto &i : v) {
+			const std::span<const std::byte> src{(const std::byte *)i.iov_base, i.iov_len};
+			const std::size_t nbytes = WriteToRing(src);
+			total += nbytes;
+			if (nbytes < src.size())
+				break;
+		}
+
+		return total;
+	}
+
 	void WriteEventCallback(unsigned events) noexcept;
 	void OnDeferredWrite() noexcept;
 
@@ -159,6 +245,9 @@ WasOutput::WriteEventCallback(unsigned) noexcept
 
 	timeout_event.Cancel();
 
+	if (ring != nullptr)
+		WasShmRing::ClearEvent(GetPipe());
+
 	if (!CheckLength())
 		return;
 
@@ -170,7 +259,7 @@ WasOutput::WriteEventCallback(unsigned) noexcept
 	if (!destructed && !got_data)
 		/* the Istream is not ready for reading, so cancel our
 		   write event */
-		event.CancelWrite();
+		CancelWrite();
 }
 
 inline void
@@ -245,8 +334,22 @@ WasOutput::OnIstreamReady() noexcept
 
 	/* write this struct iovec array */
 
-	ssize_t nbytes = writev(GetPipe().Get(), v.data(), v.size());
-	if (nbytes < 0) {
+	ssize_t nbytes;
+	if (ring != nullptr) {
+		try {
+			nbytes = WriteToRing(v);
+		} catch (...) {
+			DestroyError(std::current_exception());
+			return false;
+		}
+	} else
+		nbytes = writev(GetPipe().Get(), v.data(), v.size());
+
+	if (nbytes == 0 && ring != nullptr) {
+		/* the ring is full */
+		ScheduleWrite();
+		return false;
+	} else if (nbytes < 0) {
 		int e = errno;
 		if (e == EAGAIN) {
 			ScheduleWrite();
@@ -281,7 +384,17 @@ WasOutput::OnData(const std::span<const std::byte> src) noexcept
 
 	got_data = true;
 
-	ssize_t nbytes = GetPipe().Write(src.data(), src.size());
+	ssize_t nbytes;
+	if (ring != nullptr) {
+		try {
+			nbytes = WriteToRing(src);
+		} catch (...) {
+			DestroyError(std::current_exception());
+			return 0;
+		}
+	} else
+		nbytes = GetPipe().Write(src.data(), src.size());
+
 	if (nbytes > 0) [[likely]] {
 		sent += nbytes;
 
@@ -291,6 +404,9 @@ WasOutput::OnData(const std::span<const std::byte> src) noexcept
 			return 0;
 		}
 
+		ScheduleWrite();
+	} else if (nbytes == 0 && ring != nullptr) {
+		/* the ring is full */
 		ScheduleWrite();
 	} else if (nbytes < 0) {
 		if (errno == EAGAIN) {
@@ -311,6 +427,7 @@ WasOutput::OnDirect(FdType, FileDescriptor source_fd,
 		    std::size_t max_length) noexcept
 {
 	assert(HasPipe());
+	assert(ring == nullptr);
 	assert(!IsEof());
 
 	ssize_t nbytes = SpliceToPipe(source_fd,
@@ -388,6 +505,16 @@ was_output_new(struct pool &pool, EventLoop &event_loop,
 				      std::move(input), handler);
 }
 
+WasOutput *
+was_output_new(struct pool &pool, EventLoop &event_loop,
+	       WasShmRing &ring, UnusedIstreamPtr input,
+	       WasOutputHandler &handler) noexcept
+{
+	return NewFromPool<WasOutput>(pool, pool, event_loop,
+				      ring.GetSpaceEvent(),
+				      std::move(input), handler, &ring);
+}
+
 uint64_t
 was_output_free(WasOutput *output) noexcept
 {
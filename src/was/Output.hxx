@@ -13,6 +13,7 @@ class EventLoop;
 class FileDescriptor;
 class UnusedIstreamPtr;
 class WasOutput;
+class WasShmRing;
 
 class WasOutputHandler {
 public:
@@ -49,7 +50,17 @@ was_output_new(struct pool &pool, EventLoop &event_loop,
 	       WasOutputHandler &handler) noexcept;
 
 /**
- * @return the total number of bytes written to the pipe
+ * Like was_output_new(), but send the body over a shared-memory ring
+ * (see #WasShmChannel) instead of a pipe.
+ */
+WasOutput *
+was_output_new(struct pool &pool, EventLoop &event_loop,
+	       WasShmRing &ring, UnusedIstreamPtr input,
+	       WasOutputHandler &handler) noexcept;
+
+/**
+ * @return the total number of bytes written to the pipe (or to the
+ * shared-memory ring)
  */
 uint64_t
 was_output_free(WasOutput *data) noexcept;
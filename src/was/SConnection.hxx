@@ -32,6 +32,10 @@ public:
 		return connection.GetSocket();
 	}
 
+	WasShmChannel *GetShm() const noexcept {
+		return connection.GetShm();
+	}
+
 	/**
 	 * Set the "stopping" flag.  Call this after sending
 	 * #WAS_COMMAND_STOP, before calling hstock_put().  This will
@@ -43,8 +47,9 @@ public:
 	virtual void SetUri([[maybe_unused]] const char *uri) noexcept {}
 
 protected:
-	void Open(WasSocket &&_socket) noexcept {
-		connection.Open(std::move(_socket));
+	void Open(WasSocket &&_socket,
+		  std::unique_ptr<WasShmChannel> &&_shm={}) noexcept {
+		connection.Open(std::move(_socket), std::move(_shm));
 	}
 
 	/* virtual methods from class StockItem */
@@ -31,6 +31,13 @@ WasServer::WasServer(struct pool &_pool, EventLoop &event_loop,
 	assert(socket.control.IsDefined());
 	assert(socket.input.IsDefined());
 	assert(socket.output.IsDefined());
+
+	try {
+		shm = WasShmChannel::ReceiveHandshake(socket.control);
+	} catch (...) {
+		/* the shared-memory channel is optional; without
+		   attaching to it, the client keeps using the pipes */
+	}
 }
 
 void
@@ -333,8 +340,20 @@ WasServer::OnWasControlPacket(enum was_command cmd,
 			return false;
 		}
 
-		request.body = was_input_new(*request.pool, control.GetEventLoop(),
-					     socket.input, *this);
+		if (payload.empty())
+			request.body = was_input_new(*request.pool,
+						     control.GetEventLoop(),
+						     socket.input, *this);
+		else if (shm != nullptr &&
+			 ToStringView(payload) == WAS_SHM_DATA_PAYLOAD)
+			request.body = was_input_new(*request.pool,
+						     control.GetEventLoop(),
+						     shm->GetRequestRing(), *this);
+		else {
+			AbortProtocolError("malformed DATA packet");
+			return false;
+		}
+
 		request.state = Request::State::PENDING;
 		break;
 
@@ -446,7 +465,17 @@ WasServer::SendResponse(HttpStatus status,
 
 	Was::SendMap(control, WAS_COMMAND_HEADER, headers);
 
-	if (body) {
+	if (body && shm != nullptr) {
+		response.body = was_output_new(*request.pool,
+					       control.GetEventLoop(),
+					       shm->GetResponseRing(),
+					       std::move(body), *this);
+		if (!control.Send(WAS_COMMAND_DATA,
+				  WAS_SHM_DATA_PAYLOAD.data(),
+				  WAS_SHM_DATA_PAYLOAD.size()) ||
+		    !was_output_check_length(*response.body))
+			return;
+	} else if (body) {
 		response.body = was_output_new(*request.pool,
 					       control.GetEventLoop(),
 					       socket.output, std::move(body),
@@ -6,11 +6,14 @@
 
 #include "Output.hxx"
 #include "Input.hxx"
+#include "ShmChannel.hxx"
 #include "was/async/Control.hxx"
 #include "was/async/Socket.hxx"
 #include "pool/Ptr.hxx"
 #include "util/StringBuffer.hxx"
 
+#include <memory>
+
 enum class HttpMethod : uint_least8_t;
 enum class HttpStatus : uint_least16_t;
 class EventLoop;
@@ -31,6 +34,13 @@ class WasServer final : Was::ControlHandler, WasOutputHandler, WasInputHandler {
 
 	WasSocket socket;
 
+	/**
+	 * The shared-memory data channel offered by the client (see
+	 * #WasShmChannel); if set, all bodies are sent and received
+	 * over it.
+	 */
+	std::unique_ptr<WasShmChannel> shm;
+
 	Was::Control control;
 
 	WasServerHandler &handler;
@@ -95,6 +105,10 @@ public:
 	 * @param _input_fd a data pipe for the request body
 	 * @param _output_fd a data pipe for the response body
 	 * @param _handler a callback function which receives events
+	 *
+	 * If the client has offered a shared-memory data channel
+	 * (#WasShmChannel), it is received from the control socket
+	 * here.
 	 */
 	WasServer(struct pool &_pool, EventLoop &event_loop,
 		  WasSocket &&_socket,
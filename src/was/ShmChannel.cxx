@@ -0,0 +1,412 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#include "ShmChannel.hxx"
+#include "was/async/Error.hxx"
+#include "net/SocketDescriptor.hxx"
+#include "system/Error.hxx"
+
+#include <was/protocol.h>
+
+#include <algorithm> // for std::max()
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Identifies the handshake packet and the memfd contents.
+ */
+static constexpr uint32_t WAS_SHM_MAGIC = 0x77617331; // "was1"
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+struct WasShmRingHeader {
+	/**
+	 * The total number of bytes ever appended.  Modified only by
+	 * the producer, and never read back by it (see
+	 * WasShmRing::position).  The producer's and the consumer's
+	 * fields are on different cache lines.
+	 */
+	alignas(64) std::atomic<uint64_t> write_position{0};
+
+	/**
+	 * Set by the producer before it waits for #space_event.
+	 */
+	std::atomic<uint32_t> producer_waiting{0};
+
+	/**
+	 * The total number of bytes ever consumed.  Modified only by
+	 * the consumer, and never read back by it.
+	 */
+	alignas(64) std::atomic<uint64_t> read_position{0};
+
+	/**
+	 * Set by the consumer before it waits for #data_event.
+	 */
+	std::atomic<uint32_t> consumer_waiting{0};
+};
+
+struct WasShmChannelHeader {
+	uint32_t magic = WAS_SHM_MAGIC;
+
+	/**
+	 * Set by the WAS child process after it has received the
+	 * handshake.
+	 */
+	std::atomic<uint32_t> attached{0};
+
+	/**
+	 * The size of each ring.
+	 */
+	uint64_t capacity;
+
+	WasShmRingHeader request, response;
+
+	explicit WasShmChannelHeader(uint64_t _capacity) noexcept
+		:capacity(_capacity) {}
+};
+
+static void
+SignalEvent(FileDescriptor fd) noexcept
+{
+	const uint64_t value = 1;
+	(void)fd.Write(&value, sizeof(value));
+}
+
+void
+WasShmRing::ClearEvent(FileDescriptor fd) noexcept
+{
+	uint64_t value;
+	(void)fd.Read(&value, sizeof(value));
+}
+
+/**
+ * Check the positions of a ring, one of which has been loaded from
+ * shared memory and may have been modified arbitrarily by the peer.
+ *
+ * Throws #WasProtocolError if the amount of data in the ring would
+ * be negative or larger than its capacity.
+ */
+static void
+CheckPositions(uint64_t w, uint64_t r, std::size_t capacity)
+{
+	if (w < r || w - r > capacity)
+		throw WasProtocolError("Malformed WAS shared memory ring position");
+}
+
+std::span<std::byte>
+WasShmRing::Write()
+{
+	const uint64_t r = header->read_position.load(std::memory_order_acquire);
+	CheckPositions(position, r, capacity);
+	peer_position = r;
+
+	return {data + position % capacity, capacity - std::size_t(position - r)};
+}
+
+void
+WasShmRing::Append(std::size_t nbytes) noexcept
+{
+	assert(nbytes <= capacity - std::size_t(position - peer_position));
+
+	position += nbytes;
+	header->write_position.store(position, std::memory_order_seq_cst);
+
+	if (header->consumer_waiting.exchange(0, std::memory_order_seq_cst))
+		SignalEvent(data_event);
+}
+
+bool
+WasShmRing::WaitForSpace()
+{
+	header->producer_waiting.store(1, std::memory_order_seq_cst);
+
+	/* check again after setting the flag, because the consumer
+	   may have freed space before it could see the flag */
+	const uint64_t r = header->read_position.load(std::memory_order_seq_cst);
+	CheckPositions(position, r, capacity);
+	peer_position = r;
+
+	if (position - r < capacity) {
+		header->producer_waiting.store(0, std::memory_order_relaxed);
+		return false;
+	}
+
+	return true;
+}
+
+std::span<const std::byte>
+WasShmRing::Read()
+{
+	const uint64_t w = header->write_position.load(std::memory_order_acquire);
+	CheckPositions(w, position, capacity);
+	peer_position = w;
+
+	return {data + position % capacity, std::size_t(w - position)};
+}
+
+void
+WasShmRing::Consume(std::size_t nbytes) noexcept
+{
+	assert(nbytes <= GetAvailable());
+
+	position += nbytes;
+	header->read_position.store(position, std::memory_order_seq_cst);
+
+	if (header->producer_waiting.exchange(0, std::memory_order_seq_cst))
+		SignalEvent(space_event);
+}
+
+bool
+WasShmRing::Discard(std::size_t nbytes)
+{
+	if (Read().size() < nbytes)
+		return false;
+
+	Consume(nbytes);
+	return true;
+}
+
+bool
+WasShmRing::WaitForData()
+{
+	header->consumer_waiting.store(1, std::memory_order_seq_cst);
+
+	/* check again after setting the flag, because the producer
+	   may have appended data before it could see the flag */
+	const uint64_t w = header->write_position.load(std::memory_order_seq_cst);
+	CheckPositions(w, position, capacity);
+	peer_position = w;
+
+	if (w != position) {
+		header->consumer_waiting.store(0, std::memory_order_relaxed);
+		return false;
+	}
+
+	return true;
+}
+
+WasShmChannel::~WasShmChannel() noexcept
+{
+	if (address != nullptr)
+		munmap(address, mapping_size);
+}
+
+static std::size_t
+GetPageSize() noexcept
+{
+	return sysconf(_SC_PAGESIZE);
+}
+
+static void
+MapFixed(void *p, std::size_t size, FileDescriptor fd, off_t offset)
+{
+	if (mmap(p, size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FIXED,
+		 fd.Get(), offset) == MAP_FAILED)
+		throw MakeErrno("Failed to map WAS shared memory");
+}
+
+void
+WasShmChannel::Map(std::size_t capacity)
+{
+	const std::size_t page_size = GetPageSize();
+
+	/* reserve address space for the header page and for two
+	   mappings of each ring, then map the memfd over it */
+	mapping_size = page_size + 4 * capacity;
+	address = mmap(nullptr, mapping_size, PROT_NONE,
+		       MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (address == MAP_FAILED) {
+		address = nullptr;
+		throw MakeErrno("Failed to reserve address space for WAS shared memory");
+	}
+
+	auto *const base = (std::byte *)address;
+	MapFixed(base, page_size, memfd, 0);
+
+	std::array<std::byte *, 2> rings;
+	for (unsigned i = 0; i < rings.size(); ++i) {
+		rings[i] = base + page_size + i * 2 * capacity;
+		const off_t offset = page_size + i * capacity;
+		MapFixed(rings[i], capacity, memfd, offset);
+		MapFixed(rings[i] + capacity, capacity, memfd, offset);
+	}
+
+	header = (WasShmChannelHeader *)address;
+
+	request.Init(header->request, rings[0], capacity,
+		     events[0], events[1]);
+	response.Init(header->response, rings[1], capacity,
+		      events[2], events[3]);
+}
+
+std::unique_ptr<WasShmChannel>
+WasShmChannel::Create(std::size_t capacity)
+{
+	const std::size_t page_size = GetPageSize();
+	capacity = std::max((capacity + page_size - 1) & ~(page_size - 1),
+			    page_size);
+
+	std::unique_ptr<WasShmChannel> c{new WasShmChannel()};
+
+	c->memfd = UniqueFileDescriptor{memfd_create("was-shm", MFD_CLOEXEC)};
+	if (!c->memfd.IsDefined())
+		throw MakeErrno("memfd_create() failed");
+
+	if (ftruncate(c->memfd.Get(), page_size + 2 * capacity) < 0)
+		throw MakeErrno("Failed to resize WAS shared memory");
+
+	for (auto &i : c->events) {
+		i = UniqueFileDescriptor{eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC)};
+		if (!i.IsDefined())
+			throw MakeErrno("eventfd() failed");
+	}
+
+	c->Map(capacity);
+	new(c->header) WasShmChannelHeader(capacity);
+
+	return c;
+}
+
+/**
+ * The handshake packet: a #WAS_COMMAND_NOP with the magic as payload.
+ */
+struct WasShmHandshake {
+	struct was_header header;
+	uint32_t magic;
+};
+
+static_assert(sizeof(WasShmHandshake) == sizeof(struct was_header) + sizeof(uint32_t));
+
+void
+WasShmChannel::SendHandshake(SocketDescriptor control) const
+{
+	WasShmHandshake packet{};
+	packet.header.length = sizeof(packet.magic);
+	packet.header.command = WAS_COMMAND_NOP;
+	packet.magic = WAS_SHM_MAGIC;
+
+	const int fds[] = {
+		memfd.Get(),
+		events[0].Get(), events[1].Get(),
+		events[2].Get(), events[3].Get(),
+	};
+
+	alignas(struct cmsghdr) std::byte cmsg_buffer[CMSG_SPACE(sizeof(fds))]{};
+
+	struct iovec iov{&packet, sizeof(packet)};
+
+	struct msghdr m{};
+	m.msg_iov = &iov;
+	m.msg_iovlen = 1;
+	m.msg_control = cmsg_buffer;
+	m.msg_controllen = sizeof(cmsg_buffer);
+
+	auto *cmsg = CMSG_FIRSTHDR(&m);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	const auto nbytes = sendmsg(control.Get(), &m,
+				    MSG_DONTWAIT|MSG_NOSIGNAL);
+	if (nbytes < 0)
+		throw MakeErrno("Failed to send WAS shared memory handshake");
+
+	if (std::size_t(nbytes) != sizeof(packet))
+		throw std::runtime_error("Short send of WAS shared memory handshake");
+}
+
+std::unique_ptr<WasShmChannel>
+WasShmChannel::ReceiveHandshake(SocketDescriptor control)
+{
+	WasShmHandshake packet;
+
+	/* peek first, so anything else remains in the socket for
+	   the Was::Control */
+	auto nbytes = recv(control.Get(), &packet, sizeof(packet),
+			   MSG_PEEK|MSG_DONTWAIT);
+	if (nbytes != sizeof(packet) ||
+	    packet.header.command != WAS_COMMAND_NOP ||
+	    packet.header.length != sizeof(packet.magic) ||
+	    packet.magic != WAS_SHM_MAGIC)
+		return nullptr;
+
+	int fds[5];
+	alignas(struct cmsghdr) std::byte cmsg_buffer[CMSG_SPACE(sizeof(fds))];
+
+	struct iovec iov{&packet, sizeof(packet)};
+
+	struct msghdr m{};
+	m.msg_iov = &iov;
+	m.msg_iovlen = 1;
+	m.msg_control = cmsg_buffer;
+	m.msg_controllen = sizeof(cmsg_buffer);
+
+	nbytes = recvmsg(control.Get(), &m, MSG_DONTWAIT|MSG_CMSG_CLOEXEC);
+	if (nbytes < 0)
+		throw MakeErrno("Failed to receive WAS shared memory handshake");
+
+	std::unique_ptr<WasShmChannel> c{new WasShmChannel()};
+
+	std::size_t n_fds = 0;
+	for (auto *cmsg = CMSG_FIRSTHDR(&m); cmsg != nullptr;
+	     cmsg = CMSG_NXTHDR(&m, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET ||
+		    cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+
+		n_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		memcpy(fds, CMSG_DATA(cmsg), n_fds * sizeof(int));
+		break;
+	}
+
+	/* take ownership first, so all descriptors get closed on
+	   error */
+	for (std::size_t i = 0; i < n_fds; ++i) {
+		UniqueFileDescriptor fd{fds[i]};
+		if (i == 0)
+			c->memfd = std::move(fd);
+		else
+			c->events[i - 1] = std::move(fd);
+	}
+
+	if (n_fds != std::size(fds) || (m.msg_flags & MSG_CTRUNC) != 0)
+		throw std::runtime_error("Malformed WAS shared memory handshake");
+
+	struct stat st;
+	if (fstat(c->memfd.Get(), &st) < 0)
+		throw MakeErrno("Failed to stat WAS shared memory");
+
+	const std::size_t page_size = GetPageSize();
+	const std::size_t size = st.st_size;
+	if (size <= page_size || (size - page_size) % (2 * page_size) != 0)
+		throw std::runtime_error("Malformed WAS shared memory size");
+
+	const std::size_t capacity = (size - page_size) / 2;
+	c->Map(capacity);
+
+	if (c->header->magic != WAS_SHM_MAGIC ||
+	    c->header->capacity != capacity)
+		throw std::runtime_error("Malformed WAS shared memory header");
+
+	c->header->attached.store(1, std::memory_order_release);
+	return c;
+}
+
+bool
+WasShmChannel::IsAttached() const noexcept
+{
+	return header->attached.load(std::memory_order_acquire) != 0;
+}
@@ -0,0 +1,280 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#pragma once
+
+#include "io/UniqueFileDescriptor.hxx"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string_view>
+
+struct WasShmRingHeader;
+struct WasShmChannelHeader;
+class SocketDescriptor;
+
+/**
+ * The payload of a #WAS_COMMAND_DATA packet which announces that the
+ * body is transferred over the shared-memory ring instead of the
+ * pipe.
+ */
+inline constexpr std::string_view WAS_SHM_DATA_PAYLOAD{"shm"};
+
+/**
+ * One direction of a #WasShmChannel: a single-producer
+ * single-consumer byte ring in shared memory.  The data area is
+ * mapped twice in a row, so every readable or writable range is
+ * contiguous.
+ *
+ * The peers ring each other's "doorbell" (an eventfd) only if the
+ * other one has announced that it is waiting; as long as both sides
+ * keep up, no system call is needed.
+ *
+ * The shared header is writable by the peer, which is not trusted:
+ * this object's own position is kept in private memory (the shared
+ * copy is only published for the peer), and the peer's position is
+ * validated each time it is loaded; methods which load it throw
+ * #WasProtocolError if it is out of range.  Each object is used
+ * either as producer or as consumer, never both.
+ */
+class WasShmRing {
+	WasShmRingHeader *header = nullptr;
+
+	std::byte *data;
+
+	std::size_t capacity;
+
+	/**
+	 * Our own position: the write position if we are the
+	 * producer, the read position if we are the consumer.
+	 */
+	uint64_t position = 0;
+
+	/**
+	 * The most recent (validated) position of the peer.
+	 */
+	uint64_t peer_position = 0;
+
+	/**
+	 * An eventfd signalled by the producer after it has appended
+	 * data while the consumer was waiting.
+	 */
+	FileDescriptor data_event;
+
+	/**
+	 * An eventfd signalled by the consumer after it has freed
+	 * space while the producer was waiting.
+	 */
+	FileDescriptor space_event;
+
+	/**
+	 * Consumer only: is a body being received over this ring
+	 * which has not yet been consumed completely?  This is used
+	 * to decide whether remaining data needs to be discarded
+	 * after #WAS_COMMAND_STOP.
+	 */
+	bool in_use = false;
+
+public:
+	void Init(WasShmRingHeader &_header, std::byte *_data,
+		  std::size_t _capacity,
+		  FileDescriptor _data_event,
+		  FileDescriptor _space_event) noexcept {
+		header = &_header;
+		data = _data;
+		capacity = _capacity;
+		data_event = _data_event;
+		space_event = _space_event;
+	}
+
+	FileDescriptor GetDataEvent() const noexcept {
+		return data_event;
+	}
+
+	FileDescriptor GetSpaceEvent() const noexcept {
+		return space_event;
+	}
+
+	bool IsInUse() const noexcept {
+		return in_use;
+	}
+
+	void SetInUse(bool _in_use) noexcept {
+		in_use = _in_use;
+	}
+
+	/* producer */
+
+	/**
+	 * Returns the free space at the write position.
+	 *
+	 * Throws #WasProtocolError if the consumer's position is
+	 * invalid.
+	 */
+	std::span<std::byte> Write();
+
+	/**
+	 * Publish data which has been copied to the buffer returned by
+	 * Write().
+	 */
+	void Append(std::size_t nbytes) noexcept;
+
+	/**
+	 * Announce that the producer is going to wait for
+	 * #space_event.
+	 *
+	 * Throws #WasProtocolError if the consumer's position is
+	 * invalid.
+	 *
+	 * @return true if the ring is still full, false if space has
+	 * been freed meanwhile (and the producer should not wait)
+	 */
+	bool WaitForSpace();
+
+	/* consumer */
+
+	/**
+	 * Returns the data at the read position.
+	 *
+	 * Throws #WasProtocolError if the producer's position is
+	 * invalid.
+	 */
+	std::span<const std::byte> Read();
+
+	/**
+	 * Returns the amount of data which was available at the most
+	 * recent Read() (minus what has been consumed since).  More
+	 * may have been appended meanwhile.
+	 */
+	std::size_t GetAvailable() const noexcept {
+		return peer_position - position;
+	}
+
+	/**
+	 * Mark data returned by Read() as consumed.
+	 */
+	void Consume(std::size_t nbytes) noexcept;
+
+	/**
+	 * Consume the given amount of data without looking at it.
+	 *
+	 * Throws #WasProtocolError if the producer's position is
+	 * invalid.
+	 *
+	 * @return false if less data is available
+	 */
+	bool Discard(std::size_t nbytes);
+
+	/**
+	 * Announce that the consumer is going to wait for
+	 * #data_event.
+	 *
+	 * Throws #WasProtocolError if the producer's position is
+	 * invalid.
+	 *
+	 * @return true if the ring is still empty, false if data has
+	 * been appended meanwhile (and the consumer should not wait)
+	 */
+	bool WaitForData();
+
+	/**
+	 * Reset an eventfd after it has been reported readable.
+	 */
+	static void ClearEvent(FileDescriptor fd) noexcept;
+};
+
+/**
+ * A shared-memory data channel between beng-proxy and a local WAS
+ * child process, an optional replacement for the two data pipes.  It
+ * consists of a memfd with a header page and two rings (one for
+ * request bodies, one for response bodies) and four eventfds.
+ *
+ * The client creates it before spawning the child process and sends
+ * it over the control socket in a #WAS_COMMAND_NOP packet (see
+ * SendHandshake()), which older WAS libraries ignore.  A child which
+ * supports it takes the descriptors with ReceiveHandshake() and
+ * marks the channel as "attached"; from then on, both sides may
+ * choose the ring per body by sending #WAS_SHM_DATA_PAYLOAD with
+ * #WAS_COMMAND_DATA.  The pipes remain available as fallback.
+ */
+class WasShmChannel {
+	UniqueFileDescriptor memfd;
+
+	/**
+	 * The eventfds: request data, request space, response data,
+	 * response space.
+	 */
+	std::array<UniqueFileDescriptor, 4> events;
+
+	void *address = nullptr;
+	std::size_t mapping_size;
+
+	WasShmChannelHeader *header;
+
+	WasShmRing request, response;
+
+	WasShmChannel() noexcept = default;
+
+public:
+	~WasShmChannel() noexcept;
+
+	WasShmChannel(const WasShmChannel &) = delete;
+	WasShmChannel &operator=(const WasShmChannel &) = delete;
+
+	/**
+	 * Create a new channel (client side).
+	 *
+	 * Throws on error.
+	 *
+	 * @param capacity the size of each ring (rounded up to the page
+	 * size)
+	 */
+	static std::unique_ptr<WasShmChannel> Create(std::size_t capacity);
+
+	/**
+	 * Send the channel's descriptors to the WAS child process.
+	 * This must be called before the child starts reading from the
+	 * control socket, i.e. before it is spawned.
+	 *
+	 * Throws on error.
+	 */
+	void SendHandshake(SocketDescriptor control) const;
+
+	/**
+	 * Check whether the first packet on the control socket is a
+	 * handshake and if so, receive and attach to the channel (WAS
+	 * child process side).
+	 *
+	 * Throws on error.
+	 *
+	 * @return the channel or nullptr if the client did not offer one
+	 */
+	static std::unique_ptr<WasShmChannel> ReceiveHandshake(SocketDescriptor control);
+
+	/**
+	 * Has the WAS child process attached to the channel?  Only
+	 * then may the client send bodies over it.
+	 */
+	[[gnu::pure]]
+	bool IsAttached() const noexcept;
+
+	WasShmRing &GetRequestRing() noexcept {
+		return request;
+	}
+
+	WasShmRing &GetResponseRing() noexcept {
+		return response;
+	}
+
+private:
+	/**
+	 * Map the memfd and initialize the two rings.
+	 *
+	 * Throws on error.
+	 */
+	void Map(std::size_t capacity);
+};
@@ -58,7 +58,8 @@ public:
 	 * Throws on error.
 	 */
 	void Launch(const CgiChildParams &params, SocketDescriptor log_socket,
-		    const ChildErrorLogOptions &log_options) {
+		    const ChildErrorLogOptions &log_options,
+		    std::size_t shm_capacity) {
 		auto process =
 			was_launch(spawn_service,
 				   GetStockName(),
@@ -67,13 +68,14 @@ public:
 				   params.options,
 				   log.EnableClient(GetEventLoop(),
 						    log_socket, log_options,
-						    params.options.stderr_pond));
+						    params.options.stderr_pond),
+				   shm_capacity);
 
 		handle = std::move(process.handle);
 		handle->SetExitListener(*this);
 
 		WasSocket &socket = process;
-		Open(std::move(socket));
+		Open(std::move(socket), std::move(process.shm));
 	}
 
 	void SetSite(const char *_site) noexcept override {
@@ -123,7 +125,7 @@ WasStock::Create(CreateStockItem c, StockRequest _request,
 	auto *child = new WasChild(c, spawn_service, params.options.tag, params.disposable);
 
 	try {
-		child->Launch(params, log_socket, log_options);
+		child->Launch(params, log_socket, log_options, shm_capacity);
 	} catch (...) {
 		delete child;
 		throw;
@@ -9,6 +9,7 @@
 #include "stock/MapStock.hxx"
 #include "net/SocketDescriptor.hxx"
 
+#include <cstddef>
 #include <span>
 #include <string_view>
 
@@ -25,6 +26,12 @@ class WasStock final : StockClass {
 	const SocketDescriptor log_socket;
 	const ChildErrorLogOptions log_options;
 
+	/**
+	 * The ring size of the shared-memory data channel offered to
+	 * new child processes; 0 disables it.
+	 */
+	const std::size_t shm_capacity;
+
 	class WasStockMap final : public StockMap {
 	public:
 		using StockMap::StockMap;
@@ -40,9 +47,11 @@ public:
 	explicit WasStock(EventLoop &event_loop, SpawnService &_spawn_service,
 			  const SocketDescriptor _log_socket,
 			  const ChildErrorLogOptions &_log_options,
-			  unsigned limit, unsigned max_idle) noexcept
+			  unsigned limit, unsigned max_idle,
+			  std::size_t _shm_capacity=0) noexcept
 		:spawn_service(_spawn_service),
 		 log_socket(_log_socket), log_options(_log_options),
+		 shm_capacity(_shm_capacity),
 		 stock(event_loop, *this, limit, max_idle,
 		       std::chrono::minutes(10)) {}
 
@@ -13,6 +13,7 @@
 class EventLoop;
 class ResourceLoader;
 class WidgetRegistry;
+class XmlTemplateCache;
 class StringMap;
 class SessionManager;
 class SessionLease;
@@ -29,6 +30,12 @@ struct WidgetContext {
 
 	WidgetRegistry *widget_registry;
 
+	/**
+	 * If non-nullptr, then #XmlProcessor stores parsed templates
+	 * here.
+	 */
+	XmlTemplateCache *xml_template_cache = nullptr;
+
 	const char *site_name;
 
 	/**
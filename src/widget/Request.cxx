@@ -165,7 +165,8 @@ private:
 	 */
 	void ProcessResponse(HttpStatus status,
 			     StringMap &headers, UnusedIstreamPtr body,
-			     unsigned options) noexcept;
+			     unsigned options,
+			     const char *source_tag) noexcept;
 
 	void CssProcessResponse(HttpStatus status,
 				StringMap &headers, UnusedIstreamPtr body,
@@ -322,7 +323,8 @@ WidgetRequest::DispatchError(std::exception_ptr ep) noexcept
 void
 WidgetRequest::ProcessResponse(HttpStatus status,
 			       StringMap &headers, UnusedIstreamPtr body,
-			       unsigned options) noexcept
+			       unsigned options,
+			       const char *source_tag) noexcept
 {
 	if (!body) {
 		/* this should not happen, but we're ignoring this formal
@@ -358,7 +360,8 @@ WidgetRequest::ProcessResponse(HttpStatus status,
 		DispatchResponse(status, processor_header_forward(pool, headers),
 				 processor_process(pool, parent_stopwatch,
 						   std::move(body),
-						   widget, ctx, options));
+						   widget, ctx, options,
+						   source_tag));
 }
 
 [[gnu::pure]]
@@ -496,13 +499,17 @@ WidgetRequest::TransformResponse(HttpStatus status,
 	}
 
 	switch (t.type) {
-	case Transformation::Type::PROCESS:
-		/* processor responses cannot be cached */
+	case Transformation::Type::PROCESS: {
+		/* processor responses cannot be cached, but the
+		   parsed template can */
+		const char *source_tag =
+			resource_tag_append_etag(pool, resource_tag, headers);
 		resource_tag = nullptr;
 
 		ProcessResponse(status, headers, std::move(body),
-				t.u.processor.options);
+				t.u.processor.options, source_tag);
 		break;
+	}
 
 	case Transformation::Type::PROCESS_CSS:
 		/* processor responses cannot be cached */
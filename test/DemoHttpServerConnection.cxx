@@ -30,7 +30,7 @@ DemoHttpServerConnection::DemoHttpServerConnection(struct pool &pool,
 					       std::move(socket),
 					       nullptr,
 					       address,
-					       true,
+					       true, 0,
 					       *this, *this)),
 	 response_timer(event_loop, BIND_THIS_METHOD(OnResponseTimer)),
 	 mode(_mode) {}
@@ -0,0 +1,126 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+/*
+ * Measure the throughput of #HttpChunkParser with a small-chunk
+ * corpus (like streaming PHP/Node.js responses) and with a
+ * large-chunk corpus.  The input is fed in portions of the given
+ * read size, like it arrives from a socket.
+ *
+ * Usage: RunChunkParserBenchmark [READ_SIZE]
+ */
+
+#include "http/ChunkParser.hxx"
+#include "util/PrintException.hxx"
+
+#include <chrono>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+#include <stdio.h>
+#include <string.h>
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * Generate a chunked body with the given number of chunks of the
+ * given payload size.
+ */
+static std::string
+MakeCorpus(std::size_t chunk_size, std::size_t n_chunks)
+{
+	char header[32];
+	snprintf(header, sizeof(header), "%zx\r\n", chunk_size);
+
+	const std::string payload(chunk_size, 'x');
+
+	std::string corpus;
+	corpus.reserve(n_chunks * (strlen(header) + chunk_size + 2) + 5);
+
+	for (std::size_t i = 0; i < n_chunks; ++i) {
+		corpus += header;
+		corpus += payload;
+		corpus += "\r\n";
+	}
+
+	corpus += "0\r\n\r\n";
+	return corpus;
+}
+
+/**
+ * @return the number of payload bytes
+ */
+static std::size_t
+Parse(std::string_view corpus, std::size_t read_size)
+{
+	HttpChunkParser parser;
+	std::size_t total = 0;
+
+	while (!parser.HasEnded()) {
+		if (corpus.empty())
+			throw std::runtime_error("Premature end of corpus");
+
+		auto b = AsBytes(corpus.substr(0, read_size));
+		while (!b.empty()) {
+			const auto data = parser.Parse(b);
+			b = b.subspan(data.data() + data.size() - b.data());
+
+			if (data.empty())
+				break;
+
+			total += data.size();
+			parser.Consume(data.size());
+		}
+
+		corpus.remove_prefix(std::min(read_size, corpus.size()) - b.size());
+	}
+
+	return total;
+}
+
+static void
+Run(const char *name, std::size_t chunk_size, std::size_t n_chunks,
+    std::size_t read_size)
+{
+	const auto corpus = MakeCorpus(chunk_size, n_chunks);
+
+	constexpr unsigned n_iterations = 20;
+	std::size_t total = 0;
+
+	const auto start = Clock::now();
+
+	for (unsigned i = 0; i < n_iterations; ++i)
+		total += Parse(corpus, read_size);
+
+	const auto duration = Clock::now() - start;
+	const double seconds = std::chrono::duration<double>(duration).count();
+
+	if (total != n_iterations * chunk_size * n_chunks)
+		throw std::runtime_error("Payload size mismatch");
+
+	printf("%-6s chunks of %6zu bytes: %8.1f MB/s, %6.1f ns per chunk\n",
+	       name, chunk_size,
+	       n_iterations * corpus.size() / seconds / (1024 * 1024),
+	       seconds * 1e9 / (n_iterations * n_chunks));
+}
+
+int
+main(int argc, char **argv) noexcept
+try {
+	const std::size_t read_size = argc >= 2
+		? strtoul(argv[1], nullptr, 10)
+		: 16384;
+	if (read_size == 0)
+		throw std::runtime_error("Invalid read size");
+
+	Run("small", 16, 1024 * 1024, read_size);
+	Run("medium", 512, 64 * 1024, read_size);
+	Run("large", 65536, 512, read_size);
+
+	return EXIT_SUCCESS;
+} catch (...) {
+	PrintException(std::current_exception());
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,143 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+/*
+ * Compare the fixed-size #IntrusiveHashSet (as previously used by
+ * #Cache and #SessionManager) with #IntrusiveGrowingHashSet.
+ *
+ * Usage: RunHashSetBenchmark [COUNT...]
+ */
+
+#include "util/IntrusiveGrowingHashSet.hxx"
+#include "util/IntrusiveHashSet.hxx"
+#include "util/PrintException.hxx"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <stdio.h>
+
+struct Item {
+	IntrusiveHashSetHook<IntrusiveHookMode::NORMAL> fixed_hook;
+	IntrusiveGrowingHashSetHook growing_hook;
+
+	uint64_t key;
+
+	struct Hash {
+		std::size_t operator()(uint64_t key) const noexcept {
+			return std::hash<uint64_t>{}(key);
+		}
+
+		std::size_t operator()(const Item &item) const noexcept {
+			return (*this)(item.key);
+		}
+	};
+
+	struct Equal {
+		bool operator()(uint64_t a, const Item &b) const noexcept {
+			return a == b.key;
+		}
+
+		bool operator()(const Item &a, const Item &b) const noexcept {
+			return a.key == b.key;
+		}
+	};
+};
+
+using FixedSet = IntrusiveHashSet<Item, 65521, Item::Hash, Item::Equal,
+				  IntrusiveHashSetMemberHookTraits<&Item::fixed_hook>>;
+
+using GrowingSet = IntrusiveGrowingHashSet<Item, Item::Hash, Item::Equal,
+					   IntrusiveGrowingHashSetMemberHookTraits<&Item::growing_hook>>;
+
+using Clock = std::chrono::steady_clock;
+
+static double
+ToNanoseconds(Clock::duration d, std::size_t n) noexcept
+{
+	return std::chrono::duration<double, std::nano>(d).count() / n;
+}
+
+template<typename Set>
+static void
+Run(const char *name, std::vector<Item> &items,
+    const std::vector<uint64_t> &lookups)
+{
+	auto set = std::make_unique<Set>();
+
+	Clock::duration max_insert{};
+	auto start = Clock::now();
+
+	for (auto &i : items) {
+		const auto before = Clock::now();
+		set->insert(i);
+		max_insert = std::max(max_insert, Clock::now() - before);
+	}
+
+	const auto insert_duration = Clock::now() - start;
+
+	start = Clock::now();
+
+	std::size_t found = 0;
+	for (const auto key : lookups)
+		if (set->find(key) != set->end())
+			++found;
+
+	const auto find_duration = Clock::now() - start;
+
+	printf("%-8s %10zu items: insert %6.1f ns (max %8.1f us), find %6.1f ns (%zu found)\n",
+	       name, items.size(),
+	       ToNanoseconds(insert_duration, items.size()),
+	       std::chrono::duration<double, std::micro>(max_insert).count(),
+	       ToNanoseconds(find_duration, lookups.size()),
+	       found);
+
+	set->clear_and_dispose([](Item *){});
+}
+
+static void
+Run(std::size_t n)
+{
+	if (n == 0)
+		return;
+
+	std::mt19937_64 r;
+
+	std::vector<Item> items(n);
+	for (auto &i : items)
+		i.key = r();
+
+	/* half hits, half misses, in random order */
+	std::vector<uint64_t> lookups;
+	lookups.reserve(1000000);
+	while (lookups.size() < lookups.capacity()) {
+		lookups.push_back(items[r() % n].key);
+		lookups.push_back(r());
+	}
+
+	Run<FixedSet>("fixed", items, lookups);
+	Run<GrowingSet>("growing", items, lookups);
+}
+
+int
+main(int argc, char **argv) noexcept
+try {
+	if (argc < 2) {
+		for (std::size_t n : {10000, 1000000, 10000000})
+			Run(n);
+	} else {
+		for (int i = 1; i < argc; ++i)
+			Run(strtoul(argv[i], nullptr, 10));
+	}
+
+	return EXIT_SUCCESS;
+} catch (...) {
+	PrintException(std::current_exception());
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,206 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+/*
+ * Compare the linear evaluation of beng-lb branch conditions with
+ * #LbBranchMatcher.  The generated branch mixes "$http_host ==",
+ * "$request_uri =~" and "$remote_address in" conditions, like a
+ * typical virtual-hosting setup.
+ *
+ * Usage: RunLbBranchBenchmark [COUNT...]
+ */
+
+#include "lb/BranchMatcher.hxx"
+#include "net/IPv4Address.hxx"
+#include "util/PrintException.hxx"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+struct FakeHeaders {
+	const char *host = nullptr;
+
+	const char *Get(const char *name) const noexcept {
+		return strcmp(name, "host") == 0 ? host : nullptr;
+	}
+};
+
+struct FakeRequest {
+	HttpMethod method = HttpMethod::GET;
+	const char *uri;
+	FakeHeaders headers;
+	SocketAddress remote_address;
+};
+
+struct Query {
+	std::string host, uri;
+	IPv4Address address;
+};
+
+} // anonymous namespace
+
+using Clock = std::chrono::steady_clock;
+using Type = LbAttributeReference::Type;
+
+static double
+ToNanoseconds(Clock::duration d, std::size_t n) noexcept
+{
+	return std::chrono::duration<double, std::nano>(d).count() / n;
+}
+
+static std::vector<LbConditionConfig>
+MakeConditions(std::size_t n)
+{
+	std::vector<LbConditionConfig> conditions;
+	conditions.reserve(n);
+
+	for (std::size_t i = 0; i < n; ++i) {
+		switch (i % 3) {
+		case 0: {
+			const auto host = "h" + std::to_string(i) + ".example";
+			conditions.emplace_back(LbAttributeReference{Type::HEADER, "host"},
+						false, host.c_str());
+			break;
+		}
+
+		case 1: {
+			const auto re = "^/app" + std::to_string(i) + "/";
+			conditions.emplace_back(Type::URI, false,
+						UniqueRegex{re.c_str(), false, false},
+						re.c_str());
+			break;
+		}
+
+		case 2: {
+			const auto mask = "10." + std::to_string(i / 256 % 256) +
+				"." + std::to_string(i % 256) + ".0/24";
+			conditions.emplace_back(Type::REMOTE_ADDRESS, false,
+						MaskedSocketAddress{mask.c_str()},
+						mask.c_str());
+			break;
+		}
+		}
+	}
+
+	return conditions;
+}
+
+static std::vector<Query>
+MakeQueries(std::size_t n, std::size_t count)
+{
+	std::mt19937 r;
+
+	std::vector<Query> queries;
+	queries.reserve(count);
+
+	for (std::size_t i = 0; i < count; ++i) {
+		/* some of the values are out of range to generate
+		   misses */
+		const std::size_t a = r() % (n + n / 4 + 1);
+		const std::size_t b = r() % (n + n / 4 + 1);
+		const std::size_t c = r() % (n + n / 4 + 1);
+
+		queries.push_back({
+			"h" + std::to_string(a) + ".example",
+			"/app" + std::to_string(b) + "/index.html",
+			IPv4Address(10, uint8_t(c / 256), uint8_t(c), 1, 80),
+		});
+	}
+
+	return queries;
+}
+
+static void
+Run(std::size_t n)
+{
+	if (n == 0)
+		return;
+
+	const auto conditions = MakeConditions(n);
+
+	std::vector<const LbConditionConfig *> pointers;
+	for (const auto &i : conditions)
+		pointers.push_back(&i);
+
+	auto start = Clock::now();
+	const LbBranchMatcher matcher{pointers};
+	const auto compile_duration = Clock::now() - start;
+
+	const auto queries = MakeQueries(n, 100000);
+
+	std::vector<std::size_t> linear_results;
+	linear_results.reserve(queries.size());
+
+	start = Clock::now();
+
+	for (const auto &q : queries) {
+		FakeRequest request{.uri = q.uri.c_str(), .remote_address = q.address};
+		request.headers.host = q.host.c_str();
+
+		std::size_t result = LbBranchMatcher::NONE;
+		for (std::size_t i = 0; i < pointers.size(); ++i) {
+			if (pointers[i]->MatchRequest(request)) {
+				result = i;
+				break;
+			}
+		}
+
+		linear_results.push_back(result);
+	}
+
+	const auto linear_duration = Clock::now() - start;
+
+	std::size_t found = 0;
+
+	start = Clock::now();
+
+	for (std::size_t i = 0; i < queries.size(); ++i) {
+		const auto &q = queries[i];
+		FakeRequest request{.uri = q.uri.c_str(), .remote_address = q.address};
+		request.headers.host = q.host.c_str();
+
+		const std::size_t result = matcher.FindRequest(request);
+		if (result != linear_results[i])
+			throw std::runtime_error("Result mismatch");
+
+		if (result != LbBranchMatcher::NONE)
+			++found;
+	}
+
+	const auto matcher_duration = Clock::now() - start;
+
+	printf("%6zu conditions: compile %8.1f us, linear %10.1f ns, compiled %8.1f ns (%zu/%zu found)\n",
+	       n,
+	       std::chrono::duration<double, std::micro>(compile_duration).count(),
+	       ToNanoseconds(linear_duration, queries.size()),
+	       ToNanoseconds(matcher_duration, queries.size()),
+	       found, queries.size());
+}
+
+int
+main(int argc, char **argv) noexcept
+try {
+	if (argc < 2) {
+		for (std::size_t n : {10, 100, 1000})
+			Run(n);
+	} else {
+		for (int i = 1; i < argc; ++i)
+			Run(strtoul(argv[i], nullptr, 10));
+	}
+
+	return EXIT_SUCCESS;
+} catch (...) {
+	PrintException(std::current_exception());
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,228 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+/*
+ * Measure the body throughput between the WAS client and a WAS child
+ * process which echoes the request body (e.g. was_mirror), once over
+ * the pipes and once over the shared-memory channel.
+ *
+ * Usage: RunWasBenchmark PATH [SIZE [COUNT]]
+ */
+
+#include "was/Client.hxx"
+#include "was/Launch.hxx"
+#include "was/Lease.hxx"
+#include "http/ResponseHandler.hxx"
+#include "http/Method.hxx"
+#include "http/Status.hxx"
+#include "istream/Sink.hxx"
+#include "istream/UnusedPtr.hxx"
+#include "istream/HeadIstream.hxx"
+#include "istream/ZeroIstream.hxx"
+#include "memory/fb_pool.hxx"
+#include "pool/pool.hxx"
+#include "pool/Ptr.hxx"
+#include "event/DeferEvent.hxx"
+#include "spawn/Config.hxx"
+#include "spawn/ChildOptions.hxx"
+#include "spawn/Registry.hxx"
+#include "spawn/Local.hxx"
+#include "strmap.hxx"
+#include "PInstance.hxx"
+#include "io/SpliceSupport.hxx"
+#include "util/Cancellable.hxx"
+#include "util/PrintException.hxx"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+
+#include <stdio.h>
+
+using Clock = std::chrono::steady_clock;
+
+struct Context final
+	: PInstance, WasLease, HttpResponseHandler, IstreamSink {
+
+	DeferEvent defer_request{event_loop, BIND_THIS_METHOD(SendRequest)};
+
+	WasProcess process;
+
+	PoolPtr pool;
+
+	CancellablePointer cancel_ptr;
+
+	const std::size_t size, count;
+
+	std::size_t n_responses = 0;
+
+	uint64_t received = 0;
+
+	bool error = false;
+
+	Context(std::size_t _size, std::size_t _count) noexcept
+		:size(_size), count(_count) {}
+
+	void SendRequest() noexcept;
+
+	void Fail(std::exception_ptr ep) noexcept {
+		PrintException(ep);
+		error = true;
+		Finish();
+	}
+
+	void Finish() noexcept {
+		process.handle.reset();
+		event_loop.Break();
+	}
+
+	/* virtual methods from class WasLease */
+	void ReleaseWas(bool reuse) override {
+		if (!reuse)
+			Fail(std::make_exception_ptr(std::runtime_error("WAS process not reusable")));
+	}
+
+	void ReleaseWasStop([[maybe_unused]] uint64_t input_received) override {
+		ReleaseWas(false);
+	}
+
+	/* virtual methods from class HttpResponseHandler */
+	void OnHttpResponse(HttpStatus status, StringMap &&headers,
+			    UnusedIstreamPtr body) noexcept override;
+	void OnHttpError(std::exception_ptr ep) noexcept override {
+		Fail(ep);
+	}
+
+	/* virtual methods from class IstreamHandler */
+	std::size_t OnData(std::span<const std::byte> src) noexcept override {
+		received += src.size();
+		return src.size();
+	}
+
+	void OnEof() noexcept override;
+
+	void OnError(std::exception_ptr ep) noexcept override {
+		ClearInput();
+		Fail(ep);
+	}
+};
+
+void
+Context::SendRequest() noexcept
+{
+	pool = pool_new_linear(root_pool, "request", 8192);
+
+	StringMap headers;
+
+	was_client_request(*pool, event_loop, nullptr,
+			   process.control, process.input, process.output,
+			   process.shm.get(),
+			   *this,
+			   nullptr,
+			   HttpMethod::POST, "/",
+			   nullptr, nullptr, nullptr,
+			   headers,
+			   istream_head_new(*pool, istream_zero_new(*pool),
+					    size, true),
+			   {},
+			   nullptr,
+			   *this, cancel_ptr);
+}
+
+void
+Context::OnHttpResponse(HttpStatus status, StringMap &&,
+			UnusedIstreamPtr body) noexcept
+{
+	if (status != HttpStatus::OK || !body) {
+		Fail(std::make_exception_ptr(std::runtime_error("Unexpected response")));
+		return;
+	}
+
+	SetInput(std::move(body));
+	input.Read();
+}
+
+void
+Context::OnEof() noexcept
+{
+	ClearInput();
+
+	if (++n_responses < count)
+		/* not from inside the WAS client */
+		defer_request.Schedule();
+	else
+		Finish();
+}
+
+static void
+Run(const char *name, const char *path, std::size_t shm_capacity,
+    std::size_t size, std::size_t count)
+{
+	Context context{size, count};
+
+	SpawnConfig spawn_config;
+	ChildProcessRegistry child_process_registry;
+	LocalSpawnService spawn_service(spawn_config, context.event_loop,
+					child_process_registry);
+
+	ChildOptions child_options;
+	child_options.no_new_privs = true;
+
+	context.process = was_launch(spawn_service, "was", path, {},
+				     child_options, {}, shm_capacity);
+
+	const auto start = Clock::now();
+	context.SendRequest();
+	context.event_loop.Run();
+	const auto duration = Clock::now() - start;
+
+	if (context.error)
+		throw std::runtime_error("Benchmark failed");
+
+	if (context.received != uint64_t(size) * count)
+		throw std::runtime_error("Wrong response body size");
+
+	const bool attached = context.process.shm != nullptr &&
+		context.process.shm->IsAttached();
+
+	/* each byte is transferred twice: in the request body and in
+	   the response body */
+	const double seconds = std::chrono::duration<double>(duration).count();
+	printf("%-5s %zu x %zu bytes: %8.1f MB/s%s\n",
+	       name, count, size,
+	       2.0 * size * count / seconds / (1024 * 1024),
+	       shm_capacity > 0 && !attached ? " (not attached)" : "");
+}
+
+int
+main(int argc, char **argv) noexcept
+try {
+	if (argc < 2 || argc > 4) {
+		fprintf(stderr, "Usage: RunWasBenchmark PATH [SIZE [COUNT]]\n");
+		return EXIT_FAILURE;
+	}
+
+	const char *path = argv[1];
+	const std::size_t size = argc > 2
+		? strtoul(argv[2], nullptr, 10)
+		: 1024 * 1024;
+	const std::size_t count = argc > 3
+		? strtoul(argv[3], nullptr, 10)
+		: 1000;
+
+	if (size == 0 || count == 0)
+		throw std::runtime_error("Invalid parameter");
+
+	direct_global_init();
+	const ScopeFbPoolInit fb_pool_init;
+
+	Run("pipe", path, 0, size, count);
+	Run("shm", path, 1024 * 1024, size, count);
+
+	return EXIT_SUCCESS;
+} catch (...) {
+	PrintException(std::current_exception());
+	return EXIT_FAILURE;
+}
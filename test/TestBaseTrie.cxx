@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#include "translation/BaseTrie.hxx"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+static std::vector<std::string>
+Prefixes(const TranslationBaseTrie &trie, std::string_view key)
+{
+	std::vector<std::string> result;
+	trie.ForEachPrefix(key, [&](std::size_t length){
+		result.emplace_back(key.substr(0, length));
+	});
+	return result;
+}
+
+TEST(TranslationBaseTrie, Basic)
+{
+	TranslationBaseTrie trie;
+	EXPECT_TRUE(trie.empty());
+	EXPECT_TRUE(Prefixes(trie, "/foo/bar").empty());
+
+	trie.Add("/");
+	trie.Add("/foo/");
+	trie.Add("/foo/bar/baz/");
+	trie.Add("500:/foo/");
+	EXPECT_FALSE(trie.empty());
+
+	using V = std::vector<std::string>;
+	EXPECT_EQ(Prefixes(trie, "/foo/bar/baz/x.html"),
+		  (V{"/", "/foo/", "/foo/bar/baz/"}));
+	EXPECT_EQ(Prefixes(trie, "/foo/bar/x.html"),
+		  (V{"/", "/foo/"}));
+	EXPECT_EQ(Prefixes(trie, "/foo"), (V{"/"}));
+	EXPECT_EQ(Prefixes(trie, "/other/x"), (V{"/"}));
+	EXPECT_EQ(Prefixes(trie, "500:/foo/x"), (V{"500:/foo/"}));
+
+	/* the key itself is not a prefix */
+	EXPECT_EQ(Prefixes(trie, "/foo/"), (V{"/"}));
+
+	trie.Remove("/foo/bar/baz/");
+	EXPECT_EQ(Prefixes(trie, "/foo/bar/baz/x.html"),
+		  (V{"/", "/foo/"}));
+
+	/* keys are counted */
+	trie.Add("/foo/");
+	trie.Remove("/foo/");
+	EXPECT_EQ(Prefixes(trie, "/foo/x"), (V{"/", "/foo/"}));
+
+	trie.Remove("/foo/");
+	trie.Remove("/");
+	trie.Remove("500:/foo/");
+	EXPECT_TRUE(trie.empty());
+}
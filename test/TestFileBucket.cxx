@@ -0,0 +1,128 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#include "istream/Bucket.hxx"
+#include "istream/ConcatIstream.hxx"
+#include "istream/FileIstream.hxx"
+#include "istream/Sink.hxx"
+#include "istream/UnusedPtr.hxx"
+#include "istream/istream_string.hxx"
+#include "io/UniqueFileDescriptor.hxx"
+#include "event/Loop.hxx"
+#include "pool/RootPool.hxx"
+#include "memory/fb_pool.hxx"
+
+#include <gtest/gtest.h>
+
+#include <string_view>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+using std::string_view_literals::operator""sv;
+
+namespace {
+
+class BucketSink final : IstreamSink {
+public:
+	explicit BucketSink(UnusedIstreamPtr _input) noexcept
+		:IstreamSink(std::move(_input)) {}
+
+	~BucketSink() noexcept {
+		if (HasInput())
+			CloseInput();
+	}
+
+	void FillBucketList(IstreamBucketList &list) {
+		input.FillBucketList(list);
+	}
+
+	std::size_t ConsumeBucketList(std::size_t nbytes) noexcept {
+		return input.ConsumeBucketList(nbytes);
+	}
+
+	/* virtual methods from class IstreamHandler */
+
+	std::size_t OnData(std::span<const std::byte>) noexcept override {
+		return 0;
+	}
+
+	void OnEof() noexcept override {
+		ClearInput();
+	}
+
+	void OnError(std::exception_ptr) noexcept override {
+		ClearInput();
+	}
+};
+
+} // anonymous namespace
+
+static UniqueFileDescriptor
+MakeFile(std::string_view contents)
+{
+	UniqueFileDescriptor fd{memfd_create("TestFileBucket", MFD_CLOEXEC)};
+	EXPECT_TRUE(fd.IsDefined());
+	EXPECT_EQ(write(fd.Get(), contents.data(), contents.size()),
+		  ssize_t(contents.size()));
+	return fd;
+}
+
+TEST(FileBucket, Concat)
+{
+	const ScopeFbPoolInit fb_pool_init;
+	EventLoop event_loop;
+	RootPool pool;
+
+	/* skip the first byte of the file */
+	auto file = istream_file_fd_new(event_loop, pool, "file",
+					MakeFile("xbody"sv), 1, 5);
+
+	BucketSink sink{NewConcatIstream(pool,
+					 istream_string_new(pool, "head"),
+					 std::move(file),
+					 istream_string_new(pool, "tail"))};
+
+	{
+		/* without EnableFile(), the file ends the list */
+		IstreamBucketList list;
+		sink.FillBucketList(list);
+		EXPECT_TRUE(list.HasMore());
+		EXPECT_FALSE(list.HasNonBuffer());
+		EXPECT_EQ(list.GetTotalSize(), 4u);
+	}
+
+	IstreamBucketList list;
+	list.EnableFile();
+	sink.FillBucketList(list);
+	EXPECT_FALSE(list.HasMore());
+	EXPECT_TRUE(list.HasNonBuffer());
+	EXPECT_EQ(list.GetTotalBufferSize(), 8u);
+	EXPECT_EQ(list.GetTotalSize(), 12u);
+
+	auto i = list.begin();
+	ASSERT_TRUE(i->IsBuffer());
+	EXPECT_EQ(i->GetSize(), 4u);
+	++i;
+	ASSERT_TRUE(i->IsFile());
+	EXPECT_EQ(i->GetFile().offset, 1);
+	EXPECT_EQ(i->GetFile().size, 4u);
+	++i;
+	ASSERT_TRUE(i->IsBuffer());
+	++i;
+	EXPECT_EQ(i, list.end());
+
+	/* consume the head and half of the file */
+	EXPECT_EQ(sink.ConsumeBucketList(6), 6u);
+
+	list.Clear();
+	sink.FillBucketList(list);
+	i = list.begin();
+	ASSERT_TRUE(i->IsFile());
+	EXPECT_EQ(i->GetFile().offset, 3);
+	EXPECT_EQ(i->GetFile().size, 2u);
+	EXPECT_EQ(list.GetTotalSize(), 6u);
+
+	EXPECT_EQ(sink.ConsumeBucketList(6), 6u);
+}
@@ -17,6 +17,10 @@
 #include "net/UniqueSocketDescriptor.hxx"
 #include "lease.hxx"
 
+#ifdef HAVE_URING
+#include "event/uring/Manager.hxx"
+#endif
+
 #include <gtest/gtest.h>
 
 #include <memory>
@@ -91,6 +95,43 @@ TEST(FilteredSocket, NullFilter)
 	EXPECT_EQ(handler.WaitRead(), "foo"sv);
 }
 
+#ifdef HAVE_URING
+
+TEST(FilteredSocket, Uring)
+{
+	Instance instance;
+	Uring::Manager uring{instance.event_loop};
+	uring.SetVolatile();
+
+	auto [s, echo] = NewEchoSocket(instance.event_loop);
+
+	FilteredSocket fs{instance.event_loop};
+	TestBufferedSocketHandler handler{fs};
+	fs.InitDummy(s.Release(), FD_SOCKET);
+	fs.EnableUring(uring);
+	fs.Reinit(std::chrono::seconds{30}, handler);
+	fs.ScheduleRead();
+
+	EXPECT_EQ(fs.GetType(), FdType::FD_NONE);
+
+	handler.Write("foo"sv);
+	EXPECT_EQ(handler.WaitRead(), "foo"sv);
+
+	/* larger than the writer's buffer; needs several send
+	   operations */
+	const std::string big(256 * 1024, 'x');
+	handler.Write(big);
+
+	std::string received;
+	while (received.size() < big.size())
+		received += handler.WaitRead();
+
+	EXPECT_EQ(received, big);
+	EXPECT_TRUE(fs.IsDrained());
+}
+
+#endif
+
 TEST(FilteredSocket, NopFilter)
 {
 	Instance instance;
@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#include "http/HeaderParser.hxx"
+#include "strmap.hxx"
+#include "pool/RootPool.hxx"
+#include "AllocatorPtr.hxx"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+using std::string_view_literals::operator""sv;
+
+TEST(HeaderParser, Line)
+{
+	RootPool pool;
+	AllocatorPtr alloc(pool);
+	StringMap headers;
+
+	EXPECT_TRUE(header_parse_line(alloc, headers, "Content-Type: text/plain"sv));
+	EXPECT_TRUE(header_parse_line(alloc, headers, "X-Empty:"sv));
+	EXPECT_TRUE(header_parse_line(alloc, headers,
+				      "X-LONG-VALUE:   0123456789abcdefghijklmnopqrstuvwxyz"sv));
+	EXPECT_FALSE(header_parse_line(alloc, headers, "no colon"sv));
+	EXPECT_FALSE(header_parse_line(alloc, headers, "bad name: x"sv));
+
+	EXPECT_STREQ(headers.Get("content-type"), "text/plain");
+	EXPECT_STREQ(headers.Get("x-empty"), "");
+	EXPECT_STREQ(headers.Get("x-long-value"),
+		     "0123456789abcdefghijklmnopqrstuvwxyz");
+	EXPECT_EQ(headers.Get("bad name"), nullptr);
+}
+
+/**
+ * Illegal characters must be detected at every position, both in the
+ * word-wise loop and in the tail.
+ */
+TEST(HeaderParser, IllegalValue)
+{
+	RootPool pool;
+	AllocatorPtr alloc(pool);
+	StringMap headers;
+
+	for (const char ch : {'\0', '\n', '\r'}) {
+		for (std::size_t i = 0; i < 24; ++i) {
+			std::string line = "x:0123456789abcdefghijklmn";
+			line[2 + i] = ch;
+			EXPECT_FALSE(header_parse_line(alloc, headers, line));
+		}
+	}
+
+	/* bytes which differ from the illegal ones by one bit or
+	   which would cause a borrow */
+	EXPECT_TRUE(header_parse_line(alloc, headers,
+				      "x:\x01\x0b\x0c\x0e\x80\x8a\x8d\xff\x01\x09"sv));
+	EXPECT_NE(headers.Get("x"), nullptr);
+}
+
+TEST(HeaderParser, InPlace)
+{
+	RootPool pool;
+	AllocatorPtr alloc(pool);
+	StringMap headers;
+
+	const std::string_view input = "Host: example.com\r\nAccept: */*\r\n\r\nbody"sv;
+
+	HeaderLineCopy copy;
+	copy.Copy(alloc, input);
+	ASSERT_TRUE(copy.IsDefined());
+
+	EXPECT_TRUE(header_parse_line_in_place(alloc, headers,
+					       copy.Translate(input.substr(0, 17))));
+	EXPECT_TRUE(header_parse_line_in_place(alloc, headers,
+					       copy.Translate(input.substr(19, 11))));
+
+	EXPECT_STREQ(headers.Get("host"), "example.com");
+	EXPECT_STREQ(headers.Get("accept"), "*/*");
+
+	/* the input buffer is not modified */
+	EXPECT_EQ(input.substr(0, 4), "Host"sv);
+}
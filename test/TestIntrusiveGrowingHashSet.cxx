@@ -0,0 +1,202 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#include "util/IntrusiveGrowingHashSet.hxx"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace {
+
+struct Item {
+	IntrusiveGrowingHashSetHook hook;
+
+	unsigned value;
+
+	bool disposed = false;
+
+	explicit Item(unsigned _value) noexcept:value(_value) {}
+
+	struct Hash {
+		/* deliberately weak to test collisions */
+		std::size_t operator()(unsigned v) const noexcept {
+			return v % 1000;
+		}
+
+		std::size_t operator()(const Item &item) const noexcept {
+			return (*this)(item.value);
+		}
+	};
+
+	struct Equal {
+		bool operator()(unsigned a, const Item &b) const noexcept {
+			return a == b.value;
+		}
+	};
+};
+
+using Set = IntrusiveGrowingHashSet<Item, Item::Hash, Item::Equal,
+				    IntrusiveGrowingHashSetMemberHookTraits<&Item::hook>>;
+
+} // anonymous namespace
+
+TEST(IntrusiveGrowingHashSet, Basic)
+{
+	Item a{1}, b{2}, c{1001};
+
+	Set set;
+	EXPECT_TRUE(set.empty());
+	EXPECT_EQ(set.find(1u), set.end());
+
+	set.insert(a);
+	set.insert(b);
+	set.insert(c);
+	EXPECT_EQ(set.size(), 3u);
+
+	EXPECT_EQ(&*set.find(1u), &a);
+	EXPECT_EQ(&*set.find(2u), &b);
+	EXPECT_EQ(&*set.find(1001u), &c);
+	EXPECT_EQ(set.find(3u), set.end());
+
+	auto [i, inserted] = set.insert_check(2u);
+	EXPECT_FALSE(inserted);
+	EXPECT_EQ(&*i, &b);
+
+	set.erase(set.iterator_to(a));
+	EXPECT_EQ(set.find(1u), set.end());
+	EXPECT_EQ(&*set.find(1001u), &c);
+	EXPECT_EQ(set.size(), 2u);
+
+	std::tie(i, inserted) = set.insert_check(1u);
+	EXPECT_TRUE(inserted);
+	set.insert(i, a);
+	EXPECT_EQ(&*set.find(1u), &a);
+
+	set.clear_and_dispose([](Item *item){ item->disposed = true; });
+	EXPECT_TRUE(set.empty());
+	EXPECT_TRUE(a.disposed);
+	EXPECT_TRUE(b.disposed);
+	EXPECT_TRUE(c.disposed);
+	EXPECT_FALSE(a.hook.is_linked());
+}
+
+/**
+ * Insert many items and verify that all of them can be found while
+ * the bucket array grows.
+ */
+TEST(IntrusiveGrowingHashSet, Grow)
+{
+	constexpr unsigned N = 100000;
+
+	std::vector<Item> items;
+	items.reserve(N);
+
+	Set set;
+
+	for (unsigned i = 0; i < N; ++i) {
+		set.insert(items.emplace_back(i));
+
+		/* the load factor never exceeds 1 */
+		EXPECT_LE(set.size(), set.bucket_count());
+
+		if (i % 997 == 0) {
+			for (unsigned j = 0; j <= i; j += 101)
+				ASSERT_EQ(&*set.find(j), &items[j]);
+		}
+	}
+
+	EXPECT_EQ(set.size(), N);
+	EXPECT_GE(set.bucket_count(), N);
+
+	for (unsigned i = 0; i < N; ++i)
+		ASSERT_EQ(&*set.find(i), &items[i]);
+
+	std::size_t n = 0;
+	set.for_each([&n](const Item &){ ++n; });
+	EXPECT_EQ(n, N);
+
+	/* remove all odd items */
+	EXPECT_EQ(set.remove_and_dispose_if([](const Item &item){
+		return item.value % 2 != 0;
+	}, [](Item *item){ item->disposed = true; }), N / 2);
+
+	EXPECT_EQ(set.size(), N / 2);
+
+	for (unsigned i = 0; i < N; ++i) {
+		if (i % 2 != 0) {
+			EXPECT_TRUE(items[i].disposed);
+			ASSERT_EQ(set.find(i), set.end());
+		} else
+			ASSERT_EQ(&*set.find(i), &items[i]);
+	}
+
+	set.clear_and_dispose([](Item *){});
+}
+
+/**
+ * Remove items while a grow operation is still in progress.
+ */
+TEST(IntrusiveGrowingHashSet, EraseWhileRehashing)
+{
+	std::vector<Item> items;
+	items.reserve(4096);
+
+	Set set;
+
+	while (!set.is_rehashing())
+		set.insert(items.emplace_back(items.size()));
+
+	for (auto &i : items)
+		if (i.value % 3 == 0)
+			set.erase(set.iterator_to(i));
+
+	while (set.is_rehashing())
+		set.insert(items.emplace_back(items.size()));
+
+	for (const auto &i : items) {
+		if (i.value % 3 == 0 && i.value < 65)
+			ASSERT_EQ(set.find(i.value), set.end());
+		else
+			ASSERT_EQ(&*set.find(i.value), &i);
+	}
+
+	set.clear_and_dispose([](Item *){});
+}
+
+TEST(IntrusiveGrowingHashSet, ExpireFindIf)
+{
+	Item a{1}, b{1}, c{1}, d{2};
+
+	/* new items are inserted at the front of the chain, so a
+	   is visited first */
+	Set set;
+	set.insert(d);
+	set.insert(c);
+	set.insert(b);
+	set.insert(a);
+
+	auto i = set.expire_find_if(1u, [&a](const Item &item){
+		return &item == &a;
+	}, [](Item *item){
+		item->disposed = true;
+	}, [&c](const Item &item){
+		return &item == &c;
+	});
+
+	EXPECT_EQ(&*i, &c);
+	EXPECT_TRUE(a.disposed);
+	EXPECT_FALSE(a.hook.is_linked());
+	EXPECT_EQ(set.size(), 3u);
+
+	EXPECT_EQ(set.remove_and_dispose_if(1u, [](const Item &){ return true; },
+					    [](Item *item){ item->disposed = true; }),
+		  2u);
+	EXPECT_TRUE(b.disposed);
+	EXPECT_TRUE(c.disposed);
+	EXPECT_FALSE(d.disposed);
+	EXPECT_EQ(set.size(), 1u);
+
+	set.clear_and_dispose([](Item *){});
+}
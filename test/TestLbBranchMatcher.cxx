@@ -0,0 +1,207 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#include "lb/BranchMatcher.hxx"
+#include "net/IPv4Address.hxx"
+
+#include <gtest/gtest.h>
+
+#include <span>
+#include <vector>
+
+#include <string.h>
+
+namespace {
+
+struct FakeHeaders {
+	const char *host = nullptr;
+
+	const char *Get(const char *name) const noexcept {
+		return strcmp(name, "host") == 0 ? host : nullptr;
+	}
+};
+
+struct FakeRequest {
+	HttpMethod method = HttpMethod::GET;
+	const char *uri;
+	FakeHeaders headers;
+	SocketAddress remote_address;
+};
+
+using Type = LbAttributeReference::Type;
+
+static LbConditionConfig
+MakeExact(LbAttributeReference &&a, const char *value, bool negate=false)
+{
+	return {std::move(a), negate, value};
+}
+
+static LbConditionConfig
+MakeRegex(LbAttributeReference &&a, const char *value, bool negate=false)
+{
+	return {std::move(a), negate, UniqueRegex{value, false, false}, value};
+}
+
+static LbConditionConfig
+MakeAddress(const char *value, bool negate=false)
+{
+	return {Type::REMOTE_ADDRESS, negate, MaskedSocketAddress{value}, value};
+}
+
+class Conditions {
+	std::vector<LbConditionConfig> conditions;
+	std::vector<const LbConditionConfig *> pointers;
+
+public:
+	void Add(LbConditionConfig &&c) {
+		conditions.emplace_back(std::move(c));
+	}
+
+	std::span<const LbConditionConfig *const> Finish() {
+		for (const auto &i : conditions)
+			pointers.push_back(&i);
+		return pointers;
+	}
+};
+
+/**
+ * The reference implementation: evaluate all conditions in order.
+ */
+static std::size_t
+FindLinear(std::span<const LbConditionConfig *const> conditions,
+	   const FakeRequest &request) noexcept
+{
+	for (std::size_t i = 0; i < conditions.size(); ++i)
+		if (conditions[i]->MatchRequest(request))
+			return i;
+
+	return LbBranchMatcher::NONE;
+}
+
+} // anonymous namespace
+
+TEST(LbBranchMatcher, Basic)
+{
+	Conditions c;
+	c.Add(MakeRegex(Type::URI, "^/static/"));		// 0
+	c.Add(MakeExact(Type::URI, "/foo"));			// 1
+	c.Add(MakeExact({Type::HEADER, "host"}, "a.example"));	// 2
+	c.Add(MakeAddress("10.1.0.0/16"));			// 3
+	c.Add(MakeExact(Type::URI, "/foo"));			// 4
+	c.Add(MakeRegex(Type::URI, "\\.php$"));			// 5
+	c.Add(MakeExact(Type::URI, "/bar", true));		// 6
+	c.Add(MakeAddress("10.0.0.0/8"));			// 7
+	c.Add(MakeRegex(Type::URI, "^/static/"));		// 8
+	c.Add(MakeExact({Type::HEADER, "host"}, "b.example"));	// 9
+	c.Add(MakeRegex(Type::URI, "^/x\\Q.y"));		// 10
+
+	const auto conditions = c.Finish();
+	const LbBranchMatcher matcher{conditions};
+
+	const IPv4Address a1{10, 1, 2, 3, 80}, a2{10, 2, 3, 4, 80},
+		a3{192, 168, 1, 1, 80};
+
+	FakeRequest r{.uri = "/static/x.php", .remote_address = a3};
+	EXPECT_EQ(matcher.FindRequest(r), 0U);
+
+	r.uri = "/foo";
+	EXPECT_EQ(matcher.FindRequest(r), 1U);
+
+	r.uri = "/a.php";
+	r.headers.host = "b.example";
+	EXPECT_EQ(matcher.FindRequest(r), 5U);
+
+	r.uri = "/bar";
+	EXPECT_EQ(matcher.FindRequest(r), 9U);
+
+	r.remote_address = a2;
+	EXPECT_EQ(matcher.FindRequest(r), 7U);
+
+	r.remote_address = a1;
+	EXPECT_EQ(matcher.FindRequest(r), 3U);
+
+	r.headers.host = "a.example";
+	EXPECT_EQ(matcher.FindRequest(r), 2U);
+
+	r.uri = "/x.y";
+	r.headers.host = nullptr;
+	r.remote_address = a3;
+	EXPECT_EQ(matcher.FindRequest(r), 6U);
+}
+
+TEST(LbBranchMatcher, NoMatch)
+{
+	Conditions c;
+	c.Add(MakeExact(Type::URI, "/foo"));
+	c.Add(MakeExact(Type::URI, "/bar"));
+	c.Add(MakeRegex(Type::URI, "^/a"));
+	c.Add(MakeRegex(Type::URI, "^/b"));
+	c.Add(MakeAddress("10.0.0.0/8"));
+	c.Add(MakeAddress("fd00::/8"));
+
+	const auto conditions = c.Finish();
+	const LbBranchMatcher matcher{conditions};
+
+	const IPv4Address address{192, 168, 1, 1, 80};
+	const FakeRequest r{.uri = "/c", .remote_address = address};
+	EXPECT_EQ(matcher.FindRequest(r), LbBranchMatcher::NONE);
+}
+
+/**
+ * Compare with the linear search for many combinations.
+ */
+TEST(LbBranchMatcher, Linear)
+{
+	static constexpr const char *uris[] = {
+		"/", "/foo", "/foo/bar", "/static/a.css", "/a.php", "/bar",
+		"", "/FOO",
+	};
+
+	static constexpr const char *hosts[] = {
+		nullptr, "", "a.example", "b.example", "c.example",
+	};
+
+	const IPv4Address ipv4[] = {
+		{10, 1, 2, 3, 80},
+		{10, 2, 3, 4, 80},
+		{192, 168, 1, 1, 80},
+		{0, 0, 0, 0, 80},
+	};
+
+	Conditions c;
+	c.Add(MakeExact(Type::URI, "/bar", true));
+	c.Add(MakeRegex(Type::URI, "^/foo/"));
+	c.Add(MakeExact({Type::HEADER, "host"}, "c.example"));
+	c.Add(MakeAddress("192.168.0.0/16"));
+	c.Add(MakeExact(Type::URI, ""));
+	c.Add(MakeRegex(Type::URI, "(?i)^/foo$"));
+	c.Add(MakeExact({Type::HEADER, "host"}, ""));
+	c.Add(MakeAddress("10.1.2.3"));
+	c.Add(MakeRegex({Type::HEADER, "host"}, "^a\\."));
+	c.Add(MakeRegex(Type::URI, "\\.(css|js)$"));
+	c.Add(MakeExact(Type::METHOD, "GET"));
+	c.Add(MakeAddress("0.0.0.0/0"));
+	c.Add(MakeRegex(Type::URI, "php", true));
+
+	const auto conditions = c.Finish();
+	const LbBranchMatcher matcher{conditions};
+
+	/* the same without the last three (catch-all) conditions */
+	const auto partial = conditions.first(10);
+	const LbBranchMatcher partial_matcher{partial};
+
+	for (const char *uri : uris) {
+		for (const char *host : hosts) {
+			for (const auto &address : ipv4) {
+				FakeRequest r{.uri = uri, .remote_address = address};
+				r.headers.host = host;
+
+				EXPECT_EQ(matcher.FindRequest(r),
+					  FindLinear(conditions, r));
+				EXPECT_EQ(partial_matcher.FindRequest(r),
+					  FindLinear(partial, r));
+			}
+		}
+	}
+}
@@ -0,0 +1,103 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#include "pipe/Stock.hxx"
+#include "pipe/Lease.hxx"
+#include "event/Loop.hxx"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+TEST(PipeStock, InitialSize)
+{
+	EventLoop event_loop;
+	PipeStock stock(event_loop, "pipe", 128 * 1024);
+
+	PipeLease lease(&stock);
+	lease.Create();
+	EXPECT_EQ(lease.GetCapacity(), 128u * 1024u);
+
+	/* growing is disabled */
+	lease.OnSpliced(lease.GetCapacity());
+	EXPECT_EQ(lease.GetCapacity(), 128u * 1024u);
+	EXPECT_EQ(stock.GetStats().n_splices, 1u);
+	EXPECT_EQ(stock.GetStats().spliced_bytes, 128u * 1024u);
+	EXPECT_EQ(stock.GetStats().n_grows, 0u);
+
+	lease.Release(true);
+}
+
+TEST(PipeStock, Grow)
+{
+	EventLoop event_loop;
+	PipeStock stock(event_loop, "pipe", 64 * 1024, 256 * 1024);
+
+	PipeLease lease(&stock);
+	lease.Create();
+	EXPECT_EQ(lease.GetCapacity(), 64u * 1024u);
+
+	/* a transfer which doesn't fill the pipe */
+	lease.OnSpliced(4096);
+	EXPECT_EQ(lease.GetCapacity(), 64u * 1024u);
+
+	lease.OnSpliced(64 * 1024);
+	EXPECT_EQ(lease.GetCapacity(), 128u * 1024u);
+
+	lease.OnSpliced(128 * 1024);
+	EXPECT_EQ(lease.GetCapacity(), 256u * 1024u);
+
+	/* the limit has been reached */
+	lease.OnSpliced(256 * 1024);
+	EXPECT_EQ(lease.GetCapacity(), 256u * 1024u);
+
+	EXPECT_EQ(stock.GetStats().n_splices, 4u);
+	EXPECT_EQ(stock.GetStats().n_grows, 2u);
+
+	/* the pipe is shrunk before it is reused */
+	lease.Release(true);
+	lease.Create();
+	EXPECT_EQ(lease.GetCapacity(), 64u * 1024u);
+	lease.Release(true);
+}
+
+/**
+ * The total growth of all pipes of a stock is limited.
+ */
+TEST(PipeStock, GrowBudget)
+{
+	EventLoop event_loop;
+	PipeStock stock(event_loop, "pipe", 64 * 1024, 1024 * 1024);
+
+	std::vector<PipeLease> leases;
+	std::size_t grown = 0;
+
+	for (unsigned i = 0; i < 24; ++i) {
+		auto &lease = leases.emplace_back(&stock);
+		lease.Create();
+
+		std::size_t capacity;
+		do {
+			capacity = lease.GetCapacity();
+			lease.OnSpliced(capacity);
+		} while (lease.GetCapacity() > capacity);
+
+		grown += lease.GetCapacity() - 64 * 1024;
+	}
+
+	EXPECT_LE(grown, 16u * 1024u * 1024u);
+	EXPECT_GT(stock.GetStats().n_grow_refused, 0u);
+
+	/* releasing the pipes returns the budget */
+	for (auto &lease : leases)
+		lease.Release(true);
+	leases.clear();
+
+	PipeLease lease(&stock);
+	lease.Create();
+	EXPECT_EQ(lease.GetCapacity(), 64u * 1024u);
+	lease.OnSpliced(64 * 1024);
+	EXPECT_EQ(lease.GetCapacity(), 128u * 1024u);
+	lease.Release(true);
+}
@@ -0,0 +1,364 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#include "translation/MuxClient.hxx"
+#include "translation/MuxProtocol.hxx"
+#include "translation/Marshal.hxx"
+#include "translation/Handler.hxx"
+#include "translation/Request.hxx"
+#include "translation/Response.hxx"
+#include "translation/Protocol.hxx"
+#include "pool/pool.hxx"
+#include "pool/Ptr.hxx"
+#include "memory/fb_pool.hxx"
+#include "PInstance.hxx"
+#include "system/Error.hxx"
+#include "net/UniqueSocketDescriptor.hxx"
+#include "util/Cancellable.hxx"
+#include "stopwatch.hxx"
+#include "AllocatorPtr.hxx"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <memory>
+#include <string>
+
+#include <string.h>
+#include <sys/socket.h>
+
+namespace {
+
+struct MyTranslateHandler final : TranslateHandler {
+	EventLoop &event_loop;
+
+	bool response = false;
+	std::exception_ptr error;
+
+	explicit MyTranslateHandler(EventLoop &_event_loop) noexcept
+		:event_loop(_event_loop) {}
+
+	/* virtual methods from TranslateHandler */
+	void OnTranslateResponse(UniquePoolPtr<TranslateResponse>) noexcept override {
+		response = true;
+		event_loop.Break();
+	}
+
+	void OnTranslateError(std::exception_ptr _error) noexcept override {
+		error = std::move(_error);
+		event_loop.Break();
+	}
+};
+
+struct Instance final : PInstance, TranslationMuxHandler {
+	[[no_unique_address]]
+	const ScopeFbPoolInit fb_pool_init;
+
+	PoolPtr pool;
+
+	UniqueSocketDescriptor server;
+
+	std::unique_ptr<TranslationMuxConnection> mux;
+
+	unsigned n_fallback = 0, n_available = 0;
+
+	bool closed = false, supported = false;
+
+	Instance()
+		:pool(pool_new_libc(root_pool, "test"))
+	{
+		UniqueSocketDescriptor client;
+		if (!UniqueSocketDescriptor::CreateSocketPair(AF_LOCAL,
+							      SOCK_STREAM, 0,
+							      client, server))
+			throw MakeErrno("socketpair() failed");
+
+		client.SetNonBlocking();
+
+		mux = std::make_unique<TranslationMuxConnection>(event_loop,
+								 std::move(client),
+								 *this);
+	}
+
+	void Send(TranslateHandler &handler,
+		  CancellablePointer &cancel_ptr) noexcept {
+		auto *request = NewFromPool<TranslateRequest>(*pool);
+		request->uri = "/";
+		mux->SendRequest(*pool, *request, nullptr, handler, cancel_ptr);
+	}
+
+	void ServerWrite(std::span<const std::byte> src) {
+		ASSERT_EQ(send(server.Get(), src.data(), src.size(),
+			       MSG_NOSIGNAL),
+			  (ssize_t)src.size());
+	}
+
+	void ServerWrite(GrowingBuffer &&gb) {
+		while (true) {
+			auto src = gb.Read();
+			if (src.empty())
+				break;
+
+			ServerWrite(src);
+			gb.Consume(src.size());
+		}
+	}
+
+	/**
+	 * Send the expected negotiation response, i.e. an echo of
+	 * the negotiation request.
+	 */
+	void ServerAcceptMux() {
+		std::array<std::byte, 1 + sizeof(TRANSLATION_MUX_MAGIC)> payload;
+		payload[0] = static_cast<std::byte>(TRANSLATION_PROTOCOL_VERSION);
+		memcpy(payload.data() + 1, TRANSLATION_MUX_MAGIC,
+		       sizeof(TRANSLATION_MUX_MAGIC));
+
+		TranslationMarshaller m;
+		m.Write(TranslationCommand::BEGIN,
+			std::span<const std::byte>{payload});
+		m.Write(TranslationCommand::END);
+		ServerWrite(m.Commit());
+	}
+
+	/**
+	 * Send a response which is not an echo of the negotiation
+	 * request, just like a server without multiplexing support
+	 * would.
+	 */
+	void ServerRejectMux() {
+		const uint8_t version = TRANSLATION_PROTOCOL_VERSION;
+
+		TranslationMarshaller m;
+		m.WriteT(TranslationCommand::BEGIN, version);
+		m.Write(TranslationCommand::END);
+		ServerWrite(m.Commit());
+	}
+
+	void ServerSendResponse(uint32_t id) {
+		TranslationMarshaller m;
+		m.Write(TranslationCommand::BEGIN);
+		m.Write(TranslationCommand::END);
+		auto payload = m.Commit();
+
+		const TranslationMuxHeader header{
+			.id = id,
+			.length = static_cast<uint32_t>(payload.GetSize()),
+		};
+
+		ServerWrite(std::as_bytes(std::span{&header, 1}));
+		ServerWrite(std::move(payload));
+	}
+
+	/**
+	 * Send a response in frames with only one payload byte each,
+	 * i.e. every packet header is split across frames.  A frame
+	 * for an unknown request is inserted after each one.
+	 */
+	void ServerSendSplitResponse(uint32_t id) {
+		TranslationMarshaller m;
+		m.Write(TranslationCommand::BEGIN);
+		m.Write(TranslationCommand::END);
+		auto payload = m.Commit();
+
+		std::string frames;
+
+		while (true) {
+			const auto src = payload.Read();
+			if (src.empty())
+				break;
+
+			for (const std::byte b : src) {
+				const TranslationMuxHeader header{
+					.id = id,
+					.length = 1,
+				};
+
+				frames.append((const char *)&header, sizeof(header));
+				frames.push_back(static_cast<char>(b));
+
+				const TranslationMuxHeader other{
+					.id = 0xdeadbeef,
+					.length = 1,
+				};
+
+				frames.append((const char *)&other, sizeof(other));
+				frames.push_back('\0');
+			}
+
+			payload.Consume(src.size());
+		}
+
+		ServerWrite(std::as_bytes(std::span{frames}));
+	}
+
+	/* virtual methods from class TranslationMuxHandler */
+	void OnTranslationMuxFallback(AllocatorPtr,
+				      const TranslateRequest &,
+				      const StopwatchPtr &,
+				      TranslateHandler &,
+				      CancellablePointer &) noexcept override {
+		++n_fallback;
+	}
+
+	void OnTranslationMuxAvailable() noexcept override {
+		++n_available;
+	}
+
+	void OnTranslationMuxClosed(bool _supported) noexcept override {
+		closed = true;
+		supported = _supported;
+		mux.reset();
+		event_loop.Break();
+	}
+};
+
+} // anonymous namespace
+
+TEST(TranslationMux, Response)
+{
+	Instance instance;
+	MyTranslateHandler handler{instance.event_loop};
+	CancellablePointer cancel_ptr;
+
+	instance.Send(handler, cancel_ptr);
+	instance.ServerAcceptMux();
+	instance.ServerSendResponse(1);
+
+	instance.event_loop.Run();
+
+	EXPECT_TRUE(handler.response);
+	EXPECT_FALSE(handler.error);
+	EXPECT_FALSE(instance.closed);
+	EXPECT_EQ(instance.n_available, 1U);
+	ASSERT_TRUE(instance.mux);
+	EXPECT_TRUE(instance.mux->IsIdle());
+}
+
+/**
+ * An explicit rejection disables multiplexing.
+ */
+TEST(TranslationMux, Rejected)
+{
+	Instance instance;
+	MyTranslateHandler handler{instance.event_loop};
+	CancellablePointer cancel_ptr;
+
+	instance.Send(handler, cancel_ptr);
+	instance.Send(handler, cancel_ptr);
+	instance.ServerRejectMux();
+
+	instance.event_loop.Run();
+
+	EXPECT_TRUE(instance.closed);
+	EXPECT_FALSE(instance.supported);
+	EXPECT_EQ(instance.n_fallback, 2U);
+	EXPECT_FALSE(handler.response);
+	EXPECT_FALSE(handler.error);
+}
+
+/**
+ * A connection failure before negotiation has completed resubmits
+ * all requests, but does not disable multiplexing.
+ */
+TEST(TranslationMux, ClosedBeforeHello)
+{
+	Instance instance;
+	MyTranslateHandler handler{instance.event_loop};
+	CancellablePointer cancel_ptr;
+
+	instance.Send(handler, cancel_ptr);
+	instance.server.Close();
+
+	instance.event_loop.Run();
+
+	EXPECT_TRUE(instance.closed);
+	EXPECT_TRUE(instance.supported);
+	EXPECT_EQ(instance.n_fallback, 1U);
+	EXPECT_FALSE(handler.error);
+}
+
+/**
+ * A connection failure after negotiation resubmits pending
+ * requests instead of failing them.
+ */
+TEST(TranslationMux, ClosedAfterHello)
+{
+	Instance instance;
+	MyTranslateHandler handler{instance.event_loop};
+	CancellablePointer cancel_ptr;
+
+	instance.Send(handler, cancel_ptr);
+	instance.ServerAcceptMux();
+	instance.server.Close();
+
+	instance.event_loop.Run();
+
+	EXPECT_TRUE(instance.closed);
+	EXPECT_TRUE(instance.supported);
+	EXPECT_EQ(instance.n_fallback, 1U);
+	EXPECT_FALSE(handler.error);
+}
+
+/**
+ * Packet headers split across frames must be reassembled.
+ */
+TEST(TranslationMux, SplitPacketHeader)
+{
+	Instance instance;
+	MyTranslateHandler handler{instance.event_loop};
+	CancellablePointer cancel_ptr;
+
+	instance.Send(handler, cancel_ptr);
+	instance.ServerAcceptMux();
+	instance.ServerSendSplitResponse(1);
+
+	instance.event_loop.Run();
+
+	EXPECT_TRUE(handler.response);
+	EXPECT_FALSE(handler.error);
+	EXPECT_FALSE(instance.closed);
+	ASSERT_TRUE(instance.mux);
+	EXPECT_TRUE(instance.mux->IsIdle());
+}
+
+/**
+ * The server closes an idle connection; this is a normal close which
+ * does not disable multiplexing.
+ */
+TEST(TranslationMux, ClosedWhileIdle)
+{
+	Instance instance;
+	MyTranslateHandler handler{instance.event_loop};
+	CancellablePointer cancel_ptr;
+
+	instance.Send(handler, cancel_ptr);
+	instance.ServerAcceptMux();
+	instance.ServerSendResponse(1);
+
+	instance.event_loop.Run();
+	ASSERT_TRUE(handler.response);
+	ASSERT_FALSE(instance.closed);
+
+	instance.server.Close();
+	instance.event_loop.Run();
+
+	EXPECT_TRUE(instance.closed);
+	EXPECT_TRUE(instance.supported);
+	EXPECT_EQ(instance.n_fallback, 0U);
+}
+
+TEST(TranslationMux, Cancel)
+{
+	Instance instance;
+	MyTranslateHandler handler{instance.event_loop};
+	CancellablePointer cancel_ptr;
+
+	instance.Send(handler, cancel_ptr);
+	cancel_ptr.Cancel();
+
+	EXPECT_EQ(instance.n_available, 1U);
+	ASSERT_TRUE(instance.mux);
+	EXPECT_TRUE(instance.mux->IsIdle());
+}
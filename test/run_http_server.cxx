@@ -16,6 +16,10 @@
 #include "io/SpliceSupport.hxx"
 #include "util/PrintException.hxx"
 
+#ifdef HAVE_URING
+#include "event/uring/Manager.hxx"
+#endif
+
 #include <memory>
 
 #include <stdio.h>
@@ -48,6 +52,13 @@ using Listener = TemplateServerSocket<Connection, Instance &,
 struct Instance final : PInstance {
 	ShutdownListener shutdown_listener;
 
+#ifdef HAVE_URING
+	/**
+	 * If set, then responses are sent using io_uring.
+	 */
+	std::unique_ptr<Uring::Manager> uring;
+#endif
+
 	std::unique_ptr<Listener> listener;
 
 	Instance()
@@ -59,15 +70,29 @@ private:
 	void ShutdownCallback() noexcept;
 };
 
+static UniquePoolPtr<FilteredSocket>
+NewSocket(Instance &instance, struct pool &pool,
+	  UniqueSocketDescriptor &&fd) noexcept
+{
+	auto socket = UniquePoolPtr<FilteredSocket>::Make(pool,
+							  instance.event_loop,
+							  std::move(fd),
+							  FdType::FD_SOCKET);
+
+#ifdef HAVE_URING
+	if (instance.uring)
+		socket->EnableUring(*instance.uring);
+#endif
+
+	return socket;
+}
+
 Connection::Connection(Instance &_instance, Mode _mode,
 		       UniqueSocketDescriptor &&fd,
 		       SocketAddress address) noexcept
 	:PoolHolder(pool_new_linear(_instance.root_pool, "connection", 2048)),
 	 DemoHttpServerConnection(pool, _instance.event_loop,
-				  UniquePoolPtr<FilteredSocket>::Make(pool,
-								      _instance.event_loop,
-								      std::move(fd),
-								      FdType::FD_SOCKET),
+				  NewSocket(_instance, pool, std::move(fd)),
 				  address, _mode),
 	 instance(_instance)
 {
@@ -77,6 +102,11 @@ void
 Instance::ShutdownCallback() noexcept
 {
 	listener.reset();
+
+#ifdef HAVE_URING
+	if (uring)
+		uring->SetVolatile();
+#endif
 }
 
 void
@@ -111,8 +141,16 @@ Connection::HttpConnectionClosed() noexcept
 int
 main(int argc, char **argv)
 try {
+	bool uring = false;
+	if (argc == 3 && strcmp(argv[1], "--uring") == 0) {
+		/* benchmark the io_uring socket writer */
+		uring = true;
+		++argv;
+		--argc;
+	}
+
 	if (argc != 2) {
-		fprintf(stderr, "Usage: %s {null|mirror|close|dummy|fixed|huge|hold}\n", argv[0]);
+		fprintf(stderr, "Usage: %s [--uring] {null|mirror|close|dummy|fixed|huge|hold}\n", argv[0]);
 		return EXIT_FAILURE;
 	}
 
@@ -124,6 +162,15 @@ try {
 	Instance instance;
 	instance.shutdown_listener.Enable();
 
+	if (uring) {
+#ifdef HAVE_URING
+		instance.uring = std::make_unique<Uring::Manager>(instance.event_loop);
+#else
+		fprintf(stderr, "io_uring support is disabled at compile time\n");
+		return EXIT_FAILURE;
+#endif
+	}
+
 	const char *mode = argv[1];
 	DemoHttpServerConnection::Mode parsed_mode;
 	if (strcmp(mode, "null") == 0)
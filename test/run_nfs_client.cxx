@@ -14,6 +14,7 @@
 #include "io/FileDescriptor.hxx"
 #include "io/SpliceSupport.hxx"
 #include "PInstance.hxx"
+#include "memory/SlicePool.hxx"
 #include "pool/pool.hxx"
 #include "http/ResponseHandler.hxx"
 #include "util/Cancellable.hxx"
@@ -36,6 +37,8 @@ struct Context final
 
 	NfsClient *client;
 
+	SlicePool buffer_pool{NFS_BUFFER_SIZE, 16, "nfs_buffers"};
+
 	bool aborted = false, failed = false, connected = false, closed = false;
 
 	SinkFd *body;
@@ -131,7 +134,9 @@ Context::OnNfsOpen(NfsFileHandle *handle, const struct statx &st) noexcept
 	body = sink_fd_new(event_loop, *pool,
 			   NewAutoPipeIstream(pool,
 					      istream_nfs_new(*pool, *handle,
-							      0, st.stx_size),
+							      0, st.stx_size,
+							      buffer_pool,
+							      1024 * 1024),
 					      nullptr),
 			   FileDescriptor(STDOUT_FILENO),
 			   guess_fd_type(STDOUT_FILENO),
@@ -218,6 +218,7 @@ try {
 			   context.process.control,
 			   context.process.input,
 			   context.process.output,
+			   context.process.shm.get(),
 			   context,
 			   nullptr,
 			   HttpMethod::GET, uri,
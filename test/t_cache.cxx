@@ -9,6 +9,9 @@
 
 #include <gtest/gtest.h>
 
+#include <deque>
+#include <string>
+
 #include <time.h>
 
 static void *
@@ -27,10 +30,11 @@ struct MyCacheItem final : PoolHolder, CacheItem {
 	const int match;
 	const int value;
 
-	MyCacheItem(PoolPtr &&_pool, int _match, int _value) noexcept
+	MyCacheItem(PoolPtr &&_pool, int _match, int _value,
+		    size_t _size=1) noexcept
 		:PoolHolder(std::move(_pool)),
 		 CacheItem(std::chrono::steady_clock::now(),
-			   std::chrono::hours(1), 1),
+			   std::chrono::hours(1), _size),
 		 match(_match), value(_value) {
 	}
 
@@ -41,10 +45,10 @@ struct MyCacheItem final : PoolHolder, CacheItem {
 };
 
 static MyCacheItem *
-my_cache_item_new(struct pool *_pool, int match, int value)
+my_cache_item_new(struct pool *_pool, int match, int value, size_t size=1)
 {
 	auto pool = pool_new_linear(_pool, "my_cache_item", 1024);
-	auto i = NewFromPool<MyCacheItem>(std::move(pool), match, value);
+	auto i = NewFromPool<MyCacheItem>(std::move(pool), match, value, size);
 	return i;
 }
 
@@ -139,3 +143,98 @@ TEST(TranslationCache, Basic)
 	ASSERT_EQ(i->match, 2);
 	ASSERT_EQ(i->value, 4);
 }
+
+/**
+ * Look up the key; if it is not in the cache, add a new item.
+ *
+ * @param keys a container which owns the key strings; it must
+ * outlive the cache
+ */
+static void
+Request(Cache &cache, struct pool &pool, std::deque<std::string> &keys,
+	std::string key) noexcept
+{
+	if (cache.Get(key.c_str()) != nullptr)
+		return;
+
+	const char *k = keys.emplace_back(std::move(key)).c_str();
+	cache.Put(k, *my_cache_item_new(&pool, 0, 0));
+}
+
+/**
+ * A scan of one-off keys must not flush frequently used items.
+ */
+static void
+TestScanResistance(CachePolicy policy, bool expect_resistant)
+{
+	PInstance instance;
+	std::deque<std::string> keys;
+
+	Cache cache(instance.event_loop, 100, policy);
+
+	for (unsigned round = 0; round < 4; ++round)
+		for (unsigned i = 0; i < 10; ++i)
+			Request(cache, instance.root_pool, keys,
+				"hot" + std::to_string(i));
+
+	for (unsigned i = 0; i < 1000; ++i)
+		Request(cache, instance.root_pool, keys,
+			"scan" + std::to_string(i));
+
+	const auto &stats = cache.GetStats();
+	EXPECT_EQ(stats.misses, 10u + 1000u);
+	EXPECT_EQ(stats.hits, 30u);
+	EXPECT_GE(stats.evictions, 900u);
+
+	unsigned survivors = 0;
+	for (unsigned i = 0; i < 10; ++i)
+		if (cache.Get(("hot" + std::to_string(i)).c_str()) != nullptr)
+			++survivors;
+
+	if (expect_resistant)
+		EXPECT_EQ(survivors, 10u);
+	else
+		EXPECT_EQ(survivors, 0u);
+
+	cache.Flush();
+}
+
+TEST(Cache, ScanLRU)
+{
+	TestScanResistance(CachePolicy::LRU, false);
+}
+
+TEST(Cache, ScanTinyLFU)
+{
+	TestScanResistance(CachePolicy::TINY_LFU, true);
+}
+
+TEST(Cache, ScanS3FIFO)
+{
+	TestScanResistance(CachePolicy::S3_FIFO, true);
+}
+
+/**
+ * Evicting a window item while the main segment is empty is not an
+ * admission rejection, because there was nothing to compete with.
+ */
+TEST(Cache, TinyLFUAdmissionRejected)
+{
+	PInstance instance;
+
+	Cache cache(instance.event_loop, 100, CachePolicy::TINY_LFU);
+
+	/* this one stays in the window (1% of 100) */
+	cache.Put("small", *my_cache_item_new(instance.root_pool, 0, 0));
+
+	/* this one needs the whole cache */
+	cache.Put("big", *my_cache_item_new(instance.root_pool, 0, 0, 100));
+
+	const auto &stats = cache.GetStats();
+	EXPECT_EQ(stats.evictions, 1u);
+	EXPECT_EQ(stats.admission_rejected, 0u);
+	EXPECT_EQ(cache.Get("small"), nullptr);
+	EXPECT_NE(cache.Get("big"), nullptr);
+
+	cache.Flush();
+}
@@ -5,6 +5,7 @@
 #include "BlockingResourceLoader.hxx"
 #include "MirrorResourceLoader.hxx"
 #include "fcache.hxx"
+#include "CachePolicy.hxx"
 #include "strmap.hxx"
 #include "http/ResponseHandler.hxx"
 #include "ResourceAddress.hxx"
@@ -29,7 +30,8 @@ TestCancelBlocking()
 
 		BlockingResourceLoader resource_loader;
 		FilterCache *fcache = filter_cache_new(root_pool, 65536,
-						       event_loop, resource_loader);
+						       CachePolicy::LRU,
+						       event_loop, nullptr, resource_loader);
 
 		~Context() noexcept {
 			filter_cache_close(fcache);
@@ -59,6 +61,90 @@ TestCancelBlocking()
 	cancel_ptr.Cancel();
 }
 
+/**
+ * Concurrent misses on the same key run the filter only once.
+ */
+static void
+TestCoalesce()
+{
+	struct CountingResourceLoader final : ResourceLoader {
+		BlockingResourceLoader next;
+		unsigned n_requests = 0;
+
+		/* virtual methods from class ResourceLoader */
+		void SendRequest(struct pool &pool,
+				 const StopwatchPtr &parent_stopwatch,
+				 const ResourceRequestParams &params,
+				 HttpMethod method,
+				 const ResourceAddress &address,
+				 HttpStatus status, StringMap &&headers,
+				 UnusedIstreamPtr body, const char *body_etag,
+				 HttpResponseHandler &handler,
+				 CancellablePointer &cancel_ptr) noexcept override {
+			++n_requests;
+			next.SendRequest(pool, parent_stopwatch, params,
+					 method, address,
+					 status, std::move(headers),
+					 std::move(body), body_etag,
+					 handler, cancel_ptr);
+		}
+	};
+
+	struct Context final : HttpResponseHandler {
+		EventLoop event_loop;
+		RootPool root_pool;
+
+		CountingResourceLoader resource_loader;
+		FilterCache *fcache = filter_cache_new(root_pool, 65536,
+						       CachePolicy::LRU,
+						       event_loop, nullptr, resource_loader);
+
+		~Context() noexcept {
+			filter_cache_close(fcache);
+		}
+
+		void Request(CancellablePointer &cancel_ptr) noexcept {
+			auto request_pool = pool_new_linear(root_pool, "Request", 8192);
+			filter_cache_request(*fcache, *request_pool, nullptr,
+					     nullptr, nullptr,
+					     "foo", HttpStatus::OK, {},
+					     istream_string_new(*request_pool, "bar"),
+					     *this, cancel_ptr);
+		}
+
+		/* virtual methods from class HttpResponseHandler */
+		void OnHttpResponse(HttpStatus, StringMap &&,
+				    UnusedIstreamPtr) noexcept override {
+			abort();
+		}
+
+		void OnHttpError(std::exception_ptr) noexcept override {
+			abort();
+		}
+	};
+
+	Context context;
+	CancellablePointer cancel_ptr1, cancel_ptr2, cancel_ptr3;
+
+	context.Request(cancel_ptr1);
+	context.Request(cancel_ptr2);
+	context.Request(cancel_ptr3);
+
+	if (context.resource_loader.n_requests != 1)
+		abort();
+
+	/* cancel a waiter */
+	cancel_ptr2.Cancel();
+
+	/* cancel the running request; the remaining waiter will be
+	   resumed later, but is canceled before that */
+	cancel_ptr1.Cancel();
+	cancel_ptr3.Cancel();
+
+	if (context.resource_loader.n_requests != 1)
+		abort();
+}
+
 static void
 TestNoBody()
 {
@@ -68,7 +154,8 @@ TestNoBody()
 
 		MirrorResourceLoader resource_loader;
 		FilterCache *fcache = filter_cache_new(root_pool, 65536,
-						       event_loop, resource_loader);
+						       CachePolicy::LRU,
+						       event_loop, nullptr, resource_loader);
 
 		~Context() noexcept {
 			filter_cache_close(fcache);
@@ -99,6 +186,7 @@ int
 main(int, char **)
 try {
 		TestCancelBlocking();
+		TestCoalesce();
 		TestNoBody();
 		return EXIT_SUCCESS;
 } catch (const std::exception &e) {
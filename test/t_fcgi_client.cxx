@@ -12,6 +12,7 @@
 #include "t_client.hxx"
 #include "tio.hxx"
 #include "fcgi/Client.hxx"
+#include "fcgi/MuxClient.hxx"
 #include "system/SetupProcess.hxx"
 #include "io/UniqueFileDescriptor.hxx"
 #include "io/SpliceSupport.hxx"
@@ -20,6 +21,9 @@
 #include "strmap.hxx"
 #include "memory/fb_pool.hxx"
 #include "net/SocketDescriptor.hxx"
+#include "net/TempListener.hxx"
+#include "net/UniqueSocketDescriptor.hxx"
+#include "util/Cancellable.hxx"
 #include "util/ConstBuffer.hxx"
 #include "util/ByteOrder.hxx"
 #include "fcgi_server.hxx"
@@ -443,6 +447,225 @@ test_malformed_header_value(auto &factory, Context &c) noexcept
 	assert(c.released);
 }
 
+/*
+ * FcgiMuxConnection
+ *
+ */
+
+static void
+mux_server_read_get_values()
+{
+	struct fcgi_record_header header;
+	read_fcgi_header(&header);
+
+	if (header.type != FCGI_GET_VALUES || header.request_id != 0)
+		abort();
+
+	discard(FromBE16(header.content_length) + header.padding_length);
+}
+
+static void
+mux_server_write_mpxs_conns(char value)
+{
+	static constexpr char name[] = FCGI_MPXS_CONNS;
+	static constexpr size_t name_length = sizeof(name) - 1;
+
+	const struct fcgi_record_header header = {
+		.version = FCGI_VERSION_1,
+		.type = FCGI_GET_VALUES_RESULT,
+		.request_id = 0,
+		.content_length = ToBE16(2 + name_length + 1),
+		.padding_length = 0,
+		.reserved = 0,
+	};
+
+	write_full(&header, sizeof(header));
+	write_byte(name_length);
+	write_byte(1);
+	write_full(name, name_length);
+	write_full(&value, 1);
+}
+
+static void
+mux_server_supported()
+{
+	mux_server_read_get_values();
+	mux_server_write_mpxs_conns('1');
+
+	/* wait until the connection gets closed */
+	char buffer[256];
+	while (recv(0, buffer, sizeof(buffer), 0) > 0) {}
+}
+
+static void
+mux_server_unsupported()
+{
+	mux_server_read_get_values();
+	mux_server_write_mpxs_conns('0');
+}
+
+/**
+ * Close the connection without responding to #FCGI_GET_VALUES.
+ */
+static void
+mux_server_close()
+{
+	mux_server_read_get_values();
+}
+
+/**
+ * Accept one connection in a new child process, and run the given
+ * function with the connection on stdin/stdout.
+ */
+static void
+StartMuxServer(TempListener &listener, void (*f)())
+{
+	const auto listen_fd = listener.Create(SOCK_STREAM, 1);
+
+	const auto pid = fork();
+	if (pid < 0) {
+		perror("fork() failed");
+		abort();
+	}
+
+	if (pid == 0) {
+		const int fd = accept(listen_fd.Get(), nullptr, nullptr);
+		if (fd < 0)
+			_exit(EXIT_FAILURE);
+
+		dup2(fd, STDIN_FILENO);
+		dup2(fd, STDOUT_FILENO);
+		close(fd);
+
+		f();
+		shutdown(0, SHUT_RDWR);
+		_exit(EXIT_SUCCESS);
+	}
+}
+
+struct MuxContext final : FcgiMuxConnectionHandler, FcgiMuxGetHandler {
+	EventLoop &event_loop;
+
+	FcgiMuxConnection connection;
+
+	CancellablePointer cancel_ptr;
+
+	bool ready = false, unavailable = false;
+	bool closed = false, supported = false;
+
+	explicit MuxContext(EventLoop &_event_loop) noexcept
+		:event_loop(_event_loop),
+		 connection(event_loop, 4, *this) {}
+
+	/**
+	 * Connect to the server and wait for the result of the
+	 * negotiation.
+	 */
+	void Run(AllocatorPtr alloc, SocketAddress address) noexcept {
+		connection.Get(alloc, *this, cancel_ptr);
+		connection.Start(address);
+
+		/* a connect error may be reported right away */
+		if (!ready && !closed)
+			event_loop.Run();
+	}
+
+	/* virtual methods from class FcgiMuxGetHandler */
+	void OnFcgiMuxReady(FcgiMuxConnection &) noexcept override {
+		ready = true;
+		event_loop.Break();
+	}
+
+	void OnFcgiMuxUnavailable() noexcept override {
+		unavailable = true;
+	}
+
+	/* virtual methods from class FcgiMuxConnectionHandler */
+	void OnFcgiMuxClosed(FcgiMuxConnection &,
+			     bool _supported) noexcept override {
+		closed = true;
+		supported = _supported;
+		event_loop.Break();
+	}
+};
+
+static void
+test_mux_supported(Instance &instance)
+{
+	TempListener listener;
+	StartMuxServer(listener, mux_server_supported);
+
+	auto pool = pool_new_libc(instance.root_pool, "test");
+	MuxContext c{instance.event_loop};
+	c.Run(*pool, listener.GetAddress());
+
+	assert(c.ready);
+	assert(!c.unavailable);
+	assert(!c.closed);
+	assert(c.connection.IsIdle());
+}
+
+/**
+ * An explicit negative #FCGI_GET_VALUES_RESULT means the server does
+ * not support multiplexing.
+ */
+static void
+test_mux_unsupported(Instance &instance)
+{
+	TempListener listener;
+	StartMuxServer(listener, mux_server_unsupported);
+
+	auto pool = pool_new_libc(instance.root_pool, "test");
+	MuxContext c{instance.event_loop};
+	c.Run(*pool, listener.GetAddress());
+
+	assert(!c.ready);
+	assert(c.unavailable);
+	assert(c.closed);
+	assert(!c.supported);
+}
+
+/**
+ * A connection failure during the negotiation is an ordinary
+ * failure: the waiter falls back to a classic connection, but
+ * multiplexing is not disabled.
+ */
+static void
+test_mux_closed(Instance &instance)
+{
+	TempListener listener;
+	StartMuxServer(listener, mux_server_close);
+
+	auto pool = pool_new_libc(instance.root_pool, "test");
+	MuxContext c{instance.event_loop};
+	c.Run(*pool, listener.GetAddress());
+
+	assert(!c.ready);
+	assert(c.unavailable);
+	assert(c.closed);
+	assert(c.supported);
+}
+
+/**
+ * A connect failure does not disable multiplexing either.
+ */
+static void
+test_mux_connect_failed(Instance &instance)
+{
+	/* nobody listens on this socket */
+	TempListener listener;
+	listener.Create(SOCK_STREAM, 1);
+
+	auto pool = pool_new_libc(instance.root_pool, "test");
+	MuxContext c{instance.event_loop};
+	c.Run(*pool, listener.GetAddress());
+
+	assert(!c.ready);
+	assert(c.unavailable);
+	assert(c.closed);
+	assert(c.supported);
+}
+
 /*
  * main
  *
@@ -462,6 +685,11 @@ main(int, char **)
 	run_test(instance, factory, test_malformed_header_name);
 	run_test(instance, factory, test_malformed_header_value);
 
+	test_mux_supported(instance);
+	test_mux_unsupported(instance);
+	test_mux_closed(instance);
+	test_mux_connect_failed(instance);
+
 	int status;
 	while (wait(&status) > 0) {
 		assert(!WIFSIGNALED(status));
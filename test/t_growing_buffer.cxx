@@ -5,6 +5,8 @@
 #include "TestPool.hxx"
 #include "memory/GrowingBuffer.hxx"
 #include "memory/istream_gb.hxx"
+#include "memory/ZeroCopyHold.hxx"
+#include "istream/Bucket.hxx"
 #include "istream/istream.hxx"
 #include "istream/Sink.hxx"
 #include "istream/UnusedPtr.hxx"
@@ -258,6 +260,57 @@ TEST(GrowingBufferTest, Skip)
 	ASSERT_EQ(x.data(), nullptr);
 }
 
+/** consume buckets which may still be read by the kernel */
+TEST(GrowingBufferTest, ZeroCopy)
+{
+	const ScopeFbPoolInit fb_pool_init;
+	TestPool pool;
+	GrowingBuffer buffer;
+
+	constexpr size_t buffer_size = FB_SIZE - sizeof(void *) - sizeof(DefaultChunkAllocator) - 2 * sizeof(size_t);
+
+	static std::byte data[buffer_size * 2];
+	for (size_t i = 0; i < sizeof(data); ++i)
+		data[i] = std::byte(i);
+	buffer.Write(std::span{data});
+
+	GrowingBufferReader reader(std::move(buffer));
+
+	ZeroCopyHoldList holds;
+	IstreamBucketList list;
+	list.EnableZeroCopy(holds);
+	reader.FillBucketList(list);
+
+	auto i = list.begin();
+	ASSERT_NE(i, list.end());
+	ASSERT_TRUE(i->IsZeroCopy());
+	const auto first = i->GetBuffer();
+	ASSERT_EQ(first.size(), buffer_size);
+
+	/* consume the first buffer and half of the second one: both
+	   must be held, and the rest must be copied to a new
+	   buffer */
+	ASSERT_EQ(reader.ConsumeBucketList(buffer_size + 10, &holds),
+		  buffer_size + 10);
+	ASSERT_FALSE(holds.empty());
+
+	/* the consumed memory is still intact */
+	ASSERT_EQ(memcmp(first.data(), data, buffer_size), 0);
+
+	auto x = reader.Read();
+	ASSERT_EQ(x.size(), buffer_size - 10);
+	ASSERT_EQ(memcmp(x.data(), data + buffer_size + 10, x.size()), 0);
+
+	holds.Clear();
+
+	/* without holds, this behaves as usual */
+	IstreamBucketList list2;
+	reader.FillBucketList(list2);
+	ASSERT_FALSE(list2.begin()->IsZeroCopy());
+	ASSERT_EQ(reader.ConsumeBucketList(x.size()), x.size());
+	ASSERT_TRUE(reader.IsEOF());
+}
+
 /** test reading the head while appending to the tail */
 TEST(GrowingBufferTest, ConcurrentRW)
 {
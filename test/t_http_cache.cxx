@@ -4,6 +4,7 @@
 
 #include "tconstruct.hxx"
 #include "http/cache/Public.hxx"
+#include "CachePolicy.hxx"
 #include "ResourceLoader.hxx"
 #include "ResourceAddress.hxx"
 #include "RecordingHttpResponseHandler.hxx"
@@ -188,8 +189,9 @@ struct Instance final : PInstance {
 	HttpCache *const cache;
 
 	Instance()
-		:cache(http_cache_new(root_pool, 1024 * 1024, true,
-				      event_loop, resource_loader))
+		:cache(http_cache_new(root_pool, 1024 * 1024,
+				      CachePolicy::LRU, true,
+				      event_loop, nullptr, resource_loader))
 	{
 	}
 
@@ -40,9 +40,13 @@
 #include "stopwatch.hxx"
 
 #include <functional>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/socket.h>
 
 class Server final
 	: PoolHolder,
@@ -56,12 +60,15 @@ class Server final
 
 	FilteredSocket client_fs;
 
+	unsigned n_responses = 0, break_responses = 0;
+
 	bool client_fs_released = false;
 
 	bool break_closed = false;
 
 public:
-	Server(struct pool &_pool, EventLoop &event_loop);
+	Server(struct pool &_pool, EventLoop &event_loop,
+	       unsigned pipeline_depth=0);
 
 	~Server() noexcept {
 		CloseClientSocket();
@@ -101,6 +108,25 @@ public:
 				    handler, cancel_ptr);
 	}
 
+	SocketDescriptor GetClientSocket() noexcept {
+		return client_fs.GetSocket();
+	}
+
+	/**
+	 * Run the event loop until the given number of responses
+	 * have been finished (in total).
+	 */
+	void WaitResponses(unsigned n) noexcept {
+		if (n_responses >= n)
+			return;
+
+		break_responses = n;
+		GetEventLoop().Run();
+		break_responses = 0;
+
+		assert(n_responses >= n);
+	}
+
 	void CloseClientSocket() noexcept {
 		if (client_fs.IsValid() && client_fs.IsConnected()) {
 			client_fs.Close();
@@ -124,6 +150,13 @@ private:
 	void HandleHttpRequest(IncomingHttpRequest &request,
 			       const StopwatchPtr &parent_stopwatch,
 			       CancellablePointer &cancel_ptr) noexcept override;
+	void ResponseFinished() noexcept override {
+		++n_responses;
+
+		if (break_responses > 0 && n_responses >= break_responses)
+			GetEventLoop().Break();
+	}
+
 	void HttpConnectionError(std::exception_ptr e) noexcept override;
 	void HttpConnectionClosed() noexcept override;
 
@@ -264,7 +297,8 @@ private:
 	}
 };
 
-Server::Server(struct pool &_pool, EventLoop &event_loop)
+Server::Server(struct pool &_pool, EventLoop &event_loop,
+	       unsigned pipeline_depth)
 	:PoolHolder(pool_new_libc(&_pool, "catch")),
 	 client_fs(event_loop)
 {
@@ -279,7 +313,8 @@ Server::Server(struct pool &_pool, EventLoop &event_loop)
 										    std::move(server_socket),
 										    FdType::FD_SOCKET),
 						nullptr, nullptr,
-						true, *this, *this);
+						true, pipeline_depth,
+						*this, *this);
 
 	client_fs.InitDummy(client_socket.Release(), FdType::FD_SOCKET);
 }
@@ -505,6 +540,124 @@ TestDiscardedHugeRequestBody(Server &server)
 	client.ExpectResponse(HttpStatus::OK, "foo");
 }
 
+/**
+ * Send three pipelined requests at once.  The handler answers the
+ * later ones first, but the responses must arrive in request order.
+ */
+static void
+TestPipeline(Server &server)
+{
+	std::vector<IncomingHttpRequest *> requests;
+	server.SetRequestHandler([&requests](IncomingHttpRequest &request, CancellablePointer &) noexcept {
+		requests.push_back(&request);
+
+		if (requests.size() == 3) {
+			/* all requests have been dispatched; answer
+			   them in reverse order */
+			for (auto i = requests.rbegin(); i != requests.rend(); ++i) {
+				auto &r = **i;
+				r.SendResponse(HttpStatus::OK, {},
+					       istream_string_new(r.pool, r.uri));
+			}
+		}
+	});
+
+	static constexpr std::string_view raw_requests =
+		"GET /a HTTP/1.1\r\nHost: x\r\n\r\n"
+		"GET /b HTTP/1.1\r\nHost: x\r\n\r\n"
+		"GET /c HTTP/1.1\r\nHost: x\r\n\r\n";
+
+	const auto s = server.GetClientSocket();
+	if (send(s.Get(), raw_requests.data(), raw_requests.size(),
+		 MSG_DONTWAIT) != (ssize_t)raw_requests.size())
+		throw MakeErrno("send() failed");
+
+	server.WaitResponses(3);
+
+	if (requests.size() != 3)
+		throw std::runtime_error("Pipelined requests were not dispatched");
+
+	std::string response;
+	char buffer[4096];
+	ssize_t nbytes;
+	while ((nbytes = recv(s.Get(), buffer, sizeof(buffer),
+			      MSG_DONTWAIT)) > 0)
+		response.append(buffer, nbytes);
+
+	const auto a = response.find("\r\n\r\n/a");
+	const auto b = response.find("\r\n\r\n/b");
+	const auto c = response.find("\r\n\r\n/c");
+	if (a == response.npos || b == response.npos || c == response.npos ||
+	    a > b || b > c)
+		throw FmtRuntimeError("Wrong pipelined responses: '{}'",
+				      response);
+}
+
+/**
+ * A request pipelined after an unsafe one must not be dispatched
+ * before the response to the unsafe one has been sent.
+ */
+static void
+TestPipelineUnsafe(Server &server)
+{
+	class RespondLater {
+		FineTimerEvent timer;
+
+		IncomingHttpRequest *request = nullptr;
+
+	public:
+		explicit RespondLater(EventLoop &event_loop) noexcept
+			:timer(event_loop, BIND_THIS_METHOD(OnTimer)) {}
+
+		bool IsPending() const noexcept {
+			return request != nullptr;
+		}
+
+		void Schedule(IncomingHttpRequest &_request) noexcept {
+			request = &_request;
+			timer.Schedule(std::chrono::milliseconds(10));
+		}
+
+	private:
+		void OnTimer() noexcept {
+			std::exchange(request, nullptr)->SendResponse(HttpStatus::NO_CONTENT,
+								      {}, nullptr);
+		}
+	} respond_later(server.GetEventLoop());
+
+	bool early = false;
+
+	server.SetRequestHandler([&respond_later, &early](IncomingHttpRequest &request, CancellablePointer &) noexcept {
+		if (request.method == HttpMethod::DELETE) {
+			/* respond later; a GET dispatched meanwhile
+			   would be an error */
+			respond_later.Schedule(request);
+			return;
+		}
+
+		if (respond_later.IsPending())
+			early = true;
+
+		request.SendResponse(HttpStatus::OK, {},
+				     istream_string_new(request.pool,
+							request.uri));
+	});
+
+	static constexpr std::string_view raw_requests =
+		"DELETE /a HTTP/1.1\r\nHost: x\r\n\r\n"
+		"GET /b HTTP/1.1\r\nHost: x\r\n\r\n";
+
+	const auto s = server.GetClientSocket();
+	if (send(s.Get(), raw_requests.data(), raw_requests.size(),
+		 MSG_DONTWAIT) != (ssize_t)raw_requests.size())
+		throw MakeErrno("send() failed");
+
+	server.WaitResponses(2);
+
+	if (early)
+		throw std::runtime_error("Request after DELETE was dispatched early");
+}
+
 int
 main(int argc, char **argv) noexcept
 try {
@@ -534,6 +687,22 @@ try {
 		server.CloseClientSocket();
 		instance.event_loop.Run();
 	}
+
+	{
+		Server server(instance.root_pool, instance.event_loop, 4);
+		TestPipeline(server);
+
+		server.CloseClientSocket();
+		instance.event_loop.Run();
+	}
+
+	{
+		Server server(instance.root_pool, instance.event_loop, 4);
+		TestPipelineUnsafe(server);
+
+		server.CloseClientSocket();
+		instance.event_loop.Run();
+	}
 } catch (...) {
 	PrintException(std::current_exception());
 	return EXIT_FAILURE;
@@ -3,12 +3,18 @@
 // author: Max Kellermann <mk@cm4all.com>
 
 #include "memory/Rubber.hxx"
+#include "stats/AllocatorStats.hxx"
 
 #include <gtest/gtest.h>
 
+#include <vector>
+
 #include <assert.h>
+#include <fcntl.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 static void
 Fill(void *_p, size_t length, unsigned seed)
@@ -267,3 +273,139 @@ TEST(RubberTest, FullTable)
 	for (unsigned i = 0; i < n; ++i)
 		r.Remove(ids[i]);
 }
+
+/**
+ * Fragment the allocator, then compact it incrementally while
+ * allocating and freeing objects between the steps.
+ */
+TEST(RubberTest, CompressStep)
+{
+	Rubber r{256 * 1024 * 1024, "rubber"};
+
+	struct Object {
+		unsigned id;
+		size_t size;
+	};
+
+	std::vector<Object> objects;
+
+	/* a mix of small and large objects (large enough to be
+	   remapped) */
+	for (unsigned i = 0; i < 200; ++i) {
+		const size_t size = i % 10 == 0
+			? 4 * 1024 * 1024 + i * 4096 + 96
+			: 1000 + i * 97;
+		const unsigned id = AddFillRubber(r, size);
+		ASSERT_GT(id, 0u);
+		objects.push_back({id, size});
+	}
+
+	/* remove every other object */
+	for (std::size_t i = 0; i < objects.size(); i += 2)
+		r.Remove(objects[i].id);
+
+	std::erase_if(objects, [n = 0](const Object &) mutable {
+		return n++ % 2 == 0;
+	});
+
+	const size_t brutto_before = r.GetBruttoSize();
+	ASSERT_GT(brutto_before, r.GetNettoSize());
+
+	unsigned n_steps = 0;
+	while (r.CompressStep(64 * 1024)) {
+		ASSERT_LT(++n_steps, 100000u);
+
+		if (n_steps % 16 == 0) {
+			/* the allocator remains usable during
+			   compaction */
+			const unsigned id = AddFillRubber(r, 5000);
+			ASSERT_GT(id, 0u);
+			objects.push_back({id, 5000});
+		}
+
+		if (n_steps % 32 == 0) {
+			r.Remove(objects.front().id);
+			objects.erase(objects.begin());
+		}
+	}
+
+	EXPECT_GT(n_steps, 1u);
+	EXPECT_LT(r.GetBruttoSize(), brutto_before);
+
+	/* only holes smaller than a page may remain */
+	const auto stats = r.GetStats();
+	EXPECT_LT(r.GetBruttoSize() - r.GetNettoSize(), stats.n_holes * 4096);
+	EXPECT_GT(stats.compress_moved, 0u);
+
+	for (const auto &i : objects)
+		ASSERT_TRUE(CheckRubber(r, i.id, i.size));
+
+	for (const auto &i : objects)
+		r.Remove(i.id);
+
+	EXPECT_EQ(r.GetNettoSize(), size_t(0u));
+	EXPECT_EQ(r.GetBruttoSize(), size_t(0u));
+	EXPECT_FALSE(r.CompressStep());
+}
+
+/**
+ * Pages passed to vmsplice() must not be modified after the object
+ * has been moved or removed.
+ */
+TEST(RubberTest, Share)
+{
+	Rubber r{4 * 1024 * 1024, "rubber"};
+
+	const unsigned a = AddFillRubber(r, 64 * 1024 + 100);
+	ASSERT_GT(a, 0u);
+
+	constexpr size_t b_size = 256 * 1024;
+	const unsigned b = AddFillRubber(r, b_size);
+	ASSERT_GT(b, 0u);
+
+	/* the partial pages at both ends are not shared */
+	EXPECT_TRUE(r.Share(b, 100, 4000).empty());
+
+	const auto pages = r.Share(b, 100, b_size);
+	ASSERT_FALSE(pages.empty());
+	EXPECT_EQ((std::size_t)pages.data() % 4096, 0u);
+	EXPECT_EQ(pages.size() % 4096, 0u);
+	EXPECT_LE(pages.size(), b_size - 100);
+
+	const size_t skip = pages.data() - (const std::byte *)r.Read(b);
+	ASSERT_GE(skip, 100u);
+
+	int fds[2];
+	ASSERT_EQ(pipe2(fds, O_CLOEXEC), 0);
+
+	const struct iovec iov{
+		const_cast<std::byte *>(pages.data()),
+		std::min<size_t>(pages.size(), 64 * 1024),
+	};
+
+	const ssize_t nbytes = vmsplice(fds[1], &iov, 1, 0);
+	ASSERT_GT(nbytes, 0);
+
+	/* slide b over its old pages and overwrite the rest */
+	r.Remove(a);
+	r.Compress();
+	ASSERT_TRUE(CheckRubber(r, b, b_size));
+
+	const unsigned c = AddFillRubber(r, 512 * 1024);
+	ASSERT_GT(c, 0u);
+
+	r.Remove(b);
+	const unsigned d = AddFillRubber(r, b_size);
+	ASSERT_GT(d, 0u);
+
+	/* the pipe still contains the original data */
+	std::vector<std::byte> buffer(nbytes);
+	ASSERT_EQ(read(fds[0], buffer.data(), buffer.size()), nbytes);
+	EXPECT_TRUE(Check(buffer.data(), buffer.size(), b + skip));
+
+	close(fds[0]);
+	close(fds[1]);
+
+	r.Remove(c);
+	r.Remove(d);
+}
@@ -35,3 +35,52 @@ TEST(SessionTest, Basic)
 	widget = realm->GetWidget("a_widget_name", true);
 	ASSERT_NE(widget, nullptr);
 }
+
+TEST(SessionTest, Attach)
+{
+	EventLoop event_loop;
+
+	SessionManager session_manager(event_loop, std::chrono::minutes(30),
+				       0, 0);
+
+	static constexpr std::byte attach[] = {
+		std::byte{'f'}, std::byte{'o'}, std::byte{'o'},
+	};
+
+	const auto a_id = session_manager.CreateSession()->id;
+	const auto b_id = session_manager.CreateSession()->id;
+	ASSERT_EQ(session_manager.Count(), 2U);
+
+	{
+		/* assign the "attach" value to the first session */
+		RealmSessionLease a{session_manager, a_id, "a_realm"};
+		ASSERT_TRUE(a);
+
+		a = session_manager.Attach(std::move(a), "a_realm", attach);
+		ASSERT_TRUE(a);
+		EXPECT_EQ(a->parent.id, a_id);
+	}
+
+	{
+		/* the second session gets merged into the first one */
+		RealmSessionLease b{session_manager, b_id, "a_realm"};
+		ASSERT_TRUE(b);
+
+		b = session_manager.Attach(std::move(b), "a_realm", attach);
+		ASSERT_TRUE(b);
+		EXPECT_EQ(b->parent.id, a_id);
+	}
+
+	EXPECT_EQ(session_manager.Count(), 1U);
+	EXPECT_FALSE(session_manager.Find(b_id));
+
+	{
+		/* without a session, the existing one is found */
+		auto c = session_manager.Attach(nullptr, "a_realm", attach);
+		ASSERT_TRUE(c);
+		EXPECT_EQ(c->parent.id, a_id);
+	}
+
+	session_manager.DiscardAttachSession(attach);
+	EXPECT_EQ(session_manager.Count(), 0U);
+}
@@ -12,6 +12,8 @@
 #include "translation/Response.hxx"
 #include "translation/Transformation.hxx"
 #include "translation/Protocol.hxx"
+#include "translation/Marshal.hxx"
+#include "translation/Parser.hxx"
 #include "widget/View.hxx"
 #include "http/Status.hxx"
 #include "http/Address.hxx"
@@ -22,12 +24,19 @@
 #include "spawn/NamespaceOptions.hxx"
 #include "pool/pool.hxx"
 #include "PInstance.hxx"
+#include "io/BufferedOutputStream.hxx"
+#include "io/BufferedReader.hxx"
+#include "io/FdOutputStream.hxx"
+#include "io/FdReader.hxx"
 #include "util/Cancellable.hxx"
 #include "util/StringAPI.hxx"
 #include "stopwatch.hxx"
 
 #include <gtest/gtest.h>
 
+#include <sys/mman.h>
+#include <unistd.h>
+
 using std::string_view_literals::operator""sv;
 
 class MyTranslationService final : public TranslationService {
@@ -687,6 +696,57 @@ TEST(TranslationCache, InvalidateUri)
 	CachedError(pool, cache, request4b);
 }
 
+TEST(TranslationCache, InvalidateListenerTag)
+{
+	Instance instance;
+	struct pool &pool = instance.root_pool;
+	auto &cache = instance.cache;
+
+	static const TranslationCommand vary[] = {
+		TranslationCommand::LISTENER_TAG,
+	};
+
+	const auto request1 = MakeRequest("/lt/a").ListenerTag("foo");
+	const auto response1 = MakeResponse(pool).File("/srv/foo/a")
+		.Vary(vary);
+	Feed(pool, cache, request1, response1);
+
+	const auto request2 = MakeRequest("/lt/b").ListenerTag("foo");
+	const auto response2 = MakeResponse(pool).File("/srv/foo/b")
+		.Vary(vary);
+	Feed(pool, cache, request2, response2);
+
+	const auto request3 = MakeRequest("/lt/a").ListenerTag("bar");
+	const auto response3 = MakeResponse(pool).File("/srv/bar/a")
+		.Vary(vary);
+	Feed(pool, cache, request3, response3);
+
+	/* not varying on LISTENER_TAG, therefore not affected by
+	   INVALIDATE=LISTENER_TAG */
+	const auto request4 = MakeRequest("/lt/c").ListenerTag("foo");
+	const auto response4 = MakeResponse(pool).File("/srv/c");
+	Feed(pool, cache, request4, response4);
+
+	Cached(pool, cache, request1, response1);
+	Cached(pool, cache, request2, response2);
+	Cached(pool, cache, request3, response3);
+	Cached(pool, cache, request4, response4);
+
+	/* invalidate all items for listener "foo" */
+
+	static const TranslationCommand invalidate[] = {
+		TranslationCommand::LISTENER_TAG,
+	};
+
+	Feed(pool, cache, MakeRequest("/lt/x").ListenerTag("foo"),
+	     MakeResponse(pool).File("/srv/foo/x").Invalidate(invalidate));
+
+	CachedError(pool, cache, request1);
+	CachedError(pool, cache, request2);
+	Cached(pool, cache, request3, response3);
+	Cached(pool, cache, request4, response4);
+}
+
 TEST(TranslationCache, Regex)
 {
 	Instance instance;
@@ -1153,3 +1213,276 @@ TEST(TranslationCache, ExpandBindMount)
 		    .BindMount("/home/bar", "/mnt")
 		    .BindMount("/etc", "/etc")));
 }
+
+TEST(TranslationCache, MarshalRequest)
+{
+	Instance instance;
+	const AllocatorPtr alloc(instance.root_pool);
+
+	const TranslationCommand want[] = {
+		TranslationCommand::LANGUAGE,
+		TranslationCommand::USER_AGENT,
+	};
+
+	auto request = MakeRequest("/foo/bar.html").QueryString("a=b")
+		.ListenerTag("tag").Check("check");
+	request.host = "example.com";
+	request.param = "p";
+	request.user_agent = "Mozilla";
+	request.accept_language = "de";
+	request.want = want;
+
+	const auto marshalled =
+		MarshalTranslateRequest(TRANSLATION_PROTOCOL_VERSION, request)
+		.Dup(instance.root_pool);
+
+	const auto unmarshalled = UnmarshalTranslateRequest(alloc, marshalled);
+	EXPECT_STREQ(unmarshalled.uri, request.uri);
+	EXPECT_STREQ(unmarshalled.host, request.host);
+	EXPECT_STREQ(unmarshalled.param, request.param);
+	EXPECT_STREQ(unmarshalled.query_string, request.query_string);
+	EXPECT_STREQ(unmarshalled.listener_tag, request.listener_tag);
+	EXPECT_STREQ(unmarshalled.user_agent, request.user_agent);
+	EXPECT_STREQ(unmarshalled.accept_language, request.accept_language);
+	EXPECT_TRUE(RawEquals(unmarshalled.check, request.check));
+	EXPECT_TRUE(RawEquals(unmarshalled.want, request.want));
+
+	/* marshalling it again must yield the same packets */
+	const auto marshalled2 =
+		MarshalTranslateRequest(TRANSLATION_PROTOCOL_VERSION,
+					unmarshalled)
+		.Dup(instance.root_pool);
+	EXPECT_TRUE(RawEquals(marshalled, marshalled2));
+
+	/* truncated input must be rejected */
+	EXPECT_THROW(UnmarshalTranslateRequest(alloc,
+					       marshalled.first(marshalled.size() - 1)),
+		     std::runtime_error);
+}
+
+/**
+ * A #TranslationService which parses raw response packets, just like
+ * the real client, and passes them to the handler if it wants them.
+ */
+class RawTranslationService final : public TranslationService {
+public:
+	std::span<const std::byte> next_response{};
+
+	/**
+	 * If set, then this #EventLoop is stopped after each
+	 * request.
+	 */
+	EventLoop *break_loop = nullptr;
+
+	unsigned n_requests = 0;
+
+	/* virtual methods from class TranslationService */
+	void SendRequest(AllocatorPtr alloc,
+			 const TranslateRequest &request,
+			 const StopwatchPtr &,
+			 TranslateHandler &handler,
+			 CancellablePointer &) noexcept override {
+		++n_requests;
+
+		if (break_loop != nullptr)
+			break_loop->Break();
+
+		if (next_response.data() == nullptr) {
+			handler.OnTranslateError(std::make_exception_ptr(std::runtime_error("Error")));
+			return;
+		}
+
+		auto response = UniquePoolPtr<TranslateResponse>::Make(alloc.GetPool());
+		TranslateParser parser(alloc, request, *response);
+
+		auto src = next_response;
+		while (!src.empty()) {
+			const std::size_t nbytes = parser.Feed(src);
+			src = src.subspan(nbytes);
+			if (parser.Process() == TranslateParser::Result::DONE)
+				break;
+		}
+
+		if (handler.WantTranslateRawResponse()) {
+			GrowingBuffer raw;
+			raw.Write(next_response);
+			handler.OnTranslateRawResponse(std::move(raw));
+		}
+
+		handler.OnTranslateResponse(std::move(response));
+	}
+};
+
+static void
+ExpectFile(TranslationService &service, struct pool &parent_pool,
+	   const TranslateRequest &request, const char *path)
+{
+	RecordingTranslateHandler handler(parent_pool);
+	CancellablePointer cancel_ptr;
+
+	service.SendRequest(AllocatorPtr{handler.pool}, request, nullptr,
+			    handler, cancel_ptr);
+
+	EXPECT_TRUE(handler.finished);
+	ASSERT_TRUE(handler.response);
+	ASSERT_EQ(handler.response->address.type, ResourceAddress::Type::LOCAL);
+	EXPECT_STREQ(handler.response->address.GetFile().path, path);
+}
+
+/**
+ * Fill a new cache with one item and save a snapshot to the
+ * specified file.
+ */
+static void
+SaveSnapshot(PInstance &instance, std::span<const std::byte> raw_response,
+	     std::string_view generation, int fd)
+{
+	struct pool &pool = instance.root_pool;
+
+	RawTranslationService ts;
+	TranslationCache cache(pool, instance.event_loop, ts, 1024);
+	cache.EnableSnapshot(generation);
+
+	ts.next_response = raw_response;
+	ExpectFile(cache, pool, MakeRequest("/"), "/var/www/index.html");
+	EXPECT_EQ(ts.n_requests, 1U);
+
+	FdOutputStream fos{FileDescriptor{fd}};
+	BufferedOutputStream bos{fos};
+	cache.Save(bos);
+	bos.Flush();
+
+	ASSERT_EQ(lseek(fd, 0, SEEK_SET), 0);
+}
+
+TEST(TranslationCache, Snapshot)
+{
+	PInstance instance;
+	struct pool &pool = instance.root_pool;
+
+	TranslationMarshaller m;
+	m.Write(TranslationCommand::BEGIN);
+	m.Write(TranslationCommand::PATH, "/var/www/index.html"sv);
+	m.Write(TranslationCommand::END);
+	const auto raw_response = m.Commit().Dup(pool);
+
+	const int fd = memfd_create("tcache", 0);
+	ASSERT_GE(fd, 0);
+
+	/* fill a cache and save a snapshot */
+
+	SaveSnapshot(instance, raw_response, {}, fd);
+
+	/* restore the snapshot into a new cache; the item must be
+	   available without asking the translation server */
+
+	{
+		RawTranslationService ts;
+		TranslationCache cache(pool, instance.event_loop, ts, 1024);
+
+		FdReader fr{FileDescriptor{fd}};
+		BufferedReader r{fr};
+		cache.Load(r);
+
+		ExpectFile(cache, pool, MakeRequest("/"), "/var/www/index.html");
+		EXPECT_EQ(ts.n_requests, 0U);
+
+		/* revalidation happens in the background; let it
+		   run */
+		ts.next_response = raw_response;
+		ts.break_loop = &instance.event_loop;
+		instance.event_loop.Run();
+		EXPECT_EQ(ts.n_requests, 1U);
+
+		ExpectFile(cache, pool, MakeRequest("/"), "/var/www/index.html");
+		EXPECT_EQ(ts.n_requests, 1U);
+	}
+
+	close(fd);
+}
+
+/**
+ * A snapshot from a different generation must be discarded.
+ */
+TEST(TranslationCache, SnapshotGeneration)
+{
+	PInstance instance;
+	struct pool &pool = instance.root_pool;
+
+	TranslationMarshaller m;
+	m.Write(TranslationCommand::BEGIN);
+	m.Write(TranslationCommand::PATH, "/var/www/index.html"sv);
+	m.Write(TranslationCommand::END);
+	const auto raw_response = m.Commit().Dup(pool);
+
+	const int fd = memfd_create("tcache", 0);
+	ASSERT_GE(fd, 0);
+
+	SaveSnapshot(instance, raw_response, "1"sv, fd);
+
+	RawTranslationService ts;
+	TranslationCache cache(pool, instance.event_loop, ts, 1024);
+	cache.EnableSnapshot("2"sv);
+
+	FdReader fr{FileDescriptor{fd}};
+	BufferedReader r{fr};
+	cache.Load(r);
+
+	/* nothing was restored, so this must ask the translation
+	   server */
+	ts.next_response = raw_response;
+	ExpectFile(cache, pool, MakeRequest("/"), "/var/www/index.html");
+	EXPECT_EQ(ts.n_requests, 1U);
+
+	close(fd);
+}
+
+/**
+ * If the revalidation response is not cacheable, the restored item
+ * must be removed.
+ */
+TEST(TranslationCache, SnapshotRevalidateUncacheable)
+{
+	PInstance instance;
+	struct pool &pool = instance.root_pool;
+
+	TranslationMarshaller m;
+	m.Write(TranslationCommand::BEGIN);
+	m.Write(TranslationCommand::PATH, "/var/www/index.html"sv);
+	m.Write(TranslationCommand::END);
+	const auto raw_response = m.Commit().Dup(pool);
+
+	TranslationMarshaller m2;
+	m2.Write(TranslationCommand::BEGIN);
+	m2.Write(TranslationCommand::PATH, "/var/www/new.html"sv);
+	m2.WriteT<uint32_t>(TranslationCommand::MAX_AGE, 0);
+	m2.Write(TranslationCommand::END);
+	const auto uncacheable_response = m2.Commit().Dup(pool);
+
+	const int fd = memfd_create("tcache", 0);
+	ASSERT_GE(fd, 0);
+
+	SaveSnapshot(instance, raw_response, {}, fd);
+
+	RawTranslationService ts;
+	TranslationCache cache(pool, instance.event_loop, ts, 1024);
+
+	FdReader fr{FileDescriptor{fd}};
+	BufferedReader r{fr};
+	cache.Load(r);
+
+	ExpectFile(cache, pool, MakeRequest("/"), "/var/www/index.html");
+	EXPECT_EQ(ts.n_requests, 0U);
+
+	ts.next_response = uncacheable_response;
+	ts.break_loop = &instance.event_loop;
+	instance.event_loop.Run();
+	EXPECT_EQ(ts.n_requests, 1U);
+
+	/* the stale item is gone */
+	ts.break_loop = nullptr;
+	ExpectFile(cache, pool, MakeRequest("/"), "/var/www/new.html");
+	EXPECT_EQ(ts.n_requests, 2U);
+
+	close(fd);
+}
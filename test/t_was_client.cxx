@@ -14,6 +14,7 @@
 #include "was/Client.hxx"
 #include "was/Server.hxx"
 #include "was/Lease.hxx"
+#include "was/ShmChannel.hxx"
 #include "was/async/Socket.hxx"
 #include "system/SetupProcess.hxx"
 #include "io/FileDescriptor.hxx"
@@ -282,6 +283,8 @@ class WasConnection final : public ClientConnection, WasServerHandler, WasLease
 
 	WasSocket socket;
 
+	std::unique_ptr<WasShmChannel> shm;
+
 	WasServer *server = nullptr;
 
 	MalformedPrematureWasServer *server2 = nullptr;
@@ -297,13 +300,22 @@ class WasConnection final : public ClientConnection, WasServerHandler, WasLease
 
 public:
 	WasConnection(struct pool &pool, EventLoop &_event_loop,
-		      Callback &&_callback)
+		      Callback &&_callback, bool enable_shm)
 		:event_loop(_event_loop),
 		 callback(std::move(_callback))
 	{
+		auto server_socket = MakeWasSocket();
+
+		if (enable_shm) {
+			/* the WasServer constructor receives the
+			   handshake */
+			shm = WasShmChannel::Create(65536);
+			shm->SendHandshake(socket.control);
+		}
+
 		WasServerHandler &handler = *this;
 		server = NewFromPool<WasServer>(pool, pool, event_loop,
-						MakeWasSocket(),
+						std::move(server_socket),
 						handler);
 	}
 
@@ -340,6 +352,7 @@ public:
 		lease = &_lease;
 		was_client_request(pool, GetEventLoop(), nullptr,
 				   socket.control, socket.input, socket.output,
+				   shm.get(),
 				   *this,
 				   nullptr,
 				   method, uri, uri, nullptr, nullptr,
@@ -399,52 +412,60 @@ private:
 struct WasFactory {
 	static constexpr bool can_cancel_request_body = true;
 
+	/**
+	 * Transfer bodies over a #WasShmChannel instead of pipes?
+	 */
+	const bool shm;
+
+	explicit WasFactory(bool _shm=false) noexcept
+		:shm(_shm) {}
+
 	auto *NewMirror(struct pool &pool, EventLoop &event_loop) {
-		return new WasConnection(pool, event_loop, RunMirror);
+		return new WasConnection(pool, event_loop, RunMirror, shm);
 	}
 
 	auto *NewNull(struct pool &pool, EventLoop &event_loop) {
-		return new WasConnection(pool, event_loop, RunNull);
+		return new WasConnection(pool, event_loop, RunNull, shm);
 	}
 
 	auto *NewDummy(struct pool &pool, EventLoop &event_loop) {
-		return new WasConnection(pool, event_loop, RunHello);
+		return new WasConnection(pool, event_loop, RunHello, shm);
 	}
 
 	auto *NewFixed(struct pool &pool, EventLoop &event_loop) {
-		return new WasConnection(pool, event_loop, RunHello);
+		return new WasConnection(pool, event_loop, RunHello, shm);
 	}
 
 	auto *NewTiny(struct pool &pool, EventLoop &event_loop) {
-		return new WasConnection(pool, event_loop, RunHello);
+		return new WasConnection(pool, event_loop, RunHello, shm);
 	}
 
 	auto *NewHuge(struct pool &pool, EventLoop &event_loop) {
-		return new WasConnection(pool, event_loop, RunHuge);
+		return new WasConnection(pool, event_loop, RunHuge, shm);
 	}
 
 	auto *NewHold(struct pool &pool, EventLoop &event_loop) {
-		return new WasConnection(pool, event_loop, RunHold);
+		return new WasConnection(pool, event_loop, RunHold, shm);
 	}
 
 	auto *NewBlock(struct pool &pool, EventLoop &event_loop) {
-		return new WasConnection(pool, event_loop, RunBlock);
+		return new WasConnection(pool, event_loop, RunBlock, shm);
 	}
 
 	auto *NewNop(struct pool &pool, EventLoop &event_loop) {
-		return new WasConnection(pool, event_loop, RunNop);
+		return new WasConnection(pool, event_loop, RunNop, shm);
 	}
 
 	auto *NewMalformedHeaderName(struct pool &pool, EventLoop &event_loop) {
-		return new WasConnection(pool, event_loop, RunMalformedHeaderName);
+		return new WasConnection(pool, event_loop, RunMalformedHeaderName, shm);
 	}
 
 	auto *NewMalformedHeaderValue(struct pool &pool, EventLoop &event_loop) {
-		return new WasConnection(pool, event_loop, RunMalformedHeaderValue);
+		return new WasConnection(pool, event_loop, RunMalformedHeaderValue, shm);
 	}
 
 	auto *NewValidPremature(struct pool &pool, EventLoop &event_loop) {
-		return new WasConnection(pool, event_loop, RunValidPremature);
+		return new WasConnection(pool, event_loop, RunValidPremature, shm);
 	}
 
 	auto *NewMalformedPremature(struct pool &pool, EventLoop &event_loop) {
@@ -507,4 +528,7 @@ main(int, char **)
 	run_all_tests(instance, factory);
 	run_test(instance, factory, test_malformed_header_name);
 	run_test(instance, factory, test_malformed_header_value);
+
+	WasFactory shm_factory{true};
+	run_all_tests(instance, shm_factory);
 }
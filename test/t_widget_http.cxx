@@ -68,7 +68,7 @@ processor_process(struct pool &,
 		  UnusedIstreamPtr istream,
 		  Widget &,
 		  SharedPoolPtr<WidgetContext>,
-		  unsigned) noexcept
+		  unsigned, const char *) noexcept
 {
 	return istream;
 }
@@ -0,0 +1,208 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#include "parser/XmlParser.hxx"
+#include "pool/RootPool.hxx"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+using std::string_view_literals::operator""sv;
+
+/**
+ * Logs all parser events into a string.  Adjacent CDATA events are
+ * merged, because their boundaries depend on how the source was
+ * chunked.
+ */
+class LogXmlParserHandler final : public XmlParserHandler {
+	std::string log;
+
+	std::string cdata;
+	off_t cdata_start = -1, cdata_end;
+	bool cdata_escaped;
+
+public:
+	std::string GetLog() && noexcept {
+		FlushCdata();
+		return std::move(log);
+	}
+
+private:
+	void FlushCdata() noexcept {
+		if (cdata_start < 0)
+			return;
+
+		log += "cdata ";
+		log += cdata;
+		log += cdata_escaped ? " e " : " u ";
+		log += std::to_string(cdata_start);
+		log += '\n';
+
+		cdata.clear();
+		cdata_start = -1;
+	}
+
+public:
+	/* virtual methods from class XmlParserHandler */
+	bool OnXmlTagStart(const XmlParserTag &tag) noexcept override {
+		FlushCdata();
+		log += "start ";
+		log += tag.name;
+		log += ' ';
+		log += std::to_string(tag.start);
+		log += '\n';
+		return true;
+	}
+
+	bool OnXmlTagFinished(const XmlParserTag &tag) noexcept override {
+		FlushCdata();
+		log += "finished ";
+		log += tag.name;
+		log += ' ';
+		log += std::to_string(tag.start);
+		log += '-';
+		log += std::to_string(tag.end);
+		log += '\n';
+		return true;
+	}
+
+	void OnXmlAttributeFinished(const XmlParserAttribute &attr) noexcept override {
+		FlushCdata();
+		log += "attr ";
+		log += attr.name;
+		log += '=';
+		log += attr.value;
+		log += ' ';
+		log += std::to_string(attr.name_start);
+		log += ',';
+		log += std::to_string(attr.value_start);
+		log += ',';
+		log += std::to_string(attr.value_end);
+		log += ',';
+		log += std::to_string(attr.end);
+		log += '\n';
+	}
+
+	size_t OnXmlCdata(std::string_view text, bool escaped,
+			  off_t start) noexcept override {
+		if (cdata_start < 0 || start != cdata_end ||
+		    escaped != cdata_escaped) {
+			FlushCdata();
+			cdata_start = start;
+			cdata_escaped = escaped;
+		}
+
+		cdata += text;
+		cdata_end = start + text.size();
+		return text.size();
+	}
+};
+
+static void
+Feed(XmlParser &parser, std::string_view s) noexcept
+{
+	if (!s.empty())
+		EXPECT_EQ(parser.Feed(s.data(), s.size()), s.size());
+}
+
+/**
+ * Parse the source in two chunks, split at the specified position.
+ */
+static std::string
+ParseSplit(struct pool &pool, std::string_view src, std::size_t split) noexcept
+{
+	LogXmlParserHandler handler;
+	XmlParser parser(pool, handler);
+	Feed(parser, src.substr(0, split));
+	Feed(parser, src.substr(split));
+	return std::move(handler).GetLog();
+}
+
+/**
+ * Parse the source in chunks of the specified size.
+ */
+static std::string
+ParseChunked(struct pool &pool, std::string_view src,
+	     std::size_t chunk_size) noexcept
+{
+	LogXmlParserHandler handler;
+	XmlParser parser(pool, handler);
+
+	while (!src.empty()) {
+		const auto chunk = src.substr(0, chunk_size);
+		src = src.substr(chunk.size());
+		Feed(parser, chunk);
+	}
+
+	return std::move(handler).GetLog();
+}
+
+/**
+ * The result must not depend on where the source was split.
+ */
+static void
+ExpectParse(struct pool &pool, std::string_view src,
+	    std::string_view expected) noexcept
+{
+	EXPECT_EQ(ParseSplit(pool, src, src.size()), expected);
+
+	for (std::size_t split = 0; split < src.size(); ++split)
+		EXPECT_EQ(ParseSplit(pool, src, split), expected)
+			<< "split=" << split;
+
+	for (std::size_t chunk_size = 1; chunk_size <= 4; ++chunk_size)
+		EXPECT_EQ(ParseChunked(pool, src, chunk_size), expected)
+			<< "chunk_size=" << chunk_size;
+}
+
+TEST(XmlParser, Cdata)
+{
+	RootPool pool;
+
+	ExpectParse(pool, "<p><![CDATA[a]b]]c]]></p>"sv,
+		    "start p 0\n"
+		    "finished p 0-3\n"
+		    "cdata a]b]]c u 12\n"
+		    "start p 21\n"
+		    "finished p 21-25\n"sv);
+
+	/* only brackets */
+	ExpectParse(pool, "<![CDATA[]]]]>x"sv,
+		    "cdata ]] u 9\n"
+		    "cdata x e 14\n"sv);
+
+	/* a lone bracket at the end */
+	ExpectParse(pool, "<![CDATA[x]]]>"sv,
+		    "cdata x] u 9\n"sv);
+
+	/* a ">" which does not end the section */
+	ExpectParse(pool, "<![CDATA[]>]]>"sv,
+		    "cdata ]> u 9\n"sv);
+
+	/* empty */
+	ExpectParse(pool, "<![CDATA[]]>x"sv,
+		    "cdata x e 12\n"sv);
+}
+
+TEST(XmlParser, UnquotedAttribute)
+{
+	RootPool pool;
+
+	ExpectParse(pool, "<img alt=compat src=x>"sv,
+		    "start img 0\n"
+		    "attr alt=compat 5,9,15,15\n"
+		    "attr src=x 16,20,21,21\n"
+		    "finished img 0-22\n"sv);
+
+	/* a value which is terminated by the end of the tag and
+	   followed by text */
+	ExpectParse(pool, "<a href=foo>text</a>"sv,
+		    "start a 0\n"
+		    "attr href=foo 3,8,11,11\n"
+		    "finished a 0-12\n"
+		    "cdata text e 12\n"
+		    "start a 16\n"
+		    "finished a 16-20\n"sv);
+}
@@ -0,0 +1,398 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <mk@cm4all.com>
+
+#include "bp/XmlTemplate.hxx"
+#include "parser/XmlParser.hxx"
+#include "pool/RootPool.hxx"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+using std::string_view_literals::operator""sv;
+
+static constexpr std::string_view html = R"html(<html>
+<head><title>Test</title>
+<script type="text/javascript">if (a < b) alert("<b>");</script>
+</head>
+<body class="__foo">
+<!-- comment -->
+<a href="foo" c:base="widget">link</a>
+<c:widget id="w" type="bar"><c:param name="x" value="y"/></c:widget>
+<![CDATA[x]]y]]>
+<img src='bar.png' alt=compat>
+</body>
+</html>
+)html";
+
+/**
+ * Logs all parser events into a string.  Adjacent CDATA events are
+ * merged, because their boundaries depend on how the source was
+ * chunked.
+ */
+class LogXmlParserHandler final : public XmlParserHandler {
+	/**
+	 * If set, then this handler switches the parser to script
+	 * mode after each opening "script" tag (like XmlProcessor
+	 * does when there is no #XmlTemplateRecorder).
+	 */
+	XmlParser *parser = nullptr;
+
+	/**
+	 * Tags with this name are declined by OnXmlTagStart().
+	 */
+	std::string_view ignore_tag;
+
+	/**
+	 * OnXmlTagFinished() returns false for tags with this name.
+	 */
+	std::string_view close_tag;
+
+	std::string log;
+
+	std::string cdata;
+	off_t cdata_start = -1, cdata_end;
+	bool cdata_escaped;
+
+public:
+	LogXmlParserHandler() noexcept = default;
+
+	explicit LogXmlParserHandler(std::string_view _ignore_tag,
+				     std::string_view _close_tag={}) noexcept
+		:ignore_tag(_ignore_tag), close_tag(_close_tag) {}
+
+	void SetParser(XmlParser *_parser) noexcept {
+		parser = _parser;
+	}
+
+	std::string GetLog() && noexcept {
+		FlushCdata();
+		return std::move(log);
+	}
+
+private:
+	void FlushCdata() noexcept {
+		if (cdata_start < 0)
+			return;
+
+		log += "cdata ";
+		log += cdata;
+		log += cdata_escaped ? " e " : " u ";
+		log += std::to_string(cdata_start);
+		log += '\n';
+
+		cdata.clear();
+		cdata_start = -1;
+	}
+
+public:
+	/* virtual methods from class XmlParserHandler */
+	bool OnXmlTagStart(const XmlParserTag &tag) noexcept override {
+		FlushCdata();
+		log += "start ";
+		log += tag.name;
+		log += ' ';
+		log += std::to_string((int)tag.type);
+		log += ' ';
+		log += std::to_string(tag.start);
+		log += '\n';
+		return tag.name != ignore_tag;
+	}
+
+	bool OnXmlTagFinished(const XmlParserTag &tag) noexcept override {
+		FlushCdata();
+		log += "finished ";
+		log += tag.name;
+		log += ' ';
+		log += std::to_string(tag.start);
+		log += '-';
+		log += std::to_string(tag.end);
+		log += '\n';
+
+		if (tag.name == close_tag)
+			return false;
+
+		if (parser != nullptr && tag.type == XmlParserTagType::OPEN &&
+		    tag.name == "script"sv)
+			parser->Script();
+
+		return true;
+	}
+
+	void OnXmlAttributeFinished(const XmlParserAttribute &attr) noexcept override {
+		FlushCdata();
+		log += "attr ";
+		log += attr.name;
+		log += '=';
+		log += attr.value;
+		log += ' ';
+		log += std::to_string(attr.name_start);
+		log += ',';
+		log += std::to_string(attr.value_start);
+		log += ',';
+		log += std::to_string(attr.value_end);
+		log += ',';
+		log += std::to_string(attr.end);
+		log += '\n';
+	}
+
+	size_t OnXmlCdata(std::string_view text, bool escaped,
+			  off_t start) noexcept override {
+		if (cdata_start < 0 || start != cdata_end ||
+		    escaped != cdata_escaped) {
+			FlushCdata();
+			cdata_start = start;
+			cdata_escaped = escaped;
+		}
+
+		cdata += text;
+		cdata_end = start + text.size();
+		return text.size();
+	}
+};
+
+static void
+Feed(XmlParser &parser, std::string_view s) noexcept
+{
+	if (!s.empty())
+		parser.Feed(s.data(), s.size());
+}
+
+static std::string
+Parse(struct pool &pool, std::string_view src,
+      std::string_view ignore_tag={}) noexcept
+{
+	LogXmlParserHandler handler{ignore_tag};
+	XmlParser parser(pool, handler);
+	handler.SetParser(&parser);
+	Feed(parser, src);
+	return std::move(handler).GetLog();
+}
+
+static XmlTemplate
+Record(struct pool &pool, std::string_view src, std::size_t chunk_size,
+       std::string &log, std::string_view ignore_tag={})
+{
+	LogXmlParserHandler handler{ignore_tag};
+	XmlTemplateRecorder recorder(handler, true, 1024 * 1024);
+	XmlParser parser(pool, recorder);
+	recorder.SetParser(parser);
+
+	while (!src.empty()) {
+		const auto chunk = src.substr(0, chunk_size);
+		src = src.substr(chunk.size());
+
+		recorder.AppendSource(std::as_bytes(std::span{chunk}));
+		Feed(parser, chunk);
+		recorder.EndOfChunk(parser.IsIdle());
+	}
+
+	EXPECT_TRUE(recorder.Finish(parser.IsIdle()));
+	log = std::move(handler).GetLog();
+	return recorder.Steal();
+}
+
+/**
+ * Feed the source into an #XmlTemplatePlayer; if it does not match
+ * the template, resume parsing with an #XmlParser.
+ *
+ * @return the event log
+ */
+static std::string
+Play(struct pool &pool, const XmlTemplate &t,
+     std::string_view src, std::size_t chunk_size,
+     bool &resumed, std::string_view ignore_tag={})
+{
+	LogXmlParserHandler handler{ignore_tag};
+	XmlTemplatePlayer player(t, handler);
+	XmlParser parser(pool, handler);
+	off_t position = 0;
+
+	resumed = false;
+
+	while (!src.empty()) {
+		auto chunk = src.substr(0, chunk_size);
+		src = src.substr(chunk.size());
+
+		if (!resumed) {
+			if (player.Feed(std::as_bytes(std::span{chunk})) ==
+			    XmlTemplatePlayer::FeedResult::OK) {
+				position += chunk.size();
+				continue;
+			}
+
+			resumed = true;
+			handler.SetParser(&parser);
+
+			const off_t resume = player.GetResumePosition();
+			parser.Reset(resume);
+
+			if (resume < position) {
+				const auto s = player.GetSource(resume, position);
+				Feed(parser, {(const char *)s.data(), s.size()});
+			} else
+				chunk = chunk.substr(resume - position);
+		}
+
+		Feed(parser, chunk);
+		position += chunk.size();
+	}
+
+	if (!resumed && !player.IsComplete()) {
+		resumed = true;
+		handler.SetParser(&parser);
+
+		const off_t resume = player.GetResumePosition();
+		parser.Reset(resume);
+		const auto s = player.GetSource(resume, position);
+		Feed(parser, {(const char *)s.data(), s.size()});
+	}
+
+	return std::move(handler).GetLog();
+}
+
+TEST(XmlTemplate, Replay)
+{
+	RootPool pool;
+
+	const auto expected = Parse(pool, html);
+
+	for (std::size_t record_chunk : {1, 7, 64, 4096}) {
+		std::string log;
+		const auto t = Record(pool, html, record_chunk, log);
+		EXPECT_EQ(log, expected);
+
+		for (std::size_t play_chunk : {1, 3, 100, 4096}) {
+			bool resumed;
+			EXPECT_EQ(Play(pool, t, html, play_chunk, resumed),
+				  expected);
+			EXPECT_FALSE(resumed);
+		}
+	}
+}
+
+TEST(XmlTemplate, Mismatch)
+{
+	RootPool pool;
+
+	std::string modified{html};
+	modified.replace(modified.find("bar.png"), 7, "baz.gif");
+
+	const auto expected = Parse(pool, modified);
+
+	for (std::size_t record_chunk : {1, 7, 64, 4096}) {
+		std::string log;
+		const auto t = Record(pool, html, record_chunk, log);
+
+		for (std::size_t play_chunk : {1, 3, 100, 4096}) {
+			bool resumed;
+			EXPECT_EQ(Play(pool, t, modified, play_chunk, resumed),
+				  expected);
+			EXPECT_TRUE(resumed);
+		}
+	}
+}
+
+TEST(XmlTemplate, Length)
+{
+	RootPool pool;
+
+	std::string log;
+	const auto t = Record(pool, html, 16, log);
+
+	/* longer than the template */
+	const std::string longer = std::string{html} + "<p class=x>more</p>\n";
+	bool resumed;
+	EXPECT_EQ(Play(pool, t, longer, 16, resumed), Parse(pool, longer));
+	EXPECT_TRUE(resumed);
+
+	/* shorter than the template */
+	const auto shorter = html.substr(0, html.size() / 2);
+	EXPECT_EQ(Play(pool, t, shorter, 16, resumed), Parse(pool, shorter));
+	EXPECT_TRUE(resumed);
+}
+
+/**
+ * The template must not depend on which tags the handler was
+ * interested in while recording.
+ */
+TEST(XmlTemplate, IgnoredTags)
+{
+	RootPool pool;
+
+	for (std::string_view ignore_tag : {"a"sv, "c:param"sv, "img"sv}) {
+		const auto expected = Parse(pool, html);
+		const auto expected_ignore = Parse(pool, html, ignore_tag);
+		EXPECT_NE(expected, expected_ignore);
+
+		for (std::size_t record_chunk : {1, 7, 4096}) {
+			std::string log;
+
+			/* recorded by a handler which is interested
+			   in all tags */
+			auto t = Record(pool, html, record_chunk, log);
+			EXPECT_EQ(log, expected);
+
+			bool resumed;
+			EXPECT_EQ(Play(pool, t, html, 3, resumed, ignore_tag),
+				  expected_ignore);
+			EXPECT_FALSE(resumed);
+
+			/* recorded by a handler which ignores some
+			   tags */
+			t = Record(pool, html, record_chunk, log, ignore_tag);
+			EXPECT_EQ(log, expected_ignore);
+
+			EXPECT_EQ(Play(pool, t, html, 3, resumed), expected);
+			EXPECT_FALSE(resumed);
+		}
+	}
+}
+
+/**
+ * Tags which the parser would end differently if the handler was
+ * not interested in them disable the recorder.
+ */
+TEST(XmlTemplate, NotSimple)
+{
+	RootPool pool;
+
+	for (std::string_view src : {
+			"<p><a title=\"x>y\" href=\"z\">link</a></p>"sv,
+			"<p><a href=\"z\"!>link</a></p>"sv,
+		}) {
+		LogXmlParserHandler handler;
+		XmlTemplateRecorder recorder(handler, true, 1024 * 1024);
+		XmlParser parser(pool, recorder);
+		recorder.SetParser(parser);
+
+		recorder.AppendSource(std::as_bytes(std::span{src}));
+		Feed(parser, src);
+		recorder.EndOfChunk(parser.IsIdle());
+
+		EXPECT_FALSE(recorder.IsEnabled());
+		EXPECT_FALSE(recorder.Finish(parser.IsIdle()));
+	}
+}
+
+/**
+ * If the handler closes the parser while the template is being
+ * replayed, the player stops immediately.
+ */
+TEST(XmlTemplate, Closed)
+{
+	RootPool pool;
+
+	std::string log;
+	const auto t = Record(pool, html, 4096, log);
+
+	LogXmlParserHandler handler{{}, "title"sv};
+	XmlTemplatePlayer player(t, handler);
+	EXPECT_EQ(player.Feed(std::as_bytes(std::span{html})),
+		  XmlTemplatePlayer::FeedResult::CLOSED);
+
+	log = std::move(handler).GetLog();
+	EXPECT_NE(log.find("finished title"), log.npos);
+	EXPECT_EQ(log.find("body"), log.npos);
+}
@@ -40,6 +40,11 @@ struct MakeRequest : TranslateRequest {
 		return std::move(*this);
 	}
 
+	MakeRequest &&ListenerTag(const char *value) {
+		listener_tag = value;
+		return std::move(*this);
+	}
+
 	MakeRequest &&Check(const char *value) {
 		check = {(const std::byte *)value, strlen(value)};
 		return std::move(*this);